@@ -1,24 +1,33 @@
 #include "MainWindow.h"
 #include "../dialogs/ExamInfoDialog.h"
-#include "../exporters/DocxExporter.h"
-#include "../exporters/PdfExporter.h"
+#include "../exporters/ExportScheduler.h"
+#include "../layout/DiagramCache.h"
+#include "../models/AssetStore.h"
+#include "../models/PaperFile.h"
+#include "../models/PaperHistory.h"
+#include "../models/PaperJournal.h"
+#include "../models/PaperJson.h"
 #include "../models/PaperModel.h"
+#include "../models/StringPool.h"
 #include "../pages/question_editor/QuestionEditorPage.h"
+#include "../widgets/exportQueue/ExportQueuePanel.h"
 #include "ui_MainWindow.h"
 #include <QActionGroup>
 #include <QApplication>
 #include <QCloseEvent>
 #include <QComboBox>
+#include <QDir>
+#include <QDockWidget>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileDialog>
 #include <QFileInfo>
 #include <QFontComboBox>
+#include <QFutureWatcher>
 #include <QGraphicsOpacityEffect>
 #include <QGroupBox>
 #include <QHBoxLayout>
-#include <QJsonArray>
-#include <QJsonDocument>
-#include <QJsonObject>
+#include <QInputDialog>
 #include <QLabel>
 #include <QLineEdit>
 #include <QMenuBar>
@@ -26,13 +35,15 @@
 #include <QPropertyAnimation>
 #include <QPushButton>
 #include <QScrollArea>
+#include <QSet>
 #include <QSettings>
 #include <QSpinBox>
+#include <QStandardPaths>
 #include <QStackedWidget>
 #include <QStatusBar>
 #include <QStyleFactory>
 #include <QTextBrowser>
-#include <QTextStream>
+#include <QTimer>
 #include <QToolBar>
 #include <QVBoxLayout>
 #include <QVector>
@@ -50,17 +61,56 @@ const QString ORGANIZATION_NAME = "YourOrganization";
 const QString DEFAULT_FONT_FAMILY = "Times New Roman";
 constexpr int DEFAULT_FONT_SIZE = 12;
 constexpr int ANIMATION_DURATION = 300;
+// Time spent adding loaded sections to the editor per event loop turn
+constexpr int LOAD_SLICE_MS = 30;
+// Quiet time after an edit before it is written to the journal
+constexpr int AUTOSAVE_DELAY_MS = 1000;
+// Longest an edit waits for the journal while the user keeps typing
+constexpr int AUTOSAVE_MAX_DELAY_MS = 10000;
 
 const QString PAPER_FILE_FILTER =
-    QObject::tr("Exam Paper Files (*.epf);;All Files (*)");
+    QObject::tr("Exam Paper Files (*.epf);;Exam Paper JSON (*.json);;"
+                "All Files (*)");
+
+// Same exam and content; IDs and versions are ignored
+bool samePaper(const PaperModel &a, const PaperModel &b) {
+  if (a.exam != b.exam || a.sections.size() != b.sections.size())
+    return false;
+  for (int i = 0; i < a.sections.size(); ++i) {
+    if (a.sections[i].label != b.sections[i].label ||
+        a.sections[i].subtitle != b.sections[i].subtitle ||
+        a.sections[i].questions != b.sections[i].questions)
+      return false;
+  }
+  return true;
+}
+
+// Embedded diagrams the sections refer to, each once
+QStringList assetReferences(const QVector<Section> &sections) {
+  QStringList references;
+  QSet<QString> seen;
+  for (const Section &section : sections) {
+    for (const Question &question : section.questions) {
+      const QString &path = question.diagramPath;
+      if (AssetStore::isReference(path) && !seen.contains(path)) {
+        seen.insert(path);
+        references.append(path);
+      }
+    }
+  }
+  return references;
+}
 } // namespace
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent), ui(new Ui::MainWindow), m_tabWidget(nullptr),
       m_paperModel(nullptr), m_sectionsLayout(nullptr),
       m_previewBrowser(nullptr), m_themeCombo(nullptr),
-      m_contentModified(false), m_defaultFontFamily(DEFAULT_FONT_FAMILY),
-      m_defaultFontSize(DEFAULT_FONT_SIZE), m_portraitOrientation(true) {
+      m_exportQueueDock(nullptr), m_contentModified(false), m_defaultFontFamily(DEFAULT_FONT_FAMILY),
+      m_defaultFontSize(DEFAULT_FONT_SIZE), m_portraitOrientation(true),
+      m_inlineHtmlDiagrams(false), m_nextSectionToLoad(0),
+      m_runningExports(0), m_assetPruneDue(false), m_autosaveTimer(nullptr),
+      m_editCount(0) {
   ui->setupUi(this);
 
   // Create paper model
@@ -68,12 +118,14 @@ MainWindow::MainWindow(QWidget *parent)
 
   setupUi();
   setupPages();
+  setupExportQueue();
   setupMenuBar();
   setupToolBar();
   setupStatusBar();
   setupConnections();
 
   loadSettings();
+  setupJournal();
   updateWindowTitle();
   updateUiState();
 
@@ -83,6 +135,8 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow() {
   saveSettings();
+  // Finishes queued writes; the model must outlive it
+  m_journal.reset();
   delete m_paperModel;
   delete ui;
 }
@@ -155,6 +209,22 @@ void MainWindow::setupPreviewTab() {
           &MainWindow::onTabChanged);
 }
 
+void MainWindow::setupExportQueue() {
+  ExportScheduler &scheduler = ExportScheduler::shared();
+
+  m_exportQueueDock = new QDockWidget(tr("Export Queue"), this);
+  m_exportQueueDock->setObjectName("exportQueueDock");
+  m_exportQueueDock->setWidget(new ExportQueuePanel(scheduler));
+  addDockWidget(Qt::BottomDockWidgetArea, m_exportQueueDock);
+  m_exportQueueDock->hide();
+
+  // Bring the queue up whenever a new job arrives
+  connect(&scheduler, &ExportScheduler::jobAdded, m_exportQueueDock,
+          &QDockWidget::show);
+  connect(&scheduler, &ExportScheduler::jobChanged, this,
+          &MainWindow::pruneAssets);
+}
+
 void MainWindow::setupMenuBar() {
   // File menu
   QMenu *fileMenu = menuBar()->addMenu(tr("&File"));
@@ -181,6 +251,39 @@ void MainWindow::setupMenuBar() {
 
   fileMenu->addSeparator();
 
+  // Versions are kept in a history directory beside the paper file
+  QAction *saveVersionAction = fileMenu->addAction(tr("Save &Version..."));
+  connect(saveVersionAction, &QAction::triggered, this,
+          &MainWindow::onSaveVersion);
+
+  QAction *restoreVersionAction =
+      fileMenu->addAction(tr("&Restore Version..."));
+  connect(restoreVersionAction, &QAction::triggered, this,
+          &MainWindow::onRestoreVersion);
+
+  fileMenu->addSeparator();
+
+  QAction *exportAllAction =
+      fileMenu->addAction(tr("Export All &Formats..."));
+  connect(exportAllAction, &QAction::triggered, this,
+          &MainWindow::onExportAllFormats);
+
+  // Self-contained HTML: diagrams embedded instead of linked by file path
+  QAction *inlineDiagramsAction =
+      fileMenu->addAction(tr("&Embed Diagrams in HTML"));
+  inlineDiagramsAction->setCheckable(true);
+  m_inlineHtmlDiagrams = QSettings(ORGANIZATION_NAME, APP_NAME)
+                             .value("htmlInlineDiagrams", false)
+                             .toBool();
+  inlineDiagramsAction->setChecked(m_inlineHtmlDiagrams);
+  connect(inlineDiagramsAction, &QAction::toggled, this, [this](bool enabled) {
+    m_inlineHtmlDiagrams = enabled;
+    QSettings settings(ORGANIZATION_NAME, APP_NAME);
+    settings.setValue("htmlInlineDiagrams", enabled);
+  });
+
+  fileMenu->addSeparator();
+
   QAction *exitAction =
       fileMenu->addAction(QIcon::fromTheme("application-exit"), tr("E&xit"));
   exitAction->setShortcut(QKeySequence::Quit);
@@ -204,6 +307,9 @@ void MainWindow::setupMenuBar() {
   connect(previewAction, &QAction::triggered, this,
           &MainWindow::showPreviewPage);
 
+  viewMenu->addSeparator();
+  viewMenu->addAction(m_exportQueueDock->toggleViewAction());
+
   // Settings menu
   QMenu *settingsMenu = menuBar()->addMenu(tr("&Settings"));
 
@@ -299,13 +405,95 @@ void MainWindow::setupConnections() {
   // No page connections for now
 }
 
+void MainWindow::setupJournal() {
+  m_journal = std::make_unique<PaperJournal>(*m_paperModel);
+  m_autosaveTimer = new QTimer(this);
+  m_autosaveTimer->setSingleShot(true);
+  m_autosaveTimer->setInterval(AUTOSAVE_DELAY_MS);
+  connect(m_autosaveTimer, &QTimer::timeout, this, &MainWindow::autosave);
+  m_journal->setErrorHandler([this](const QString &error) {
+    // Called on the journal's writer thread
+    QMetaObject::invokeMethod(
+        this,
+        [this, error]() {
+          if (error.isEmpty()) {
+            updateStatus(tr("Autosave resumed"), 3000);
+          } else {
+            updateStatus(tr("Autosave failed, retrying: %1").arg(error));
+          }
+        },
+        Qt::QueuedConnection);
+  });
+
+  const QString directory =
+      QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation))
+          .filePath("recovery");
+  if (!m_journal->open(directory)) {
+    updateStatus(tr("Autosave is off: %1").arg(m_journal->errorString()),
+                 5000);
+    return;
+  }
+  if (m_journal->hasRecovery()) {
+    recoverPaper();
+  }
+  m_journal->start();
+  m_journal->setDocumentPath(m_currentFilePath);
+}
+
+void MainWindow::recoverPaper() {
+  PaperModel recovered;
+  QString documentPath;
+  if (!m_journal->recover(recovered, &documentPath)) {
+    return;
+  }
+
+  // Nothing to offer if the journal only holds what is already saved
+  PaperModel saved;
+  bool isSaved = recovered.sections.isEmpty() && recovered.exam == Exam();
+  if (!isSaved && !documentPath.isEmpty()) {
+    PaperFile file;
+    const bool loaded = PaperFile::isPaperFile(documentPath)
+                            ? file.open(documentPath) && file.load(saved)
+                            : PaperJson::load(documentPath, saved);
+    isSaved = loaded && samePaper(saved, recovered);
+  }
+  if (isSaved ||
+      !confirmAction(tr("Recover Paper"),
+                     tr("The application did not close properly. Recover "
+                        "the changes that were not saved?"))) {
+    return;
+  }
+
+  m_paperModel->setExam(recovered.exam);
+  if (m_questionEditorPage) {
+    m_questionEditorPage->setSections(recovered.sections);
+  }
+  setPaperAssets(assetReferences(recovered.sections));
+  updatePaperModel();
+  m_currentFilePath = documentPath;
+  m_contentModified = true;
+  updateStatus(tr("Recovered unsaved changes"), 5000);
+}
+
+void MainWindow::autosave() {
+  if (!m_journal || !m_journal->isOpen()) {
+    return;
+  }
+  // Sections still being added to the editor are in the file already
+  if (m_loadingFile) {
+    m_autosaveTimer->start(AUTOSAVE_DELAY_MS);
+    return;
+  }
+  // Edits since the last call become journal records
+  updatePaperModel();
+}
+
 void MainWindow::showExamInfoDialog() {
   ExamInfoDialog dialog(this);
   dialog.setExam(m_paperModel->exam);
   if (dialog.exec() == QDialog::Accepted) {
-    m_paperModel->exam = dialog.getExam();
-    m_contentModified = true;
-    updateWindowTitle();
+    m_paperModel->setExam(dialog.getExam());
+    onContentChanged();
     // Update preview if needed
     // m_previewPage->refreshPreview();
   }
@@ -365,8 +553,11 @@ int MainWindow::getCurrentPageIndex() const {
 }
 
 void MainWindow::updatePaperModel() {
+  // Everything that reads the model sees the whole paper
+  finishLoading();
   if (m_questionEditorPage && m_paperModel) {
-    m_paperModel->sections = m_questionEditorPage->getSections();
+    // Only sections and questions edited since the last call are touched
+    m_paperModel->setSections(m_questionEditorPage->getSections());
   }
 }
 
@@ -377,7 +568,17 @@ bool MainWindow::validateCurrentPage(QString &errorMessage) {
 
 void MainWindow::onContentChanged() {
   m_contentModified = true;
+  ++m_editCount;
   updateWindowTitle();
+  if (m_autosaveTimer) {
+    // Each edit restarts the quiet time, but steady typing cannot hold the
+    // journal back for longer than AUTOSAVE_MAX_DELAY_MS
+    if (!m_autosaveTimer->isActive()) {
+      m_autosaveWait.start();
+    }
+    const qint64 left = AUTOSAVE_MAX_DELAY_MS - m_autosaveWait.elapsed();
+    m_autosaveTimer->start(int(qBound<qint64>(0, left, AUTOSAVE_DELAY_MS)));
+  }
 }
 
 void MainWindow::onThemeChanged(const QString &theme) { applyTheme(theme); }
@@ -462,14 +663,17 @@ void MainWindow::onNewPaper() {
     return;
   }
 
-  delete m_paperModel;
-  m_paperModel = new PaperModel();
+  cancelLoading();
+  m_paperModel->clear();
 
   if (m_questionEditorPage) {
     m_questionEditorPage->setSections(m_paperModel->sections);
   }
+  setPaperAssets(QStringList());
+  releaseUnusedData();
 
   m_currentFilePath.clear();
+  m_journal->setDocumentPath(m_currentFilePath);
   m_contentModified = false;
   showQuestionEditorPage();
   updateWindowTitle();
@@ -485,7 +689,9 @@ void MainWindow::onOpenPaper() {
                                                   "", PAPER_FILE_FILTER);
   if (!filePath.isEmpty()) {
     if (loadPaperFromFile(filePath)) {
+      releaseUnusedData();
       m_currentFilePath = filePath;
+      m_journal->setDocumentPath(filePath);
       m_contentModified = false;
       updateWindowTitle();
       updateStatus(tr("Opened: %1").arg(filePath), 3000);
@@ -494,76 +700,339 @@ void MainWindow::onOpenPaper() {
 }
 
 void MainWindow::onSavePaper() {
-  if (m_currentFilePath.isEmpty()) {
+  // Damaged sections are only known once every section has been read
+  finishLoading();
+  if (m_currentFilePath.isEmpty() || !m_damagedSections.isEmpty()) {
     onSaveAsPaper();
     return;
   }
-  if (savePaperToFile(m_currentFilePath)) {
-    m_contentModified = false;
-    updateWindowTitle();
-    updateStatus(tr("Saved: %1").arg(m_currentFilePath), 3000);
-  }
+  savePaperToFile(m_currentFilePath, tr("Saved: %1"));
 }
 
 void MainWindow::onSaveAsPaper() {
   QString filePath = QFileDialog::getSaveFileName(this, tr("Save Exam Paper"),
                                                   "", PAPER_FILE_FILTER);
   if (!filePath.isEmpty()) {
-    if (!filePath.endsWith(".epf", Qt::CaseInsensitive))
+    if (!filePath.endsWith(".epf", Qt::CaseInsensitive) &&
+        !filePath.endsWith(".json", Qt::CaseInsensitive))
       filePath += ".epf";
-    if (savePaperToFile(filePath)) {
-      m_currentFilePath = filePath;
-      m_contentModified = false;
-      updateWindowTitle();
-      updateStatus(tr("Saved as: %1").arg(filePath), 3000);
+    finishLoading();
+    if (!m_damagedSections.isEmpty() &&
+        QFileInfo(filePath) == QFileInfo(m_currentFilePath) &&
+        !confirmAction(tr("Save Exam Paper"),
+                       tr("Some sections of this file could not be read. "
+                          "Saving over it loses them for good. Continue?"))) {
+      return;
     }
+    savePaperToFile(filePath, tr("Saved as: %1"));
   }
 }
 
 bool MainWindow::loadPaperFromFile(const QString &filePath) {
-  QFile file(filePath);
-  if (!file.open(QIODevice::ReadOnly)) {
+  // The signature decides; a .epf file without it is a damaged paper, whose
+  // error is more use than a JSON syntax error
+  const bool binary = PaperFile::isPaperFile(filePath) ||
+                      filePath.endsWith(".epf", Qt::CaseInsensitive);
+  if (!binary) {
+    // JSON is parsed whole, its sections in parallel
+    PaperModel paper;
+    QString error;
+    if (!PaperJson::load(filePath, paper, &error)) {
+      showError(tr("Load Error"), tr("Failed to open file: %1").arg(error));
+      return false;
+    }
+    cancelLoading();
+    m_paperModel->clear();
+    m_paperModel->setExam(paper.exam);
+    if (m_questionEditorPage) {
+      m_questionEditorPage->setSections(paper.sections);
+    }
+    setPaperAssets(assetReferences(paper.sections));
+    return true;
+  }
+
+  auto paperFile = std::make_shared<PaperFile>();
+  if (!paperFile->open(filePath)) {
     showError(tr("Load Error"),
-              tr("Failed to open file: %1").arg(file.errorString()));
+              tr("Failed to open file: %1").arg(paperFile->errorString()));
     return false;
   }
 
-  QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
-  if (doc.isNull() || !doc.isObject()) {
-    showError(tr("Load Error"), tr("Invalid file format."));
+  // Only the first readable section is decoded before the editor shows it;
+  // the rest are decoded and added from the event loop, see
+  // loadNextSections(). Damaged sections are skipped and reported.
+  QVector<int> damaged;
+  QVector<Section> firstSection;
+  int next = 0;
+  while (firstSection.isEmpty() && next < paperFile->sectionCount()) {
+    bool ok = false;
+    const Section section = paperFile->section(next, &ok);
+    if (ok) {
+      firstSection.append(section);
+    } else {
+      damaged.append(next);
+    }
+    ++next;
+  }
+  if (paperFile->sectionCount() > 0 && firstSection.isEmpty()) {
+    showError(tr("Load Error"), tr("The paper file is damaged."));
     return false;
   }
 
-  // TODO: Implement proper JSON deserialization
-  // For now, just show a message
-  showInfo(tr("Load"), tr("File loaded successfully (implementation pending)"));
-
-  // In a real app, you'd deserialize the JSON into sections
-  // For now, let's assume it's done and update the editor
+  cancelLoading();
+  m_paperModel->clear();
+  m_paperModel->setExam(paperFile->exam());
   if (m_questionEditorPage) {
-    m_questionEditorPage->setSections(m_paperModel->sections);
+    m_questionEditorPage->setSections(firstSection);
+  }
+  setPaperAssets(paperFile->assets());
+  m_damagedSections = damaged;
+  m_loadingFile = paperFile;
+  m_nextSectionToLoad = next;
+  if (next < paperFile->sectionCount()) {
+    // Sections added or removed now would end up out of file order
+    if (m_questionEditorPage) {
+      m_questionEditorPage->setSectionsLocked(true);
+    }
+    QTimer::singleShot(0, this, &MainWindow::loadNextSections);
+  } else {
+    endLoading();
   }
   return true;
 }
 
-bool MainWindow::savePaperToFile(const QString &filePath) {
+void MainWindow::appendLoadedSection() {
+  bool ok = false;
+  const Section section = m_loadingFile->section(m_nextSectionToLoad, &ok);
+  if (!ok) {
+    // Later sections are independent of this one and still load
+    m_damagedSections.append(m_nextSectionToLoad);
+  } else if (m_questionEditorPage) {
+    m_questionEditorPage->appendSection(section);
+  }
+  ++m_nextSectionToLoad;
+  if (m_nextSectionToLoad == m_loadingFile->sectionCount()) {
+    endLoading();
+  }
+}
+
+void MainWindow::loadNextSections() {
+  // Add sections for a short slice, then let the window repaint
+  QElapsedTimer slice;
+  slice.start();
+  while (m_loadingFile && slice.elapsed() < LOAD_SLICE_MS) {
+    appendLoadedSection();
+  }
+  if (m_loadingFile) {
+    updateStatus(tr("Loading sections... %1 of %2")
+                     .arg(m_nextSectionToLoad)
+                     .arg(m_loadingFile->sectionCount()));
+    QTimer::singleShot(0, this, &MainWindow::loadNextSections);
+  } else {
+    updateStatus(tr("Ready"), 3000);
+  }
+}
+
+void MainWindow::finishLoading() {
+  while (m_loadingFile) {
+    appendLoadedSection();
+  }
+}
+
+void MainWindow::endLoading() {
+  // Closing unmaps the file so it can be saved over
+  m_loadingFile.reset();
+  if (m_questionEditorPage) {
+    m_questionEditorPage->setSectionsLocked(false);
+  }
+  if (m_damagedSections.isEmpty()) {
+    return;
+  }
+  QStringList numbers;
+  for (int index : m_damagedSections) {
+    numbers.append(QString::number(index + 1));
+  }
+  showError(tr("Load Error"),
+            tr("Section(s) %1 of the paper are damaged and were not loaded. "
+               "Save the paper under a new name to keep the original file.")
+                .arg(numbers.join(", ")));
+}
+
+void MainWindow::setPaperAssets(const QStringList &references) {
+  // Retained before the old ones are released, so shared blobs stay put
+  AssetStore &store = AssetStore::shared();
+  store.retain(references);
+  store.release(m_paperAssets);
+  m_paperAssets = references;
+}
+
+void MainWindow::releaseUnusedData() {
+  // Options and cells only the previous paper used
+  StringPool::shared().prune();
+  m_assetPruneDue = true;
+  pruneAssets();
+}
+
+void MainWindow::pruneAssets() {
+  // Queued exports and saves of the previous paper may not have read its
+  // diagrams yet; the prune waits until they have all finished
+  if (!m_assetPruneDue || m_runningExports > 0 ||
+      ExportScheduler::shared().pendingCount() > 0 ||
+      m_pendingSave.isRunning()) {
+    return;
+  }
+  m_assetPruneDue = false;
+  AssetStore::shared().prune();
+}
+
+void MainWindow::cancelLoading() {
+  m_loadingFile.reset();
+  m_damagedSections.clear();
+  if (m_questionEditorPage) {
+    m_questionEditorPage->setSectionsLocked(false);
+  }
+}
+
+void MainWindow::savePaperToFile(const QString &filePath,
+                                 const QString &savedMessage) {
   updatePaperModel();
 
-  QJsonObject json;
-  json["version"] = APP_VERSION;
-  json["exam"] = QJsonObject();    // Add exam data
-  json["sections"] = QJsonArray(); // Add sections data
-  // Serialize model here...
+  // Written from a snapshot on the journal's thread, so the window does not
+  // wait for a large paper
+  const bool json = filePath.endsWith(".json", Qt::CaseInsensitive);
+  auto error = std::make_shared<QString>();
+  m_pendingSave = m_journal->save([filePath, json, error](const PaperModel &paper) {
+    return json ? PaperJson::save(paper, filePath, error.get())
+                : PaperFile::save(paper, filePath, error.get());
+  });
+  updateStatus(tr("Saving..."), 0);
+
+  const int editCount = m_editCount;
+  auto *watcher = new QFutureWatcher<bool>(this);
+  connect(watcher, &QFutureWatcherBase::finished, this,
+          [this, watcher, filePath, savedMessage, error, editCount]() {
+            watcher->deleteLater();
+            pruneAssets();
+            if (!watcher->result()) {
+              updateStatus(tr("Ready"), 3000);
+              showError(tr("Save Error"),
+                        tr("Failed to save file: %1").arg(*error));
+              return;
+            }
+            m_currentFilePath = filePath;
+            m_journal->setDocumentPath(filePath);
+            // The saved file is complete in itself
+            m_damagedSections.clear();
+            // Edits made while saving still need saving
+            if (m_editCount == editCount)
+              m_contentModified = false;
+            updateWindowTitle();
+            updateStatus(savedMessage.arg(filePath), 3000);
+          });
+  watcher->setFuture(m_pendingSave);
+}
 
-  QFile file(filePath);
-  if (!file.open(QIODevice::WriteOnly)) {
-    showError(tr("Save Error"),
-              tr("Failed to save file: %1").arg(file.errorString()));
-    return false;
+PaperHistory *MainWindow::paperHistory() {
+  if (m_currentFilePath.isEmpty()) {
+    showInfo(tr("Versions"), tr("Save the paper to a file first; its "
+                                "versions are kept beside it."));
+    return nullptr;
+  }
+  const QString directory = PaperHistory::pathFor(m_currentFilePath);
+  if (!m_history || m_history->directory() != directory) {
+    m_history = std::make_unique<PaperHistory>();
+    if (!m_history->open(directory)) {
+      showError(tr("Versions"), m_history->errorString());
+      m_history.reset();
+    }
+  }
+  return m_history.get();
+}
+
+void MainWindow::onSaveVersion() {
+  PaperHistory *history = paperHistory();
+  if (!history) {
+    return;
+  }
+  bool ok = false;
+  const QString message =
+      QInputDialog::getText(this, tr("Save Version"),
+                            tr("Describe this version:"), QLineEdit::Normal,
+                            QString(), &ok);
+  if (!ok) {
+    return;
+  }
+
+  updatePaperModel();
+  const QByteArray previous = history->head();
+  const QByteArray version = history->snapshot(*m_paperModel, message);
+  if (version.isEmpty()) {
+    showError(tr("Version Error"), tr("Failed to save the version: %1")
+                                       .arg(history->errorString()));
+  } else if (version == previous) {
+    updateStatus(tr("No changes since the last version"), 3000);
+  } else {
+    updateStatus(tr("Saved version"), 3000);
   }
-  file.write(QJsonDocument(json).toJson());
-  file.close();
-  return true;
+}
+
+void MainWindow::onRestoreVersion() {
+  PaperHistory *history = paperHistory();
+  if (!history) {
+    return;
+  }
+  const QVector<PaperHistory::Version> versions = history->versions();
+  if (versions.isEmpty()) {
+    showInfo(tr("Restore Version"),
+             tr("No versions have been saved for this paper."));
+    return;
+  }
+
+  // Only version objects are read for the list; the short hash keeps every
+  // label unique, so the choice maps back to its version
+  QStringList items;
+  for (const PaperHistory::Version &version : versions) {
+    const QString message =
+        version.message.isEmpty() ? tr("(no description)") : version.message;
+    items.append(QStringLiteral("%1  %2  (%3)")
+                     .arg(version.time.toString("yyyy-MM-dd hh:mm"), message,
+                          QString::fromLatin1(version.hash.toHex().left(7))));
+  }
+  bool ok = false;
+  const QString item =
+      QInputDialog::getItem(this, tr("Restore Version"), tr("Version:"),
+                            items, 0, false, &ok);
+  const int index = items.indexOf(item);
+  if (!ok || index < 0 || !checkUnsavedChanges()) {
+    return;
+  }
+
+  const PaperHistory::Version &version = versions[index];
+  PaperModel restored;
+  if (!history->checkout(version.hash, restored)) {
+    showError(tr("Restore Version"),
+              tr("The version could not be read; its history is damaged."));
+    return;
+  }
+  cancelLoading();
+  m_paperModel->setExam(restored.exam);
+  if (m_questionEditorPage) {
+    m_questionEditorPage->setSections(restored.sections);
+  }
+  setPaperAssets(assetReferences(restored.sections));
+  updatePaperModel();
+  // The file still holds what was last saved
+  onContentChanged();
+  // Diffed for the chosen version only
+  const QString changes =
+      version.parent.isEmpty()
+          ? tr("first version")
+          : tr("%n change(s) from the version before", nullptr,
+               int(history->diff(version.parent, version.hash).size()));
+  updateStatus(tr("Restored version %1 (%2)")
+                   .arg(QString::fromLatin1(version.hash.toHex().left(7)),
+                        changes),
+               3000);
 }
 
 void MainWindow::onShowSettings() {
@@ -639,8 +1108,24 @@ void MainWindow::saveSettings() {
 }
 
 void MainWindow::closeEvent(QCloseEvent *event) {
+  // A save still being written decides whether anything is unsaved
+  if (m_pendingSave.isRunning()) {
+    m_pendingSave.waitForFinished();
+    QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
+  }
   if (checkUnsavedChanges()) {
     saveSettings();
+    // Drop exports that have not started and let running ones finish
+    // writing their files
+    ExportScheduler &scheduler = ExportScheduler::shared();
+    if (scheduler.pendingCount() > 0) {
+      updateStatus(tr("Finishing exports..."), 0);
+      for (const ExportScheduler::JobInfo &job : scheduler.jobs()) {
+        if (job.state == ExportScheduler::State::Queued)
+          scheduler.cancel(job.id);
+      }
+      scheduler.waitForRunning();
+    }
     event->accept();
   } else
     event->ignore();
@@ -654,6 +1139,10 @@ void MainWindow::onTabChanged(int index) {
 void MainWindow::updatePreview() {
   if (m_previewBrowser) {
     updatePaperModel();
+    // Show diagrams from the shared cache instead of decoding the originals
+    DiagramCache::shared().addResources(
+        *m_previewBrowser->document(), *m_paperModel,
+        qRound(DiagramCache::SCREEN_DPI * m_previewBrowser->devicePixelRatioF()));
     m_previewBrowser->setHtml(
         m_paperModel->toHtml(m_defaultFontFamily, m_defaultFontSize, m_portraitOrientation));
   }
@@ -663,12 +1152,9 @@ void MainWindow::onExportDocx() {
   QString filePath = QFileDialog::getSaveFileName(this, tr("Export DOCX"), "",
                                                   "DOCX Files (*.docx)");
   if (!filePath.isEmpty()) {
-    updatePaperModel();
-    DocxExporter exporter;
-    if (exporter.exportToDocx(*m_paperModel, filePath, m_defaultFontFamily, m_defaultFontSize, m_portraitOrientation))
-      QMessageBox::information(this, tr("Success"), tr("DOCX exported."));
-    else
-      QMessageBox::warning(this, tr("Error"), tr("Export failed."));
+    watchExport(scheduleExport(ExportJob::Format::Docx, filePath,
+                               ExportJob::Priority::Interactive),
+                tr("DOCX exported."), tr("Error"), tr("Export failed."));
   }
 }
 
@@ -676,12 +1162,9 @@ void MainWindow::onExportPdf() {
   QString filePath = QFileDialog::getSaveFileName(this, tr("Export PDF"), "",
                                                   "PDF Files (*.pdf)");
   if (!filePath.isEmpty()) {
-    updatePaperModel();
-    PdfExporter exporter;
-    if (exporter.exportToPdf(*m_paperModel, filePath, m_defaultFontFamily, m_defaultFontSize, m_portraitOrientation))
-      QMessageBox::information(this, tr("Success"), tr("PDF exported."));
-    else
-      QMessageBox::warning(this, tr("Error"), tr("Export failed."));
+    watchExport(scheduleExport(ExportJob::Format::Pdf, filePath,
+                               ExportJob::Priority::Interactive),
+                tr("PDF exported."), tr("Error"), tr("Export failed."));
   }
 }
 
@@ -689,21 +1172,99 @@ void MainWindow::onExportHtml() {
   QString filePath = QFileDialog::getSaveFileName(this, tr("Export HTML"), "",
                                                   "HTML Files (*.html)");
   if (!filePath.isEmpty()) {
-    updatePaperModel();
-    QFile file(filePath);
-    if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-      QTextStream out(&file);
-      out.setEncoding(QStringConverter::Utf8);
-      out << m_paperModel->toHtml(m_defaultFontFamily, m_defaultFontSize, m_portraitOrientation);
-      file.close();
-      QMessageBox::information(this, tr("Success"), tr("HTML exported."));
-    } else {
-      QMessageBox::warning(this, tr("Export Failed"),
-                           tr("Failed to export HTML."));
-    }
+    watchExport(scheduleExport(ExportJob::Format::Html, filePath,
+                               ExportJob::Priority::Interactive),
+                tr("HTML exported."), tr("Export Failed"),
+                tr("Failed to export HTML."));
   }
 }
 
+void MainWindow::onExportAllFormats() {
+  const QString directory = QFileDialog::getExistingDirectory(
+      this, tr("Export All Formats"), QFileInfo(m_currentFilePath).path());
+  if (directory.isEmpty())
+    return;
+
+  updatePaperModel();
+  QString baseName = m_currentFilePath.isEmpty()
+                         ? m_paperModel->exam.title.trimmed()
+                         : QFileInfo(m_currentFilePath).completeBaseName();
+  if (baseName.isEmpty())
+    baseName = "paper";
+  const QString basePath = QDir(directory).filePath(baseName);
+
+  // One snapshot for all three files; progress shows in the export queue
+  const PaperSnapshot snapshot = m_paperModel->snapshot();
+  ExportJob job;
+  job.snapshot = snapshot;
+  job.style = RenderStyle{m_defaultFontFamily, m_defaultFontSize,
+                          m_portraitOrientation};
+  job.priority = ExportJob::Priority::Batch;
+  const QPair<ExportJob::Format, QString> formats[] = {
+      {ExportJob::Format::Pdf, ".pdf"},
+      {ExportJob::Format::Docx, ".docx"},
+      {ExportJob::Format::Html, ".html"}};
+  for (const auto &format : formats) {
+    job.format = format.first;
+    job.filePath = basePath + format.second;
+    job.style.inlineDiagrams =
+        m_inlineHtmlDiagrams && job.format == ExportJob::Format::Html;
+    ExportScheduler::shared().schedule(job);
+  }
+  updateStatus(tr("Queued exports to %1").arg(directory), 3000);
+}
+
+PaperSnapshot MainWindow::takeSnapshot() {
+  // Exports only ever see this snapshot, so the user can keep editing
+  updatePaperModel();
+  return m_paperModel->snapshot();
+}
+
+QFuture<bool> MainWindow::scheduleExport(ExportJob::Format format,
+                                         const QString &filePath,
+                                         ExportJob::Priority priority) {
+  ExportJob job;
+  job.snapshot = takeSnapshot();
+  job.format = format;
+  job.filePath = filePath;
+  job.style = RenderStyle{m_defaultFontFamily, m_defaultFontSize,
+                          m_portraitOrientation};
+  // Only HTML embeds diagrams; keeping the flag off elsewhere lets other
+  // formats merge with identical queued jobs
+  job.style.inlineDiagrams =
+      m_inlineHtmlDiagrams && format == ExportJob::Format::Html;
+  job.priority = priority;
+  return ExportScheduler::shared().schedule(job);
+}
+
+void MainWindow::watchExport(const QFuture<bool> &future,
+                             const QString &successMessage,
+                             const QString &failureTitle,
+                             const QString &failureMessage) {
+  ++m_runningExports;
+  updateStatus(tr("Exporting..."), 0);
+
+  auto *watcher = new QFutureWatcher<bool>(this);
+  connect(watcher, &QFutureWatcherBase::progressTextChanged, this,
+          [this](const QString &step) {
+            updateStatus(tr("Exporting... %1").arg(step), 0);
+          });
+  connect(watcher, &QFutureWatcherBase::finished, this,
+          [this, watcher, successMessage, failureTitle, failureMessage]() {
+            watcher->deleteLater();
+            --m_runningExports;
+            pruneAssets();
+            updateStatus(m_runningExports > 0 ? tr("Exporting...")
+                                              : tr("Ready"),
+                         3000);
+            if (!watcher->isCanceled() && watcher->result())
+              QMessageBox::information(this, tr("Success"), successMessage);
+            else
+              QMessageBox::warning(this, failureTitle, failureMessage);
+          });
+  watcher->setFuture(future);
+}
+
 void MainWindow::setPaperOrientation(bool portrait) {
   m_portraitOrientation = portrait;
   
@@ -1,9 +1,14 @@
 #pragma once
 
+#include <QElapsedTimer>
+#include <QFuture>
 #include <QMainWindow>
 #include <QString>
+#include <QStringList>
 #include <QTextBrowser>
 #include <QVBoxLayout>
+#include <memory>
+#include "../exporters/ExportScheduler.h"
 
 // Forward declarations
 namespace Ui {
@@ -11,11 +16,16 @@ class MainWindow;
 }
 
 class PaperModel;
+class PaperFile;
+class PaperHistory;
+class PaperJournal;
 class ExamInfoDialog;
 class QTabWidget;
 class Question;
 class Section;
 class QComboBox;
+class QDockWidget;
+class QTimer;
 class QuestionEditorPage;
 
 /**
@@ -45,10 +55,13 @@ private slots:
   void onExportDocx();
   void onExportPdf();
   void onExportHtml();
+  void onExportAllFormats();
   void onNewPaper();
   void onOpenPaper();
   void onSavePaper();
   void onSaveAsPaper();
+  void onSaveVersion();
+  void onRestoreVersion();
   void onShowSettings();
   void onShowAbout();
   void setPaperOrientation(bool portrait);
@@ -57,6 +70,7 @@ private slots:
   void onTabChanged(int index);
   void updatePaperModel();
   void onContentChanged();
+  void autosave();
 
 private:
   Ui::MainWindow *ui;
@@ -66,24 +80,56 @@ private:
   QVBoxLayout *m_sectionsLayout;
   QTextBrowser *m_previewBrowser;
   QComboBox *m_themeCombo;
+  QDockWidget *m_exportQueueDock;
   QString m_currentFilePath;
   bool m_contentModified;
   QString m_defaultFontFamily;
   int m_defaultFontSize;
   bool m_portraitOrientation;
+  bool m_inlineHtmlDiagrams;
+  // Paper whose sections are still being added to the editor
+  std::shared_ptr<PaperFile> m_loadingFile;
+  int m_nextSectionToLoad;
+  // Sections of the opened file that could not be read; saving over the
+  // file would lose them, so Save asks for a new name
+  QVector<int> m_damagedSections;
+  // Embedded diagrams the current paper retains in the AssetStore
+  QStringList m_paperAssets;
+  int m_runningExports;
+  // Blobs of a replaced paper wait to be pruned until exports of it finish
+  bool m_assetPruneDue;
+  // Autosave journal; edits reach it when the timer syncs the model
+  std::unique_ptr<PaperJournal> m_journal;
+  QTimer *m_autosaveTimer;
+  QElapsedTimer m_autosaveWait; // Since the oldest edit not yet journaled
+  QFuture<bool> m_pendingSave;
+  int m_editCount; // Edits since startup, to tell if a save is current
+  std::unique_ptr<PaperHistory> m_history; // Versions of the current file
 
   void setupUi();
   void setupPages();
+  void setupExportQueue();
   void setupMenuBar();
   void setupToolBar();
   void setupStatusBar();
   void setupConnections();
+  void setupJournal();
+  void recoverPaper();
+  PaperHistory *paperHistory();
   void applyTheme(const QString &theme);
   void updateWindowTitle();
   void updateUiState();
   bool checkUnsavedChanges();
   bool loadPaperFromFile(const QString &filePath);
-  bool savePaperToFile(const QString &filePath);
+  void loadNextSections();
+  void appendLoadedSection();
+  void finishLoading();
+  void endLoading();
+  void cancelLoading();
+  void setPaperAssets(const QStringList &references);
+  void releaseUnusedData();
+  void pruneAssets();
+  void savePaperToFile(const QString &filePath, const QString &savedMessage);
   int getCurrentPageIndex() const;
   void navigateToPage(int pageIndex);
   bool validateCurrentPage(QString &errorMessage);
@@ -93,4 +139,10 @@ private:
   bool confirmAction(const QString &title, const QString &message);
   void loadSettings();
   void saveSettings();
+  std::shared_ptr<const PaperModel> takeSnapshot();
+  QFuture<bool> scheduleExport(ExportJob::Format format,
+                               const QString &filePath,
+                               ExportJob::Priority priority);
+  void watchExport(const QFuture<bool> &future, const QString &successMessage,
+                   const QString &failureTitle, const QString &failureMessage);
 };
\ No newline at end of file
@@ -1,14 +1,28 @@
 #include "DocxExporter.h"
+#include "DocxWriter.h"
+#include "../layout/LayoutBuilder.h"
 #include <QFile>
-#include <QTextStream>
+#include <QObject>
 
-bool DocxExporter::exportToDocx(const PaperModel &model, const QString &filePath, const QString &fontFamily, int fontSize, bool portrait)
+bool DocxExporter::exportToDocx(const PaperModel &model, const QString &filePath, const QString &fontFamily, int fontSize, bool portrait, const ExportProgress &progress)
 {
-    // Simple strategy: write an HTML file and save with .docx extension.
     QFile f(filePath);
-    if (!f.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
-    QTextStream out(&f);
-    out << model.toHtml(fontFamily, fontSize, portrait);
+    if (!f.open(QIODevice::WriteOnly)) return false;
+
+    // Lower the model once and stream the layout tree as WordprocessingML
+    const LayoutDocument layout = LayoutBuilder().build(model, RenderStyle{fontFamily, fontSize, portrait});
+    const int sectionCount = layout.sections.size();
+    const bool ok = DocxWriter(layout).write(f, [&](int done) {
+        progress.update(done, sectionCount, QObject::tr("Section %1 of %2").arg(done).arg(sectionCount));
+        return !progress.isCanceled();
+    });
     f.close();
-    return true;
+    return ok && f.error() == QFileDevice::NoError;
+}
+
+QFuture<bool> DocxExporter::exportToDocxAsync(PaperSnapshot snapshot, const QString &filePath, const QString &fontFamily, int fontSize, bool portrait)
+{
+    return ExportTask::start(filePath, [=](const QString &path, const ExportProgress &progress) {
+        return DocxExporter().exportToDocx(*snapshot, path, fontFamily, fontSize, portrait, progress);
+    });
 }
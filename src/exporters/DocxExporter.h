@@ -1,14 +1,24 @@
 #pragma once
 
+#include <QFuture>
 #include <QString>
 #include "../models/PaperModel.h"
+#include "ExportTask.h"
 
 /**
- * DocxExporter: Writes a simple HTML-based .docx file (Word can open HTML-wrapped DOC files).
+ * DocxExporter: Writes a native WordprocessingML .docx file, streamed by DocxWriter.
  */
 class DocxExporter
 {
 public:
     DocxExporter() = default;
-    bool exportToDocx(const PaperModel &model, const QString &filePath, const QString &fontFamily = "Times New Roman", int fontSize = 12, bool portrait = true);
+    bool exportToDocx(const PaperModel &model, const QString &filePath, const QString &fontFamily = "Times New Roman", int fontSize = 12, bool portrait = true, const ExportProgress &progress = ExportProgress());
+
+    /**
+     * @brief Exports a snapshot on the global thread pool.
+     *
+     * Progress is reported per section; canceling the future stops the
+     * export after the current section and removes the partial file.
+     */
+    static QFuture<bool> exportToDocxAsync(PaperSnapshot snapshot, const QString &filePath, const QString &fontFamily = "Times New Roman", int fontSize = 12, bool portrait = true);
 };
@@ -0,0 +1,896 @@
+#include "DocxWriter.h"
+#include "ZipWriter.h"
+#include "../layout/DiagramCache.h"
+#include <QHash>
+#include <QSize>
+#include <QThreadPool>
+#include <QXmlStreamWriter>
+#include <functional>
+
+/**
+ * @file DocxWriter.cpp
+ * @brief Implementation of the DocxWriter class.
+ */
+
+namespace {
+const QString WORD_NAMESPACE =
+    "http://schemas.openxmlformats.org/wordprocessingml/2006/main";
+const QString RELATIONSHIPS_NAMESPACE =
+    "http://schemas.openxmlformats.org/officeDocument/2006/relationships";
+const QString PACKAGE_RELATIONSHIPS_NAMESPACE =
+    "http://schemas.openxmlformats.org/package/2006/relationships";
+const QString DRAWING_NAMESPACE =
+    "http://schemas.openxmlformats.org/drawingml/2006/wordprocessingDrawing";
+const QString DRAWINGML_NAMESPACE =
+    "http://schemas.openxmlformats.org/drawingml/2006/main";
+const QString PICTURE_NAMESPACE =
+    "http://schemas.openxmlformats.org/drawingml/2006/picture";
+
+const QString MAIN_DOCUMENT_TYPE = "application/vnd.openxmlformats-"
+                                   "officedocument.wordprocessingml.document."
+                                   "main+xml";
+const QString STYLES_TYPE = "application/vnd.openxmlformats-officedocument."
+                            "wordprocessingml.styles+xml";
+const QString NUMBERING_TYPE = "application/vnd.openxmlformats-"
+                               "officedocument.wordprocessingml.numbering+xml";
+const QString CORE_PROPERTIES_TYPE =
+    "application/vnd.openxmlformats-package.core-properties+xml";
+
+// Page geometry matches the PDF export: A4 with 15 mm margins, in twips
+constexpr int A4_WIDTH = 11906;
+constexpr int A4_HEIGHT = 16838;
+constexpr int PAGE_MARGIN = 850;
+
+// Spacing in CSS pixels, as in PaperLayoutEngine
+constexpr int QUESTION_NUMBER_WIDTH = 30;
+constexpr int QUESTION_SPACING = 6;
+constexpr int SECTION_SPACING = 10;
+constexpr int TITLE_SPACING = 20;
+constexpr int RULE_SPACING = 4;
+constexpr int OPTION_INDENT = 15;
+constexpr int OR_INDENT = 20;
+constexpr int OR_SPACING = 5;
+constexpr int FLOAT_MARGIN = 5;
+constexpr int CELL_PADDING = 4;
+constexpr qreal MAX_TABLE_SHARE = 0.45; // Of the question text column
+constexpr qreal TITLE_SCALE = 1.3;
+constexpr qreal METADATA_SCALE = 0.8;
+constexpr qreal SUBTITLE_SCALE = 0.85;
+
+constexpr int TWIPS_PER_PIXEL = 15;
+constexpr qint64 EMU_PER_PIXEL = 9525;
+constexpr qint64 EMU_PER_TWIP = 635;
+constexpr int RULE_WIDTH = 6; // Eighths of a point
+
+int twips(int cssPixels) { return cssPixels * TWIPS_PER_PIXEL; }
+
+QString number(qint64 value) { return QString::number(value); }
+
+// An embedded diagram and its relationship from document.xml
+struct Media {
+  QString relationshipId;
+  QString target; // Relative to word/
+  QSize pixelSize;
+};
+
+using MediaMap = QHash<QString, Media>; // By diagram path
+
+// Writes one XML part into its own zip entry
+bool writePart(ZipWriter &zip, const QString &name,
+               const std::function<bool(QXmlStreamWriter &)> &body) {
+  QIODevice *device = zip.beginEntry(name);
+  if (!device) {
+    return false;
+  }
+  QXmlStreamWriter xml(device);
+  xml.writeStartDocument("1.0", true);
+  const bool complete = body(xml);
+  xml.writeEndDocument();
+  return zip.endEntry() && complete && !xml.hasError();
+}
+
+void writeValue(QXmlStreamWriter &xml, const QString &element,
+                const QString &value) {
+  xml.writeEmptyElement(element);
+  xml.writeAttribute("w:val", value);
+}
+
+// Text with tabs and line breaks as Word elements; other control characters
+// are not allowed in XML and are dropped
+void writeText(QXmlStreamWriter &xml, const QString &text) {
+  QString pending;
+  const auto flush = [&]() {
+    if (pending.isEmpty()) {
+      return;
+    }
+    xml.writeStartElement("w:t");
+    xml.writeAttribute("xml:space", "preserve");
+    xml.writeCharacters(pending);
+    xml.writeEndElement();
+    pending.clear();
+  };
+
+  for (const QChar c : text) {
+    if (c == '\n' || c == QChar::LineSeparator) {
+      flush();
+      xml.writeEmptyElement("w:br");
+    } else if (c == '\t') {
+      flush();
+      xml.writeEmptyElement("w:tab");
+    } else if (c.unicode() >= 0x20) {
+      pending += c;
+    }
+  }
+  flush();
+}
+
+void writeRun(QXmlStreamWriter &xml, const LayoutRun &run) {
+  xml.writeStartElement("w:r");
+  if (run.bold || run.italic || run.underline ||
+      run.verticalAlignment != LayoutRun::VerticalAlignment::Normal) {
+    xml.writeStartElement("w:rPr");
+    if (run.bold) {
+      xml.writeEmptyElement("w:b");
+    }
+    if (run.italic) {
+      xml.writeEmptyElement("w:i");
+    }
+    if (run.underline) {
+      writeValue(xml, "w:u", "single");
+    }
+    switch (run.verticalAlignment) {
+    case LayoutRun::VerticalAlignment::Superscript:
+      writeValue(xml, "w:vertAlign", "superscript");
+      break;
+    case LayoutRun::VerticalAlignment::Subscript:
+      writeValue(xml, "w:vertAlign", "subscript");
+      break;
+    case LayoutRun::VerticalAlignment::Normal:
+      break;
+    }
+    xml.writeEndElement(); // rPr
+  }
+  writeText(xml, run.text);
+  xml.writeEndElement(); // r
+}
+
+void writeTextRun(QXmlStreamWriter &xml, const QString &text,
+                  bool bold = false) {
+  LayoutRun run;
+  run.text = text;
+  run.bold = bold;
+  writeRun(xml, run);
+}
+
+void beginParagraph(QXmlStreamWriter &xml, const QString &style,
+                    int numId = 0) {
+  xml.writeStartElement("w:p");
+  xml.writeStartElement("w:pPr");
+  writeValue(xml, "w:pStyle", style);
+  if (numId > 0) {
+    xml.writeStartElement("w:numPr");
+    writeValue(xml, "w:ilvl", "0");
+    writeValue(xml, "w:numId", number(numId));
+    xml.writeEndElement();
+  }
+  xml.writeEndElement(); // pPr
+}
+
+void writeParagraph(QXmlStreamWriter &xml, const QString &style,
+                    const QString &text) {
+  beginParagraph(xml, style);
+  writeTextRun(xml, text);
+  xml.writeEndElement();
+}
+
+// Package-level parts
+
+bool writeContentTypes(QXmlStreamWriter &xml) {
+  xml.writeStartElement("Types");
+  xml.writeDefaultNamespace(
+      "http://schemas.openxmlformats.org/package/2006/content-types");
+  const auto addDefault = [&xml](const QString &extension,
+                                 const QString &type) {
+    xml.writeEmptyElement("Default");
+    xml.writeAttribute("Extension", extension);
+    xml.writeAttribute("ContentType", type);
+  };
+  const auto addOverride = [&xml](const QString &part, const QString &type) {
+    xml.writeEmptyElement("Override");
+    xml.writeAttribute("PartName", part);
+    xml.writeAttribute("ContentType", type);
+  };
+  addDefault("rels",
+             "application/vnd.openxmlformats-package.relationships+xml");
+  addDefault("xml", "application/xml");
+  addDefault("jpeg", "image/jpeg");
+  addDefault("png", "image/png");
+  addOverride("/word/document.xml", MAIN_DOCUMENT_TYPE);
+  addOverride("/word/styles.xml", STYLES_TYPE);
+  addOverride("/word/numbering.xml", NUMBERING_TYPE);
+  addOverride("/docProps/core.xml", CORE_PROPERTIES_TYPE);
+  xml.writeEndElement();
+  return true;
+}
+
+void writeRelationship(QXmlStreamWriter &xml, const QString &id,
+                       const QString &type, const QString &target) {
+  xml.writeEmptyElement("Relationship");
+  xml.writeAttribute("Id", id);
+  xml.writeAttribute("Type", type);
+  xml.writeAttribute("Target", target);
+}
+
+bool writePackageRelationships(QXmlStreamWriter &xml) {
+  xml.writeStartElement("Relationships");
+  xml.writeDefaultNamespace(PACKAGE_RELATIONSHIPS_NAMESPACE);
+  writeRelationship(xml, "rIdDocument",
+                    RELATIONSHIPS_NAMESPACE + "/officeDocument",
+                    "word/document.xml");
+  writeRelationship(xml, "rIdCore",
+                    "http://schemas.openxmlformats.org/package/2006/"
+                    "relationships/metadata/core-properties",
+                    "docProps/core.xml");
+  xml.writeEndElement();
+  return true;
+}
+
+bool writeDocumentRelationships(QXmlStreamWriter &xml, const MediaMap &media) {
+  xml.writeStartElement("Relationships");
+  xml.writeDefaultNamespace(PACKAGE_RELATIONSHIPS_NAMESPACE);
+  writeRelationship(xml, "rIdStyles", RELATIONSHIPS_NAMESPACE + "/styles",
+                    "styles.xml");
+  writeRelationship(xml, "rIdNumbering",
+                    RELATIONSHIPS_NAMESPACE + "/numbering", "numbering.xml");
+  for (const Media &image : media) {
+    writeRelationship(xml, image.relationshipId,
+                      RELATIONSHIPS_NAMESPACE + "/image", image.target);
+  }
+  xml.writeEndElement();
+  return true;
+}
+
+bool writeCoreProperties(QXmlStreamWriter &xml, const QString &title) {
+  xml.writeStartElement("cp:coreProperties");
+  xml.writeNamespace("http://schemas.openxmlformats.org/package/2006/"
+                     "metadata/core-properties",
+                     "cp");
+  xml.writeNamespace("http://purl.org/dc/elements/1.1/", "dc");
+  xml.writeTextElement("dc:title", title);
+  xml.writeEndElement();
+  return true;
+}
+
+// Styles: every spacing and font decision of the paper lives here, so
+// document.xml only names styles
+
+struct StyleFormat {
+  bool keepNext = false;
+  bool ruleBelow = false;
+  int spaceBefore = 0; // Twips
+  int spaceAfter = 0;
+  int indent = 0;
+  int hanging = 0;
+  bool centered = false;
+  bool bold = false;
+  bool italic = false;
+  int halfPoints = 0; // 0 keeps the document default
+};
+
+void writeParagraphStyle(QXmlStreamWriter &xml, const QString &id,
+                         const StyleFormat &format) {
+  xml.writeStartElement("w:style");
+  xml.writeAttribute("w:type", "paragraph");
+  xml.writeAttribute("w:customStyle", "1");
+  xml.writeAttribute("w:styleId", id);
+  writeValue(xml, "w:name", id);
+  writeValue(xml, "w:basedOn", "Normal");
+  xml.writeEmptyElement("w:qFormat");
+
+  xml.writeStartElement("w:pPr");
+  if (format.keepNext) {
+    xml.writeEmptyElement("w:keepNext");
+  }
+  if (format.ruleBelow) {
+    xml.writeStartElement("w:pBdr");
+    xml.writeEmptyElement("w:bottom");
+    xml.writeAttribute("w:val", "single");
+    xml.writeAttribute("w:sz", number(RULE_WIDTH));
+    xml.writeAttribute("w:space", number(twips(RULE_SPACING) / 20));
+    xml.writeAttribute("w:color", "000000");
+    xml.writeEndElement();
+  }
+  if (format.spaceBefore > 0 || format.spaceAfter > 0) {
+    xml.writeEmptyElement("w:spacing");
+    xml.writeAttribute("w:before", number(format.spaceBefore));
+    xml.writeAttribute("w:after", number(format.spaceAfter));
+  }
+  if (format.indent > 0) {
+    xml.writeEmptyElement("w:ind");
+    xml.writeAttribute("w:left", number(format.indent));
+    if (format.hanging > 0) {
+      xml.writeAttribute("w:hanging", number(format.hanging));
+    }
+  }
+  if (format.centered) {
+    writeValue(xml, "w:jc", "center");
+  }
+  xml.writeEndElement(); // pPr
+
+  if (format.bold || format.italic || format.halfPoints > 0) {
+    xml.writeStartElement("w:rPr");
+    if (format.bold) {
+      xml.writeEmptyElement("w:b");
+    }
+    if (format.italic) {
+      xml.writeEmptyElement("w:i");
+    }
+    if (format.halfPoints > 0) {
+      writeValue(xml, "w:sz", number(format.halfPoints));
+      writeValue(xml, "w:szCs", number(format.halfPoints));
+    }
+    xml.writeEndElement();
+  }
+  xml.writeEndElement(); // style
+}
+
+void writeTableStyle(QXmlStreamWriter &xml, const QString &id, bool borders) {
+  xml.writeStartElement("w:style");
+  xml.writeAttribute("w:type", "table");
+  xml.writeAttribute("w:customStyle", "1");
+  xml.writeAttribute("w:styleId", id);
+  writeValue(xml, "w:name", id);
+  xml.writeStartElement("w:tblPr");
+  if (borders) {
+    xml.writeStartElement("w:tblBorders");
+    for (const char *side :
+         {"w:top", "w:left", "w:bottom", "w:right", "w:insideH", "w:insideV"}) {
+      xml.writeEmptyElement(side);
+      xml.writeAttribute("w:val", "single");
+      xml.writeAttribute("w:sz", number(RULE_WIDTH));
+      xml.writeAttribute("w:space", "0");
+      xml.writeAttribute("w:color", "000000");
+    }
+    xml.writeEndElement();
+  }
+  xml.writeStartElement("w:tblCellMar");
+  for (const char *side : {"w:top", "w:left", "w:bottom", "w:right"}) {
+    xml.writeEmptyElement(side);
+    xml.writeAttribute("w:w", number(twips(borders ? CELL_PADDING : 2)));
+    xml.writeAttribute("w:type", "dxa");
+  }
+  xml.writeEndElement(); // tblCellMar
+  xml.writeEndElement(); // tblPr
+  xml.writeEndElement(); // style
+}
+
+bool writeStyles(QXmlStreamWriter &xml, const RenderStyle &style) {
+  const auto scaled = [&style](qreal scale) {
+    return qRound(style.fontSize * scale * 2);
+  };
+
+  xml.writeStartElement("w:styles");
+  xml.writeNamespace(WORD_NAMESPACE, "w");
+
+  xml.writeStartElement("w:docDefaults");
+  xml.writeStartElement("w:rPrDefault");
+  xml.writeStartElement("w:rPr");
+  xml.writeEmptyElement("w:rFonts");
+  for (const char *attribute :
+       {"w:ascii", "w:hAnsi", "w:eastAsia", "w:cs"}) {
+    xml.writeAttribute(attribute, style.fontFamily);
+  }
+  writeValue(xml, "w:sz", number(scaled(1.0)));
+  writeValue(xml, "w:szCs", number(scaled(1.0)));
+  xml.writeEndElement(); // rPr
+  xml.writeEndElement(); // rPrDefault
+  xml.writeStartElement("w:pPrDefault");
+  xml.writeStartElement("w:pPr");
+  xml.writeEmptyElement("w:spacing");
+  xml.writeAttribute("w:before", "0");
+  xml.writeAttribute("w:after", "0");
+  xml.writeAttribute("w:line", "240");
+  xml.writeAttribute("w:lineRule", "auto");
+  xml.writeEndElement(); // pPr
+  xml.writeEndElement(); // pPrDefault
+  xml.writeEndElement(); // docDefaults
+
+  xml.writeStartElement("w:style");
+  xml.writeAttribute("w:type", "paragraph");
+  xml.writeAttribute("w:default", "1");
+  xml.writeAttribute("w:styleId", "Normal");
+  writeValue(xml, "w:name", "Normal");
+  xml.writeEmptyElement("w:qFormat");
+  xml.writeEndElement();
+
+  StyleFormat title;
+  title.centered = true;
+  title.bold = true;
+  title.halfPoints = scaled(TITLE_SCALE);
+  writeParagraphStyle(xml, "PaperTitle", title);
+
+  StyleFormat metadata;
+  metadata.centered = true;
+  metadata.ruleBelow = true;
+  metadata.spaceAfter = twips(TITLE_SPACING);
+  metadata.halfPoints = scaled(METADATA_SCALE);
+  writeParagraphStyle(xml, "PaperMetadata", metadata);
+
+  StyleFormat heading;
+  heading.keepNext = true;
+  heading.centered = true;
+  heading.bold = true;
+  heading.spaceBefore = twips(SECTION_SPACING);
+  writeParagraphStyle(xml, "SectionHeading", heading);
+
+  StyleFormat subtitle;
+  subtitle.keepNext = true;
+  subtitle.centered = true;
+  subtitle.bold = true;
+  subtitle.italic = true;
+  subtitle.halfPoints = scaled(SUBTITLE_SCALE);
+  writeParagraphStyle(xml, "SectionSubtitle", subtitle);
+
+  StyleFormat question;
+  question.spaceBefore = twips(QUESTION_SPACING);
+  question.indent = twips(QUESTION_NUMBER_WIDTH);
+  question.hanging = twips(QUESTION_NUMBER_WIDTH);
+  writeParagraphStyle(xml, "Question", question);
+
+  StyleFormat questionText;
+  questionText.indent = twips(QUESTION_NUMBER_WIDTH);
+  writeParagraphStyle(xml, "QuestionText", questionText);
+
+  StyleFormat option;
+  option.indent = twips(OPTION_INDENT);
+  writeParagraphStyle(xml, "Option", option);
+
+  StyleFormat orHeading;
+  orHeading.centered = true;
+  orHeading.bold = true;
+  orHeading.spaceBefore = twips(OR_SPACING);
+  orHeading.spaceAfter = twips(OR_SPACING);
+  writeParagraphStyle(xml, "OrHeading", orHeading);
+
+  StyleFormat alternative;
+  alternative.indent = twips(OR_INDENT);
+  writeParagraphStyle(xml, "Alternative", alternative);
+
+  writeTableStyle(xml, "DataTable", true);
+  writeTableStyle(xml, "OptionGrid", false);
+
+  xml.writeEndElement(); // styles
+  return true;
+}
+
+// One numbering instance per section, so numbers restart like the IR's
+bool writeNumbering(QXmlStreamWriter &xml, const LayoutDocument &document) {
+  xml.writeStartElement("w:numbering");
+  xml.writeNamespace(WORD_NAMESPACE, "w");
+
+  xml.writeStartElement("w:abstractNum");
+  xml.writeAttribute("w:abstractNumId", "0");
+  writeValue(xml, "w:multiLevelType", "singleLevel");
+  xml.writeStartElement("w:lvl");
+  xml.writeAttribute("w:ilvl", "0");
+  writeValue(xml, "w:start", "1");
+  writeValue(xml, "w:numFmt", "decimal");
+  writeValue(xml, "w:lvlText", "%1)");
+  writeValue(xml, "w:lvlJc", "left");
+  xml.writeStartElement("w:pPr");
+  xml.writeEmptyElement("w:ind");
+  xml.writeAttribute("w:left", number(twips(QUESTION_NUMBER_WIDTH)));
+  xml.writeAttribute("w:hanging", number(twips(QUESTION_NUMBER_WIDTH)));
+  xml.writeEndElement(); // pPr
+  xml.writeEndElement(); // lvl
+  xml.writeEndElement(); // abstractNum
+
+  for (int i = 0; i < document.sections.size(); ++i) {
+    const LayoutSection &section = document.sections[i];
+    const int start =
+        section.questions.isEmpty() ? 1 : section.questions.first().number;
+    xml.writeStartElement("w:num");
+    xml.writeAttribute("w:numId", number(i + 1));
+    writeValue(xml, "w:abstractNumId", "0");
+    xml.writeStartElement("w:lvlOverride");
+    xml.writeAttribute("w:ilvl", "0");
+    writeValue(xml, "w:startOverride", number(start));
+    xml.writeEndElement(); // lvlOverride
+    xml.writeEndElement(); // num
+  }
+
+  xml.writeEndElement(); // numbering
+  return true;
+}
+
+// Embeds every distinct diagram once, before document.xml refers to them.
+// The cache hands out JPEG or PNG data, which is stored as is.
+bool writeMedia(ZipWriter &zip, const LayoutDocument &document,
+                MediaMap &media) {
+  DiagramCache &cache = DiagramCache::shared();
+  for (const LayoutSection &section : document.sections) {
+    for (const LayoutQuestion &question : section.questions) {
+      const LayoutImage &diagram = question.diagram;
+      if (diagram.isNull() || media.contains(diagram.path)) {
+        continue;
+      }
+      const DiagramCache::Diagram encoded =
+          cache.encoded(diagram.path, diagram.width);
+      if (encoded.isNull() || encoded.data.isEmpty()) {
+        continue;
+      }
+      const int index = media.size() + 1;
+      const QString extension =
+          encoded.mimeType == "image/png" ? "png" : "jpeg";
+      Media image;
+      image.relationshipId = "rIdImage" + number(index);
+      image.target = "media/image" + number(index) + "." + extension;
+      image.pixelSize = encoded.image.size();
+      if (!zip.addEntry("word/" + image.target, encoded.data,
+                        ZipWriter::Method::Stored)) {
+        return false;
+      }
+      media.insert(diagram.path, image);
+    }
+  }
+  return true;
+}
+
+// Streams word/document.xml
+class DocumentPart {
+public:
+  DocumentPart(QXmlStreamWriter &xml, const LayoutDocument &document,
+               const MediaMap &media)
+      : m_xml(xml), m_document(document), m_media(media),
+        m_pageWidth(document.style.portrait ? A4_WIDTH : A4_HEIGHT),
+        m_pageHeight(document.style.portrait ? A4_HEIGHT : A4_WIDTH),
+        m_textWidth(m_pageWidth - 2 * PAGE_MARGIN) {}
+
+  bool write(const DocxWriter::SectionCallback &sectionWritten) {
+    m_xml.writeStartElement("w:document");
+    m_xml.writeNamespace(WORD_NAMESPACE, "w");
+    m_xml.writeNamespace(RELATIONSHIPS_NAMESPACE, "r");
+    m_xml.writeNamespace(DRAWING_NAMESPACE, "wp");
+    m_xml.writeNamespace(DRAWINGML_NAMESPACE, "a");
+    m_xml.writeNamespace(PICTURE_NAMESPACE, "pic");
+    m_xml.writeStartElement("w:body");
+
+    writeTitle();
+    for (int i = 0; i < m_document.sections.size(); ++i) {
+      writeSection(m_document.sections[i], i + 1);
+      if (sectionWritten && !sectionWritten(i + 1)) {
+        return false;
+      }
+    }
+    writePageSetup();
+
+    m_xml.writeEndElement(); // body
+    m_xml.writeEndElement(); // document
+    return true;
+  }
+
+private:
+  QXmlStreamWriter &m_xml;
+  const LayoutDocument &m_document;
+  const MediaMap &m_media;
+  const int m_pageWidth; // Twips
+  const int m_pageHeight;
+  const int m_textWidth;
+  int m_drawingId = 0;
+
+  void writeTitle() {
+    if (!m_document.title.isEmpty()) {
+      writeParagraph(m_xml, "PaperTitle", m_document.title);
+    }
+    // Carries the separator line even when there is no metadata
+    writeParagraph(m_xml, "PaperMetadata", m_document.metadata.join(" | "));
+  }
+
+  void writeSection(const LayoutSection &section, int numId) {
+    writeParagraph(m_xml, "SectionHeading", section.label);
+    if (!section.subtitle.isEmpty()) {
+      writeParagraph(m_xml, "SectionSubtitle", section.subtitle);
+    }
+    for (const LayoutQuestion &question : section.questions) {
+      writeQuestion(question, numId);
+    }
+  }
+
+  void writeQuestion(const LayoutQuestion &question, int numId) {
+    const Media *diagram = nullptr;
+    if (!question.diagram.isNull()) {
+      auto it = m_media.constFind(question.diagram.path);
+      if (it != m_media.constEnd()) {
+        diagram = &*it;
+      }
+    }
+    const qint64 diagramWidth = EMU_PER_PIXEL * question.diagram.width;
+    const qint64 diagramHeight =
+        diagram ? diagramWidth * diagram->pixelSize.height() /
+                      qMax(1, diagram->pixelSize.width())
+                : 0;
+
+    // A floating table precedes the paragraph it floats beside, below the
+    // diagram if there is one
+    if (!question.table.isEmpty()) {
+      const int tableTop =
+          diagram ? int(diagramHeight / EMU_PER_TWIP) + twips(FLOAT_MARGIN) : 0;
+      writeDataTable(question.table, tableTop);
+    }
+
+    // The numbered paragraph anchors the diagram
+    beginParagraph(m_xml, "Question", numId);
+    if (diagram) {
+      writeDrawing(*diagram, diagramWidth, diagramHeight);
+    }
+    if (!question.text.isEmpty()) {
+      for (const LayoutRun &run : question.text.first().runs) {
+        writeRun(m_xml, run);
+      }
+    }
+    m_xml.writeEndElement(); // p
+    for (int i = 1; i < question.text.size(); ++i) {
+      beginParagraph(m_xml, "QuestionText");
+      for (const LayoutRun &run : question.text[i].runs) {
+        writeRun(m_xml, run);
+      }
+      m_xml.writeEndElement();
+    }
+
+    if (!question.alternatives.isEmpty()) {
+      beginParagraph(m_xml, "OrHeading");
+      writeTextRun(m_xml, "OR");
+      m_xml.writeEndElement();
+      for (const QString &alternative : question.alternatives) {
+        writeParagraph(m_xml, "Alternative", alternative);
+      }
+    } else if (!question.options.isEmpty()) {
+      if (question.options.columns > 1) {
+        writeOptionGrid(question.options);
+      } else {
+        for (int i = 0; i < question.options.options.size(); ++i) {
+          writeParagraph(m_xml, "Option",
+                         optionLabel(i, question.options.options[i]));
+        }
+      }
+    }
+  }
+
+  static QString optionLabel(int index, const QString &option) {
+    return "(" + QString(QChar('a' + index)) + ") " + option;
+  }
+
+  void writeGrid(int columns, int columnWidth) {
+    m_xml.writeStartElement("w:tblGrid");
+    for (int i = 0; i < columns; ++i) {
+      m_xml.writeEmptyElement("w:gridCol");
+      m_xml.writeAttribute("w:w", number(columnWidth));
+    }
+    m_xml.writeEndElement();
+  }
+
+  void writeCell(const QString &text, int width, bool bold) {
+    m_xml.writeStartElement("w:tc");
+    m_xml.writeStartElement("w:tcPr");
+    m_xml.writeEmptyElement("w:tcW");
+    m_xml.writeAttribute("w:w", number(width));
+    m_xml.writeAttribute("w:type", "dxa");
+    m_xml.writeEndElement();
+    m_xml.writeStartElement("w:p");
+    if (!text.isEmpty()) {
+      writeTextRun(m_xml, text, bold);
+    }
+    m_xml.writeEndElement(); // p
+    m_xml.writeEndElement(); // tc
+  }
+
+  // Right-aligned floating table with the header row in bold; Word sizes
+  // the columns to their content within the preferred width
+  void writeDataTable(const LayoutTable &table, int top) {
+    const int questionWidth = m_textWidth - twips(QUESTION_NUMBER_WIDTH);
+    const int width = int(questionWidth * MAX_TABLE_SHARE);
+    const int columnWidth = width / table.columns;
+
+    m_xml.writeStartElement("w:tbl");
+    m_xml.writeStartElement("w:tblPr");
+    writeValue(m_xml, "w:tblStyle", "DataTable");
+    m_xml.writeEmptyElement("w:tblpPr");
+    m_xml.writeAttribute("w:leftFromText", number(twips(FLOAT_MARGIN)));
+    m_xml.writeAttribute("w:bottomFromText", number(twips(FLOAT_MARGIN)));
+    m_xml.writeAttribute("w:vertAnchor", "text");
+    m_xml.writeAttribute("w:horzAnchor", "margin");
+    m_xml.writeAttribute("w:tblpXSpec", "right");
+    m_xml.writeAttribute("w:tblpY", number(top));
+    m_xml.writeEmptyElement("w:tblW");
+    m_xml.writeAttribute("w:w", "0");
+    m_xml.writeAttribute("w:type", "auto");
+    m_xml.writeEmptyElement("w:tblLayout");
+    m_xml.writeAttribute("w:type", "autofit");
+    m_xml.writeEndElement(); // tblPr
+    writeGrid(table.columns, columnWidth);
+
+    for (int row = 0; row < table.rows; ++row) {
+      m_xml.writeStartElement("w:tr");
+      for (int column = 0; column < table.columns; ++column) {
+        writeCell(table.cell(row, column), columnWidth, row == 0);
+      }
+      m_xml.writeEndElement();
+    }
+    m_xml.writeEndElement(); // tbl
+  }
+
+  // Borderless grid of equal columns below the question
+  void writeOptionGrid(const LayoutOptionGrid &grid) {
+    const int indent = twips(OPTION_INDENT);
+    const int columnWidth = (m_textWidth - indent) / grid.columns;
+
+    m_xml.writeStartElement("w:tbl");
+    m_xml.writeStartElement("w:tblPr");
+    writeValue(m_xml, "w:tblStyle", "OptionGrid");
+    m_xml.writeEmptyElement("w:tblW");
+    m_xml.writeAttribute("w:w", number(columnWidth * grid.columns));
+    m_xml.writeAttribute("w:type", "dxa");
+    m_xml.writeEmptyElement("w:tblInd");
+    m_xml.writeAttribute("w:w", number(indent));
+    m_xml.writeAttribute("w:type", "dxa");
+    m_xml.writeEmptyElement("w:tblLayout");
+    m_xml.writeAttribute("w:type", "fixed");
+    m_xml.writeEndElement(); // tblPr
+    writeGrid(grid.columns, columnWidth);
+
+    for (int first = 0; first < grid.options.size(); first += grid.columns) {
+      m_xml.writeStartElement("w:tr");
+      for (int i = first; i < first + grid.columns; ++i) {
+        writeCell(i < grid.options.size() ? optionLabel(i, grid.options[i])
+                                          : QString(),
+                  columnWidth, false);
+      }
+      m_xml.writeEndElement();
+    }
+    m_xml.writeEndElement(); // tbl
+  }
+
+  // Picture floated against the right margin, text wrapping on its left
+  void writeDrawing(const Media &image, qint64 width, qint64 height) {
+    const QString id = number(++m_drawingId);
+    const QString cx = number(width);
+    const QString cy = number(height);
+    const QString margin = number(twips(FLOAT_MARGIN) * EMU_PER_TWIP);
+
+    m_xml.writeStartElement("w:r");
+    m_xml.writeStartElement("w:drawing");
+    m_xml.writeStartElement("wp:anchor");
+    m_xml.writeAttribute("distT", "0");
+    m_xml.writeAttribute("distB", margin);
+    m_xml.writeAttribute("distL", margin);
+    m_xml.writeAttribute("distR", "0");
+    m_xml.writeAttribute("simplePos", "0");
+    m_xml.writeAttribute("relativeHeight", id);
+    m_xml.writeAttribute("behindDoc", "0");
+    m_xml.writeAttribute("locked", "0");
+    m_xml.writeAttribute("layoutInCell", "1");
+    m_xml.writeAttribute("allowOverlap", "0");
+    m_xml.writeEmptyElement("wp:simplePos");
+    m_xml.writeAttribute("x", "0");
+    m_xml.writeAttribute("y", "0");
+    m_xml.writeStartElement("wp:positionH");
+    m_xml.writeAttribute("relativeFrom", "margin");
+    m_xml.writeTextElement("wp:align", "right");
+    m_xml.writeEndElement();
+    m_xml.writeStartElement("wp:positionV");
+    m_xml.writeAttribute("relativeFrom", "paragraph");
+    m_xml.writeTextElement("wp:posOffset", "0");
+    m_xml.writeEndElement();
+    m_xml.writeEmptyElement("wp:extent");
+    m_xml.writeAttribute("cx", cx);
+    m_xml.writeAttribute("cy", cy);
+    m_xml.writeEmptyElement("wp:effectExtent");
+    for (const char *side : {"l", "t", "r", "b"}) {
+      m_xml.writeAttribute(side, "0");
+    }
+    m_xml.writeEmptyElement("wp:wrapSquare");
+    m_xml.writeAttribute("wrapText", "left");
+    m_xml.writeEmptyElement("wp:docPr");
+    m_xml.writeAttribute("id", id);
+    m_xml.writeAttribute("name", "Diagram " + id);
+    m_xml.writeEmptyElement("wp:cNvGraphicFramePr");
+
+    m_xml.writeStartElement("a:graphic");
+    m_xml.writeStartElement("a:graphicData");
+    m_xml.writeAttribute("uri", PICTURE_NAMESPACE);
+    m_xml.writeStartElement("pic:pic");
+    m_xml.writeStartElement("pic:nvPicPr");
+    m_xml.writeEmptyElement("pic:cNvPr");
+    m_xml.writeAttribute("id", id);
+    m_xml.writeAttribute("name", image.target.section('/', -1));
+    m_xml.writeEmptyElement("pic:cNvPicPr");
+    m_xml.writeEndElement(); // nvPicPr
+    m_xml.writeStartElement("pic:blipFill");
+    m_xml.writeEmptyElement("a:blip");
+    m_xml.writeAttribute("r:embed", image.relationshipId);
+    m_xml.writeStartElement("a:stretch");
+    m_xml.writeEmptyElement("a:fillRect");
+    m_xml.writeEndElement(); // stretch
+    m_xml.writeEndElement(); // blipFill
+    m_xml.writeStartElement("pic:spPr");
+    m_xml.writeStartElement("a:xfrm");
+    m_xml.writeEmptyElement("a:off");
+    m_xml.writeAttribute("x", "0");
+    m_xml.writeAttribute("y", "0");
+    m_xml.writeEmptyElement("a:ext");
+    m_xml.writeAttribute("cx", cx);
+    m_xml.writeAttribute("cy", cy);
+    m_xml.writeEndElement(); // xfrm
+    m_xml.writeStartElement("a:prstGeom");
+    m_xml.writeAttribute("prst", "rect");
+    m_xml.writeEmptyElement("a:avLst");
+    m_xml.writeEndElement(); // prstGeom
+    m_xml.writeEndElement(); // spPr
+    m_xml.writeEndElement(); // pic
+    m_xml.writeEndElement(); // graphicData
+    m_xml.writeEndElement(); // graphic
+
+    m_xml.writeEndElement(); // anchor
+    m_xml.writeEndElement(); // drawing
+    m_xml.writeEndElement(); // r
+  }
+
+  void writePageSetup() {
+    m_xml.writeStartElement("w:sectPr");
+    m_xml.writeEmptyElement("w:pgSz");
+    m_xml.writeAttribute("w:w", number(m_pageWidth));
+    m_xml.writeAttribute("w:h", number(m_pageHeight));
+    if (!m_document.style.portrait) {
+      m_xml.writeAttribute("w:orient", "landscape");
+    }
+    m_xml.writeEmptyElement("w:pgMar");
+    for (const char *side :
+         {"w:top", "w:right", "w:bottom", "w:left"}) {
+      m_xml.writeAttribute(side, number(PAGE_MARGIN));
+    }
+    for (const char *distance : {"w:header", "w:footer", "w:gutter"}) {
+      m_xml.writeAttribute(distance, "0");
+    }
+    m_xml.writeEndElement(); // sectPr
+  }
+};
+} // namespace
+
+DocxWriter::DocxWriter(const LayoutDocument &document) : m_document(document) {}
+
+bool DocxWriter::write(QIODevice &device,
+                       const SectionCallback &sectionWritten) const {
+  // Parts and blocks of document.xml are compressed on the pool while the
+  // next ones are being generated
+  ZipWriter zip(&device, QThreadPool::globalInstance());
+  MediaMap media;
+
+  // [Content_Types].xml first, as some readers expect
+  const bool ok =
+      writePart(zip, "[Content_Types].xml", writeContentTypes) &&
+      writePart(zip, "_rels/.rels", writePackageRelationships) &&
+      writePart(zip, "docProps/core.xml",
+                [this](QXmlStreamWriter &xml) {
+                  return writeCoreProperties(xml, m_document.title);
+                }) &&
+      writePart(zip, "word/styles.xml",
+                [this](QXmlStreamWriter &xml) {
+                  return writeStyles(xml, m_document.style);
+                }) &&
+      writePart(zip, "word/numbering.xml",
+                [this](QXmlStreamWriter &xml) {
+                  return writeNumbering(xml, m_document);
+                }) &&
+      writeMedia(zip, m_document, media) &&
+      writePart(zip, "word/document.xml",
+                [&](QXmlStreamWriter &xml) {
+                  return DocumentPart(xml, m_document, media)
+                      .write(sectionWritten);
+                }) &&
+      writePart(zip, "word/_rels/document.xml.rels",
+                [&media](QXmlStreamWriter &xml) {
+                  return writeDocumentRelationships(xml, media);
+                });
+
+  return ok && zip.finish();
+}
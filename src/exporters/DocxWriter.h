@@ -0,0 +1,51 @@
+#pragma once
+
+#include <functional>
+#include "../layout/LayoutDocument.h"
+
+class QIODevice;
+
+/**
+ * @file DocxWriter.h
+ * @brief Defines the DocxWriter class that streams the layout IR as a .docx package.
+ */
+
+/**
+ * @class DocxWriter
+ * @brief Writes a LayoutDocument as a WordprocessingML (.docx) package.
+ *
+ * Every part is written straight into a ZipWriter with QXmlStreamWriter, so
+ * no XML tree is ever built: document.xml is deflated as it is produced, one
+ * question at a time, and memory use does not grow with the paper.
+ * Compression runs on the global thread pool, overlapping with generation.
+ *
+ * Paper structure maps onto native Word features: question numbers are a
+ * numbered list restarting in every section, diagrams are floating pictures
+ * and data tables floating tables on the right, and all spacing lives in
+ * named paragraph styles. Diagrams come from the DiagramCache at print
+ * resolution and are stored without recompression.
+ */
+class DocxWriter
+{
+public:
+    /**
+     * @brief Called after each section with the number written so far;
+     * returning false stops the export.
+     */
+    using SectionCallback = std::function<bool(int sectionsWritten)>;
+
+    /**
+     * @brief Creates a writer for a document, which must outlive it.
+     */
+    explicit DocxWriter(const LayoutDocument &document);
+
+    /**
+     * @brief Writes the whole package to @p device, which must be open for writing.
+     * @param sectionWritten Optional progress callback, see SectionCallback
+     * @return true if the package is complete
+     */
+    bool write(QIODevice &device, const SectionCallback &sectionWritten = SectionCallback()) const;
+
+private:
+    const LayoutDocument &m_document;
+};
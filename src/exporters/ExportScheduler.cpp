@@ -0,0 +1,349 @@
+#include "ExportScheduler.h"
+#include "DocxExporter.h"
+#include "ExportTask.h"
+#include "HtmlExporter.h"
+#include "PdfExporter.h"
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QPointer>
+#include <QPromise>
+#include <QThread>
+#include <algorithm>
+
+/**
+ * @file ExportScheduler.cpp
+ * @brief Implementation of the ExportScheduler class.
+ */
+
+namespace {
+ExportTask::Job exportFunction(const ExportJob &job) {
+  return [job](const QString &path, const ExportProgress &progress) {
+    const PaperModel &model = *job.snapshot;
+    const RenderStyle &style = job.style;
+    switch (job.format) {
+    case ExportJob::Format::Pdf:
+      return PdfExporter().exportToPdf(model, path, style.fontFamily,
+                                       style.fontSize, style.portrait,
+                                       progress);
+    case ExportJob::Format::Docx:
+      return DocxExporter().exportToDocx(model, path, style.fontFamily,
+                                         style.fontSize, style.portrait,
+                                         progress);
+    case ExportJob::Format::Html:
+      return HtmlExporter().exportToHtml(model, path, style, progress);
+    }
+    return false;
+  };
+}
+} // namespace
+
+bool ExportJob::isSameExport(const ExportJob &other) const {
+  if (format != other.format || filePath != other.filePath ||
+      style != other.style) {
+    return false;
+  }
+  if (snapshot == other.snapshot) {
+    return true;
+  }
+  // Snapshots of an unchanged model share their section data
+  return snapshot && other.snapshot &&
+         snapshot->sections.constData() ==
+             other.snapshot->sections.constData() &&
+         snapshot->exam == other.snapshot->exam;
+}
+
+QString ExportJob::formatName(Format format) {
+  switch (format) {
+  case Format::Pdf:
+    return QStringLiteral("PDF");
+  case Format::Docx:
+    return QStringLiteral("DOCX");
+  case Format::Html:
+    return QStringLiteral("HTML");
+  }
+  return QString();
+}
+
+// The future handed to one schedule() call; its watcher reports a cancel
+struct ExportScheduler::Caller {
+  QPromise<bool> promise;
+  QFutureWatcher<bool> *watcher = nullptr;
+};
+
+struct ExportScheduler::Entry {
+  JobInfo info;
+  QString target; // Absolute path of the file written
+  // Shared with the worker, which may still hold it after the entry is gone
+  std::shared_ptr<QPromise<bool>> promise;
+  QFuture<bool> future;
+  QFutureWatcher<bool> *watcher = nullptr;
+  QVector<std::shared_ptr<Caller>> callers; // Still waiting for the result
+};
+
+ExportScheduler::ExportScheduler(QObject *parent) : QObject(parent) {
+  m_pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+ExportScheduler::~ExportScheduler() {
+  cancelAll();
+  m_pool.waitForDone();
+}
+
+ExportScheduler &ExportScheduler::shared() {
+  static QPointer<ExportScheduler> scheduler;
+  if (!scheduler) {
+    scheduler = new ExportScheduler(QCoreApplication::instance());
+  }
+  return *scheduler;
+}
+
+QFuture<bool> ExportScheduler::schedule(const ExportJob &job, int *jobId) {
+  // Merge into an identical job that has not finished yet
+  for (const auto &entry : m_entries) {
+    if (entry->info.isDone() || !entry->info.job.isSameExport(job)) {
+      continue;
+    }
+    if (job.priority > entry->info.job.priority) {
+      entry->info.job.priority = job.priority;
+      emit jobChanged(entry->info.id);
+    }
+    if (jobId) {
+      *jobId = entry->info.id;
+    }
+    return addCaller(*entry);
+  }
+
+  auto entry = std::make_shared<Entry>();
+  const int id = m_nextId++;
+  entry->info.id = id;
+  entry->info.job = job;
+  entry->target = QFileInfo(job.filePath).absoluteFilePath();
+  entry->promise = std::make_shared<QPromise<bool>>();
+  entry->future = entry->promise->future();
+  entry->promise->start();
+
+  entry->watcher = new QFutureWatcher<bool>(this);
+  connect(entry->watcher, &QFutureWatcherBase::progressValueChanged, this,
+          [this, id]() { onProgress(id); });
+  connect(entry->watcher, &QFutureWatcherBase::progressRangeChanged, this,
+          [this, id]() { onProgress(id); });
+  connect(entry->watcher, &QFutureWatcherBase::progressTextChanged, this,
+          [this, id]() { onProgress(id); });
+  connect(entry->watcher, &QFutureWatcherBase::finished, this,
+          [this, id]() { onFinished(id); });
+  entry->watcher->setFuture(entry->future);
+
+  m_entries.append(entry);
+  if (jobId) {
+    *jobId = id;
+  }
+  const QFuture<bool> future = addCaller(*entry);
+  emit jobAdded(id);
+  dispatch();
+  return future;
+}
+
+QFuture<bool> ExportScheduler::addCaller(Entry &entry) {
+  auto caller = std::make_shared<Caller>();
+  caller->promise.start();
+  if (entry.info.progressMaximum > 0) {
+    caller->promise.setProgressRange(0, entry.info.progressMaximum);
+    caller->promise.setProgressValueAndText(entry.info.progressValue,
+                                            entry.info.progressText);
+  }
+
+  const int id = entry.info.id;
+  const Caller *key = caller.get();
+  caller->watcher = new QFutureWatcher<bool>(this);
+  connect(caller->watcher, &QFutureWatcherBase::canceled, this,
+          [this, id, key]() { onCallerCanceled(id, key); });
+  const QFuture<bool> future = caller->promise.future();
+  caller->watcher->setFuture(future);
+  entry.callers.append(caller);
+  return future;
+}
+
+void ExportScheduler::cancel(int id) {
+  Entry *entry = findEntry(id);
+  if (!entry || entry->info.isDone()) {
+    return;
+  }
+  entry->future.cancel();
+  if (entry->info.state == State::Queued) {
+    // Nothing will run it, so finish it here
+    entry->promise->finish();
+  }
+}
+
+void ExportScheduler::cancelAll() {
+  for (const auto &entry : m_entries) {
+    cancel(entry->info.id);
+  }
+}
+
+void ExportScheduler::clearFinished() {
+  const qsizetype removed =
+      m_entries.removeIf([](const std::shared_ptr<Entry> &entry) {
+        if (!entry->info.isDone()) {
+          return false;
+        }
+        entry->watcher->deleteLater();
+        return true;
+      });
+  if (removed > 0) {
+    emit jobsRemoved();
+  }
+}
+
+QVector<ExportScheduler::JobInfo> ExportScheduler::jobs() const {
+  QVector<JobInfo> result;
+  result.reserve(m_entries.size());
+  for (const auto &entry : m_entries) {
+    result.append(entry->info);
+  }
+  return result;
+}
+
+const ExportScheduler::JobInfo *ExportScheduler::job(int id) const {
+  const Entry *entry = findEntry(id);
+  return entry ? &entry->info : nullptr;
+}
+
+int ExportScheduler::pendingCount() const {
+  return static_cast<int>(
+      std::count_if(m_entries.cbegin(), m_entries.cend(),
+                    [](const std::shared_ptr<Entry> &entry) {
+                      return !entry->info.isDone();
+                    }));
+}
+
+int ExportScheduler::maxConcurrentJobs() const {
+  return m_pool.maxThreadCount();
+}
+
+void ExportScheduler::setMaxConcurrentJobs(int count) {
+  m_pool.setMaxThreadCount(qMax(1, count));
+  dispatch();
+}
+
+void ExportScheduler::waitForRunning() { m_pool.waitForDone(); }
+
+ExportScheduler::Entry *ExportScheduler::findEntry(int id) const {
+  for (const auto &entry : m_entries) {
+    if (entry->info.id == id) {
+      return entry.get();
+    }
+  }
+  return nullptr;
+}
+
+bool ExportScheduler::waitsForEarlierJob(const Entry &entry) const {
+  for (const auto &other : m_entries) {
+    if (other.get() == &entry) {
+      return false;
+    }
+    if (!other->info.isDone() && other->target == entry.target) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ExportScheduler::dispatch() {
+  while (m_running < m_pool.maxThreadCount()) {
+    // Highest priority first, oldest first within a priority
+    Entry *next = nullptr;
+    for (const auto &entry : m_entries) {
+      if (entry->info.state == State::Queued && !entry->future.isCanceled() &&
+          (!next || entry->info.job.priority > next->info.job.priority) &&
+          !waitsForEarlierJob(*entry)) {
+        next = entry.get();
+      }
+    }
+    if (!next) {
+      return;
+    }
+
+    next->info.state = State::Running;
+    ++m_running;
+    emit jobChanged(next->info.id);
+
+    const std::shared_ptr<QPromise<bool>> promise = next->promise;
+    const QString filePath = next->info.job.filePath;
+    const ExportTask::Job job = exportFunction(next->info.job);
+    m_pool.start(
+        [promise, filePath, job]() { ExportTask::run(*promise, filePath, job); });
+  }
+}
+
+void ExportScheduler::onProgress(int id) {
+  Entry *entry = findEntry(id);
+  if (!entry) {
+    return;
+  }
+  entry->info.progressValue = entry->watcher->progressValue();
+  entry->info.progressMaximum = entry->watcher->progressMaximum();
+  entry->info.progressText = entry->watcher->progressText();
+  for (const auto &caller : entry->callers) {
+    caller->promise.setProgressRange(0, entry->info.progressMaximum);
+    caller->promise.setProgressValueAndText(entry->info.progressValue,
+                                            entry->info.progressText);
+  }
+  emit jobChanged(id);
+}
+
+void ExportScheduler::onFinished(int id) {
+  Entry *entry = findEntry(id);
+  if (!entry || entry->info.isDone()) {
+    return;
+  }
+  if (entry->info.state == State::Running) {
+    --m_running;
+  }
+  if (entry->future.isCanceled()) {
+    entry->info.state = State::Canceled;
+  } else if (entry->future.resultCount() > 0 && entry->future.result()) {
+    entry->info.state = State::Finished;
+  } else {
+    entry->info.state = State::Failed;
+  }
+
+  // Cleared first, so the cancel reported below finds no caller to remove
+  const QVector<std::shared_ptr<Caller>> callers = std::move(entry->callers);
+  entry->callers.clear();
+  for (const auto &caller : callers) {
+    if (entry->info.state == State::Canceled) {
+      caller->promise.future().cancel();
+    } else {
+      caller->promise.addResult(entry->info.state == State::Finished);
+    }
+    caller->promise.finish();
+    caller->watcher->deleteLater();
+  }
+  emit jobChanged(id);
+  dispatch();
+}
+
+void ExportScheduler::onCallerCanceled(int id, const Caller *caller) {
+  Entry *entry = findEntry(id);
+  if (!entry) {
+    return;
+  }
+  const auto it = std::find_if(
+      entry->callers.begin(), entry->callers.end(),
+      [caller](const std::shared_ptr<Caller> &other) {
+        return other.get() == caller;
+      });
+  if (it == entry->callers.end()) {
+    return;
+  }
+  (*it)->promise.finish();
+  (*it)->watcher->deleteLater();
+  entry->callers.erase(it);
+
+  // The job runs on for as long as any caller still wants the file
+  if (entry->callers.isEmpty()) {
+    cancel(id);
+  }
+}
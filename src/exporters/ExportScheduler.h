@@ -0,0 +1,175 @@
+#pragma once
+
+#include <QFuture>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+#include <memory>
+#include "../models/PaperModel.h"
+#include "../models/RenderStyle.h"
+
+/**
+ * @file ExportScheduler.h
+ * @brief Defines the ExportScheduler class that queues and runs export jobs.
+ */
+
+/**
+ * ExportJob: One paper exported to one file in one format.
+ */
+struct ExportJob
+{
+    enum class Format { Pdf, Docx, Html };
+
+    /**
+     * Higher priorities start first. Interactive is for exports the user is
+     * waiting on; Batch for bulk exports that may run behind them.
+     */
+    enum class Priority { Batch, Normal, Interactive };
+
+    PaperSnapshot snapshot;
+    Format format = Format::Pdf;
+    QString filePath;
+    RenderStyle style;
+    Priority priority = Priority::Normal;
+
+    /**
+     * @brief Whether both jobs would write the same file with the same bytes.
+     *
+     * Snapshots match if they are the same object or were taken from an
+     * unchanged model, i.e. share their sections and have equal metadata.
+     */
+    bool isSameExport(const ExportJob &other) const;
+
+    static QString formatName(Format format);
+};
+
+/**
+ * @class ExportScheduler
+ * @brief Runs export jobs on a worker pool, highest priority first.
+ *
+ * Jobs wait in a queue until a worker is free; independent jobs run in
+ * parallel, one per core by default. Jobs writing the same file run one at a
+ * time in the order they were scheduled, so the last export scheduled is the
+ * one left on disk. Scheduling a job identical to one that is still queued
+ * or running merges the two: the existing job takes the higher priority.
+ * Each caller still gets a future of its own; canceling it only stops the
+ * job once every caller merged into it has canceled.
+ *
+ * The scheduler lives on the GUI thread and reports job changes through
+ * signals, for the queue panel.
+ */
+class ExportScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class State { Queued, Running, Finished, Failed, Canceled };
+
+    /**
+     * JobInfo: A job and what has happened to it so far.
+     */
+    struct JobInfo
+    {
+        int id = 0;
+        ExportJob job;
+        State state = State::Queued;
+        int progressValue = 0;
+        int progressMaximum = 0;
+        QString progressText;
+
+        bool isDone() const { return state != State::Queued && state != State::Running; }
+    };
+
+    explicit ExportScheduler(QObject *parent = nullptr);
+    ~ExportScheduler() override;
+
+    /**
+     * @brief The application-wide scheduler, owned by the application object.
+     */
+    static ExportScheduler &shared();
+
+    /**
+     * @brief Queues a job, or merges it into an identical pending one.
+     * @param job The job; its snapshot must not be null
+     * @param jobId Optional output for the ID of the (possibly merged) job
+     * @return Future holding true once the file is complete
+     */
+    QFuture<bool> schedule(const ExportJob &job, int *jobId = nullptr);
+
+    /**
+     * @brief Cancels a queued or running job for all of its callers.
+     */
+    void cancel(int id);
+
+    /**
+     * @brief Cancels every job that has not finished.
+     */
+    void cancelAll();
+
+    /**
+     * @brief Forgets finished, failed and canceled jobs.
+     */
+    void clearFinished();
+
+    /**
+     * @brief All known jobs in scheduling order.
+     */
+    QVector<JobInfo> jobs() const;
+
+    /**
+     * @brief The job with the given ID, or nullptr.
+     */
+    const JobInfo *job(int id) const;
+
+    /**
+     * @brief Number of jobs that have not finished yet.
+     */
+    int pendingCount() const;
+
+    int maxConcurrentJobs() const;
+    void setMaxConcurrentJobs(int count);
+
+    /**
+     * @brief Blocks until every running job has finished.
+     *
+     * Queued jobs are not started by this call.
+     */
+    void waitForRunning();
+
+signals:
+    void jobAdded(int id);
+    void jobChanged(int id);
+    void jobsRemoved();
+
+private:
+    struct Entry;
+
+    QThreadPool m_pool;
+    QVector<std::shared_ptr<Entry>> m_entries;
+    int m_nextId = 1;
+    int m_running = 0;
+
+    struct Caller;
+
+    Entry *findEntry(int id) const;
+
+    /**
+     * @brief Adds a caller to a job and returns the caller's future.
+     */
+    QFuture<bool> addCaller(Entry &entry);
+
+    /**
+     * @brief Whether an earlier job writing the same file has not finished.
+     */
+    bool waitsForEarlierJob(const Entry &entry) const;
+
+    /**
+     * @brief Starts queued jobs while workers are free.
+     */
+    void dispatch();
+
+    void onProgress(int id);
+    void onFinished(int id);
+    void onCallerCanceled(int id, const Caller *caller);
+};
@@ -0,0 +1,81 @@
+#include "ExportTask.h"
+#include <QFile>
+#include <QPromise>
+#include <QTemporaryFile>
+#include <QThreadPool>
+#include <memory>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#else
+#include <cstdio>
+#endif
+
+QFuture<bool> ExportTask::start(const QString &filePath, Job job) {
+  // QThreadPool needs a copyable task, so the promise is shared
+  auto promise = std::make_shared<QPromise<bool>>();
+  QFuture<bool> future = promise->future();
+  promise->start();
+
+  QThreadPool::globalInstance()->start(
+      [promise, filePath, job]() { run(*promise, filePath, job); });
+  return future;
+}
+
+namespace {
+/**
+ * Creates an empty, uniquely named file beside @p filePath for a job to
+ * write. Returns an empty string if the directory is not writable.
+ */
+QString createPartialFile(const QString &filePath) {
+  QTemporaryFile file(filePath + QStringLiteral(".XXXXXX.part"));
+  file.setAutoRemove(false);
+  if (!file.open()) {
+    return QString();
+  }
+  // Temporary files are private to the owner; exports are not
+  file.setPermissions(QFile::exists(filePath)
+                          ? QFile::permissions(filePath)
+                          : QFileDevice::ReadOwner | QFileDevice::WriteOwner |
+                                QFileDevice::ReadGroup | QFileDevice::ReadOther);
+  return file.fileName();
+}
+
+/**
+ * Moves @p from over @p to in one step: @p to holds either its old contents
+ * or the new ones, whatever happens, as QSaveFile::commit() does.
+ */
+bool replaceFile(const QString &from, const QString &to) {
+#if defined(Q_OS_WIN)
+  return MoveFileExW(reinterpret_cast<const wchar_t *>(from.utf16()),
+                     reinterpret_cast<const wchar_t *>(to.utf16()),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  return std::rename(QFile::encodeName(from).constData(),
+                     QFile::encodeName(to).constData()) == 0;
+#endif
+}
+} // namespace
+
+void ExportTask::run(QPromise<bool> &promise, const QString &filePath,
+                     const Job &job) {
+  ExportProgress progress;
+  progress.report = [&promise](int value, int maximum, const QString &step) {
+    promise.setProgressRange(0, maximum);
+    promise.setProgressValueAndText(value, step);
+  };
+  progress.canceled = [&promise]() { return promise.isCanceled(); };
+
+  // The target is only ever replaced, atomically, by a complete file, so a
+  // failed export, a crash or another export of the same file never leaves
+  // it damaged or removed. QFile::rename() cannot be used: it does not
+  // replace an existing file.
+  const QString partialPath = createPartialFile(filePath);
+  const bool ok = !partialPath.isEmpty() && job(partialPath, progress) &&
+                  !promise.isCanceled() && replaceFile(partialPath, filePath);
+  if (!ok && !partialPath.isEmpty()) {
+    QFile::remove(partialPath);
+  }
+  promise.addResult(ok);
+  promise.finish();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QFuture>
+#include <QPromise>
+#include <QString>
+#include <functional>
+
+/**
+ * ExportProgress: Progress and cancellation hooks handed to an export.
+ * Both callbacks are optional.
+ */
+struct ExportProgress
+{
+    std::function<void(int value, int maximum, const QString &step)> report;
+    std::function<bool()> canceled;
+
+    void update(int value, int maximum, const QString &step) const
+    {
+        if (report) {
+            report(value, maximum, step);
+        }
+    }
+
+    bool isCanceled() const { return canceled && canceled(); }
+};
+
+/**
+ * ExportTask: Runs exports on the global thread pool behind a QFuture.
+ */
+namespace ExportTask {
+    /**
+     * Writes the export to the given path, a temporary file beside the
+     * target.
+     */
+    using Job = std::function<bool(const QString &path, const ExportProgress &)>;
+
+    /**
+     * @brief Starts an export job that writes @p filePath.
+     *
+     * The job's progress shows up as the future's progress value and text,
+     * and QFuture::cancel() is passed to it through ExportProgress. The job
+     * writes a temporary file that atomically replaces @p filePath once it
+     * is complete; a failed or canceled export removes it and leaves
+     * @p filePath alone.
+     *
+     * @return Future holding true once the file is complete
+     */
+    QFuture<bool> start(const QString &filePath, Job job);
+
+    /**
+     * @brief Runs an export job in the calling thread.
+     *
+     * Same contract as start(), for callers that schedule jobs themselves.
+     * @p promise must already be started; it is finished on return.
+     */
+    void run(QPromise<bool> &promise, const QString &filePath, const Job &job);
+}
@@ -0,0 +1,318 @@
+#include "HtmlExporter.h"
+#include "../layout/DiagramCache.h"
+#include "../layout/LayoutDocument.h"
+#include "../models/AssetStore.h"
+#include "../models/CompactPaper.h"
+#include "../models/PaperHtml.h"
+#include "../utils/Base64.h"
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QImageReader>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+namespace
+{
+// Bytes of image data encoded per step; a multiple of 3 so the pieces of
+// base64 join without padding in between.
+constexpr qint64 BASE64_CHUNK_SIZE = 48 * 1024;
+
+// Papers with at least this many questions are rendered from a CompactPaper
+// in one linear pass, instead of through the model's fragment cache, which
+// would otherwise keep a fragment of every question after the export.
+constexpr int COMPACT_RENDER_QUESTIONS = 2000;
+
+/**
+ * InlineDiagram: One distinct image and the classes of all diagrams showing it.
+ *
+ * The data comes either from sourcePath, streamed when the style is written,
+ * or from data: an embedded blob or an image already recompressed by the
+ * DiagramCache.
+ */
+struct InlineDiagram
+{
+    QByteArray mimeType;
+    QString sourcePath;
+    QByteArray data;
+    int height = 0; // CSS pixels
+    QStringList classes;
+};
+
+QByteArray streamableMimeType(const QString &path)
+{
+    // Embedded diagrams have no file name, but the store knows their format
+    const QString suffix = AssetStore::isReference(path)
+                               ? QString::fromLatin1(AssetStore::shared().format(path))
+                               : QFileInfo(path).suffix().toLower();
+    if (suffix == QLatin1String("svg")) return QByteArrayLiteral("image/svg+xml");
+    if (suffix == QLatin1String("jpg") || suffix == QLatin1String("jpeg")) return QByteArrayLiteral("image/jpeg");
+    if (suffix == QLatin1String("png")) return QByteArrayLiteral("image/png");
+    if (suffix == QLatin1String("gif")) return QByteArrayLiteral("image/gif");
+    if (suffix == QLatin1String("webp")) return QByteArrayLiteral("image/webp");
+    return QByteArray();
+}
+
+int heightForWidth(const QSize &size, int width)
+{
+    return qMax(1, qRound(double(width) * size.height() / size.width()));
+}
+
+/**
+ * Prepares the diagram at @p path. The original file is used when browsers
+ * can show it and it is no larger than print resolution needs, which only
+ * takes reading its header; anything else goes through the DiagramCache.
+ * Returns false if the file cannot be read.
+ */
+bool prepareInlineDiagram(const QString &path, InlineDiagram &diagram, QByteArray &contentHash)
+{
+    const int width = LayoutImage().width;
+    const QByteArray mimeType = streamableMimeType(path);
+    if (!mimeType.isEmpty()) {
+        const bool embedded = AssetStore::isReference(path);
+        QBuffer blob;
+        QImageReader reader;
+        if (embedded) {
+            blob.setData(AssetStore::shared().data(path));
+            blob.open(QIODevice::ReadOnly);
+            reader.setDevice(&blob);
+        } else {
+            reader.setFileName(path);
+        }
+        QSize size = reader.size();
+        // Browsers apply EXIF orientation too
+        if (reader.transformation() & QImageIOHandler::TransformationRotate90) {
+            size.transpose();
+        }
+        const bool vector = mimeType == "image/svg+xml";
+        if (size.isValid() && !size.isEmpty() &&
+            (vector || DiagramCache::targetSize(size, width, DiagramCache::PRINT_DPI) == size)) {
+            // The reference already names the content
+            if (embedded) {
+                diagram.mimeType = mimeType;
+                diagram.data = blob.data();
+                diagram.height = heightForWidth(size, width);
+                contentHash = mimeType + path.toLatin1();
+                return true;
+            }
+            QFile file(path);
+            QCryptographicHash hash(QCryptographicHash::Sha1);
+            if (file.open(QIODevice::ReadOnly) && hash.addData(&file)) {
+                diagram.mimeType = mimeType;
+                diagram.sourcePath = path;
+                diagram.height = heightForWidth(size, width);
+                contentHash = mimeType + hash.result();
+                return true;
+            }
+        }
+    }
+
+    const DiagramCache::Diagram prepared = DiagramCache::shared().encoded(path, width);
+    if (prepared.isNull() || prepared.data.isEmpty()) {
+        return false;
+    }
+    diagram.mimeType = prepared.mimeType;
+    diagram.data = prepared.data;
+    diagram.height = heightForWidth(prepared.image.size(), width);
+    contentHash = prepared.mimeType + QCryptographicHash::hash(prepared.data, QCryptographicHash::Sha1);
+    return true;
+}
+
+/**
+ * Collects the distinct images behind the paper's diagrams, in order of
+ * first use. Paths with the same content share one entry.
+ */
+QVector<InlineDiagram> collectInlineDiagrams(const PaperModel &model)
+{
+    QVector<InlineDiagram> diagrams;
+    QHash<QByteArray, int> byContent;
+    QSet<QString> seenPaths;
+    for (const Section &section : model.sections) {
+        for (const Question &question : section.questions) {
+            const QString &path = question.diagramPath;
+            if (path.isEmpty() || seenPaths.contains(path)) {
+                continue;
+            }
+            seenPaths.insert(path);
+
+            InlineDiagram diagram;
+            QByteArray contentHash;
+            if (!prepareInlineDiagram(path, diagram, contentHash)) {
+                continue;
+            }
+            const auto it = byContent.constFind(contentHash);
+            if (it != byContent.constEnd()) {
+                diagrams[it.value()].classes.append(PaperHtml::diagramClass(path));
+                continue;
+            }
+            diagram.classes.append(PaperHtml::diagramClass(path));
+            byContent.insert(contentHash, diagrams.size());
+            diagrams.append(diagram);
+        }
+    }
+    return diagrams;
+}
+
+bool writeBase64(QIODevice &out, const char *data, qint64 size)
+{
+    QByteArray encoded(Base64::encodedSize(qMin(size, BASE64_CHUNK_SIZE)), Qt::Uninitialized);
+    for (qint64 pos = 0; pos < size; pos += BASE64_CHUNK_SIZE) {
+        const qint64 length = qMin(BASE64_CHUNK_SIZE, size - pos);
+        const qint64 encodedLength = Base64::encodedSize(length);
+        Base64::encode(data + pos, length, encoded.data());
+        if (out.write(encoded.constData(), encodedLength) != encodedLength) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool streamBase64(QIODevice &out, const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QByteArray buffer(BASE64_CHUNK_SIZE, Qt::Uninitialized);
+    while (true) {
+        // Fill whole chunks so only the last one can end in padding
+        qint64 filled = 0;
+        while (filled < BASE64_CHUNK_SIZE) {
+            const qint64 read = file.read(buffer.data() + filled, BASE64_CHUNK_SIZE - filled);
+            if (read < 0) return false;
+            if (read == 0) break;
+            filled += read;
+        }
+        if (filled > 0 && !writeBase64(out, buffer.constData(), filled)) {
+            return false;
+        }
+        if (filled < BASE64_CHUNK_SIZE) {
+            return true;
+        }
+    }
+}
+
+/**
+ * One rule per distinct image: its classes, height and data URI.
+ */
+bool writeDiagramStyles(QIODevice &out, const QVector<InlineDiagram> &diagrams)
+{
+    if (out.write("<style>") < 0) return false;
+    for (const InlineDiagram &diagram : diagrams) {
+        QByteArray opening;
+        for (const QString &className : diagram.classes) {
+            opening += (opening.isEmpty() ? "." : ",.") + className.toLatin1();
+        }
+        opening += " { height:" + QByteArray::number(diagram.height) +
+                   "px; background-image:url(\"data:" + diagram.mimeType + ";base64,";
+        if (out.write(opening) != opening.size()) return false;
+
+        const bool ok = diagram.sourcePath.isEmpty()
+                            ? writeBase64(out, diagram.data.constData(), diagram.data.size())
+                            : streamBase64(out, diagram.sourcePath);
+        if (!ok || out.write("\"); }") < 0) return false;
+    }
+    return out.write("</style>") >= 0;
+}
+
+/**
+ * DiagramStyleDevice: Passes the rendered paper through to a file, adding
+ * the diagram style rules just before "</head>".
+ *
+ * The renderer writes the document head in a single write, so the tag is
+ * never split between two calls.
+ */
+class DiagramStyleDevice : public QIODevice
+{
+public:
+    DiagramStyleDevice(QIODevice &target, const QVector<InlineDiagram> &diagrams)
+        : m_target(target), m_diagrams(diagrams)
+    {
+        open(QIODevice::WriteOnly);
+    }
+
+    bool isSequential() const override { return true; }
+
+protected:
+    qint64 readData(char *, qint64) override { return -1; }
+
+    qint64 writeData(const char *data, qint64 size) override
+    {
+        qint64 pos = 0;
+        if (!m_stylesWritten) {
+            const qsizetype headEnd = QByteArray::fromRawData(data, size).indexOf("</head>");
+            if (headEnd >= 0) {
+                if (m_target.write(data, headEnd) != headEnd || !writeDiagramStyles(m_target, m_diagrams)) {
+                    return -1;
+                }
+                m_stylesWritten = true;
+                pos = headEnd;
+            }
+        }
+        return m_target.write(data + pos, size - pos) == size - pos ? size : -1;
+    }
+
+private:
+    QIODevice &m_target;
+    const QVector<InlineDiagram> &m_diagrams;
+    bool m_stylesWritten = false;
+};
+}
+
+bool HtmlExporter::exportToHtml(const PaperModel &model, const QString &filePath, const QString &fontFamily, int fontSize, bool portrait, const ExportProgress &progress)
+{
+    return exportToHtml(model, filePath, RenderStyle{fontFamily, fontSize, portrait}, progress);
+}
+
+bool HtmlExporter::exportToHtml(const PaperModel &model, const QString &filePath, const RenderStyle &style, const ExportProgress &progress)
+{
+    QFile f(filePath);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+    const int sectionCount = model.sections.size();
+    const auto sectionRendered = [&](int done) {
+        progress.update(done, sectionCount, QObject::tr("Section %1 of %2").arg(done).arg(sectionCount));
+        return !progress.isCanceled();
+    };
+
+    // Embedded diagrams have no file to link to, so they are always inlined
+    bool embedded = false;
+    int questionCount = 0;
+    for (const Section &section : model.sections) {
+        questionCount += section.questions.size();
+        for (const Question &question : section.questions) {
+            embedded = embedded || AssetStore::isReference(question.diagramPath);
+        }
+    }
+    const auto render = [&](QIODevice &out, const RenderStyle &renderStyle) {
+        if (questionCount < COMPACT_RENDER_QUESTIONS) {
+            return model.render(out, renderStyle, sectionRendered);
+        }
+        return CompactPaper(model).render(out, renderStyle, sectionRendered);
+    };
+
+    bool ok;
+    if (style.inlineDiagrams || embedded) {
+        RenderStyle inlined = style;
+        inlined.inlineDiagrams = true;
+        const QVector<InlineDiagram> diagrams = collectInlineDiagrams(model);
+        DiagramStyleDevice out(f, diagrams);
+        ok = render(out, inlined);
+    } else {
+        ok = render(f, style);
+    }
+    f.close();
+    return ok;
+}
+
+QFuture<bool> HtmlExporter::exportToHtmlAsync(PaperSnapshot snapshot, const QString &filePath, const QString &fontFamily, int fontSize, bool portrait, bool inlineDiagrams)
+{
+    RenderStyle style{fontFamily, fontSize, portrait};
+    style.inlineDiagrams = inlineDiagrams;
+    return ExportTask::start(filePath, [=](const QString &path, const ExportProgress &progress) {
+        return HtmlExporter().exportToHtml(*snapshot, path, style, progress);
+    });
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <QFuture>
+#include <QString>
+#include "../models/PaperModel.h"
+#include "../models/RenderStyle.h"
+#include "ExportTask.h"
+
+/**
+ * HtmlExporter: Writes the paper as a standalone UTF-8 HTML file.
+ *
+ * Diagrams are linked by file URL unless the style asks for inline diagrams:
+ * then every distinct image is embedded once, as a base64 data URI in a
+ * style rule that all questions showing it share, and the file can be moved
+ * or mailed on its own. Originals that need no downscaling are streamed from
+ * disk into the output without being decoded. Papers with diagrams embedded
+ * in the paper file are always written this way.
+ *
+ * Very large papers are copied into a CompactPaper and rendered from its
+ * records, so an export does not fill the editor's fragment cache.
+ */
+class HtmlExporter
+{
+public:
+    HtmlExporter() = default;
+    bool exportToHtml(const PaperModel &model, const QString &filePath, const QString &fontFamily = "Times New Roman", int fontSize = 12, bool portrait = true, const ExportProgress &progress = ExportProgress());
+    bool exportToHtml(const PaperModel &model, const QString &filePath, const RenderStyle &style, const ExportProgress &progress = ExportProgress());
+
+    /**
+     * @brief Exports a snapshot on the global thread pool.
+     *
+     * Progress is reported per section; canceling the future stops the
+     * export after the current section and removes the partial file.
+     */
+    static QFuture<bool> exportToHtmlAsync(PaperSnapshot snapshot, const QString &filePath, const QString &fontFamily = "Times New Roman", int fontSize = 12, bool portrait = true, bool inlineDiagrams = false);
+};
@@ -1,17 +1,44 @@
 #include "PdfExporter.h"
+#include "../layout/LayoutBuilder.h"
+#include "../layout/PaperLayoutEngine.h"
 #include <QPageLayout>
 #include <QPainter>
+#include <QObject>
 #include <QPdfWriter>
-#include <QTextDocument>
 
 bool PdfExporter::exportToPdf(const PaperModel &model, const QString &filePath,
-                              const QString &fontFamily, int fontSize, bool portrait) {
+                              const QString &fontFamily, int fontSize, bool portrait,
+                              const ExportProgress &progress) {
   QPdfWriter writer(filePath);
   writer.setPageSize(QPageSize(QPageSize::A4));
   writer.setPageOrientation(portrait ? QPageLayout::Portrait : QPageLayout::Landscape);
   writer.setPageMargins(QMarginsF(15, 15, 15, 15)); // 15mm margins
-  QTextDocument doc;
-  doc.setHtml(model.toHtml(fontFamily, fontSize, portrait));
-  doc.print(&writer);
-  return true;
+
+  // Lower the model once and paint the layout tree straight onto the pages
+  const LayoutDocument layout =
+      LayoutBuilder().build(model, RenderStyle{fontFamily, fontSize, portrait});
+  writer.setTitle(layout.title);
+
+  QPainter painter;
+  if (!painter.begin(&writer)) {
+    return false;
+  }
+  const int questionCount = model.getTotalQuestions();
+  PaperLayoutEngine(layout).paint(
+      painter, writer, [&progress, questionCount](int page, int placed) {
+        progress.update(placed, questionCount, QObject::tr("Page %1").arg(page));
+        return !progress.isCanceled();
+      });
+  return painter.end() && !progress.isCanceled();
+}
+
+QFuture<bool> PdfExporter::exportToPdfAsync(PaperSnapshot snapshot,
+                                            const QString &filePath,
+                                            const QString &fontFamily,
+                                            int fontSize, bool portrait) {
+  return ExportTask::start(filePath, [=](const QString &path,
+                                        const ExportProgress &progress) {
+    return PdfExporter().exportToPdf(*snapshot, path, fontFamily, fontSize,
+                                     portrait, progress);
+  });
 }
@@ -1,14 +1,26 @@
 #pragma once
 
+#include <QFuture>
 #include <QString>
 #include "../models/PaperModel.h"
+#include "ExportTask.h"
 
 /**
- * PdfExporter: Renders the PaperModel HTML to a PDF using Qt's QPdfWriter.
+ * PdfExporter: Lays the PaperModel out with PaperLayoutEngine and paints it
+ * to a PDF using Qt's QPdfWriter.
  */
 class PdfExporter
 {
 public:
     PdfExporter() = default;
-    bool exportToPdf(const PaperModel &model, const QString &filePath, const QString &fontFamily = "Times New Roman", int fontSize = 12, bool portrait = true);
+    bool exportToPdf(const PaperModel &model, const QString &filePath, const QString &fontFamily = "Times New Roman", int fontSize = 12, bool portrait = true, const ExportProgress &progress = ExportProgress());
+
+    /**
+     * @brief Exports a snapshot on the global thread pool.
+     *
+     * Progress is reported per page, counted in questions placed; canceling
+     * the future stops the export at the next page break and removes the
+     * partial file.
+     */
+    static QFuture<bool> exportToPdfAsync(PaperSnapshot snapshot, const QString &filePath, const QString &fontFamily = "Times New Roman", int fontSize = 12, bool portrait = true);
 };
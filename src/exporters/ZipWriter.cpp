@@ -0,0 +1,418 @@
+#include "ZipWriter.h"
+#include <QIODevice>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QtEndian>
+#include <atomic>
+#include <zlib.h>
+
+/**
+ * @file ZipWriter.cpp
+ * @brief Implementation of the ZipWriter class.
+ */
+
+namespace {
+constexpr quint32 LOCAL_HEADER_SIGNATURE = 0x04034b50;
+constexpr quint32 DATA_DESCRIPTOR_SIGNATURE = 0x08074b50;
+constexpr quint32 CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+constexpr quint32 END_OF_CENTRAL_DIRECTORY_SIGNATURE = 0x06054b50;
+constexpr quint16 VERSION_NEEDED = 20; // Deflate
+constexpr quint16 FLAG_DATA_DESCRIPTOR = 0x0008;
+constexpr quint16 FLAG_UTF8_NAME = 0x0800;
+constexpr quint16 METHOD_STORED = 0;
+constexpr quint16 METHOD_DEFLATED = 8;
+constexpr quint16 DOS_TIME = 0;
+constexpr quint16 DOS_DATE = (1 << 5) | 1; // 1980-01-01
+constexpr int DEFLATE_LEVEL = 6;
+constexpr int RAW_DEFLATE_WINDOW_BITS = -15;
+constexpr int DEFLATE_MEMORY_LEVEL = 8;
+constexpr qint64 MAX_ZIP32_SIZE = 0xffffffffLL;
+// Uncompressed data per block, as in pigz; each block is primed with the
+// deflate window's worth of data before it
+constexpr int BLOCK_SIZE = 128 * 1024;
+constexpr int DICTIONARY_SIZE = 32 * 1024;
+// Blocks waiting to be written, per pool thread
+constexpr int BLOCKS_IN_FLIGHT_PER_THREAD = 2;
+
+// Little-endian field writer for headers
+class HeaderBuffer {
+public:
+  void add16(quint16 value) {
+    char bytes[2];
+    qToLittleEndian(value, bytes);
+    m_data.append(bytes, 2);
+  }
+
+  void add32(quint32 value) {
+    char bytes[4];
+    qToLittleEndian(value, bytes);
+    m_data.append(bytes, 4);
+  }
+
+  void add(const QByteArray &bytes) { m_data.append(bytes); }
+
+  const QByteArray &data() const { return m_data; }
+
+private:
+  QByteArray m_data;
+};
+
+// zlib takes uInt lengths; feed it in pieces it can count
+constexpr qint64 MAX_ZLIB_CHUNK = 1 << 30;
+
+uLong checksum(const QByteArray &data) {
+  uLong crc = crc32(0L, Z_NULL, 0);
+  for (qint64 done = 0; done < data.size(); done += MAX_ZLIB_CHUNK) {
+    const qint64 length = qMin(MAX_ZLIB_CHUNK, data.size() - done);
+    crc = crc32(crc, reinterpret_cast<const Bytef *>(data.constData() + done),
+                uInt(length));
+  }
+  return crc;
+}
+
+// Deflates one block into a raw deflate fragment. Fragments end byte-aligned
+// (sync flush) so they can be concatenated; the last one ends the stream.
+bool deflateBlock(const QByteArray &input, const QByteArray &dictionary,
+                  bool last, QByteArray &output) {
+  z_stream stream{};
+  if (deflateInit2(&stream, DEFLATE_LEVEL, Z_DEFLATED, RAW_DEFLATE_WINDOW_BITS,
+                   DEFLATE_MEMORY_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  if (!dictionary.isEmpty()) {
+    deflateSetDictionary(&stream,
+                         reinterpret_cast<const Bytef *>(dictionary.constData()),
+                         uInt(dictionary.size()));
+  }
+
+  // Room for the worst case plus the sync flush marker
+  output.resize(qsizetype(deflateBound(&stream, uLong(input.size()))) + 16);
+  stream.next_in =
+      reinterpret_cast<Bytef *>(const_cast<char *>(input.constData()));
+  stream.avail_in = uInt(input.size());
+  int result = Z_OK;
+  do {
+    const qsizetype written = qsizetype(stream.total_out);
+    if (written == output.size()) {
+      output.resize(output.size() * 2);
+    }
+    stream.next_out = reinterpret_cast<Bytef *>(output.data() + written);
+    stream.avail_out = uInt(output.size() - written);
+    result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+  } while (result == Z_OK && (last || stream.avail_out == 0));
+
+  output.resize(qsizetype(stream.total_out));
+  deflateEnd(&stream);
+  return last ? result == Z_STREAM_END : result == Z_OK || result == Z_BUF_ERROR;
+}
+} // namespace
+
+// A step of the archive, in order. Blocks and stored entries have work that
+// any thread may do; writing always happens on the thread using the writer.
+struct ZipWriter::Job {
+  enum class Kind { BeginEntry, Block, EndEntry, StoredEntry };
+
+  Kind kind;
+  QByteArray name;       // BeginEntry, StoredEntry
+  QByteArray input;      // Block: uncompressed data; StoredEntry: the data
+  QByteArray dictionary; // Block
+  bool last = false;     // Block
+
+  // Results
+  QByteArray output;
+  uLong crc = 0;
+  bool ok = true;
+
+  // Whoever claims the job runs it: a pool thread, or the writer's thread
+  // when it needs the result first
+  std::atomic<bool> claimed{false};
+  QSemaphore done;
+
+  explicit Job(Kind jobKind) : kind(jobKind) {}
+
+  bool hasWork() const {
+    return kind == Kind::Block || kind == Kind::StoredEntry;
+  }
+
+  void run() {
+    if (kind == Kind::Block) {
+      crc = checksum(input);
+      ok = deflateBlock(input, dictionary, last, output);
+      dictionary.clear();
+    } else if (kind == Kind::StoredEntry) {
+      crc = checksum(input);
+    }
+  }
+
+  // Called from the pool
+  void tryRun() {
+    if (!claimed.exchange(true)) {
+      run();
+      done.release();
+    }
+  }
+
+  // Called by the writer; runs the job here unless a pool thread has it
+  void complete() {
+    if (!claimed.exchange(true)) {
+      run();
+    } else {
+      done.acquire();
+    }
+  }
+};
+
+// Write-only device that cuts its data into blocks
+class ZipWriter::EntryDevice : public QIODevice {
+public:
+  explicit EntryDevice(ZipWriter *writer) : m_writer(writer) {
+    open(QIODevice::WriteOnly);
+  }
+
+  bool isSequential() const override { return true; }
+
+protected:
+  qint64 readData(char *, qint64) override { return -1; }
+
+  qint64 writeData(const char *data, qint64 size) override {
+    return m_writer->writeEntryData(data, size) ? size : -1;
+  }
+
+private:
+  ZipWriter *m_writer;
+};
+
+ZipWriter::ZipWriter(QIODevice *device, QThreadPool *pool)
+    : m_device(device), m_pool(pool) {}
+
+// Jobs still on the pool own their data and finish on their own
+ZipWriter::~ZipWriter() = default;
+
+bool ZipWriter::writeRaw(const char *data, qint64 size) {
+  if (m_error) {
+    return false;
+  }
+  if (m_device->write(data, size) != size ||
+      m_offset + size > MAX_ZIP32_SIZE) {
+    m_error = true;
+    return false;
+  }
+  m_offset += size;
+  return true;
+}
+
+bool ZipWriter::writeLocalHeader(const CentralEntry &entry) {
+  HeaderBuffer header;
+  header.add32(LOCAL_HEADER_SIGNATURE);
+  header.add16(VERSION_NEEDED);
+  header.add16(entry.flags);
+  header.add16(entry.method);
+  header.add16(DOS_TIME);
+  header.add16(DOS_DATE);
+  header.add32(entry.crc);
+  header.add32(entry.compressedSize);
+  header.add32(entry.size);
+  header.add16(quint16(entry.name.size()));
+  header.add16(0); // Extra field length
+  header.add(entry.name);
+  return writeRaw(header.data().constData(), header.data().size());
+}
+
+bool ZipWriter::addEntry(const QString &name, const QByteArray &data,
+                         Method method) {
+  if (m_error || m_finished || m_entryDevice || data.size() > MAX_ZIP32_SIZE) {
+    m_error = true;
+    return false;
+  }
+
+  if (method == Method::Stored) {
+    auto job = std::make_shared<Job>(Job::Kind::StoredEntry);
+    job->name = name.toUtf8();
+    job->input = data;
+    enqueue(job);
+    return !m_error;
+  }
+
+  QIODevice *device = beginEntry(name);
+  return device && device->write(data) == data.size() && endEntry();
+}
+
+QIODevice *ZipWriter::beginEntry(const QString &name) {
+  if (m_error || m_finished || m_entryDevice) {
+    m_error = true;
+    return nullptr;
+  }
+
+  auto job = std::make_shared<Job>(Job::Kind::BeginEntry);
+  job->name = name.toUtf8();
+  enqueue(job);
+  m_input.clear();
+  m_dictionary.clear();
+  m_entryDevice = std::make_unique<EntryDevice>(this);
+  return m_entryDevice.get();
+}
+
+bool ZipWriter::writeEntryData(const char *data, qint64 size) {
+  if (!m_entryDevice || m_error) {
+    return false;
+  }
+  // Small writes, e.g. from QXmlStreamWriter, are gathered into blocks
+  m_input.append(data, size);
+  if (m_input.size() >= BLOCK_SIZE) {
+    submitBlock(false);
+  }
+  return !m_error;
+}
+
+void ZipWriter::submitBlock(bool last) {
+  auto job = std::make_shared<Job>(Job::Kind::Block);
+  job->input = m_input;
+  job->dictionary = m_dictionary;
+  job->last = last;
+  m_dictionary = m_input.right(DICTIONARY_SIZE);
+  m_input.clear();
+  enqueue(job);
+}
+
+bool ZipWriter::endEntry() {
+  if (!m_entryDevice || m_error) {
+    m_error = true;
+    return false;
+  }
+  submitBlock(true);
+  m_dictionary.clear();
+  m_entryDevice.reset();
+  enqueue(std::make_shared<Job>(Job::Kind::EndEntry));
+  return !m_error;
+}
+
+void ZipWriter::enqueue(const std::shared_ptr<Job> &job) {
+  m_jobs.enqueue(job);
+  if (m_pool && job->hasWork()) {
+    // If the pool is busy, the job is run here when its turn comes
+    m_pool->tryStart([job]() { job->tryRun(); });
+  }
+  const int inFlight =
+      m_pool ? m_pool->maxThreadCount() * BLOCKS_IN_FLIGHT_PER_THREAD : 0;
+  while (m_jobs.size() > inFlight && writeNext()) {
+  }
+}
+
+bool ZipWriter::writeNext() {
+  const std::shared_ptr<Job> job = m_jobs.dequeue();
+  job->complete();
+  if (m_error) {
+    return false;
+  }
+
+  switch (job->kind) {
+  case Job::Kind::BeginEntry:
+    m_current = CentralEntry();
+    m_current.name = job->name;
+    m_current.flags = FLAG_UTF8_NAME | FLAG_DATA_DESCRIPTOR;
+    m_current.method = METHOD_DEFLATED;
+    m_current.offset = quint32(m_offset);
+    m_currentCrc = crc32(0L, Z_NULL, 0);
+    m_currentSize = 0;
+    m_currentCompressedSize = 0;
+    return writeLocalHeader(m_current);
+
+  case Job::Kind::Block:
+    if (!job->ok) {
+      m_error = true;
+      return false;
+    }
+    m_currentCrc = crc32_combine(uLong(m_currentCrc), job->crc,
+                                 z_off_t(job->input.size()));
+    m_currentSize += job->input.size();
+    m_currentCompressedSize += job->output.size();
+    return writeRaw(job->output.constData(), job->output.size());
+
+  case Job::Kind::EndEntry: {
+    if (m_currentSize > quint64(MAX_ZIP32_SIZE)) {
+      m_error = true;
+      return false;
+    }
+    m_current.crc = quint32(m_currentCrc);
+    m_current.compressedSize = quint32(m_currentCompressedSize);
+    m_current.size = quint32(m_currentSize);
+
+    HeaderBuffer descriptor;
+    descriptor.add32(DATA_DESCRIPTOR_SIGNATURE);
+    descriptor.add32(m_current.crc);
+    descriptor.add32(m_current.compressedSize);
+    descriptor.add32(m_current.size);
+    if (!writeRaw(descriptor.data().constData(), descriptor.data().size())) {
+      return false;
+    }
+    m_entries.append(m_current);
+    return true;
+  }
+
+  case Job::Kind::StoredEntry: {
+    CentralEntry entry;
+    entry.name = job->name;
+    entry.flags = FLAG_UTF8_NAME;
+    entry.method = METHOD_STORED;
+    entry.crc = quint32(job->crc);
+    entry.compressedSize = quint32(job->input.size());
+    entry.size = entry.compressedSize;
+    entry.offset = quint32(m_offset);
+    if (!writeLocalHeader(entry) ||
+        !writeRaw(job->input.constData(), job->input.size())) {
+      return false;
+    }
+    m_entries.append(entry);
+    return true;
+  }
+  }
+  return false;
+}
+
+bool ZipWriter::finish() {
+  if (m_error || m_finished || m_entryDevice) {
+    m_error = true;
+    return false;
+  }
+  while (!m_jobs.isEmpty() && writeNext()) {
+  }
+  if (m_error || m_entries.size() > 0xffff) {
+    m_error = true;
+    return false;
+  }
+
+  const qint64 directoryOffset = m_offset;
+  HeaderBuffer directory;
+  for (const CentralEntry &entry : m_entries) {
+    directory.add32(CENTRAL_HEADER_SIGNATURE);
+    directory.add16(VERSION_NEEDED); // Version made by
+    directory.add16(VERSION_NEEDED);
+    directory.add16(entry.flags);
+    directory.add16(entry.method);
+    directory.add16(DOS_TIME);
+    directory.add16(DOS_DATE);
+    directory.add32(entry.crc);
+    directory.add32(entry.compressedSize);
+    directory.add32(entry.size);
+    directory.add16(quint16(entry.name.size()));
+    directory.add16(0); // Extra field length
+    directory.add16(0); // Comment length
+    directory.add16(0); // Disk number
+    directory.add16(0); // Internal attributes
+    directory.add32(0); // External attributes
+    directory.add32(entry.offset);
+    directory.add(entry.name);
+  }
+
+  const quint32 directorySize = quint32(directory.data().size());
+  directory.add32(END_OF_CENTRAL_DIRECTORY_SIGNATURE);
+  directory.add16(0); // This disk
+  directory.add16(0); // Disk with the central directory
+  directory.add16(quint16(m_entries.size()));
+  directory.add16(quint16(m_entries.size()));
+  directory.add32(directorySize);
+  directory.add32(quint32(directoryOffset));
+  directory.add16(0); // Comment length
+  m_finished = true;
+  return writeRaw(directory.data().constData(), directory.data().size());
+}
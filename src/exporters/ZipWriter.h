@@ -0,0 +1,124 @@
+#pragma once
+
+#include <QByteArray>
+#include <QQueue>
+#include <QString>
+#include <QVector>
+#include <memory>
+
+class QIODevice;
+class QThreadPool;
+
+/**
+ * @file ZipWriter.h
+ * @brief Defines the ZipWriter class that streams a zip archive to a device.
+ */
+
+/**
+ * @class ZipWriter
+ * @brief Writes a zip archive front to back without seeking.
+ *
+ * Entries are either added whole or streamed: beginEntry() returns a device
+ * whose data is cut into blocks and deflated as it arrives, so an entry of
+ * any size needs a fixed amount of memory. Deflated entries record their CRC
+ * and sizes in a data descriptor after the data.
+ *
+ * Given a thread pool, blocks are compressed concurrently, pigz style: each
+ * block is deflated on its own, primed with the end of the previous block as
+ * dictionary and ended with a sync flush, so the blocks join into one deflate
+ * stream. Blocks of different entries overlap too. Output is written in
+ * order by the calling thread, which also compresses any block the pool has
+ * not picked up, and only a few blocks per thread are in flight at a time.
+ * Stored entries, meant for JPEG or PNG data, are only checksummed.
+ *
+ * Entry times are fixed at 1980-01-01 so the same content always produces
+ * the same archive. Archives are limited to 4 GiB (no Zip64).
+ */
+class ZipWriter
+{
+public:
+    enum class Method { Stored, Deflated };
+
+    /**
+     * @brief Creates a writer for @p device, which must be open for writing.
+     * @param pool Pool to compress on, or nullptr to compress in the calling thread
+     */
+    explicit ZipWriter(QIODevice *device, QThreadPool *pool = nullptr);
+    ~ZipWriter();
+
+    ZipWriter(const ZipWriter &) = delete;
+    ZipWriter &operator=(const ZipWriter &) = delete;
+
+    /**
+     * @brief Adds an entry whose data is known up front.
+     *
+     * Use Stored for data that is already compressed, such as JPEG or PNG;
+     * it is written without another copy.
+     */
+    bool addEntry(const QString &name, const QByteArray &data, Method method = Method::Deflated);
+
+    /**
+     * @brief Starts a deflated entry and returns the device to write it to.
+     *
+     * The device stays valid until endEntry(); only one entry can be open.
+     * Returns nullptr if the archive already failed.
+     */
+    QIODevice *beginEntry(const QString &name);
+
+    /**
+     * @brief Finishes the entry started by beginEntry().
+     */
+    bool endEntry();
+
+    /**
+     * @brief Writes the remaining data and the central directory. No
+     * entries can be added after.
+     */
+    bool finish();
+
+    /**
+     * @brief Whether any write failed; the archive is then unusable.
+     */
+    bool hasError() const { return m_error; }
+
+private:
+    class EntryDevice;
+    struct Job;
+
+    struct CentralEntry
+    {
+        QByteArray name; // UTF-8
+        quint16 flags = 0;
+        quint16 method = 0;
+        quint32 crc = 0;
+        quint32 compressedSize = 0;
+        quint32 size = 0;
+        quint32 offset = 0;
+    };
+
+    QIODevice *m_device;
+    QThreadPool *m_pool;
+    QVector<CentralEntry> m_entries;
+    QQueue<std::shared_ptr<Job>> m_jobs; // In archive order
+    qint64 m_offset = 0;
+    bool m_error = false;
+    bool m_finished = false;
+
+    // The entry open for streaming
+    std::unique_ptr<EntryDevice> m_entryDevice;
+    QByteArray m_input;      // Not yet cut into a block
+    QByteArray m_dictionary; // End of the previous block
+
+    // The deflated entry being written out
+    CentralEntry m_current;
+    quint64 m_currentCrc = 0;
+    quint64 m_currentSize = 0;
+    quint64 m_currentCompressedSize = 0;
+
+    bool writeRaw(const char *data, qint64 size);
+    bool writeLocalHeader(const CentralEntry &entry);
+    bool writeEntryData(const char *data, qint64 size);
+    void submitBlock(bool last);
+    void enqueue(const std::shared_ptr<Job> &job);
+    bool writeNext();
+};
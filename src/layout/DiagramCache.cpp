@@ -0,0 +1,375 @@
+#include "DiagramCache.h"
+#include "LayoutDocument.h"
+#include "../models/AssetStore.h"
+#include "../models/PaperModel.h"
+#include <QBuffer>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QPainter>
+#include <QSet>
+#include <QSvgRenderer>
+#include <QTextDocument>
+#include <QUrl>
+#include <algorithm>
+
+/**
+ * @file DiagramCache.cpp
+ * @brief Implementation of the DiagramCache class.
+ */
+
+namespace {
+constexpr int JPEG_QUALITY = 85;
+// Large images are decoded at up to this multiple of the target size, so the
+// decoder can skip detail (JPEG decodes at 1/2, 1/4 or 1/8 scale) and the
+// final resample still has enough pixels to filter.
+constexpr int DECODE_OVERSAMPLING = 2;
+// A parsed SVG's node tree is taken to be this many times its file size
+constexpr int VECTOR_BYTES_PER_FILE_BYTE = 4;
+
+qsizetype diagramBytes(const DiagramCache::Diagram &diagram) {
+  return diagram.image.sizeInBytes() + diagram.data.size();
+}
+
+// Modification time of a diagram file, or 0 for an embedded diagram, whose
+// contents never change. -1 if there is nothing to read.
+qint64 diagramVersion(const QString &path) {
+  if (AssetStore::isReference(path)) {
+    return AssetStore::shared().contains(path) ? 0 : -1;
+  }
+  const QFileInfo info(path);
+  return info.isFile() ? info.lastModified().toMSecsSinceEpoch() : -1;
+}
+
+// Size of a diagram file or embedded diagram
+qint64 diagramSize(const QString &path) {
+  if (AssetStore::isReference(path)) {
+    return AssetStore::shared().data(path).size();
+  }
+  return QFileInfo(path).size();
+}
+
+// The bytes of a diagram file or embedded diagram
+QByteArray diagramData(const QString &path) {
+  if (AssetStore::isReference(path)) {
+    return AssetStore::shared().data(path);
+  }
+  QFile file(path);
+  return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+} // namespace
+
+DiagramCache::VectorDiagram::VectorDiagram(const QString &path)
+    : m_renderer(AssetStore::isReference(path)
+                     ? std::make_unique<QSvgRenderer>(
+                           AssetStore::shared().data(path))
+                     : std::make_unique<QSvgRenderer>(path)) {
+  // Parsed on whichever worker asked first and drawn from others; the
+  // renderer never needs events, so it belongs to no thread
+  m_renderer->moveToThread(nullptr);
+}
+
+DiagramCache::VectorDiagram::~VectorDiagram() = default;
+
+bool DiagramCache::VectorDiagram::isValid() const {
+  QMutexLocker locker(&m_mutex);
+  return m_renderer->isValid();
+}
+
+QSizeF DiagramCache::VectorDiagram::defaultSize() const {
+  QMutexLocker locker(&m_mutex);
+  const QSize size = m_renderer->defaultSize();
+  if (!size.isEmpty()) {
+    return QSizeF(size);
+  }
+  return m_renderer->viewBoxF().size();
+}
+
+void DiagramCache::VectorDiagram::render(QPainter &painter,
+                                         const QRectF &target) const {
+  QMutexLocker locker(&m_mutex);
+  m_renderer->render(&painter, target);
+}
+
+size_t qHash(const DiagramCache::Key &key, size_t seed) {
+  return qHashMulti(seed, key.path, key.modified, key.cssWidth, key.dpi);
+}
+
+DiagramCache::DiagramCache(qsizetype capacity) : m_capacity(capacity) {}
+
+DiagramCache &DiagramCache::shared() {
+  static DiagramCache cache;
+  return cache;
+}
+
+QImage DiagramCache::image(const QString &path, int cssWidth, int dpi) {
+  return fetch(path, cssWidth, dpi, false).image;
+}
+
+DiagramCache::Diagram DiagramCache::encoded(const QString &path, int cssWidth,
+                                            int dpi) {
+  return fetch(path, cssWidth, dpi, true);
+}
+
+std::shared_ptr<const DiagramCache::VectorDiagram>
+DiagramCache::vector(const QString &path) {
+  const qint64 modified = isVector(path) ? diagramVersion(path) : -1;
+  if (modified < 0) {
+    return nullptr;
+  }
+  {
+    QMutexLocker locker(&m_mutex);
+    auto it = m_vectors.find(path);
+    if (it != m_vectors.end() && it->modified == modified) {
+      ++m_hits;
+      it->lastUse = ++m_useCounter;
+      return it->diagram;
+    }
+    ++m_misses;
+  }
+
+  // Parse outside the lock
+  auto diagram = std::make_shared<const VectorDiagram>(path);
+  if (!diagram->isValid()) {
+    diagram.reset();
+  }
+  const qsizetype bytes =
+      diagram ? diagramSize(path) * VECTOR_BYTES_PER_FILE_BYTE : 0;
+
+  QMutexLocker locker(&m_mutex);
+  auto it = m_vectors.find(path);
+  if (it != m_vectors.end()) {
+    m_bytes -= it->bytes;
+  }
+  m_vectors.insert(path, VectorEntry{modified, diagram, bytes, ++m_useCounter});
+  m_bytes += bytes;
+  evict();
+  return diagram;
+}
+
+bool DiagramCache::isVector(const QString &path) {
+  if (AssetStore::isReference(path)) {
+    const QByteArray format = AssetStore::shared().format(path);
+    return format == "svg" || format == "svgz";
+  }
+  return path.endsWith(".svg", Qt::CaseInsensitive) ||
+         path.endsWith(".svgz", Qt::CaseInsensitive);
+}
+
+void DiagramCache::addResources(QTextDocument &document,
+                                const PaperModel &model, int dpi) {
+  QSet<QString> added;
+  for (const Section &section : model.sections) {
+    for (const Question &question : section.questions) {
+      const QString &path = question.diagramPath;
+      if (path.isEmpty() || added.contains(path)) {
+        continue;
+      }
+      added.insert(path);
+      // Same URL and width as the img element written by PaperHtml
+      const QImage prepared = image(path, LayoutImage().width, dpi);
+      if (!prepared.isNull()) {
+        const QUrl url = AssetStore::isReference(path) ? QUrl(path)
+                                                        : QUrl("file://" + path);
+        document.addResource(QTextDocument::ImageResource, url, prepared);
+      }
+    }
+  }
+}
+
+QSize DiagramCache::targetSize(const QSize &source, int cssWidth, int dpi) {
+  if (source.isEmpty()) {
+    return source;
+  }
+  const int width = qMax(1, qRound(qreal(cssWidth) * dpi / SCREEN_DPI));
+  if (width >= source.width()) {
+    return source;
+  }
+  const int height =
+      qMax(1, qRound(qreal(source.height()) * width / source.width()));
+  return QSize(width, height);
+}
+
+void DiagramCache::clear() {
+  QMutexLocker locker(&m_mutex);
+  m_entries.clear();
+  m_vectors.clear();
+  m_bytes = 0;
+  m_hits = 0;
+  m_misses = 0;
+}
+
+int DiagramCache::hits() const {
+  QMutexLocker locker(&m_mutex);
+  return m_hits;
+}
+
+int DiagramCache::misses() const {
+  QMutexLocker locker(&m_mutex);
+  return m_misses;
+}
+
+int DiagramCache::size() const {
+  QMutexLocker locker(&m_mutex);
+  return static_cast<int>(m_entries.size());
+}
+
+int DiagramCache::vectorCount() const {
+  QMutexLocker locker(&m_mutex);
+  return static_cast<int>(m_vectors.size());
+}
+
+qsizetype DiagramCache::bytes() const {
+  QMutexLocker locker(&m_mutex);
+  return m_bytes;
+}
+
+DiagramCache::Diagram DiagramCache::fetch(const QString &path, int cssWidth,
+                                          int dpi, bool encode) {
+  const qint64 modified = path.isEmpty() ? -1 : diagramVersion(path);
+  if (modified < 0) {
+    return Diagram();
+  }
+  const Key key{path, modified, cssWidth, dpi};
+
+  Diagram diagram;
+  {
+    QMutexLocker locker(&m_mutex);
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+      it->lastUse = ++m_useCounter;
+      if (!encode || !it->diagram.data.isEmpty()) {
+        ++m_hits;
+        return it->diagram;
+      }
+      diagram = it->diagram; // Decoded, but not encoded yet
+    }
+    ++m_misses;
+  }
+
+  // Decode and encode outside the lock
+  if (diagram.isNull()) {
+    diagram.image = prepare(path, cssWidth, dpi);
+    if (diagram.isNull()) {
+      return diagram;
+    }
+  }
+  if (encode) {
+    DiagramCache::encode(diagram, path);
+  }
+
+  QMutexLocker locker(&m_mutex);
+  auto it = m_entries.find(key);
+  if (it != m_entries.end()) {
+    m_bytes -= diagramBytes(it->diagram);
+  }
+  m_entries.insert(key, Entry{diagram, ++m_useCounter});
+  m_bytes += diagramBytes(diagram);
+  evict();
+  return diagram;
+}
+
+void DiagramCache::evict() {
+  if (m_bytes <= m_capacity || m_entries.size() + m_vectors.size() <= 1) {
+    return;
+  }
+  // Images and parsed SVGs in one list; an SVG is listed by its path alone
+  struct Use {
+    quint64 lastUse;
+    bool vector;
+    Key key;
+  };
+  QVector<Use> byUse;
+  byUse.reserve(m_entries.size() + m_vectors.size());
+  for (auto it = m_entries.cbegin(); it != m_entries.cend(); ++it) {
+    byUse.append(Use{it->lastUse, false, it.key()});
+  }
+  for (auto it = m_vectors.cbegin(); it != m_vectors.cend(); ++it) {
+    byUse.append(Use{it->lastUse, true, Key{it.key()}});
+  }
+  std::sort(byUse.begin(), byUse.end(), [](const Use &a, const Use &b) {
+    return a.lastUse < b.lastUse;
+  });
+  // The newest entry always stays, even if it alone exceeds the capacity
+  for (int i = 0; i < byUse.size() - 1 && m_bytes > m_capacity; ++i) {
+    if (byUse[i].vector) {
+      auto it = m_vectors.find(byUse[i].key.path);
+      m_bytes -= it->bytes;
+      m_vectors.erase(it);
+    } else {
+      auto it = m_entries.find(byUse[i].key);
+      m_bytes -= diagramBytes(it->diagram);
+      m_entries.erase(it);
+    }
+  }
+}
+
+QImage DiagramCache::prepare(const QString &path, int cssWidth, int dpi) {
+  QBuffer buffer;
+  QImageReader reader;
+  if (AssetStore::isReference(path)) {
+    buffer.setData(AssetStore::shared().data(path));
+    buffer.open(QIODevice::ReadOnly);
+    reader.setDevice(&buffer);
+  } else {
+    reader.setFileName(path);
+  }
+  const QSize source = reader.size();
+  const QSize target = targetSize(source, cssWidth, dpi);
+  if (source.isValid() &&
+      target.width() * DECODE_OVERSAMPLING < source.width()) {
+    reader.setScaledSize(target * DECODE_OVERSAMPLING);
+  }
+
+  QImage image = reader.read();
+  if (image.isNull()) {
+    return image;
+  }
+
+  // The smooth scaler has vectorised paths for 32-bit formats
+  image = image.convertToFormat(image.hasAlphaChannel()
+                                    ? QImage::Format_ARGB32_Premultiplied
+                                    : QImage::Format_RGB32);
+  const QSize size = targetSize(image.size(), cssWidth, dpi);
+  if (size != image.size()) {
+    image = image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+  }
+  return image;
+}
+
+void DiagramCache::encode(Diagram &diagram, const QString &path) {
+  const bool opaque = !diagram.image.hasAlphaChannel();
+  QByteArray data;
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::WriteOnly);
+  QImageWriter writer(&buffer, opaque ? "jpeg" : "png");
+  if (opaque) {
+    writer.setQuality(JPEG_QUALITY);
+  }
+  if (!writer.write(diagram.image)) {
+    data.clear();
+  }
+  QByteArray mimeType = opaque ? "image/jpeg" : "image/png";
+
+  // A small original that needed no scaling may beat the re-encode
+  const bool embedded = AssetStore::isReference(path);
+  const QByteArray format = embedded ? AssetStore::shared().format(path)
+                                     : QImageReader::imageFormat(path);
+  const qint64 originalSize = embedded ? AssetStore::shared().data(path).size()
+                                       : QFileInfo(path).size();
+  if ((format == "jpeg" || format == "png") && originalSize < data.size()) {
+    QBuffer original;
+    original.setData(diagramData(path));
+    original.open(QIODevice::ReadOnly);
+    if (!original.data().isEmpty() &&
+        QImageReader(&original).size() == diagram.image.size()) {
+      data = original.data();
+      mimeType = "image/" + format;
+    }
+  }
+
+  diagram.data = data;
+  diagram.mimeType = mimeType;
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QRectF>
+#include <QSizeF>
+#include <QString>
+#include <memory>
+
+class PaperModel;
+class QPainter;
+class QSvgRenderer;
+class QTextDocument;
+
+/**
+ * @file DiagramCache.h
+ * @brief Defines the DiagramCache class that prepares question diagrams for output.
+ */
+
+/**
+ * @class DiagramCache
+ * @brief Decodes, downscales and recompresses diagrams once for every output.
+ *
+ * Diagrams are often phone photos many times larger than the 150 px they are
+ * shown at. The cache decodes each file at the resolution needed for its
+ * displayed width at a target DPI, resamples it with Qt's smooth (SIMD)
+ * scaler and keeps the result, keyed by path, modification time and target
+ * size. Editing the file on disk invalidates its entries.
+ *
+ * Every path argument may also be an AssetStore reference to a diagram
+ * embedded in a paper. Those are read from the store, and since a blob never
+ * changes, every question showing it shares the same entries.
+ *
+ * Encoded data is produced on request: JPEG for opaque images, PNG for
+ * images with transparency, or the original file when it is already smaller.
+ *
+ * SVG diagrams can also be fetched as vector(), parsed once per file, for
+ * outputs such as PDF that draw them as vector content.
+ *
+ * All members are thread-safe; images are prepared outside the lock. The
+ * least recently used entries are dropped once the cache outgrows its
+ * capacity. Parsed SVGs count against the same capacity, at an estimate
+ * based on their file size, and are dropped along with the images.
+ */
+class DiagramCache
+{
+public:
+    /**
+     * Resolution for print and export output.
+     */
+    static constexpr int PRINT_DPI = 300;
+
+    /**
+     * Resolution of one CSS pixel on screen.
+     */
+    static constexpr int SCREEN_DPI = 96;
+
+    /**
+     * Diagram: A prepared image and, if requested, its encoded file data.
+     */
+    struct Diagram
+    {
+        QImage image;
+        QByteArray data;
+        QByteArray mimeType;
+
+        bool isNull() const { return image.isNull(); }
+    };
+
+    /**
+     * VectorDiagram: A parsed SVG file that draws itself as vector content.
+     *
+     * Drawing is serialized, so one diagram may be shared by several exports.
+     */
+    class VectorDiagram
+    {
+    public:
+        explicit VectorDiagram(const QString &path);
+        ~VectorDiagram();
+
+        bool isValid() const;
+
+        /**
+         * @brief Size from the SVG's width/height or view box, in CSS pixels.
+         */
+        QSizeF defaultSize() const;
+
+        void render(QPainter &painter, const QRectF &target) const;
+
+    private:
+        mutable QMutex m_mutex;
+        std::unique_ptr<QSvgRenderer> m_renderer;
+    };
+
+    /**
+     * @brief Creates a cache holding at most @p capacity bytes of images.
+     */
+    explicit DiagramCache(qsizetype capacity = 128 * 1024 * 1024);
+
+    /**
+     * @brief The cache shared by the preview and all exporters.
+     */
+    static DiagramCache &shared();
+
+    /**
+     * @brief The diagram at @p path, sized for @p cssWidth CSS pixels at @p dpi.
+     *
+     * Images are never scaled up. Returns a null image if the file cannot be
+     * read.
+     */
+    QImage image(const QString &path, int cssWidth, int dpi = PRINT_DPI);
+
+    /**
+     * @brief Like image(), together with the recompressed file data.
+     */
+    Diagram encoded(const QString &path, int cssWidth, int dpi = PRINT_DPI);
+
+    /**
+     * @brief The parsed SVG at @p path, or nullptr if it is not a valid SVG.
+     */
+    std::shared_ptr<const VectorDiagram> vector(const QString &path);
+
+    /**
+     * @brief Whether @p path names an SVG file, which vector() can draw.
+     */
+    static bool isVector(const QString &path);
+
+    /**
+     * @brief Registers the prepared diagrams of a paper with a text document.
+     *
+     * The paper HTML refers to diagrams by file URL; registering them lets a
+     * QTextBrowser show cached images instead of decoding the originals.
+     * Call before setting the HTML.
+     */
+    void addResources(QTextDocument &document, const PaperModel &model, int dpi);
+
+    /**
+     * @brief Pixel size for showing an image of @p source size @p cssWidth wide.
+     */
+    static QSize targetSize(const QSize &source, int cssWidth, int dpi);
+
+    /**
+     * @brief Removes all images and parsed SVGs and resets the counters.
+     */
+    void clear();
+
+    int hits() const;
+    int misses() const;
+    int size() const;
+
+    /**
+     * @brief Number of parsed SVGs held.
+     */
+    int vectorCount() const;
+
+    /**
+     * @brief Bytes held by cached images and encoded data, plus the estimated
+     * size of parsed SVGs.
+     */
+    qsizetype bytes() const;
+
+private:
+    struct Key
+    {
+        QString path;
+        qint64 modified = 0;
+        int cssWidth = 0;
+        int dpi = 0;
+
+        bool operator==(const Key &other) const
+        {
+            return modified == other.modified && cssWidth == other.cssWidth &&
+                   dpi == other.dpi && path == other.path;
+        }
+    };
+
+    struct Entry
+    {
+        Diagram diagram;
+        quint64 lastUse = 0;
+    };
+
+    struct VectorEntry
+    {
+        qint64 modified = 0;
+        std::shared_ptr<const VectorDiagram> diagram;
+        qsizetype bytes = 0; // Estimated
+        quint64 lastUse = 0;
+    };
+
+    friend size_t qHash(const Key &key, size_t seed);
+
+    mutable QMutex m_mutex;
+    QHash<Key, Entry> m_entries;
+    QHash<QString, VectorEntry> m_vectors; // By path
+    const qsizetype m_capacity;
+    qsizetype m_bytes = 0;
+    quint64 m_useCounter = 0;
+    int m_hits = 0;
+    int m_misses = 0;
+
+    Diagram fetch(const QString &path, int cssWidth, int dpi, bool encode);
+
+    /**
+     * @brief Drops least recently used images and SVGs until under capacity.
+     * Called with the lock held.
+     */
+    void evict();
+
+    static QImage prepare(const QString &path, int cssWidth, int dpi);
+    static void encode(Diagram &diagram, const QString &path);
+};
@@ -0,0 +1,108 @@
+#include "LayoutBuilder.h"
+#include "../models/PaperModel.h"
+#include <variant>
+
+/**
+ * @file LayoutBuilder.cpp
+ * @brief Implementation of the LayoutBuilder class.
+ */
+
+namespace {
+// Flattens a possibly ragged table into a row-major grid; short rows are
+// padded with empty cells.
+LayoutTable buildTable(const QVector<QVector<QString>> &table) {
+  LayoutTable layout;
+  for (const QVector<QString> &row : table) {
+    layout.columns = qMax(layout.columns, static_cast<int>(row.size()));
+  }
+  if (layout.columns == 0) {
+    return layout;
+  }
+
+  layout.rows = table.size();
+  layout.cells.reserve(layout.rows * layout.columns);
+  for (const QVector<QString> &row : table) {
+    layout.cells += row;
+    for (int i = row.size(); i < layout.columns; ++i) {
+      layout.cells.append(QString());
+    }
+  }
+  return layout;
+}
+
+// Answer parts, one overload per question type.
+void lowerPayload(LayoutQuestion &, const RegularPayload &) {}
+
+void lowerPayload(LayoutQuestion &layout, const OrPayload &payload) {
+  if (!payload.alternative.isEmpty()) {
+    layout.alternatives.append(payload.alternative);
+  }
+}
+
+void lowerPayload(LayoutQuestion &layout, const McqPayload &payload) {
+  layout.options.options = payload.options;
+  layout.options.columns = 2;
+}
+
+void lowerPayload(LayoutQuestion &layout, const MixedPayload &payload) {
+  layout.options.options = payload.options;
+  layout.options.columns = 1;
+}
+} // namespace
+
+LayoutDocument LayoutBuilder::build(const PaperModel &model,
+                                    const RenderStyle &style) const {
+  LayoutDocument document;
+  document.style = style;
+
+  // Title and metadata line
+  const Exam &exam = model.exam;
+  document.title = exam.title;
+  if (!exam.subject.isEmpty()) {
+    document.metadata.append(exam.subject);
+  }
+  if (!exam.duration.isEmpty()) {
+    document.metadata.append(exam.duration);
+  }
+  if (exam.totalMarks > 0) {
+    document.metadata.append("Total Marks: " + QString::number(exam.totalMarks));
+  }
+  if (exam.passMarks > 0) {
+    document.metadata.append("Pass Marks: " + QString::number(exam.passMarks));
+  }
+  if (!exam.className.isEmpty()) {
+    document.metadata.append("Class: " + exam.className);
+  }
+
+  // Sections; numbering restarts in every section
+  document.sections.reserve(model.sections.size());
+  for (const Section &section : model.sections) {
+    LayoutSection layoutSection;
+    layoutSection.label = section.label;
+    layoutSection.subtitle = section.subtitle;
+    layoutSection.questions.reserve(section.questions.size());
+
+    int questionNumber = 1;
+    for (const Question &question : section.questions) {
+      layoutSection.questions.append(buildQuestion(question, questionNumber));
+      ++questionNumber;
+    }
+    document.sections.append(layoutSection);
+  }
+
+  return document;
+}
+
+LayoutQuestion LayoutBuilder::buildQuestion(const Question &question,
+                                            int questionNumber) const {
+  LayoutQuestion layout;
+  layout.number = questionNumber;
+  layout.text = m_parser.parse(question.text);
+  layout.diagram.path = question.diagramPath;
+  layout.table = buildTable(question.table);
+
+  std::visit([&layout](const auto &payload) { lowerPayload(layout, payload); },
+             question.payload);
+
+  return layout;
+}
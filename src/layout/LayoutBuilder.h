@@ -0,0 +1,40 @@
+#pragma once
+
+#include "LayoutDocument.h"
+#include "RichTextParser.h"
+
+class PaperModel;
+class Question;
+
+/**
+ * @file LayoutBuilder.h
+ * @brief Defines the LayoutBuilder class that lowers a PaperModel to the layout IR.
+ */
+
+/**
+ * @class LayoutBuilder
+ * @brief Lowers a PaperModel into a LayoutDocument.
+ *
+ * Lowering resolves everything the backends would otherwise have to decide
+ * again: question numbering (restarting in every section), the metadata line,
+ * rich text runs, option grid shape and padded table cells. The result has
+ * the same content and order as PaperModel::toHtml().
+ */
+class LayoutBuilder
+{
+public:
+    LayoutBuilder() = default;
+
+    /**
+     * @brief Builds the layout tree for a paper.
+     * @param model The paper to lower
+     * @param style Font and orientation the backends should use
+     * @return Layout document
+     */
+    LayoutDocument build(const PaperModel &model, const RenderStyle &style) const;
+
+private:
+    RichTextParser m_parser;
+
+    LayoutQuestion buildQuestion(const Question &question, int questionNumber) const;
+};
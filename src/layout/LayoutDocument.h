@@ -0,0 +1,120 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "../models/RenderStyle.h"
+
+/**
+ * @file LayoutDocument.h
+ * @brief Format-neutral layout IR shared by the export backends.
+ *
+ * A PaperModel is lowered once into a LayoutDocument by LayoutBuilder. Export
+ * backends then walk this tree instead of serializing the model to HTML and
+ * parsing it back.
+ */
+
+/**
+ * LayoutRun: A span of text with uniform character formatting.
+ */
+struct LayoutRun
+{
+    enum class VerticalAlignment { Normal, Superscript, Subscript };
+
+    QString text;
+    bool bold = false;
+    bool italic = false;
+    bool underline = false;
+    VerticalAlignment verticalAlignment = VerticalAlignment::Normal;
+
+    /**
+     * @brief Whether two runs share all character formatting.
+     */
+    bool hasSameFormat(const LayoutRun &other) const
+    {
+        return bold == other.bold && italic == other.italic &&
+               underline == other.underline &&
+               verticalAlignment == other.verticalAlignment;
+    }
+};
+
+/**
+ * LayoutParagraph: A block of runs; line breaks inside it are U+2028.
+ */
+struct LayoutParagraph
+{
+    QVector<LayoutRun> runs;
+
+    bool isEmpty() const { return runs.isEmpty(); }
+};
+
+/**
+ * LayoutImage: A diagram shown at a fixed width beside the question text.
+ */
+struct LayoutImage
+{
+    QString path;
+    int width = 150; // CSS pixels
+
+    bool isNull() const { return path.isEmpty(); }
+};
+
+/**
+ * LayoutTable: A data table stored row-major; the first row is the header.
+ */
+struct LayoutTable
+{
+    int rows = 0;
+    int columns = 0;
+    QVector<QString> cells;
+
+    bool isEmpty() const { return rows == 0 || columns == 0; }
+    const QString &cell(int row, int column) const { return cells[row * columns + column]; }
+};
+
+/**
+ * LayoutOptionGrid: Labelled answer options laid out in a grid.
+ *
+ * MCQ options use two columns, Mixed options a single column list.
+ */
+struct LayoutOptionGrid
+{
+    QVector<QString> options;
+    int columns = 2;
+
+    bool isEmpty() const { return options.isEmpty(); }
+};
+
+/**
+ * LayoutQuestion: One numbered question with its floats and answer parts.
+ */
+struct LayoutQuestion
+{
+    int number = 0;
+    QVector<LayoutParagraph> text;
+    LayoutImage diagram;
+    LayoutTable table;
+    QStringList alternatives; // OR alternatives, plain text
+    LayoutOptionGrid options;
+};
+
+/**
+ * LayoutSection: A titled group of questions.
+ */
+struct LayoutSection
+{
+    QString label;
+    QString subtitle;
+    QVector<LayoutQuestion> questions;
+};
+
+/**
+ * LayoutDocument: A whole paper ready for a backend.
+ */
+struct LayoutDocument
+{
+    RenderStyle style;
+    QString title;
+    QStringList metadata; // Shown on one line, separated by " | "
+    QVector<LayoutSection> sections;
+};
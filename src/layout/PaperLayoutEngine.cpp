@@ -0,0 +1,640 @@
+#include "PaperLayoutEngine.h"
+#include "DiagramCache.h"
+#include <QFont>
+#include <QFontMetricsF>
+#include <QImage>
+#include <QPagedPaintDevice>
+#include <QPainter>
+#include <QPen>
+#include <QSemaphore>
+#include <QTextLayout>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <functional>
+#include <memory>
+
+/**
+ * @file PaperLayoutEngine.cpp
+ * @brief Implementation of the PaperLayoutEngine class.
+ */
+
+namespace {
+constexpr qreal CSS_DPI = 96.0;
+constexpr int QUESTION_NUMBER_WIDTH = 30;
+constexpr int QUESTION_SPACING = 6;
+constexpr int SECTION_SPACING = 10;
+constexpr int TITLE_SPACING = 20;
+constexpr int RULE_SPACING = 4;
+constexpr int OPTION_INDENT = 15;
+constexpr int OPTION_PADDING = 2;
+constexpr int OR_INDENT = 20;
+constexpr int OR_SPACING = 5;
+constexpr int FLOAT_MARGIN = 5;
+constexpr int CELL_PADDING = 4;
+constexpr qreal MAX_TABLE_SHARE = 0.45; // Of the question text column
+constexpr qreal MAX_DIAGRAM_SHARE = 0.5;
+constexpr qreal TITLE_SCALE = 1.3;
+constexpr qreal METADATA_SCALE = 0.8;
+constexpr qreal SUBTITLE_SCALE = 0.85;
+// A section heading is moved to the next page unless this many body lines
+// fit below it
+constexpr int HEADING_KEEP_LINES = 3;
+// Blocks built per pool thread before the batch is painted
+constexpr int PARALLEL_BLOCKS_PER_THREAD = 8;
+
+using DrawFunction = std::function<void(QPainter &, const QPointF &)>;
+
+// One unbreakable piece of a block, e.g. a line of text or an image.
+// Positions are relative to the block origin.
+struct Fragment {
+  qreal top;
+  qreal height;
+  DrawFunction draw;
+};
+
+// Content placed as a unit; only blocks taller than a page are split, and
+// then only between fragments.
+struct Block {
+  QVector<Fragment> fragments;
+  qreal height = 0;
+
+  void add(qreal top, qreal fragmentHeight, DrawFunction draw) {
+    fragments.append(Fragment{top, fragmentHeight, std::move(draw)});
+    extend(top + fragmentHeight);
+  }
+
+  void extend(qreal bottom) { height = qMax(height, bottom); }
+};
+
+QTextCharFormat runFormat(const LayoutRun &run) {
+  QTextCharFormat format;
+  format.setFontWeight(run.bold ? QFont::Bold : QFont::Normal);
+  format.setFontItalic(run.italic);
+  format.setFontUnderline(run.underline);
+  switch (run.verticalAlignment) {
+  case LayoutRun::VerticalAlignment::Superscript:
+    format.setVerticalAlignment(QTextCharFormat::AlignSuperScript);
+    break;
+  case LayoutRun::VerticalAlignment::Subscript:
+    format.setVerticalAlignment(QTextCharFormat::AlignSubScript);
+    break;
+  case LayoutRun::VerticalAlignment::Normal:
+    format.setVerticalAlignment(QTextCharFormat::AlignNormal);
+    break;
+  }
+  return format;
+}
+
+QString optionLabel(int index, const QString &option) {
+  return "(" + QString(QChar('a' + index)) + ") " + option;
+}
+
+// Stands in for the target device when text is shaped on worker threads:
+// it has the same metrics but is never painted on, and every thread may read
+// it at once.
+class PageMetrics : public QPaintDevice {
+public:
+  explicit PageMetrics(const QPaintDevice &device)
+      : m_width(device.width()), m_height(device.height()),
+        m_widthMM(device.widthMM()), m_heightMM(device.heightMM()),
+        m_dpiX(device.logicalDpiX()), m_dpiY(device.logicalDpiY()),
+        m_physicalDpiX(device.physicalDpiX()),
+        m_physicalDpiY(device.physicalDpiY()),
+        m_depth(device.depth()) {}
+
+  QPaintEngine *paintEngine() const override { return nullptr; }
+
+protected:
+  int metric(PaintDeviceMetric metric) const override {
+    switch (metric) {
+    case PdmWidth:
+      return m_width;
+    case PdmHeight:
+      return m_height;
+    case PdmWidthMM:
+      return m_widthMM;
+    case PdmHeightMM:
+      return m_heightMM;
+    case PdmDpiX:
+      return m_dpiX;
+    case PdmDpiY:
+      return m_dpiY;
+    case PdmPhysicalDpiX:
+      return m_physicalDpiX;
+    case PdmPhysicalDpiY:
+      return m_physicalDpiY;
+    case PdmDepth:
+      return m_depth;
+    case PdmNumColors:
+      return INT_MAX;
+    case PdmDevicePixelRatio:
+      return 1;
+    case PdmDevicePixelRatioScaled:
+      return int(devicePixelRatioFScale());
+    default:
+      return QPaintDevice::metric(metric);
+    }
+  }
+
+private:
+  const int m_width;
+  const int m_height;
+  const int m_widthMM;
+  const int m_heightMM;
+  const int m_dpiX;
+  const int m_dpiY;
+  const int m_physicalDpiX;
+  const int m_physicalDpiY;
+  const int m_depth;
+};
+
+// Turns headings and questions into blocks: shapes and wraps their text and
+// loads their images. Holds no mutable state, so one builder serves every
+// worker thread.
+class BlockBuilder {
+public:
+  BlockBuilder(const LayoutDocument &document, PageMetrics &metrics)
+      : m_document(document), m_device(metrics),
+        m_pageWidth(metrics.width()),
+        m_pixel(metrics.logicalDpiY() / CSS_DPI) {}
+
+  // Height a heading needs below it to stay on its page
+  qreal headingKeepHeight() const {
+    return QFontMetricsF(font(), &m_device).lineSpacing() * HEADING_KEEP_LINES;
+  }
+
+  Block titleBlock() const {
+    Block block;
+    qreal y = 0;
+    if (!m_document.title.isEmpty()) {
+      y = addText(block, m_document.title, font(TITLE_SCALE, true), 0, y,
+                  m_pageWidth, Qt::AlignHCenter);
+    }
+    y = addText(block, m_document.metadata.join(" | "), font(METADATA_SCALE), 0,
+                y, m_pageWidth, Qt::AlignHCenter);
+
+    // Separator line
+    const qreal ruleY = y + px(RULE_SPACING);
+    const qreal width = m_pageWidth;
+    const QPen pen = rulePen();
+    block.add(ruleY, px(1),
+              [ruleY, width, pen](QPainter &painter, const QPointF &origin) {
+                painter.setPen(pen);
+                painter.drawLine(QPointF(origin.x(), origin.y() + ruleY),
+                                 QPointF(origin.x() + width, origin.y() + ruleY));
+              });
+    block.extend(ruleY + px(TITLE_SPACING));
+    return block;
+  }
+
+  Block headingBlock(const LayoutSection &section) const {
+    Block block;
+    qreal y = addText(block, section.label, font(1.0, true), 0,
+                      px(SECTION_SPACING), m_pageWidth, Qt::AlignHCenter);
+    if (!section.subtitle.isEmpty()) {
+      y = addText(block, section.subtitle, font(SUBTITLE_SCALE, true, true), 0,
+                  y, m_pageWidth, Qt::AlignHCenter);
+    }
+    block.extend(y);
+    return block;
+  }
+
+  Block questionBlock(const LayoutQuestion &question) const {
+    Block block;
+    const qreal top = px(QUESTION_SPACING);
+    const qreal textLeft = px(QUESTION_NUMBER_WIDTH);
+    const qreal textWidth = m_pageWidth - textLeft;
+
+    addText(block, QString::number(question.number) + ")", font(), 0, top,
+            textLeft);
+
+    // Diagram and data table float on the right, one above the other
+    qreal floatWidth = 0;
+    qreal floatBottom = top;
+    if (!question.diagram.isNull()) {
+      const QSizeF size = addDiagram(block, question.diagram, floatBottom,
+                                     textWidth * MAX_DIAGRAM_SHARE);
+      if (!size.isEmpty()) {
+        floatWidth = size.width();
+        floatBottom += size.height() + px(FLOAT_MARGIN);
+      }
+    }
+    if (!question.table.isEmpty()) {
+      const QSizeF size = addDataTable(block, question.table, floatBottom,
+                                       textWidth * MAX_TABLE_SHARE);
+      floatWidth = qMax(floatWidth, size.width());
+      floatBottom += size.height() + px(FLOAT_MARGIN);
+    }
+
+    // Question text, narrowed beside the floats
+    const qreal besideFloats = textWidth - floatWidth - px(FLOAT_MARGIN);
+    const auto widthAt = [=](qreal y) {
+      return y < floatBottom ? besideFloats : textWidth;
+    };
+    qreal y = top;
+    for (const LayoutParagraph &paragraph : question.text) {
+      y = addParagraph(block, paragraph, textLeft, y, widthAt);
+    }
+    y = qMax(y, floatBottom);
+
+    if (!question.alternatives.isEmpty()) {
+      y = addAlternatives(block, question.alternatives, y);
+    } else if (!question.options.isEmpty()) {
+      y = question.options.columns > 1
+              ? addOptionGrid(block, question.options, y)
+              : addOptionList(block, question.options, y);
+    }
+
+    block.extend(y);
+    return block;
+  }
+
+private:
+  const LayoutDocument &m_document;
+  PageMetrics &m_device;
+  const qreal m_pageWidth;
+  const qreal m_pixel; // Device units per CSS pixel
+
+  qreal px(qreal cssPixels) const { return cssPixels * m_pixel; }
+
+  QFont font(qreal scale = 1.0, bool bold = false, bool italic = false) const {
+    QFont result(m_document.style.fontFamily);
+    result.setPointSizeF(m_document.style.fontSize * scale);
+    result.setBold(bold);
+    result.setItalic(italic);
+    return result;
+  }
+
+  QPen rulePen() const { return QPen(QColor(Qt::black), px(1)); }
+
+  // Shapes and wraps text at (x, top) in block coordinates. widthAt() gives
+  // the width of a line starting at a given height, so text can flow around
+  // floats. Returns the bottom of the text.
+  qreal addText(Block &block, const QString &text, const QFont &textFont,
+                const QVector<QTextLayout::FormatRange> &formats, qreal x,
+                qreal top, const std::function<qreal(qreal)> &widthAt,
+                Qt::Alignment alignment = Qt::AlignLeft) const {
+    auto layout = std::make_shared<QTextLayout>(text, textFont, &m_device);
+    QTextOption option(alignment);
+    option.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+    layout->setTextOption(option);
+    layout->setFormats(formats);
+
+    qreal y = top;
+    layout->beginLayout();
+    for (QTextLine line = layout->createLine(); line.isValid();
+         line = layout->createLine()) {
+      line.setLineWidth(qMax<qreal>(widthAt(y), px(1)));
+      line.setPosition(QPointF(x, y));
+      y += line.height();
+    }
+    layout->endLayout();
+
+    for (int i = 0; i < layout->lineCount(); ++i) {
+      const QTextLine line = layout->lineAt(i);
+      block.add(line.y(), line.height(),
+                [layout, i](QPainter &painter, const QPointF &origin) {
+                  layout->lineAt(i).draw(&painter, origin);
+                });
+    }
+    return y;
+  }
+
+  qreal addText(Block &block, const QString &text, const QFont &textFont,
+                qreal x, qreal top, qreal width,
+                Qt::Alignment alignment = Qt::AlignLeft) const {
+    return addText(
+        block, text, textFont, {}, x, top, [width](qreal) { return width; },
+        alignment);
+  }
+
+  qreal addParagraph(Block &block, const LayoutParagraph &paragraph, qreal x,
+                     qreal top,
+                     const std::function<qreal(qreal)> &widthAt) const {
+    QString text;
+    QVector<QTextLayout::FormatRange> formats;
+    for (const LayoutRun &run : paragraph.runs) {
+      QTextLayout::FormatRange range;
+      range.start = text.size();
+      range.length = run.text.size();
+      range.format = runFormat(run);
+      formats.append(range);
+      text += run.text;
+    }
+    return addText(block, text, font(), formats, x, top, widthAt);
+  }
+
+  // Draws a diagram right-aligned at top, at its display width or maxWidth
+  // if narrower. SVG files stay vector content; other images come from the
+  // diagram cache at print resolution. Returns the size, empty if the file
+  // cannot be read.
+  QSizeF addDiagram(Block &block, const LayoutImage &diagram, qreal top,
+                    qreal maxWidth) const {
+    DiagramCache &cache = DiagramCache::shared();
+    const qreal width = qMin(px(diagram.width), maxWidth);
+
+    if (DiagramCache::isVector(diagram.path)) {
+      const std::shared_ptr<const DiagramCache::VectorDiagram> svg =
+          cache.vector(diagram.path);
+      const QSizeF size = svg ? svg->defaultSize() : QSizeF();
+      if (!size.isEmpty()) {
+        const QRectF rect(m_pageWidth - width, top, width,
+                          width * size.height() / size.width());
+        block.add(rect.top(), rect.height(),
+                  [svg, rect](QPainter &painter, const QPointF &origin) {
+                    svg->render(painter, rect.translated(origin));
+                  });
+        return rect.size();
+      }
+    }
+
+    const QImage image = cache.image(diagram.path, diagram.width);
+    if (image.isNull()) {
+      return QSizeF();
+    }
+    const QRectF rect(m_pageWidth - width, top, width,
+                      width * image.height() / image.width());
+    block.add(rect.top(), rect.height(),
+              [image, rect](QPainter &painter, const QPointF &origin) {
+                painter.drawImage(rect.translated(origin), image);
+              });
+    return rect.size();
+  }
+
+  // Columns get their natural width, scaled down to fit maxWidth; cells then
+  // wrap. The table is right-aligned at top. Returns its size.
+  QSizeF addDataTable(Block &block, const LayoutTable &table, qreal top,
+                      qreal maxWidth) const {
+    const qreal padding = px(CELL_PADDING);
+    const QFont bodyFont = font();
+    const QFont headerFont = font(1.0, true);
+    const QFontMetricsF bodyMetrics(bodyFont, &m_device);
+    const QFontMetricsF headerMetrics(headerFont, &m_device);
+
+    QVector<qreal> widths(table.columns, 2 * padding);
+    for (int row = 0; row < table.rows; ++row) {
+      const QFontMetricsF &metrics = row == 0 ? headerMetrics : bodyMetrics;
+      for (int column = 0; column < table.columns; ++column) {
+        widths[column] =
+            qMax(widths[column], metrics.horizontalAdvance(table.cell(row, column)) +
+                                     2 * padding);
+      }
+    }
+    qreal total = 0;
+    for (qreal width : widths) {
+      total += width;
+    }
+    if (total > maxWidth) {
+      for (qreal &width : widths) {
+        width *= maxWidth / total;
+      }
+      total = maxWidth;
+    }
+
+    const qreal left = m_pageWidth - total;
+    const QPen pen = rulePen();
+    qreal y = top;
+    for (int row = 0; row < table.rows; ++row) {
+      const QFont &cellFont = row == 0 ? headerFont : bodyFont;
+      qreal rowBottom = y + bodyMetrics.lineSpacing() + 2 * padding;
+      qreal x = left;
+      for (int column = 0; column < table.columns; ++column) {
+        const qreal bottom =
+            addText(block, table.cell(row, column), cellFont, x + padding,
+                    y + padding, widths[column] - 2 * padding);
+        rowBottom = qMax(rowBottom, bottom + padding);
+        x += widths[column];
+      }
+
+      // Cell borders
+      const QRectF rowRect(left, y, total, rowBottom - y);
+      block.add(rowRect.top(), rowRect.height(),
+                [rowRect, widths, pen](QPainter &painter, const QPointF &origin) {
+                  painter.setPen(pen);
+                  painter.setBrush(Qt::NoBrush);
+                  qreal cellLeft = rowRect.left();
+                  for (qreal width : widths) {
+                    painter.drawRect(QRectF(cellLeft, rowRect.top(), width,
+                                            rowRect.height())
+                                         .translated(origin));
+                    cellLeft += width;
+                  }
+                });
+      y = rowBottom;
+    }
+    return QSizeF(total, y - top);
+  }
+
+  qreal addAlternatives(Block &block, const QStringList &alternatives,
+                        qreal top) const {
+    qreal y = addText(block, "OR", font(1.0, true), 0, top + px(OR_SPACING),
+                      m_pageWidth, Qt::AlignHCenter) +
+              px(OR_SPACING);
+    const qreal indent = px(OR_INDENT);
+    for (QString alternative : alternatives) {
+      alternative.replace('\n', QChar::LineSeparator);
+      y = addText(block, alternative, font(), indent, y, m_pageWidth - indent);
+    }
+    return y;
+  }
+
+  qreal addOptionGrid(Block &block, const LayoutOptionGrid &grid,
+                      qreal top) const {
+    const qreal indent = px(OPTION_INDENT);
+    const qreal padding = px(OPTION_PADDING);
+    const qreal cellWidth = (m_pageWidth - indent) / grid.columns;
+    const QFont optionFont = font();
+
+    qreal y = top;
+    for (int first = 0; first < grid.options.size(); first += grid.columns) {
+      qreal rowBottom = y;
+      const int end = qMin(first + grid.columns, int(grid.options.size()));
+      for (int i = first; i < end; ++i) {
+        const qreal x = indent + (i - first) * cellWidth + padding;
+        rowBottom = qMax(rowBottom,
+                         addText(block, optionLabel(i, grid.options[i]),
+                                 optionFont, x, y + padding,
+                                 cellWidth - 2 * padding));
+      }
+      y = rowBottom + padding;
+    }
+    return y;
+  }
+
+  qreal addOptionList(Block &block, const LayoutOptionGrid &grid,
+                      qreal top) const {
+    const qreal indent = px(OPTION_INDENT);
+    const QFont optionFont = font();
+    qreal y = top;
+    for (int i = 0; i < grid.options.size(); ++i) {
+      y = addText(block, optionLabel(i, grid.options[i]), optionFont, indent,
+                  y, m_pageWidth - indent);
+    }
+    return y;
+  }
+};
+
+// A heading or question, in paper order
+struct BlockItem {
+  const LayoutSection *section;
+  const LayoutQuestion *question; // nullptr for the section heading
+};
+
+// Paginates blocks top to bottom and paints them, one page after another.
+// Blocks are built on worker threads a batch at a time; placing and painting
+// stay on the calling thread, so all pages go through one painter and share
+// the device's fonts and images.
+class PageWriter {
+public:
+  PageWriter(const LayoutDocument &document, QPainter &painter,
+             QPagedPaintDevice &device,
+             const PaperLayoutEngine::PageCallback &pageFinished)
+      : m_document(document), m_painter(painter), m_device(device),
+        m_pageFinished(pageFinished), m_metrics(device),
+        m_builder(document, m_metrics), m_pageHeight(device.height()) {}
+
+  int write() {
+    place(m_builder.titleBlock());
+    const qreal keepWithHeading = m_builder.headingKeepHeight();
+
+    QVector<BlockItem> items;
+    for (const LayoutSection &section : m_document.sections) {
+      items.append(BlockItem{&section, nullptr});
+      for (const LayoutQuestion &question : section.questions) {
+        items.append(BlockItem{&section, &question});
+      }
+    }
+
+    // Blocks only depend on their own content, so a batch is built in any
+    // order and then placed in paper order. Bounded batches keep at most a
+    // few pages of shaped text alive.
+    QThreadPool *pool = QThreadPool::globalInstance();
+    const int batchSize =
+        qMax(1, pool->maxThreadCount()) * PARALLEL_BLOCKS_PER_THREAD;
+    for (int batchStart = 0; batchStart < items.size();
+         batchStart += batchSize) {
+      const int batchCount = qMin(batchSize, int(items.size()) - batchStart);
+      const QVector<Block> blocks =
+          buildBlocks(items.constData() + batchStart, batchCount);
+      for (int i = 0; i < batchCount; ++i) {
+        if (m_stopped) {
+          return m_pages;
+        }
+        const BlockItem &item = items[batchStart + i];
+        if (item.question) {
+          place(blocks[i]);
+          ++m_questionsPlaced;
+        } else {
+          place(blocks[i], keepWithHeading);
+        }
+      }
+    }
+    if (m_stopped) {
+      return m_pages;
+    }
+    if (m_pageFinished) {
+      m_pageFinished(m_pages, m_questionsPlaced);
+    }
+    return m_pages;
+  }
+
+private:
+  const LayoutDocument &m_document;
+  QPainter &m_painter;
+  QPagedPaintDevice &m_device;
+  const PaperLayoutEngine::PageCallback &m_pageFinished;
+  PageMetrics m_metrics;
+  const BlockBuilder m_builder;
+  const qreal m_pageHeight;
+  qreal m_y = 0;
+  int m_pages = 1;
+  int m_questionsPlaced = 0;
+  bool m_stopped = false;
+
+  QVector<Block> buildBlocks(const BlockItem *items, int count) const {
+    QVector<Block> blocks(count);
+    Block *results = blocks.data();
+    std::atomic<int> next{0};
+
+    const auto work = [&]() {
+      for (int i = next++; i < count; i = next++) {
+        const BlockItem &item = items[i];
+        results[i] = item.question ? m_builder.questionBlock(*item.question)
+                                   : m_builder.headingBlock(*item.section);
+      }
+    };
+
+    // The calling thread works too. Helpers only count if the pool could
+    // start them, so a saturated pool degrades to serial instead of blocking.
+    QThreadPool *pool = QThreadPool::globalInstance();
+    QSemaphore finished;
+    int helpers = 0;
+    while (helpers < count - 1 && pool->tryStart([&work, &finished]() {
+      work();
+      finished.release();
+    })) {
+      ++helpers;
+    }
+    work();
+    finished.acquire(helpers);
+    return blocks;
+  }
+
+  // Starts a new page when a block does not fit, or splits blocks that
+  // cannot fit on any page
+  void place(const Block &block, qreal keepWithNext = 0) {
+    if (m_y > 0 && m_y + block.height + keepWithNext > m_pageHeight &&
+        block.height + keepWithNext <= m_pageHeight && !newPage()) {
+      return;
+    }
+
+    if (m_y + block.height <= m_pageHeight) {
+      for (const Fragment &fragment : block.fragments) {
+        fragment.draw(m_painter, QPointF(0, m_y));
+      }
+      m_y += block.height;
+      return;
+    }
+
+    QVector<Fragment> fragments = block.fragments;
+    std::stable_sort(fragments.begin(), fragments.end(),
+                     [](const Fragment &a, const Fragment &b) {
+                       return a.top < b.top;
+                     });
+    qreal origin = m_y;
+    for (const Fragment &fragment : fragments) {
+      if (origin + fragment.top + fragment.height > m_pageHeight &&
+          origin + fragment.top > 0) {
+        if (!newPage()) {
+          return;
+        }
+        origin = -fragment.top;
+      }
+      fragment.draw(m_painter, QPointF(0, origin));
+    }
+    m_y = origin + block.height;
+  }
+
+  // Finishes the current page; false if the callback stopped painting
+  bool newPage() {
+    if (m_pageFinished && !m_pageFinished(m_pages, m_questionsPlaced)) {
+      m_stopped = true;
+      return false;
+    }
+    m_device.newPage();
+    ++m_pages;
+    m_y = 0;
+    return true;
+  }
+};
+} // namespace
+
+PaperLayoutEngine::PaperLayoutEngine(const LayoutDocument &document)
+    : m_document(document) {}
+
+int PaperLayoutEngine::paint(QPainter &painter, QPagedPaintDevice &device,
+                             const PageCallback &pageFinished) const {
+  return PageWriter(m_document, painter, device, pageFinished).write();
+}
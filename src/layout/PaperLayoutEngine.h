@@ -0,0 +1,58 @@
+#pragma once
+
+#include <functional>
+#include "LayoutDocument.h"
+
+class QPagedPaintDevice;
+class QPainter;
+
+/**
+ * @file PaperLayoutEngine.h
+ * @brief Defines the PaperLayoutEngine class that paginates and paints the layout IR.
+ */
+
+/**
+ * @class PaperLayoutEngine
+ * @brief Lays a LayoutDocument out in pages and draws it with QPainter.
+ *
+ * The structure of a paper is fixed: numbered questions, right-floated
+ * diagrams and tables, option grids. The engine positions all of it itself
+ * and only uses QTextLayout to shape and wrap runs of text, so no HTML, CSS
+ * or QTextDocument is involved.
+ *
+ * Lengths in the IR are CSS pixels and font sizes are points; both are
+ * converted to the resolution of the target device.
+ *
+ * Questions are shaped, wrapped and measured on the global thread pool in
+ * batches. The paper is then paginated once, in order, and painted through a
+ * single painter, so the output is the same for any number of threads and
+ * every page shares the device's font and image resources.
+ */
+class PaperLayoutEngine
+{
+public:
+    /**
+     * @brief Called when a page is finished, with its number and the number
+     * of questions placed so far; returning false stops painting.
+     */
+    using PageCallback = std::function<bool(int page, int questionsPlaced)>;
+
+    /**
+     * @brief Creates an engine for a document, which must outlive it.
+     */
+    explicit PaperLayoutEngine(const LayoutDocument &document);
+
+    /**
+     * @brief Paints the whole document, starting new pages as needed.
+     *
+     * @p painter and @p device are only used from the calling thread.
+     * @param painter Painter already active on @p device
+     * @param device The paged device, e.g. a QPdfWriter
+     * @param pageFinished Optional progress callback, see PageCallback
+     * @return Number of pages painted
+     */
+    int paint(QPainter &painter, QPagedPaintDevice &device, const PageCallback &pageFinished = PageCallback()) const;
+
+private:
+    const LayoutDocument &m_document;
+};
@@ -0,0 +1,340 @@
+#include "RichTextParser.h"
+#include <QChar>
+#include <QStringView>
+
+/**
+ * @file RichTextParser.cpp
+ * @brief Implementation of the RichTextParser class.
+ */
+
+namespace {
+constexpr int MAX_ENTITY_LENGTH = 10;
+
+bool isSkippedElement(const QString &tag) {
+  return tag == "head" || tag == "style" || tag == "script" || tag == "title";
+}
+
+bool isBlockElement(const QString &tag) {
+  return tag == "p" || tag == "div" || tag == "li" || tag == "ul" ||
+         tag == "ol" || tag == "blockquote" || tag == "pre" || tag == "tr" ||
+         tag == "table" || (tag.size() == 2 && tag[0] == 'h' &&
+                            tag[1] >= '1' && tag[1] <= '6');
+}
+
+bool isVoidElement(const QString &tag) {
+  return tag == "img" || tag == "meta" || tag == "link" || tag == "input" ||
+         tag == "col";
+}
+
+// Reads the value of the style attribute from a tag's attribute text.
+QString styleAttribute(const QString &attributes) {
+  const int start = attributes.indexOf(QStringLiteral("style="), 0,
+                                       Qt::CaseInsensitive);
+  if (start < 0 || start + 6 >= attributes.size()) {
+    return QString();
+  }
+  const QChar quote = attributes[start + 6];
+  if (quote != '"' && quote != '\'') {
+    return QString();
+  }
+  const int end = attributes.indexOf(quote, start + 7);
+  return end < 0 ? QString() : attributes.mid(start + 7, end - start - 7);
+}
+
+// Applies the inline CSS properties QTextEdit uses for character formats.
+void applyStyle(const QString &style, LayoutRun &format) {
+  const QStringList declarations = style.split(';', Qt::SkipEmptyParts);
+  for (const QString &declaration : declarations) {
+    const int colon = declaration.indexOf(':');
+    if (colon < 0) {
+      continue;
+    }
+    const QString property = declaration.left(colon).trimmed().toLower();
+    const QString value = declaration.mid(colon + 1).trimmed().toLower();
+
+    if (property == "font-weight") {
+      bool isNumber = false;
+      const int weight = value.toInt(&isNumber);
+      format.bold = isNumber ? weight >= 600
+                             : (value == "bold" || value == "bolder");
+    } else if (property == "font-style") {
+      format.italic = value == "italic" || value == "oblique";
+    } else if (property == "text-decoration") {
+      format.underline = value.contains("underline");
+    } else if (property == "vertical-align") {
+      if (value == "super") {
+        format.verticalAlignment = LayoutRun::VerticalAlignment::Superscript;
+      } else if (value == "sub") {
+        format.verticalAlignment = LayoutRun::VerticalAlignment::Subscript;
+      } else {
+        format.verticalAlignment = LayoutRun::VerticalAlignment::Normal;
+      }
+    }
+  }
+}
+
+// Applies the formatting implied by the element itself.
+void applyElement(const QString &tag, LayoutRun &format) {
+  if (tag == "b" || tag == "strong") {
+    format.bold = true;
+  } else if (tag == "i" || tag == "em") {
+    format.italic = true;
+  } else if (tag == "u" || tag == "ins") {
+    format.underline = true;
+  } else if (tag == "sup") {
+    format.verticalAlignment = LayoutRun::VerticalAlignment::Superscript;
+  } else if (tag == "sub") {
+    format.verticalAlignment = LayoutRun::VerticalAlignment::Subscript;
+  }
+}
+
+// Accumulates runs and paragraphs while the markup is walked.
+class ParagraphBuilder {
+public:
+  struct OpenElement {
+    QString tag;
+    LayoutRun format;
+  };
+
+  QVector<LayoutParagraph> paragraphs;
+  QVector<OpenElement> openElements;
+  bool inBlock = false;
+
+  LayoutRun currentFormat() const {
+    return openElements.isEmpty() ? LayoutRun() : openElements.last().format;
+  }
+
+  void appendText(const QString &text) {
+    if (text.isEmpty()) {
+      return;
+    }
+    LayoutRun run = currentFormat();
+    run.text = text;
+    if (!m_current.runs.isEmpty() && m_current.runs.last().hasSameFormat(run)) {
+      m_current.runs.last().text += text;
+    } else {
+      m_current.runs.append(run);
+    }
+  }
+
+  void endParagraph() {
+    if (!m_current.isEmpty()) {
+      paragraphs.append(m_current);
+      m_current = LayoutParagraph();
+    }
+  }
+
+  void open(const QString &tag, const QString &attributes) {
+    LayoutRun format = currentFormat();
+    applyElement(tag, format);
+    const QString style = styleAttribute(attributes);
+    if (!style.isEmpty()) {
+      applyStyle(style, format);
+    }
+    openElements.append(OpenElement{tag, format});
+  }
+
+  void close(const QString &tag) {
+    for (int i = openElements.size() - 1; i >= 0; --i) {
+      if (openElements[i].tag == tag) {
+        openElements.resize(i);
+        return;
+      }
+    }
+  }
+
+private:
+  LayoutParagraph m_current;
+};
+
+// Decodes entities in a run of character data.
+QString decodeText(QStringView text) {
+  QString decoded;
+  decoded.reserve(text.size());
+  int i = 0;
+  while (i < text.size()) {
+    if (text[i] == '&') {
+      int semicolon = -1;
+      for (int j = i + 1; j < text.size() && j <= i + MAX_ENTITY_LENGTH; ++j) {
+        if (text[j] == ';') {
+          semicolon = j;
+          break;
+        }
+      }
+      if (semicolon > 0) {
+        const QString entity = RichTextParser::decodeEntity(
+            text.mid(i + 1, semicolon - i - 1));
+        if (!entity.isEmpty()) {
+          decoded += entity;
+          i = semicolon + 1;
+          continue;
+        }
+      }
+    }
+    decoded += text[i];
+    ++i;
+  }
+  return decoded;
+}
+
+// Index just past the '>' closing the tag that starts at from, honouring
+// quoted attribute values; -1 if the tag is not terminated.
+int findTagEnd(const QString &html, int from) {
+  QChar quote;
+  for (int i = from; i < html.size(); ++i) {
+    const QChar c = html[i];
+    if (!quote.isNull()) {
+      if (c == quote) {
+        quote = QChar();
+      }
+    } else if (c == '"' || c == '\'') {
+      quote = c;
+    } else if (c == '>') {
+      return i + 1;
+    }
+  }
+  return -1;
+}
+
+QVector<LayoutParagraph> parsePlainText(const QString &text) {
+  QVector<LayoutParagraph> paragraphs;
+  const QStringList lines = text.split('\n');
+  for (const QString &line : lines) {
+    LayoutParagraph paragraph;
+    LayoutRun run;
+    run.text = line;
+    paragraph.runs.append(run);
+    paragraphs.append(paragraph);
+  }
+  while (!paragraphs.isEmpty() && paragraphs.last().runs.first().text.isEmpty()) {
+    paragraphs.removeLast();
+  }
+  return paragraphs;
+}
+} // namespace
+
+QVector<LayoutParagraph> RichTextParser::parse(const QString &text) const {
+  if (!text.trimmed().startsWith('<')) {
+    return parsePlainText(text);
+  }
+
+  ParagraphBuilder builder;
+  int pos = 0;
+  while (pos < text.size()) {
+    const int tagStart = text.indexOf('<', pos);
+    const int textEnd = tagStart < 0 ? text.size() : tagStart;
+
+    // Character data; whitespace between blocks is formatting, not content
+    if (textEnd > pos) {
+      QString chunk = decodeText(QStringView(text).mid(pos, textEnd - pos));
+      if (builder.inBlock || !chunk.trimmed().isEmpty()) {
+        chunk.replace('\n', QChar::LineSeparator);
+        builder.appendText(chunk);
+      }
+    }
+    if (tagStart < 0) {
+      break;
+    }
+
+    // Comments, doctype and processing instructions
+    if (text.mid(tagStart, 4) == "<!--") {
+      const int end = text.indexOf("-->", tagStart + 4);
+      pos = end < 0 ? text.size() : end + 3;
+      continue;
+    }
+    if (tagStart + 1 < text.size() &&
+        (text[tagStart + 1] == '!' || text[tagStart + 1] == '?')) {
+      const int end = text.indexOf('>', tagStart);
+      pos = end < 0 ? text.size() : end + 1;
+      continue;
+    }
+
+    const int tagEnd = findTagEnd(text, tagStart + 1);
+    if (tagEnd < 0) {
+      builder.appendText(decodeText(QStringView(text).mid(tagStart)));
+      break;
+    }
+    pos = tagEnd;
+
+    // Split "<name attributes/>" into its parts
+    const bool closing = text[tagStart + 1] == '/';
+    int nameStart = tagStart + (closing ? 2 : 1);
+    int nameEnd = nameStart;
+    while (nameEnd < tagEnd - 1 && text[nameEnd].isLetterOrNumber()) {
+      ++nameEnd;
+    }
+    const QString tag = text.mid(nameStart, nameEnd - nameStart).toLower();
+    const QString attributes = text.mid(nameEnd, tagEnd - 1 - nameEnd);
+    const bool selfClosing = attributes.trimmed().endsWith('/');
+    if (tag.isEmpty()) {
+      continue;
+    }
+
+    if (closing) {
+      if (isBlockElement(tag)) {
+        builder.endParagraph();
+        builder.inBlock = false;
+      }
+      builder.close(tag);
+    } else if (isSkippedElement(tag)) {
+      if (!selfClosing) {
+        const int close = text.indexOf("</" + tag, pos, Qt::CaseInsensitive);
+        const int closeEnd = close < 0 ? -1 : text.indexOf('>', close);
+        pos = closeEnd < 0 ? text.size() : closeEnd + 1;
+      }
+    } else if (tag == "br") {
+      builder.appendText(QString(QChar::LineSeparator));
+    } else if (tag == "hr") {
+      builder.endParagraph();
+    } else if (!isVoidElement(tag)) {
+      if (isBlockElement(tag)) {
+        builder.endParagraph();
+        builder.inBlock = true;
+      }
+      if (!selfClosing) {
+        builder.open(tag, attributes);
+      }
+    }
+  }
+
+  builder.endParagraph();
+  return builder.paragraphs;
+}
+
+QString RichTextParser::decodeEntity(QStringView name) {
+  if (name.isEmpty()) {
+    return QString();
+  }
+
+  if (name[0] == '#') {
+    bool ok = false;
+    const bool hex = name.size() > 1 && (name[1] == 'x' || name[1] == 'X');
+    const uint codePoint =
+        name.mid(hex ? 2 : 1).toString().toUInt(&ok, hex ? 16 : 10);
+    if (!ok || codePoint == 0 || codePoint > 0x10FFFF) {
+      return QString();
+    }
+    const char32_t ucs4 = codePoint;
+    return QString::fromUcs4(&ucs4, 1);
+  }
+
+  if (name == u"amp") {
+    return QStringLiteral("&");
+  }
+  if (name == u"lt") {
+    return QStringLiteral("<");
+  }
+  if (name == u"gt") {
+    return QStringLiteral(">");
+  }
+  if (name == u"quot") {
+    return QStringLiteral("\"");
+  }
+  if (name == u"apos") {
+    return QStringLiteral("'");
+  }
+  if (name == u"nbsp") {
+    return QString(QChar(0x00A0));
+  }
+  return QString();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+#include "LayoutDocument.h"
+
+/**
+ * @file RichTextParser.h
+ * @brief Defines the RichTextParser class for lowering question text to runs.
+ */
+
+/**
+ * @class RichTextParser
+ * @brief Converts question text from the rich text editor into layout paragraphs.
+ *
+ * Question text is either plain text or the HTML produced by QTextEdit::toHtml().
+ * The parser understands the subset QTextEdit emits: paragraphs, line breaks,
+ * bold, italic, underline, superscript and subscript (as tags or inline
+ * styles) and character entities. Everything else is reduced to its text.
+ *
+ * It only depends on QtCore, so lowering does not need a QGuiApplication.
+ */
+class RichTextParser
+{
+public:
+    RichTextParser() = default;
+
+    /**
+     * @brief Parses question text into paragraphs of formatted runs.
+     * @param text Plain text or QTextEdit HTML
+     * @return Paragraphs with adjacent equally formatted runs merged
+     */
+    QVector<LayoutParagraph> parse(const QString &text) const;
+
+    /**
+     * @brief Decodes a character entity such as "amp" or "#169".
+     * @param name Entity name without '&' and ';'
+     * @return Decoded text, or an empty string if the entity is unknown
+     */
+    static QString decodeEntity(QStringView name);
+};
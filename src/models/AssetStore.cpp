@@ -0,0 +1,268 @@
+#include "AssetStore.h"
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+
+/**
+ * @file AssetStore.cpp
+ * @brief Implementation of the AssetStore class.
+ */
+
+namespace {
+const QString REFERENCE_PREFIX = QStringLiteral("asset:");
+
+// Only the header is looked at
+QByteArray imageFormat(const QByteArray &data) {
+  QBuffer buffer;
+  buffer.setData(data);
+  buffer.open(QIODevice::ReadOnly);
+  return QImageReader::imageFormat(&buffer);
+}
+
+QByteArray readRange(const QString &path, qint64 offset, qint64 size) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly) || !file.seek(offset)) {
+    return QByteArray();
+  }
+  return file.read(size);
+}
+} // namespace
+
+AssetStore &AssetStore::shared() {
+  static AssetStore store;
+  return store;
+}
+
+bool AssetStore::isReference(QStringView path) {
+  return path.startsWith(REFERENCE_PREFIX);
+}
+
+QString AssetStore::reference(const QByteArray &hash) {
+  return REFERENCE_PREFIX + QString::fromLatin1(hash.toHex());
+}
+
+QByteArray AssetStore::hash(QStringView reference) {
+  if (!isReference(reference) ||
+      reference.size() != REFERENCE_PREFIX.size() + 2 * HASH_SIZE) {
+    return QByteArray();
+  }
+  const QByteArray hex = reference.mid(REFERENCE_PREFIX.size()).toLatin1();
+  const QByteArray raw = QByteArray::fromHex(hex);
+  // fromHex() skips invalid characters instead of failing
+  return raw.size() == HASH_SIZE ? raw : QByteArray();
+}
+
+QString AssetStore::add(const QByteArray &data) {
+  const QString key = reference(
+      QCryptographicHash::hash(data, QCryptographicHash::Sha256));
+  store(key, data);
+  return key;
+}
+
+bool AssetStore::insert(const QString &reference, const QByteArray &data) {
+  {
+    // An unread blob may yet fail its hash; these bytes are checked now
+    QReadLocker locker(&m_lock);
+    const auto it = m_blobs.constFind(reference);
+    if (it != m_blobs.constEnd() && it->sourcePath.isEmpty()) {
+      return true;
+    }
+  }
+  if (QCryptographicHash::hash(data, QCryptographicHash::Sha256) !=
+      hash(reference)) {
+    return false;
+  }
+  store(reference, data);
+  return true;
+}
+
+void AssetStore::store(const QString &reference, const QByteArray &data) {
+  {
+    QReadLocker locker(&m_lock);
+    const auto it = m_blobs.constFind(reference);
+    if (it != m_blobs.constEnd() && it->sourcePath.isEmpty()) {
+      return;
+    }
+  }
+
+  // Sniffed outside the lock
+  const QByteArray format = imageFormat(data);
+
+  QWriteLocker locker(&m_lock);
+  const auto it = m_blobs.find(reference);
+  if (it == m_blobs.end()) {
+    Blob blob;
+    blob.data = data;
+    blob.format = format;
+    m_blobs.insert(reference, blob);
+  } else if (!it->sourcePath.isEmpty()) {
+    // An unread blob keeps its users
+    it->data = data;
+    it->format = format;
+    it->sourcePath.clear();
+  } else {
+    return; // Stored meanwhile
+  }
+  m_bytes += data.size();
+}
+
+void AssetStore::insertRange(const QString &reference, const QString &path,
+                             qint64 offset, qint64 size) {
+  QWriteLocker locker(&m_lock);
+  const auto it = m_blobs.constFind(reference);
+  if (it != m_blobs.constEnd() && it->sourcePath.isEmpty()) {
+    return;
+  }
+  Blob &blob = m_blobs[reference];
+  blob.sourcePath = path;
+  blob.sourceOffset = offset;
+  blob.sourceSize = size;
+}
+
+AssetStore::Blob AssetStore::blob(const QString &reference) const {
+  Blob blob;
+  {
+    QReadLocker locker(&m_lock);
+    blob = m_blobs.value(reference);
+  }
+  if (blob.sourcePath.isEmpty()) {
+    return blob;
+  }
+
+  // Read and checked outside the lock. If two threads race for the same
+  // blob, both read it and the first result is kept.
+  const QByteArray data =
+      readRange(blob.sourcePath, blob.sourceOffset, blob.sourceSize);
+  const bool valid =
+      data.size() == blob.sourceSize &&
+      QCryptographicHash::hash(data, QCryptographicHash::Sha256) ==
+          hash(reference);
+  const QByteArray format = valid ? imageFormat(data) : QByteArray();
+
+  QWriteLocker locker(&m_lock);
+  const auto it = m_blobs.find(reference);
+  if (it == m_blobs.end() || it->sourcePath.isEmpty()) {
+    return it == m_blobs.end() ? Blob() : *it;
+  }
+  if (it->sourcePath != blob.sourcePath ||
+      it->sourceOffset != blob.sourceOffset) {
+    return Blob(); // Pointed at another file meanwhile
+  }
+  if (!valid) {
+    // Damaged, or the file changed since the paper was opened; only the
+    // diagrams using the blob go missing
+    m_blobs.erase(it);
+    return Blob();
+  }
+  it->data = data;
+  it->format = format;
+  it->sourcePath.clear();
+  m_bytes += data.size();
+  return *it;
+}
+
+QString AssetStore::addFile(const QString &path) {
+  const QFileInfo info(path);
+  if (!info.isFile()) {
+    return QString();
+  }
+  const qint64 size = info.size();
+  const qint64 modified = info.lastModified().toMSecsSinceEpoch();
+  {
+    QReadLocker locker(&m_lock);
+    const auto it = m_files.constFind(path);
+    if (it != m_files.constEnd() && it->size == size &&
+        it->modified == modified && m_blobs.contains(it->reference)) {
+      return it->reference;
+    }
+  }
+
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return QString();
+  }
+  const QByteArray data = file.readAll();
+  if (data.size() != size) {
+    return QString();
+  }
+  const QString key = add(data);
+
+  QWriteLocker locker(&m_lock);
+  m_files.insert(path, FileEntry{size, modified, key});
+  return key;
+}
+
+bool AssetStore::contains(const QString &reference) const {
+  QReadLocker locker(&m_lock);
+  return m_blobs.contains(reference);
+}
+
+QByteArray AssetStore::data(const QString &reference) const {
+  return blob(reference).data;
+}
+
+QByteArray AssetStore::format(const QString &reference) const {
+  return blob(reference).format;
+}
+
+int AssetStore::size() const {
+  QReadLocker locker(&m_lock);
+  return static_cast<int>(m_blobs.size());
+}
+
+qsizetype AssetStore::bytes() const {
+  QReadLocker locker(&m_lock);
+  return m_bytes;
+}
+
+void AssetStore::retain(const QStringList &references) {
+  QWriteLocker locker(&m_lock);
+  for (const QString &reference : references) {
+    const auto it = m_blobs.find(reference);
+    if (it != m_blobs.end()) {
+      ++it->users;
+    }
+  }
+}
+
+void AssetStore::release(const QStringList &references) {
+  QWriteLocker locker(&m_lock);
+  for (const QString &reference : references) {
+    const auto it = m_blobs.find(reference);
+    if (it != m_blobs.end() && it->users > 0) {
+      --it->users;
+    }
+  }
+}
+
+int AssetStore::prune() {
+  QWriteLocker locker(&m_lock);
+  int dropped = 0;
+  for (auto it = m_blobs.begin(); it != m_blobs.end();) {
+    if (it->users > 0) {
+      ++it;
+      continue;
+    }
+    m_bytes -= it->data.size();
+    it = m_blobs.erase(it);
+    ++dropped;
+  }
+  for (auto it = m_files.begin(); it != m_files.end();) {
+    if (m_blobs.contains(it->reference)) {
+      ++it;
+    } else {
+      it = m_files.erase(it);
+    }
+  }
+  return dropped;
+}
+
+void AssetStore::clear() {
+  QWriteLocker locker(&m_lock);
+  m_blobs.clear();
+  m_files.clear();
+  m_bytes = 0;
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+
+/**
+ * @file AssetStore.h
+ * @brief Defines the AssetStore class that holds embedded diagram files.
+ */
+
+/**
+ * @class AssetStore
+ * @brief Content-addressed store for the diagram files embedded in papers.
+ *
+ * Each blob is kept once, under the SHA-256 of its bytes. A question refers
+ * to an embedded diagram with a reference, "asset:" followed by the hash in
+ * hex, stored in Question::diagramPath in place of a file path; any path
+ * with that prefix names a blob rather than a file. Equal files therefore
+ * share one blob however many questions or papers use them.
+ *
+ * Papers fill the store as they are loaded, and saving a paper adds the
+ * files its diagrams point to. A paper file only notes where its blobs lie
+ * (insertRange()); each is read and checked against its hash the first time
+ * data() or format() asks for it. Blobs never change, so anything derived
+ * from one may be cached under its reference for good.
+ *
+ * Open papers retain() their blobs and release() them when closed; prune()
+ * then drops every blob no paper retains. All members are thread-safe.
+ */
+class AssetStore
+{
+public:
+    /**
+     * Bytes in a blob hash (SHA-256).
+     */
+    static constexpr int HASH_SIZE = 32;
+
+    AssetStore() = default;
+
+    /**
+     * @brief The store shared by loaders, the editor and all outputs.
+     */
+    static AssetStore &shared();
+
+    /**
+     * @brief Whether @p path is a blob reference rather than a file path.
+     */
+    static bool isReference(QStringView path);
+
+    /**
+     * @brief The reference for a blob with the given raw hash.
+     */
+    static QString reference(const QByteArray &hash);
+
+    /**
+     * @brief The raw hash named by @p reference, or an empty array if it is
+     * not a well-formed reference.
+     */
+    static QByteArray hash(QStringView reference);
+
+    /**
+     * @brief Stores @p data unless an equal blob is already held.
+     * @return The blob's reference
+     */
+    QString add(const QByteArray &data);
+
+    /**
+     * @brief Stores @p data, read from a paper, under @p reference.
+     * @return false, storing nothing, if the data does not hash to
+     * @p reference
+     */
+    bool insert(const QString &reference, const QByteArray &data);
+
+    /**
+     * @brief Notes that the blob @p reference is the @p size bytes at
+     * @p offset in the file at @p path, without reading them.
+     *
+     * The bytes are read and checked against the hash on first use. A blob
+     * that is held but still unread is pointed at the new range, since the
+     * newest file is the likeliest to still be there.
+     */
+    void insertRange(const QString &reference, const QString &path,
+                     qint64 offset, qint64 size);
+
+    /**
+     * @brief Stores the contents of the file at @p path.
+     *
+     * The reference is remembered per path, size and modification time, so
+     * saving a paper again does not read and hash its diagrams again.
+     * @return The blob's reference, or an empty string if the file cannot be
+     * read
+     */
+    QString addFile(const QString &path);
+
+    /**
+     * @brief Whether the blob is held. A blob not read yet counts until
+     * reading it fails.
+     */
+    bool contains(const QString &reference) const;
+
+    /**
+     * @brief The blob's bytes, read on first use, or an empty array if it is
+     * not held or its bytes do not match its hash.
+     */
+    QByteArray data(const QString &reference) const;
+
+    /**
+     * @brief Image format of the blob as QImageReader names it, e.g. "png",
+     * "jpeg" or "svg"; empty if unknown.
+     */
+    QByteArray format(const QString &reference) const;
+
+    /**
+     * @brief Number of blobs held.
+     */
+    int size() const;
+
+    /**
+     * @brief Bytes held in memory; blobs not read yet count nothing.
+     */
+    qsizetype bytes() const;
+
+    /**
+     * @brief Marks the blobs as used by one more open paper.
+     */
+    void retain(const QStringList &references);
+
+    /**
+     * @brief Undoes retain(); the blobs stay until prune().
+     */
+    void release(const QStringList &references);
+
+    /**
+     * @brief Drops the blobs that no paper retains.
+     *
+     * Call once nothing still renders or saves a paper that was closed.
+     * @return Number of blobs dropped
+     */
+    int prune();
+
+    /**
+     * @brief Drops every blob; data already handed out stays valid.
+     */
+    void clear();
+
+private:
+    struct Blob
+    {
+        QByteArray data;
+        QByteArray format;
+        // File range an unread blob is read from; empty once read
+        QString sourcePath;
+        qint64 sourceOffset = 0;
+        qint64 sourceSize = 0;
+        int users = 0; // Open papers that retain the blob
+    };
+
+    struct FileEntry
+    {
+        qint64 size = 0;
+        qint64 modified = 0;
+        QString reference;
+    };
+
+    mutable QReadWriteLock m_lock;
+    mutable QHash<QString, Blob> m_blobs; // By reference; read on first use
+    QHash<QString, FileEntry> m_files;    // By path, for addFile()
+    mutable qsizetype m_bytes = 0;
+
+    void store(const QString &reference, const QByteArray &data);
+    Blob blob(const QString &reference) const;
+};
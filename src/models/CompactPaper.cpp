@@ -0,0 +1,262 @@
+#include "CompactPaper.h"
+#include "PaperHtml.h"
+#include "PaperModel.h"
+#include <QByteArray>
+#include <QIODevice>
+
+/**
+ * @file CompactPaper.cpp
+ * @brief Implementation of the CompactPaper class.
+ */
+
+namespace {
+constexpr int ESTIMATED_HEADER_SIZE = 4096;
+constexpr int ESTIMATED_QUESTION_SIZE = 512;
+// Buffered markup is handed to the sink once it grows past this many
+// UTF-16 code units.
+constexpr int STREAM_FLUSH_SIZE = 64 * 1024;
+} // namespace
+
+CompactPaper::CompactPaper(const PaperModel &model) : exam(model.exam) {
+  reserve(model.sections.size(), model.getTotalQuestions());
+  for (const Section &section : model.sections) {
+    appendSection(section);
+  }
+}
+
+void CompactPaper::reserve(int sections, int questions) {
+  m_sections.reserve(sections);
+  m_questions.reserve(questions);
+}
+
+void CompactPaper::appendSection(const Section &section) {
+  SectionRecord sectionRecord;
+  sectionRecord.label = m_strings.store(section.label);
+  sectionRecord.subtitle = m_strings.store(section.subtitle);
+  sectionRecord.firstQuestion = m_questions.size();
+  sectionRecord.questionCount = section.questions.size();
+  m_sections.append(sectionRecord);
+
+  for (const Question &question : section.questions) {
+    QuestionRecord record;
+    record.type = question.type();
+    record.text = m_strings.store(question.text);
+    record.diagramPath = m_strings.store(question.diagramPath);
+
+    // Payload
+    const QVector<QString> *options = nullptr;
+    if (const OrPayload *orPayload = question.as<OrPayload>()) {
+      record.alternative = m_strings.store(orPayload->alternative);
+    } else if (const McqPayload *mcq = question.as<McqPayload>()) {
+      options = &mcq->options;
+      record.correctIndex = mcq->correctIndex;
+    } else if (const MixedPayload *mixed = question.as<MixedPayload>()) {
+      options = &mixed->options;
+    }
+    if (options) {
+      record.firstOption = m_options.size();
+      record.optionCount = options->size();
+      for (const QString &option : *options) {
+        m_options.append(storeShared(option));
+      }
+    }
+
+    // Table, flattened row by row; empty and short rows stay as they are
+    record.firstRow = m_rows.size();
+    record.tableRows = question.table.size();
+    for (const QVector<QString> &row : question.table) {
+      m_rows.append(RowRecord{static_cast<int>(m_cells.size()),
+                              static_cast<int>(row.size())});
+      for (const QString &cell : row) {
+        m_cells.append(storeShared(cell));
+      }
+    }
+
+    m_questions.append(record);
+  }
+}
+
+void CompactPaper::clear() {
+  exam = Exam();
+  m_sections.clear();
+  m_questions.clear();
+  m_options.clear();
+  m_rows.clear();
+  m_cells.clear();
+  m_shared.clear();
+  m_strings.clear();
+}
+
+QStringView CompactPaper::storeShared(QStringView text) {
+  if (text.isEmpty()) {
+    return QStringView();
+  }
+  const auto it = m_shared.constFind(text);
+  if (it != m_shared.constEnd()) {
+    return it.value();
+  }
+  const QStringView stored = m_strings.store(text);
+  m_shared.insert(stored, stored);
+  return stored;
+}
+
+Question CompactPaper::toQuestion(int index) const {
+  const QuestionRecord &record = m_questions[index];
+  Question question;
+  question.text = record.text.toString();
+  question.diagramPath = record.diagramPath.toString();
+  question.setType(record.type);
+
+  QVector<QString> options;
+  options.reserve(record.optionCount);
+  for (int i = 0; i < record.optionCount; ++i) {
+    options.append(option(record, i).toString());
+  }
+  if (OrPayload *orPayload = question.as<OrPayload>()) {
+    orPayload->alternative = record.alternative.toString();
+  } else if (McqPayload *mcq = question.as<McqPayload>()) {
+    mcq->options = options;
+    mcq->correctIndex = record.correctIndex;
+  } else if (MixedPayload *mixed = question.as<MixedPayload>()) {
+    mixed->options = options;
+  }
+
+  question.table.reserve(record.tableRows);
+  for (int row = 0; row < record.tableRows; ++row) {
+    QVector<QString> cells;
+    cells.reserve(cellCount(record, row));
+    for (int column = 0; column < cellCount(record, row); ++column) {
+      cells.append(cell(record, row, column).toString());
+    }
+    question.table.append(cells);
+  }
+  return question;
+}
+
+PaperModel CompactPaper::toModel() const {
+  PaperModel model;
+  model.exam = exam;
+  model.sections.reserve(m_sections.size());
+  for (const SectionRecord &record : m_sections) {
+    Section section;
+    section.label = record.label.toString();
+    section.subtitle = record.subtitle.toString();
+    section.questions.reserve(record.questionCount);
+    for (int i = 0; i < record.questionCount; ++i) {
+      section.questions.append(toQuestion(record.firstQuestion + i));
+    }
+    model.sections.append(section);
+  }
+  return model;
+}
+
+QString CompactPaper::toHtml(const QString &fontFamily, int fontSize,
+                             bool portrait) const {
+  QString html;
+  html.reserve(ESTIMATED_HEADER_SIZE +
+               questionCount() * ESTIMATED_QUESTION_SIZE);
+  renderDocument(RenderStyle{fontFamily, fontSize, portrait},
+                 [&html](const QString &chunk) {
+                   html += chunk;
+                   return true;
+                 });
+  return html;
+}
+
+bool CompactPaper::render(QIODevice &device, const QString &fontFamily,
+                          int fontSize, bool portrait) const {
+  return render(device, RenderStyle{fontFamily, fontSize, portrait});
+}
+
+bool CompactPaper::render(QIODevice &device, const RenderStyle &style,
+                          const SectionCallback &sectionRendered) const {
+  if (!device.isWritable()) {
+    return false;
+  }
+  return renderDocument(
+      style,
+      [&device](const QString &chunk) {
+        const QByteArray utf8 = chunk.toUtf8();
+        return device.write(utf8) == utf8.size();
+      },
+      sectionRendered);
+}
+
+template <typename Sink>
+bool CompactPaper::renderDocument(const RenderStyle &style, Sink &&sink,
+                                  const SectionCallback &sectionRendered) const {
+  if (!sink(PaperHtml::header(style)) ||
+      !sink(PaperHtml::titleBlock(exam))) {
+    return false;
+  }
+
+  // One pass over the records; markup is buffered and flushed in large
+  // chunks instead of one fragment per question.
+  QString buffer;
+  buffer.reserve(STREAM_FLUSH_SIZE + ESTIMATED_QUESTION_SIZE);
+  for (int s = 0; s < m_sections.size(); ++s) {
+    const SectionRecord &section = m_sections[s];
+    buffer += PaperHtml::sectionOpening(section.label, section.subtitle);
+
+    // Numbering restarts in every section
+    for (int i = 0; i < section.questionCount; ++i) {
+      appendQuestionHtml(buffer, m_questions[section.firstQuestion + i], i + 1,
+                         style.inlineDiagrams);
+      if (buffer.size() >= STREAM_FLUSH_SIZE) {
+        if (!sink(buffer)) {
+          return false;
+        }
+        buffer.clear();
+      }
+    }
+
+    buffer += QLatin1String("</div>");
+    if (sectionRendered && !sectionRendered(s + 1)) {
+      return false;
+    }
+  }
+
+  buffer += QLatin1String("</body></html>");
+  return sink(buffer);
+}
+
+void CompactPaper::appendQuestionHtml(QString &out,
+                                      const QuestionRecord &question,
+                                      int questionNumber,
+                                      bool inlineDiagram) const {
+  PaperHtml::appendQuestionOpening(out, questionNumber, question.text,
+                                   question.diagramPath, inlineDiagram);
+
+  // Render table if present (floated right)
+  if (question.tableRows > 0) {
+    PaperHtml::appendTableOpening(out);
+    for (int row = 0; row < question.tableRows; ++row) {
+      const RowRecord &cells = m_rows[question.firstRow + row];
+      PaperHtml::appendTableRow(
+          out, row == 0,
+          CellRange{m_cells.constData() + cells.firstCell, cells.cellCount});
+    }
+    PaperHtml::appendTableEnd(out);
+  }
+
+  PaperHtml::appendQuestionBodyEnd(out);
+
+  // Type-specific answer parts
+  const OptionRange options{m_options.constData() + question.firstOption,
+                            question.optionCount};
+  switch (question.type) {
+  case QuestionType::Regular:
+    break;
+  case QuestionType::Or:
+    PaperHtml::appendOrAlternative(out, question.alternative);
+    break;
+  case QuestionType::Mcq:
+    PaperHtml::appendMcqOptions(out, options);
+    break;
+  case QuestionType::Mixed:
+    PaperHtml::appendMixedOptions(out, options);
+    break;
+  }
+
+  PaperHtml::appendQuestionEnd(out);
+}
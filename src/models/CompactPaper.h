@@ -0,0 +1,235 @@
+#pragma once
+
+#include <QHash>
+#include <QString>
+#include <QStringView>
+#include <QVector>
+#include "Exam.h"
+#include "PaperModel.h"
+#include "Question.h"
+#include "RenderStyle.h"
+#include "Section.h"
+#include "StringArena.h"
+
+class QIODevice;
+
+/**
+ * @file CompactPaper.h
+ * @brief Defines the CompactPaper class, flat storage for very large papers.
+ */
+
+/**
+ * @class CompactPaper
+ * @brief Read-mostly paper storage built from contiguous records.
+ *
+ * Sections and questions are fixed-size records in two arrays, MCQ/Mixed
+ * options and table cells are views in flat arrays (tables row by row, each
+ * row keeping its own cell count), and
+ * all string data lives in one StringArena. Building, iterating and rendering
+ * are linear scans; the whole paper is released in a handful of frees.
+ *
+ * Options and table cells are interned within the paper, so a repeated
+ * "None of these" or table header is stored once.
+ *
+ * Tables keep their exact shape, empty and ragged rows included, so the
+ * paper renders byte-identically to PaperModel::toHtml() and toModel()
+ * gives back the same paper. The class is move-only, because
+ * its records point into its own arena. HtmlExporter renders very large
+ * papers through it.
+ */
+class CompactPaper
+{
+public:
+    /**
+     * SectionRecord: A section and the range of its questions.
+     */
+    struct SectionRecord
+    {
+        QStringView label;
+        QStringView subtitle;
+        int firstQuestion = 0;
+        int questionCount = 0;
+    };
+
+    /**
+     * QuestionRecord: One question; options and cells are ranges into the
+     * shared flat arrays.
+     */
+    struct QuestionRecord
+    {
+        QStringView text;
+        QStringView diagramPath;
+        QStringView alternative; // OR questions
+        int firstOption = 0;
+        int optionCount = 0;
+        int correctIndex = -1; // MCQ
+        int firstRow = 0;
+        int tableRows = 0;
+        QuestionType type = QuestionType::Regular;
+    };
+
+    CompactPaper() = default;
+
+    /**
+     * @brief Copies a paper into compact storage.
+     * @param model The paper to copy
+     */
+    explicit CompactPaper(const PaperModel &model);
+
+    CompactPaper(const CompactPaper &) = delete;
+    CompactPaper &operator=(const CompactPaper &) = delete;
+    CompactPaper(CompactPaper &&) = default;
+    CompactPaper &operator=(CompactPaper &&) = default;
+
+    /**
+     * @brief Exam metadata including title, subject, duration, and marks.
+     */
+    Exam exam;
+
+    /**
+     * @brief Appends a section and its questions.
+     * @param section The section to copy
+     */
+    void appendSection(const Section &section);
+
+    /**
+     * @brief Reserves record space ahead of a bulk load.
+     * @param sections Expected number of sections
+     * @param questions Expected total number of questions
+     */
+    void reserve(int sections, int questions);
+
+    /**
+     * @brief Removes all sections and releases the string arena.
+     */
+    void clear();
+
+    int sectionCount() const { return m_sections.size(); }
+    const SectionRecord &section(int index) const { return m_sections[index]; }
+
+    int questionCount() const { return m_questions.size(); }
+    const QuestionRecord &question(int index) const { return m_questions[index]; }
+
+    /**
+     * @brief Option @p index of an MCQ or Mixed question.
+     */
+    QStringView option(const QuestionRecord &question, int index) const
+    {
+        return m_options[question.firstOption + index];
+    }
+
+    /**
+     * @brief Number of cells in a table row of a question.
+     */
+    int cellCount(const QuestionRecord &question, int row) const
+    {
+        return m_rows[question.firstRow + row].cellCount;
+    }
+
+    /**
+     * @brief Table cell of a question.
+     */
+    QStringView cell(const QuestionRecord &question, int row, int column) const
+    {
+        return m_cells[m_rows[question.firstRow + row].firstCell + column];
+    }
+
+    /**
+     * @brief Expands a record back into a Question.
+     * @param index Question index across all sections
+     * @return The question with its payload restored
+     */
+    Question toQuestion(int index) const;
+
+    /**
+     * @brief Expands the paper back into a PaperModel.
+     * @return A model with the same exam and sections
+     */
+    PaperModel toModel() const;
+
+    /**
+     * @brief Renders the paper to an HTML string.
+     *
+     * Same document as PaperModel::toHtml(), rendered straight from the
+     * records without the per-question fragment cache.
+     */
+    QString toHtml(const QString &fontFamily = "Times New Roman", int fontSize = 12, bool portrait = true) const;
+
+    /**
+     * @brief Streams the paper as UTF-8 HTML to a device.
+     * @param device Output device, already open for writing
+     * @return true if everything was written successfully
+     */
+    bool render(QIODevice &device, const QString &fontFamily = "Times New Roman", int fontSize = 12, bool portrait = true) const;
+
+    /**
+     * @brief Streams the paper in a full render style.
+     *
+     * Same as render() above; the style can also inline diagrams, and
+     * @p sectionRendered works as in PaperModel::render().
+     */
+    bool render(QIODevice &device, const RenderStyle &style, const SectionCallback &sectionRendered = SectionCallback()) const;
+
+    /**
+     * @brief Bytes held by the string arena.
+     */
+    qsizetype stringBytes() const { return m_strings.bytesAllocated(); }
+
+private:
+    /**
+     * Options of one question, indexable like a QVector<QString>.
+     */
+    struct OptionRange
+    {
+        const QStringView *first;
+        int count;
+
+        int size() const { return count; }
+        QStringView operator[](int index) const { return first[index]; }
+    };
+
+    /**
+     * One table row, iterable like a QVector<QString>.
+     */
+    struct CellRange
+    {
+        const QStringView *first;
+        int count;
+
+        const QStringView *begin() const { return first; }
+        const QStringView *end() const { return first + count; }
+    };
+
+    /**
+     * A table row: a range of m_cells.
+     */
+    struct RowRecord
+    {
+        int firstCell = 0;
+        int cellCount = 0;
+    };
+
+    StringArena m_strings;
+    QVector<SectionRecord> m_sections;
+    QVector<QuestionRecord> m_questions;
+    QVector<QStringView> m_options;
+    QVector<RowRecord> m_rows;
+    QVector<QStringView> m_cells;
+    QHash<QStringView, QStringView> m_shared; // Interned options and cells
+
+    /**
+     * @brief Stores option or cell text once per distinct value.
+     */
+    QStringView storeShared(QStringView text);
+
+    /**
+     * @brief Renders the whole document, passing each fragment to a sink.
+     */
+    template <typename Sink>
+    bool renderDocument(const RenderStyle &style, Sink &&sink, const SectionCallback &sectionRendered = SectionCallback()) const;
+
+    /**
+     * @brief Appends the HTML of one question.
+     */
+    void appendQuestionHtml(QString &out, const QuestionRecord &question, int questionNumber, bool inlineDiagram) const;
+};
@@ -17,4 +17,13 @@ public:
   QDate examDate;
   QString term;
   bool isLandscape = false;
+
+  bool operator==(const Exam &other) const {
+    return title == other.title && subject == other.subject &&
+           duration == other.duration && totalMarks == other.totalMarks &&
+           passMarks == other.passMarks && className == other.className &&
+           examDate == other.examDate && term == other.term &&
+           isLandscape == other.isLandscape;
+  }
+  bool operator!=(const Exam &other) const { return !(*this == other); }
 };
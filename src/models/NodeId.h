@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QtGlobal>
+#include <atomic>
+
+/**
+ * @file NodeId.h
+ * @brief Stable identities for sections and questions.
+ */
+
+/**
+ * NodeId: Identifies a section or question for its whole lifetime, across
+ * edits, moves and model snapshots. 0 means "not assigned yet".
+ */
+using NodeId = quint64;
+
+/**
+ * @brief Returns a new process-wide unique, non-zero ID. Thread-safe.
+ */
+inline NodeId newNodeId()
+{
+    static std::atomic<NodeId> lastId{0};
+    return ++lastId;
+}
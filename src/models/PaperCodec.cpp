@@ -0,0 +1,107 @@
+#include "PaperCodec.h"
+#include "StringPool.h"
+
+/**
+ * @file PaperCodec.cpp
+ * @brief Implementation of the binary paper encoding.
+ */
+
+namespace PaperCodec {
+void writeExam(BlockWriter &out, const Exam &exam) {
+  out.string(exam.title);
+  out.string(exam.subject);
+  out.string(exam.duration);
+  out.integer<qint32>(exam.totalMarks);
+  out.integer<qint32>(exam.passMarks);
+  out.string(exam.className);
+  // Invalid dates have their own day number and round-trip as such
+  out.integer<qint64>(exam.examDate.toJulianDay());
+  out.string(exam.term);
+  out.integer<quint8>(exam.isLandscape);
+}
+
+Exam readExam(BlockReader &in) {
+  Exam exam;
+  exam.title = in.string();
+  exam.subject = in.string();
+  exam.duration = in.string();
+  exam.totalMarks = in.integer<qint32>();
+  exam.passMarks = in.integer<qint32>();
+  exam.className = in.string();
+  exam.examDate = QDate::fromJulianDay(in.integer<qint64>());
+  exam.term = in.string();
+  exam.isLandscape = in.integer<quint8>() != 0;
+  return exam;
+}
+
+void writeQuestion(BlockWriter &out, const Question &question) {
+  out.integer<quint8>(static_cast<quint8>(question.type()));
+  out.string(question.text);
+  out.string(question.diagramPath);
+  out.integer<quint32>(question.table.size());
+  for (const QVector<QString> &row : question.table) {
+    out.strings(row);
+  }
+
+  if (const auto *payload = question.as<OrPayload>()) {
+    out.string(payload->alternative);
+  } else if (const auto *payload = question.as<McqPayload>()) {
+    out.integer<qint32>(payload->correctIndex);
+    out.strings(payload->options);
+  } else if (const auto *payload = question.as<MixedPayload>()) {
+    out.strings(payload->options);
+  }
+}
+
+bool readQuestion(BlockReader &in, Question &question) {
+  const quint8 type = in.integer<quint8>();
+  if (type > static_cast<quint8>(QuestionType::Mixed)) {
+    return false;
+  }
+  question.setType(static_cast<QuestionType>(type));
+  question.text = in.string();
+  question.diagramPath = in.string();
+  question.table.resize(in.count(MIN_STRING_SIZE));
+  for (QVector<QString> &row : question.table) {
+    in.strings(row);
+  }
+
+  if (auto *payload = question.as<OrPayload>()) {
+    payload->alternative = in.string();
+  } else if (auto *payload = question.as<McqPayload>()) {
+    payload->correctIndex = in.integer<qint32>();
+    in.strings(payload->options);
+  } else if (auto *payload = question.as<MixedPayload>()) {
+    in.strings(payload->options);
+  }
+
+  question.id = newNodeId();
+  StringPool::shared().internQuestion(question);
+  return in.ok();
+}
+
+void writeSection(BlockWriter &out, const Section &section) {
+  out.string(section.label);
+  out.string(section.subtitle);
+  out.integer<quint32>(section.questions.size());
+  for (const Question &question : section.questions) {
+    writeQuestion(out, question);
+  }
+}
+
+bool readSection(BlockReader &in, Section &section) {
+  section.label = in.string();
+  section.subtitle = in.string();
+  section.questions.resize(in.count(MIN_QUESTION_SIZE));
+  if (!in.ok()) {
+    return false;
+  }
+  for (Question &question : section.questions) {
+    if (!readQuestion(in, question)) {
+      return false;
+    }
+  }
+  section.id = newNodeId();
+  return true;
+}
+} // namespace PaperCodec
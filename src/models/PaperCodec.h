@@ -0,0 +1,168 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <QtEndian>
+#include "Exam.h"
+#include "Section.h"
+
+/**
+ * @file PaperCodec.h
+ * @brief Binary encoding of exams, sections and questions.
+ *
+ * Shared by the .epf container (PaperFile) and the edit journal
+ * (PaperJournal). Integers are little-endian and strings are a u32 byte
+ * length followed by UTF-8. A question is its type (u8), text, diagram path,
+ * the table as u32 row count and per row a u32 cell count and the cells,
+ * then the payload: OR the alternative, MCQ the correct index (i32) and
+ * options, Mixed the options; option lists are a u32 count and the strings.
+ * A section is its label, subtitle, u32 question count and the questions.
+ */
+namespace PaperCodec {
+    // Smallest encodings, used to reject counts a block cannot hold before
+    // allocating for them
+    constexpr int MIN_STRING_SIZE = 4;
+    constexpr int MIN_QUESTION_SIZE = 1 + 3 * 4;
+
+    /**
+     * BlockWriter: Appends integers and length-prefixed strings to a block.
+     */
+    class BlockWriter
+    {
+    public:
+        explicit BlockWriter(QByteArray &out) : m_out(out) {}
+
+        template <typename T>
+        void integer(T value)
+        {
+            char bytes[sizeof(T)];
+            qToLittleEndian(value, bytes);
+            m_out.append(bytes, sizeof(T));
+        }
+
+        void string(const QString &text)
+        {
+            const QByteArray utf8 = text.toUtf8();
+            integer<quint32>(utf8.size());
+            m_out += utf8;
+        }
+
+        void strings(const QVector<QString> &list)
+        {
+            integer<quint32>(list.size());
+            for (const QString &text : list) {
+                string(text);
+            }
+        }
+
+        void bytes(const QByteArray &data) { m_out += data; }
+
+    private:
+        QByteArray &m_out;
+    };
+
+    /**
+     * BlockReader: Reads a block written by BlockWriter. Reading past the end
+     * of the block clears ok() and returns empty values from then on.
+     */
+    class BlockReader
+    {
+    public:
+        BlockReader(const uchar *data, quint64 size) : m_pos(data), m_end(data + size) {}
+
+        bool ok() const { return m_ok; }
+        bool atEnd() const { return m_pos == m_end; }
+        const uchar *position() const { return m_pos; }
+
+        template <typename T>
+        T integer()
+        {
+            if (!need(sizeof(T))) {
+                return T(0);
+            }
+            const T value = qFromLittleEndian<T>(m_pos);
+            m_pos += sizeof(T);
+            return value;
+        }
+
+        QString string()
+        {
+            const quint32 length = integer<quint32>();
+            if (!need(length)) {
+                return QString();
+            }
+            const QString text = QString::fromUtf8(reinterpret_cast<const char *>(m_pos), length);
+            m_pos += length;
+            return text;
+        }
+
+        /**
+         * @p size raw bytes, as written by BlockWriter::bytes().
+         */
+        QByteArray bytes(quint32 size)
+        {
+            if (!need(size)) {
+                return QByteArray();
+            }
+            const QByteArray data(reinterpret_cast<const char *>(m_pos), size);
+            m_pos += size;
+            return data;
+        }
+
+        /**
+         * A u32 element count, rejected if that many elements of at least
+         * @p minSize bytes cannot fit in the rest of the block.
+         */
+        int count(int minSize)
+        {
+            const quint32 value = integer<quint32>();
+            if (!m_ok || value > quint64(m_end - m_pos) / minSize) {
+                m_ok = false;
+                return 0;
+            }
+            return int(value);
+        }
+
+        void strings(QVector<QString> &list)
+        {
+            const int size = count(MIN_STRING_SIZE);
+            list.resize(size);
+            for (QString &text : list) {
+                text = string();
+            }
+        }
+
+    private:
+        const uchar *m_pos;
+        const uchar *m_end;
+        bool m_ok = true;
+
+        bool need(quint64 size)
+        {
+            if (!m_ok || size > quint64(m_end - m_pos)) {
+                m_ok = false;
+            }
+            return m_ok;
+        }
+    };
+
+    void writeExam(BlockWriter &out, const Exam &exam);
+    Exam readExam(BlockReader &in);
+
+    void writeQuestion(BlockWriter &out, const Question &question);
+
+    /**
+     * Reads a question, giving it a new ID and interning its strings in
+     * StringPool::shared(). Returns false if the data is invalid.
+     */
+    bool readQuestion(BlockReader &in, Question &question);
+
+    void writeSection(BlockWriter &out, const Section &section);
+
+    /**
+     * Reads a section and its questions, assigning new IDs. Returns false if
+     * the data is invalid.
+     */
+    bool readSection(BlockReader &in, Section &section);
+}
@@ -0,0 +1,400 @@
+#include "PaperFile.h"
+#include "AssetStore.h"
+#include "PaperCodec.h"
+#include "PaperModel.h"
+#include <QFileInfo>
+#include <QIODevice>
+#include <QObject>
+#include <QSet>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+
+/**
+ * @file PaperFile.cpp
+ * @brief Implementation of the PaperFile class.
+ *
+ * Layout, all integers little-endian:
+ *
+ *   Header (32 bytes)
+ *     0  signature  "\x89" "EPF\r\n\x1A\n"
+ *     8  u16        format version
+ *     10 u16        flags, 0
+ *     12 u32        section count
+ *     16 u64        exam block offset
+ *     24 u32        exam block size
+ *     28 u32        asset count (reserved, 0, in version 1)
+ *   Section table, one 16-byte entry per section
+ *     u64 block offset, u32 block size, u32 question count
+ *   Asset table, one 48-byte entry per asset
+ *     32-byte SHA-256, u64 blob offset, u32 blob size, u32 reserved
+ *   Exam block, the section blocks, then the asset blobs
+ *
+ * The blocks are encoded as described in PaperCodec.h. Assets are the
+ * diagram files, each stored once; questions name them with AssetStore
+ * references.
+ */
+
+using namespace PaperCodec;
+
+namespace {
+constexpr char SIGNATURE[8] = {'\x89', 'E', 'P', 'F', '\r', '\n', '\x1A', '\n'};
+constexpr int HEADER_SIZE = 32;
+constexpr int TABLE_ENTRY_SIZE = 16;
+constexpr int ASSET_ENTRY_SIZE = AssetStore::HASH_SIZE + 16;
+constexpr quint64 MAX_BLOCK_SIZE = std::numeric_limits<quint32>::max();
+
+// Diagram paths are written as the references they were packaged under
+QByteArray encodeSection(const Section &section,
+                         const QHash<QString, QString> &references) {
+  QByteArray block;
+  BlockWriter out(block);
+  const auto packaged = [&references](const Question &question) {
+    return references.value(question.diagramPath, question.diagramPath) !=
+           question.diagramPath;
+  };
+  if (std::none_of(section.questions.cbegin(), section.questions.cend(),
+                   packaged)) {
+    writeSection(out, section);
+    return block;
+  }
+  Section copy = section;
+  for (Question &question : copy.questions) {
+    question.diagramPath =
+        references.value(question.diagramPath, question.diagramPath);
+  }
+  writeSection(out, copy);
+  return block;
+}
+} // namespace
+
+PaperFile::~PaperFile() { close(); }
+
+bool PaperFile::isPaperFile(const QString &path) {
+  QFile file(path);
+  char signature[sizeof(SIGNATURE)];
+  return file.open(QIODevice::ReadOnly) &&
+         file.read(signature, sizeof(signature)) == sizeof(signature) &&
+         std::memcmp(signature, SIGNATURE, sizeof(signature)) == 0;
+}
+
+bool PaperFile::fail(const QString &reason) {
+  close();
+  m_errorString = reason;
+  return false;
+}
+
+bool PaperFile::open(const QString &path) {
+  close();
+  m_errorString.clear();
+
+  m_file.setFileName(path);
+  if (!m_file.open(QIODevice::ReadOnly)) {
+    return fail(m_file.errorString());
+  }
+  m_size = m_file.size();
+  m_data = m_size > 0 ? m_file.map(0, m_size) : nullptr;
+  if (!m_data) {
+    m_buffer = m_file.readAll();
+    if (m_buffer.size() != m_size) {
+      return fail(m_file.errorString());
+    }
+    m_data = reinterpret_cast<const uchar *>(m_buffer.constData());
+  }
+
+  const QString corrupt = QObject::tr("The paper file is damaged.");
+  if (m_size < HEADER_SIZE ||
+      std::memcmp(m_data, SIGNATURE, sizeof(SIGNATURE)) != 0) {
+    return fail(QObject::tr("Not an exam paper file."));
+  }
+  BlockReader header(m_data + sizeof(SIGNATURE),
+                     HEADER_SIZE - sizeof(SIGNATURE));
+  m_version = header.integer<quint16>();
+  header.integer<quint16>(); // Flags
+  const quint32 sectionCount = header.integer<quint32>();
+  const quint64 examOffset = header.integer<quint64>();
+  const quint32 examSize = header.integer<quint32>();
+  const quint32 assetCount = header.integer<quint32>();
+  if (m_version == 0 || m_version > FORMAT_VERSION) {
+    return fail(QObject::tr("The paper was saved by a newer version of the "
+                            "application (format %1).")
+                    .arg(m_version));
+  }
+
+  // Offsets are checked against the size before being added, so a corrupt
+  // table cannot overflow them
+  const quint64 size = quint64(m_size);
+  const auto fits = [size](quint64 offset, quint64 length) {
+    return offset <= size && length <= size - offset;
+  };
+  const quint64 tableSize = quint64(sectionCount) * TABLE_ENTRY_SIZE;
+  const quint64 assetTableSize = quint64(assetCount) * ASSET_ENTRY_SIZE;
+  if (!fits(HEADER_SIZE, tableSize) ||
+      !fits(HEADER_SIZE + tableSize, assetTableSize) ||
+      !fits(examOffset, examSize)) {
+    return fail(corrupt);
+  }
+
+  BlockReader table(m_data + HEADER_SIZE, tableSize);
+  m_table.resize(sectionCount);
+  for (TableEntry &entry : m_table) {
+    entry.offset = table.integer<quint64>();
+    entry.size = table.integer<quint32>();
+    const quint32 questionCount = table.integer<quint32>();
+    if (!fits(entry.offset, entry.size) ||
+        questionCount > entry.size / MIN_QUESTION_SIZE) {
+      return fail(corrupt);
+    }
+    entry.questionCount = int(questionCount);
+  }
+
+  BlockReader exam(m_data + examOffset, examSize);
+  m_exam = readExam(exam);
+  if (!exam.ok() || !exam.atEnd()) {
+    return fail(corrupt);
+  }
+
+  // The shared store only learns where the blobs are; each is read and
+  // hashed the first time a diagram needs it. The paper retains them until
+  // it is closed.
+  AssetStore &store = AssetStore::shared();
+  const QString source = QFileInfo(path).absoluteFilePath();
+  const uchar *assetTable = m_data + HEADER_SIZE + tableSize;
+  QVector<QString> assets(assetCount);
+  for (QString &reference : assets) {
+    const QByteArray hash(reinterpret_cast<const char *>(assetTable),
+                          AssetStore::HASH_SIZE);
+    BlockReader entry(assetTable + AssetStore::HASH_SIZE,
+                      ASSET_ENTRY_SIZE - AssetStore::HASH_SIZE);
+    const quint64 offset = entry.integer<quint64>();
+    const quint32 blobSize = entry.integer<quint32>();
+    assetTable += ASSET_ENTRY_SIZE;
+    if (!fits(offset, blobSize)) {
+      return fail(corrupt);
+    }
+    reference = AssetStore::reference(hash);
+    store.insertRange(reference, source, qint64(offset), blobSize);
+  }
+  store.retain(assets);
+  m_assets = assets;
+  return true;
+}
+
+void PaperFile::close() {
+  {
+    QMutexLocker locker(&m_mutex);
+    m_decoded.clear();
+  }
+  m_file.close();
+  m_buffer.clear();
+  m_data = nullptr;
+  m_size = 0;
+  m_version = 0;
+  m_exam = Exam();
+  m_table.clear();
+  if (!m_assets.isEmpty()) {
+    AssetStore::shared().release(m_assets);
+    m_assets.clear();
+  }
+}
+
+Section PaperFile::section(int index, bool *ok) const {
+  {
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_decoded.constFind(index);
+    if (it != m_decoded.constEnd()) {
+      if (ok) {
+        *ok = true;
+      }
+      return it.value();
+    }
+  }
+
+  // Decoded outside the lock, so sections decode in parallel. If two
+  // threads race for the same one, the first result is kept and both get it.
+  Section section;
+  const bool decoded = decodeSection(index, section);
+  if (ok) {
+    *ok = decoded;
+  }
+  if (!decoded) {
+    return Section();
+  }
+
+  QMutexLocker locker(&m_mutex);
+  const auto it = m_decoded.constFind(index);
+  if (it != m_decoded.constEnd()) {
+    return it.value();
+  }
+  m_decoded.insert(index, section);
+  return section;
+}
+
+bool PaperFile::isDecoded(int index) const {
+  QMutexLocker locker(&m_mutex);
+  return m_decoded.contains(index);
+}
+
+bool PaperFile::decodeSection(int index, Section &section) const {
+  const TableEntry &entry = m_table[index];
+  BlockReader in(m_data + entry.offset, entry.size);
+  // IDs are assigned once here, so every caller sees the same nodes
+  return readSection(in, section) &&
+         section.questions.size() == entry.questionCount && in.atEnd();
+}
+
+bool PaperFile::load(PaperModel &model) const {
+  const int count = sectionCount();
+  QVector<Section> sections(count);
+  Section *results = sections.data();
+  std::atomic<int> next{0};
+  std::atomic<bool> failed{false};
+
+  const auto work = [&]() {
+    for (int i = next++; i < count; i = next++) {
+      bool ok = false;
+      results[i] = section(i, &ok);
+      if (!ok) {
+        failed = true;
+      }
+    }
+  };
+
+  // Same scheme as parallel rendering: the calling thread works too and
+  // helpers only count if the pool could start them
+  QThreadPool *pool = QThreadPool::globalInstance();
+  QSemaphore finished;
+  int helpers = 0;
+  while (helpers < count - 1 && pool->tryStart([&work, &finished]() {
+    work();
+    finished.release();
+  })) {
+    ++helpers;
+  }
+  work();
+  finished.acquire(helpers);
+
+  if (failed) {
+    return false;
+  }
+  model.exam = m_exam;
+  model.setSections(sections);
+  return true;
+}
+
+bool PaperFile::write(const PaperModel &model, QIODevice &device) {
+  QByteArray exam;
+  BlockWriter examOut(exam);
+  writeExam(examOut, model.exam);
+
+  // Every diagram file is stored once, by content. Paths that cannot be
+  // read, and references to blobs no longer held, are kept as they are.
+  AssetStore &store = AssetStore::shared();
+  QHash<QString, QString> references; // Diagram path to reference
+  QVector<QString> assets;
+  QSet<QString> packaged;
+  for (const Section &section : model.sections) {
+    for (const Question &question : section.questions) {
+      const QString &path = question.diagramPath;
+      if (path.isEmpty() || references.contains(path)) {
+        continue;
+      }
+      QString reference;
+      if (!AssetStore::isReference(path)) {
+        reference = store.addFile(path);
+      } else if (!store.data(path).isEmpty()) {
+        // Read now, so a blob that fails its hash is not packaged
+        reference = path;
+      }
+      references.insert(path, reference.isEmpty() ? path : reference);
+      if (!reference.isEmpty() && !packaged.contains(reference)) {
+        packaged.insert(reference);
+        assets.append(reference);
+      }
+    }
+  }
+  QVector<QByteArray> blobs;
+  blobs.reserve(assets.size());
+  for (const QString &reference : assets) {
+    blobs.append(store.data(reference));
+    if (quint64(blobs.last().size()) > MAX_BLOCK_SIZE) {
+      return false;
+    }
+  }
+
+  const int count = model.sections.size();
+  QVector<QByteArray> blocks;
+  blocks.reserve(count);
+  for (const Section &section : model.sections) {
+    blocks.append(encodeSection(section, references));
+    if (quint64(blocks.last().size()) > MAX_BLOCK_SIZE) {
+      return false;
+    }
+  }
+
+  QByteArray head;
+  BlockWriter headOut(head);
+  head.append(SIGNATURE, sizeof(SIGNATURE));
+  headOut.integer<quint16>(FORMAT_VERSION);
+  headOut.integer<quint16>(0);
+  headOut.integer<quint32>(count);
+  quint64 offset = HEADER_SIZE + quint64(count) * TABLE_ENTRY_SIZE +
+                   quint64(assets.size()) * ASSET_ENTRY_SIZE;
+  headOut.integer<quint64>(offset);
+  headOut.integer<quint32>(exam.size());
+  headOut.integer<quint32>(assets.size());
+
+  offset += exam.size();
+  for (int i = 0; i < count; ++i) {
+    headOut.integer<quint64>(offset);
+    headOut.integer<quint32>(blocks[i].size());
+    headOut.integer<quint32>(model.sections[i].questions.size());
+    offset += blocks[i].size();
+  }
+  for (int i = 0; i < assets.size(); ++i) {
+    head += AssetStore::hash(assets[i]);
+    headOut.integer<quint64>(offset);
+    headOut.integer<quint32>(blobs[i].size());
+    headOut.integer<quint32>(0);
+    offset += blobs[i].size();
+  }
+
+  if (device.write(head) != head.size() ||
+      device.write(exam) != exam.size()) {
+    return false;
+  }
+  for (const QByteArray &block : blocks) {
+    if (device.write(block) != block.size()) {
+      return false;
+    }
+  }
+  for (const QByteArray &blob : blobs) {
+    if (device.write(blob) != blob.size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PaperFile::save(const PaperModel &model, const QString &path,
+                     QString *errorString) {
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly) || !write(model, file)) {
+    if (errorString) {
+      *errorString = file.errorString();
+    }
+    file.cancelWriting();
+    return false;
+  }
+  if (!file.commit()) {
+    if (errorString) {
+      *errorString = file.errorString();
+    }
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include "Exam.h"
+#include "Section.h"
+
+class PaperModel;
+class QIODevice;
+
+/**
+ * @file PaperFile.h
+ * @brief Defines the PaperFile class, the binary .epf paper container.
+ */
+
+/**
+ * @class PaperFile
+ * @brief Reads and writes papers in the versioned binary .epf format.
+ *
+ * A file is a fixed header, a table with the offset, size and question count
+ * of every section, the exam metadata block and one block per section.
+ * Integers are little-endian and strings are UTF-8 with a 32-bit length
+ * prefix, so a block can be decoded without looking at any other.
+ *
+ * open() maps the file into memory and reads only the header, the table
+ * and the exam block; a section is decoded the first time section() asks
+ * for it and kept for later calls. Opening a paper with thousands of
+ * questions therefore costs the same as opening an empty one, and the first
+ * section can be shown before the rest has been looked at. Files that
+ * cannot be mapped are read into memory instead.
+ *
+ * Diagram files are packaged into the paper: save() stores each distinct
+ * file once, as a blob keyed by its SHA-256, and writes the questions with
+ * AssetStore references in place of the paths. open() points
+ * AssetStore::shared() at the blobs without reading them and retains them
+ * until close(), so a paper renders the same wherever it is moved.
+ *
+ * Every length and offset is checked against the file, so a truncated or
+ * corrupt file fails cleanly. Decoded strings go through
+ * StringPool::shared(). All const members are thread-safe.
+ */
+class PaperFile
+{
+public:
+    /**
+     * Format version written by save(); open() rejects newer files.
+     */
+    static constexpr quint16 FORMAT_VERSION = 2;
+
+    PaperFile() = default;
+    ~PaperFile();
+
+    PaperFile(const PaperFile &) = delete;
+    PaperFile &operator=(const PaperFile &) = delete;
+
+    /**
+     * @brief Whether @p path starts with the binary .epf signature.
+     */
+    static bool isPaperFile(const QString &path);
+
+    /**
+     * @brief Maps the file at @p path and reads its header, section table
+     * and exam metadata.
+     * @return false if the file cannot be read or is not a valid paper;
+     * errorString() says why
+     */
+    bool open(const QString &path);
+
+    /**
+     * @brief Unmaps the file, drops decoded sections and releases the
+     * paper's blobs in the shared AssetStore.
+     */
+    void close();
+
+    bool isOpen() const { return m_data != nullptr; }
+    QString errorString() const { return m_errorString; }
+
+    /**
+     * @brief Format version of the open file.
+     */
+    quint16 version() const { return m_version; }
+
+    const Exam &exam() const { return m_exam; }
+
+    int sectionCount() const { return m_table.size(); }
+
+    /**
+     * @brief Number of questions in a section, read from the table without
+     * decoding the section.
+     */
+    int questionCount(int index) const { return m_table[index].questionCount; }
+
+    /**
+     * @brief Number of distinct diagram files packaged in the paper.
+     */
+    int assetCount() const { return m_assets.size(); }
+
+    /**
+     * @brief AssetStore references of the packaged diagram files.
+     */
+    const QVector<QString> &assets() const { return m_assets; }
+
+    /**
+     * @brief The section at @p index, decoded on first use.
+     * @param ok Set to false if the section block is corrupt
+     * @return The section, or an empty one if it is corrupt
+     */
+    Section section(int index, bool *ok = nullptr) const;
+
+    /**
+     * @brief Whether section() has already decoded the section at @p index.
+     */
+    bool isDecoded(int index) const;
+
+    /**
+     * @brief Decodes every section into @p model, several at a time on the
+     * global QThreadPool.
+     * @return false if any section is corrupt; the model is then unchanged
+     */
+    bool load(PaperModel &model) const;
+
+    /**
+     * @brief Writes @p model to @p device in the binary format.
+     */
+    static bool write(const PaperModel &model, QIODevice &device);
+
+    /**
+     * @brief Writes @p model to @p path, replacing the file atomically.
+     * @param errorString Set to the reason on failure, if given
+     */
+    static bool save(const PaperModel &model, const QString &path, QString *errorString = nullptr);
+
+private:
+    struct TableEntry
+    {
+        quint64 offset = 0;
+        quint32 size = 0;
+        int questionCount = 0;
+    };
+
+    QFile m_file;
+    QByteArray m_buffer; // File contents when it could not be mapped; the
+                         // mapping itself is released by closing m_file
+    const uchar *m_data = nullptr;
+    qint64 m_size = 0;
+    quint16 m_version = 0;
+    Exam m_exam;
+    QVector<TableEntry> m_table;
+    QVector<QString> m_assets; // Retained references, in file order
+    QString m_errorString;
+
+    mutable QMutex m_mutex;
+    mutable QHash<int, Section> m_decoded;
+
+    bool fail(const QString &reason);
+    bool decodeSection(int index, Section &section) const;
+};
@@ -0,0 +1,588 @@
+#include "PaperHistory.h"
+#include "AssetStore.h"
+#include "PaperCodec.h"
+#include "PaperModel.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QObject>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+
+/**
+ * @file PaperHistory.cpp
+ * @brief Implementation of the PaperHistory class.
+ *
+ * Objects, all integers little-endian, hashes raw 32-byte SHA-256:
+ *
+ *   Question  u8 1, the question as in PaperCodec
+ *   Section   u8 2, label, subtitle, u32 question count, question hashes
+ *   Exam      u8 3, the exam as in PaperCodec
+ *   Version   u8 4, u16 format version, exam hash, u32 section count,
+ *             section hashes, u8 has parent, parent hash if any,
+ *             i64 time in ms since the epoch, message
+ *   Blob      the bytes of an embedded diagram, no kind byte; its name is
+ *             the hash in the AssetStore reference
+ */
+
+using namespace PaperCodec;
+
+namespace {
+constexpr int HASH_SIZE = 32;
+// Past this many insertions and removals, align() stops looking for the
+// shortest edit script and pairs the elements up by position
+constexpr int MAX_ALIGN_DISTANCE = 1000;
+
+const QString HEAD_FILE_NAME = QStringLiteral("HEAD");
+
+enum class ObjectKind : quint8 { Question = 1, Section, Exam, Version };
+
+QByteArray hashOf(const QByteArray &object) {
+  return QCryptographicHash::hash(object, QCryptographicHash::Sha256);
+}
+
+/**
+ * Reads the kind byte of @p object; false if it is not @p kind.
+ */
+bool expectKind(BlockReader &in, ObjectKind kind) {
+  return in.integer<quint8>() == static_cast<quint8>(kind) && in.ok();
+}
+
+void writeHashes(BlockWriter &out, const QVector<QByteArray> &hashes) {
+  out.integer<quint32>(hashes.size());
+  for (const QByteArray &hash : hashes) {
+    out.bytes(hash);
+  }
+}
+
+bool readHashes(BlockReader &in, QVector<QByteArray> &hashes) {
+  hashes.resize(in.count(HASH_SIZE));
+  for (QByteArray &hash : hashes) {
+    hash = in.bytes(HASH_SIZE);
+  }
+  return in.ok();
+}
+
+/**
+ * One step from a list of hashes to another: an element is kept, added
+ * (from is -1), removed (to is -1) or replaced by another.
+ */
+struct Edit {
+  int from = -1;
+  int to = -1;
+  bool kept = false;
+};
+
+/**
+ * Matches between the runs x and y, as pairs of indices in increasing
+ * order, from the shortest edit script by Myers' O((n + m) D) algorithm.
+ * Gives up, returning false, if more than MAX_ALIGN_DISTANCE insertions
+ * and removals are needed.
+ */
+bool shortestEditMatches(const QByteArray *x, int n, const QByteArray *y,
+                         int m, QVector<QPair<int, int>> &matches) {
+  const int max = qMin(n + m, MAX_ALIGN_DISTANCE);
+  const int offset = max + 1;
+  // v[k + offset]: furthest x reached on diagonal k = x - y
+  QVector<int> v(2 * max + 3, 0);
+  // For backtracking, v around the diagonals in reach before each step
+  QVector<QVector<int>> trace;
+  int distance = -1;
+  for (int d = 0; d <= max && distance < 0; ++d) {
+    trace.append(v.mid(offset - d - 1, 2 * d + 3));
+    for (int k = -d; k <= d; k += 2) {
+      int i = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]))
+                  ? v[offset + k + 1]
+                  : v[offset + k - 1] + 1;
+      int j = i - k;
+      while (i < n && j < m && x[i] == y[j]) {
+        ++i;
+        ++j;
+      }
+      v[offset + k] = i;
+      if (i >= n && j >= m) {
+        distance = d;
+        break;
+      }
+    }
+  }
+  if (distance < 0) {
+    return false;
+  }
+
+  int i = n;
+  int j = m;
+  for (int d = distance; d >= 0; --d) {
+    const QVector<int> &before = trace[d];
+    const auto at = [&before, d](int k) { return before[k + d + 1]; };
+    const int k = i - j;
+    const int previousK =
+        (k == -d || (k != d && at(k - 1) < at(k + 1))) ? k + 1 : k - 1;
+    const int previousI = at(previousK);
+    const int previousJ = previousI - previousK;
+    while (i > previousI && j > previousJ) {
+      --i;
+      --j;
+      matches.append(qMakePair(i, j));
+    }
+    i = previousI;
+    j = previousJ;
+  }
+  std::reverse(matches.begin(), matches.end());
+  return true;
+}
+
+/**
+ * Aligns @p a with @p b on a shortest edit script. Between two kept
+ * elements, removed and added ones are paired up as replacements. Lists
+ * that differ too much for that are compared position by position.
+ */
+QVector<Edit> align(const QVector<QByteArray> &a,
+                    const QVector<QByteArray> &b) {
+  // A shared prefix and suffix are kept as they are; usually only a short
+  // run in between needs the edit script
+  int prefix = 0;
+  while (prefix < a.size() && prefix < b.size() && a[prefix] == b[prefix]) {
+    ++prefix;
+  }
+  int suffix = 0;
+  while (suffix < a.size() - prefix && suffix < b.size() - prefix &&
+         a[a.size() - 1 - suffix] == b[b.size() - 1 - suffix]) {
+    ++suffix;
+  }
+  const int n = a.size() - prefix - suffix;
+  const int m = b.size() - prefix - suffix;
+
+  QVector<QPair<int, int>> matches; // In the middle runs
+  if (!shortestEditMatches(a.constData() + prefix, n, b.constData() + prefix,
+                           m, matches)) {
+    for (int i = 0; i < qMin(n, m); ++i) {
+      if (a[prefix + i] == b[prefix + i]) {
+        matches.append(qMakePair(i, i));
+      }
+    }
+  }
+
+  QVector<Edit> edits;
+  const auto keep = [&edits](int from, int to) {
+    edits.append(Edit{from, to, true});
+  };
+  // Unmatched runs a[from, fromEnd) and b[to, toEnd)
+  const auto replace = [&edits](int from, int fromEnd, int to, int toEnd) {
+    for (; from < fromEnd || to < toEnd; ++from, ++to) {
+      edits.append(
+          Edit{from < fromEnd ? from : -1, to < toEnd ? to : -1, false});
+    }
+  };
+
+  for (int i = 0; i < prefix; ++i) {
+    keep(i, i);
+  }
+  int runI = 0;
+  int runJ = 0;
+  for (const QPair<int, int> &match : matches) {
+    replace(prefix + runI, prefix + match.first, prefix + runJ,
+            prefix + match.second);
+    keep(prefix + match.first, prefix + match.second);
+    runI = match.first + 1;
+    runJ = match.second + 1;
+  }
+  replace(prefix + runI, prefix + n, prefix + runJ, prefix + m);
+  for (int k = 0; k < suffix; ++k) {
+    keep(prefix + n + k, prefix + m + k);
+  }
+  return edits;
+}
+} // namespace
+
+QString PaperHistory::pathFor(const QString &paperPath) {
+  return paperPath + QStringLiteral(".history");
+}
+
+bool PaperHistory::open(const QString &directory) {
+  m_directory.clear();
+  m_stored.clear();
+  m_objectsWritten = 0;
+  {
+    QMutexLocker locker(&m_mutex);
+    m_questions.clear();
+  }
+  if (!QDir().mkpath(QDir(directory).filePath(QStringLiteral("objects")))) {
+    m_errorString = QObject::tr("Cannot create %1.").arg(directory);
+    return false;
+  }
+  m_directory = directory;
+  m_errorString.clear();
+  return true;
+}
+
+QString PaperHistory::objectPath(const QByteArray &hash) const {
+  const QString hex = QString::fromLatin1(hash.toHex());
+  return QDir(m_directory).filePath(QStringLiteral("objects/%1/%2")
+                                        .arg(hex.left(2), hex.mid(2)));
+}
+
+QByteArray PaperHistory::store(const QByteArray &object) {
+  const QByteArray hash = hashOf(object);
+  if (m_stored.contains(hash)) {
+    return hash;
+  }
+  const QString path = objectPath(hash);
+  if (!QFile::exists(path)) {
+    QSaveFile file(path);
+    if (!QDir().mkpath(path.left(path.lastIndexOf('/'))) ||
+        !file.open(QIODevice::WriteOnly) ||
+        file.write(object) != object.size() || !file.commit()) {
+      m_errorString = file.errorString();
+      return QByteArray();
+    }
+    ++m_objectsWritten;
+  }
+  m_stored.insert(hash);
+  return hash;
+}
+
+bool PaperHistory::storeAsset(const QString &reference) {
+  const QByteArray hash = AssetStore::hash(reference);
+  if (hash.isEmpty() || m_stored.contains(hash)) {
+    return true;
+  }
+  if (QFile::exists(objectPath(hash))) {
+    m_stored.insert(hash);
+    return true;
+  }
+  // A blob the store no longer holds cannot be kept; its diagram was
+  // already missing from the paper
+  const QByteArray data = AssetStore::shared().data(reference);
+  return data.isEmpty() || store(data) == hash;
+}
+
+QByteArray PaperHistory::load(const QByteArray &hash) const {
+  QFile file(objectPath(hash));
+  if (hash.size() != HASH_SIZE || !file.open(QIODevice::ReadOnly)) {
+    return QByteArray();
+  }
+  const QByteArray object = file.readAll();
+  return hashOf(object) == hash ? object : QByteArray();
+}
+
+QByteArray PaperHistory::snapshot(const PaperModel &paper,
+                                  const QString &message) {
+  if (!isOpen()) {
+    return QByteArray();
+  }
+
+  // Unchanged objects hash to names already stored and are not written
+  Tree tree;
+  for (const Section &section : paper.sections) {
+    QVector<QByteArray> questions;
+    questions.reserve(section.questions.size());
+    for (const Question &question : section.questions) {
+      QByteArray object;
+      BlockWriter out(object);
+      out.integer<quint8>(static_cast<quint8>(ObjectKind::Question));
+      writeQuestion(out, question);
+      questions.append(store(object));
+      if (questions.last().isEmpty() ||
+          (AssetStore::isReference(question.diagramPath) &&
+           !storeAsset(question.diagramPath))) {
+        return QByteArray();
+      }
+    }
+
+    QByteArray object;
+    BlockWriter out(object);
+    out.integer<quint8>(static_cast<quint8>(ObjectKind::Section));
+    out.string(section.label);
+    out.string(section.subtitle);
+    writeHashes(out, questions);
+    tree.sections.append(store(object));
+    if (tree.sections.last().isEmpty()) {
+      return QByteArray();
+    }
+  }
+  QByteArray exam;
+  BlockWriter examOut(exam);
+  examOut.integer<quint8>(static_cast<quint8>(ObjectKind::Exam));
+  writeExam(examOut, paper.exam);
+  tree.exam = store(exam);
+  if (tree.exam.isEmpty()) {
+    return QByteArray();
+  }
+
+  const QByteArray parent = head();
+  Tree parentTree;
+  if (!parent.isEmpty() && readVersion(parent, nullptr, &parentTree) &&
+      parentTree.exam == tree.exam && parentTree.sections == tree.sections) {
+    return parent;
+  }
+
+  QByteArray version;
+  BlockWriter out(version);
+  out.integer<quint8>(static_cast<quint8>(ObjectKind::Version));
+  out.integer<quint16>(FORMAT_VERSION);
+  out.bytes(tree.exam);
+  writeHashes(out, tree.sections);
+  out.integer<quint8>(!parent.isEmpty());
+  out.bytes(parent);
+  out.integer<qint64>(QDateTime::currentMSecsSinceEpoch());
+  out.string(message);
+  const QByteArray hash = store(version);
+  if (hash.isEmpty()) {
+    return QByteArray();
+  }
+
+  // The version is complete on disk before HEAD names it
+  QSaveFile headFile(QDir(m_directory).filePath(HEAD_FILE_NAME));
+  if (!headFile.open(QIODevice::WriteOnly) ||
+      headFile.write(hash.toHex() + '\n') != HASH_SIZE * 2 + 1 ||
+      !headFile.commit()) {
+    m_errorString = headFile.errorString();
+    return QByteArray();
+  }
+  return hash;
+}
+
+QByteArray PaperHistory::head() const {
+  QFile file(QDir(m_directory).filePath(HEAD_FILE_NAME));
+  if (!isOpen() || !file.open(QIODevice::ReadOnly)) {
+    return QByteArray();
+  }
+  const QByteArray hash = QByteArray::fromHex(file.readAll().trimmed());
+  return hash.size() == HASH_SIZE ? hash : QByteArray();
+}
+
+bool PaperHistory::readVersion(const QByteArray &hash, Version *version,
+                               Tree *tree) const {
+  const QByteArray object = load(hash);
+  BlockReader in(reinterpret_cast<const uchar *>(object.constData()),
+                 object.size());
+  if (!expectKind(in, ObjectKind::Version)) {
+    return false;
+  }
+  const quint16 format = in.integer<quint16>();
+  Tree read;
+  read.exam = in.bytes(HASH_SIZE);
+  if (format == 0 || format > FORMAT_VERSION || !readHashes(in, read.sections)) {
+    return false;
+  }
+  const bool hasParent = in.integer<quint8>() != 0;
+  const QByteArray parent = hasParent ? in.bytes(HASH_SIZE) : QByteArray();
+  const qint64 time = in.integer<qint64>();
+  const QString message = in.string();
+  if (!in.ok() || !in.atEnd()) {
+    return false;
+  }
+  if (version) {
+    *version = Version{hash, parent,
+                       QDateTime::fromMSecsSinceEpoch(time), message};
+  }
+  if (tree) {
+    *tree = read;
+  }
+  return true;
+}
+
+QVector<PaperHistory::Version> PaperHistory::versions() const {
+  QVector<Version> list;
+  QSet<QByteArray> seen;
+  QByteArray hash = head();
+  Version version;
+  while (!hash.isEmpty() && !seen.contains(hash) &&
+         readVersion(hash, &version, nullptr)) {
+    seen.insert(hash);
+    list.append(version);
+    hash = version.parent;
+  }
+  return list;
+}
+
+bool PaperHistory::readSectionObject(const QByteArray &hash, Section *section,
+                                     QVector<QByteArray> &questions) const {
+  const QByteArray object = load(hash);
+  BlockReader in(reinterpret_cast<const uchar *>(object.constData()),
+                 object.size());
+  if (!expectKind(in, ObjectKind::Section)) {
+    return false;
+  }
+  const QString label = in.string();
+  const QString subtitle = in.string();
+  if (!readHashes(in, questions) || !in.atEnd()) {
+    return false;
+  }
+  if (section) {
+    section->label = label;
+    section->subtitle = subtitle;
+  }
+  return true;
+}
+
+bool PaperHistory::readSection(const QByteArray &hash, Section &section) const {
+  QVector<QByteArray> hashes;
+  if (!readSectionObject(hash, &section, hashes)) {
+    return false;
+  }
+  section.questions.resize(hashes.size());
+  for (int i = 0; i < hashes.size(); ++i) {
+    Question &question = section.questions[i];
+    bool cached = false;
+    {
+      QMutexLocker locker(&m_mutex);
+      const auto it = m_questions.constFind(hashes[i]);
+      if (it != m_questions.constEnd()) {
+        question = it.value();
+        cached = true;
+      }
+    }
+    if (!cached) {
+      const QByteArray object = load(hashes[i]);
+      BlockReader in(reinterpret_cast<const uchar *>(object.constData()),
+                     object.size());
+      if (!expectKind(in, ObjectKind::Question) ||
+          !PaperCodec::readQuestion(in, question) || !in.atEnd()) {
+        return false;
+      }
+      QMutexLocker locker(&m_mutex);
+      m_questions.insert(hashes[i], question);
+    }
+    // Every copy of a question is its own node
+    question.id = newNodeId();
+  }
+  section.id = newNodeId();
+  return true;
+}
+
+bool PaperHistory::checkout(const QByteArray &hash, PaperModel &paper) const {
+  Tree tree;
+  if (!isOpen() || !readVersion(hash, nullptr, &tree)) {
+    return false;
+  }
+  const QByteArray examObject = load(tree.exam);
+  BlockReader examIn(reinterpret_cast<const uchar *>(examObject.constData()),
+                     examObject.size());
+  if (!expectKind(examIn, ObjectKind::Exam)) {
+    return false;
+  }
+  const Exam exam = readExam(examIn);
+  if (!examIn.ok() || !examIn.atEnd()) {
+    return false;
+  }
+
+  const int count = tree.sections.size();
+  QVector<Section> sections(count);
+  Section *results = sections.data();
+  std::atomic<int> next{0};
+  std::atomic<bool> failed{false};
+
+  const auto work = [&]() {
+    for (int i = next++; i < count; i = next++) {
+      if (!readSection(tree.sections[i], results[i])) {
+        failed = true;
+      }
+    }
+  };
+
+  // Same scheme as parallel rendering: the calling thread works too and
+  // helpers only count if the pool could start them
+  QThreadPool *pool = QThreadPool::globalInstance();
+  QSemaphore finished;
+  int helpers = 0;
+  while (helpers < count - 1 && pool->tryStart([&work, &finished]() {
+    work();
+    finished.release();
+  })) {
+    ++helpers;
+  }
+  work();
+  finished.acquire(helpers);
+
+  if (failed) {
+    return false;
+  }
+
+  // Diagrams the paper has dropped since this version come back from the
+  // history; AssetStore::insert() checks them against their hash
+  AssetStore &assets = AssetStore::shared();
+  QSet<QString> restored;
+  for (const Section &section : sections) {
+    for (const Question &question : section.questions) {
+      const QString &reference = question.diagramPath;
+      if (!AssetStore::isReference(reference) ||
+          restored.contains(reference)) {
+        continue;
+      }
+      restored.insert(reference);
+      if (!assets.contains(reference)) {
+        assets.insert(reference, load(AssetStore::hash(reference)));
+      }
+    }
+  }
+  paper.setExam(exam);
+  paper.setSections(sections);
+  return true;
+}
+
+QVector<PaperHistory::Change>
+PaperHistory::diff(const QByteArray &from, const QByteArray &to,
+                   bool *ok) const {
+  QVector<Change> changes;
+  Tree before;
+  Tree after;
+  const bool read = isOpen() && readVersion(from, nullptr, &before) &&
+                    readVersion(to, nullptr, &after);
+  if (ok) {
+    *ok = read;
+  }
+  if (!read) {
+    return changes;
+  }
+  if (before.exam != after.exam) {
+    changes.append(Change{Change::Kind::ExamChanged});
+  }
+
+  for (const Edit &edit : align(before.sections, after.sections)) {
+    if (edit.kept) {
+      continue;
+    }
+    if (edit.to < 0) {
+      changes.append(Change{Change::Kind::SectionRemoved, edit.from});
+      continue;
+    }
+    if (edit.from < 0) {
+      changes.append(Change{Change::Kind::SectionAdded, edit.to});
+      continue;
+    }
+    changes.append(Change{Change::Kind::SectionChanged, edit.to});
+
+    // Question lists only; the questions themselves are never read
+    QVector<QByteArray> oldQuestions;
+    QVector<QByteArray> newQuestions;
+    if (!readSectionObject(before.sections[edit.from], nullptr, oldQuestions) ||
+        !readSectionObject(after.sections[edit.to], nullptr, newQuestions)) {
+      if (ok) {
+        *ok = false;
+      }
+      continue;
+    }
+    for (const Edit &question : align(oldQuestions, newQuestions)) {
+      if (question.kept) {
+        continue;
+      }
+      if (question.to < 0) {
+        changes.append(
+            Change{Change::Kind::QuestionRemoved, edit.to, question.from});
+      } else if (question.from < 0) {
+        changes.append(
+            Change{Change::Kind::QuestionAdded, edit.to, question.to});
+      } else {
+        changes.append(
+            Change{Change::Kind::QuestionChanged, edit.to, question.to});
+      }
+    }
+  }
+  return changes;
+}
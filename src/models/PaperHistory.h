@@ -0,0 +1,173 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include "Section.h"
+
+class PaperModel;
+
+/**
+ * @file PaperHistory.h
+ * @brief Defines the PaperHistory class, the version store of a paper.
+ */
+
+/**
+ * @class PaperHistory
+ * @brief Keeps the saved versions of a paper as content-addressed objects.
+ *
+ * Every question, section and exam block is an immutable object named by
+ * the SHA-256 of its bytes. A section object lists the hashes of its
+ * questions and a version object lists the exam and section hashes, its
+ * parent version, the time and a message. An unchanged question or section
+ * has the same hash in every version, so a snapshot writes only the objects
+ * that are new, and a version costs little more than the edits since the
+ * last one.
+ *
+ * Objects live in the history directory as objects/ab/cdef..., the hex
+ * hash split after two digits; the file HEAD names the newest version.
+ * Objects are written before HEAD, each atomically, and checked against
+ * their name when read.
+ *
+ * checkout() reads sections concurrently on the global QThreadPool and
+ * keeps decoded questions, so switching between versions only decodes the
+ * questions not seen before. diff() compares versions using the section
+ * and version objects alone; no question is read.
+ *
+ * Question and section objects use the PaperCodec encodings, diagrams
+ * included as the paths or AssetStore references the paper holds. The blob
+ * behind each reference is stored too, as a raw object whose name is the
+ * reference's own hash, and checkout() puts it back into the AssetStore, so
+ * an old version keeps its diagrams after the paper has dropped them.
+ */
+class PaperHistory
+{
+public:
+    static constexpr quint16 FORMAT_VERSION = 1;
+
+    /**
+     * Version: One saved version of the paper.
+     */
+    struct Version
+    {
+        QByteArray hash; // Raw SHA-256
+        QByteArray parent; // Empty for the first version
+        QDateTime time;
+        QString message;
+    };
+
+    /**
+     * Change: One difference between two versions.
+     *
+     * section is an index in the newer version, or in the older one for
+     * SectionRemoved. question likewise, within that section. A changed
+     * section, its label, subtitle or questions, is followed by the changes
+     * to its questions.
+     */
+    struct Change
+    {
+        enum class Kind
+        {
+            ExamChanged,
+            SectionAdded,
+            SectionRemoved,
+            SectionChanged,
+            QuestionAdded,
+            QuestionRemoved,
+            QuestionChanged
+        };
+
+        Kind kind = Kind::ExamChanged;
+        int section = -1;
+        int question = -1;
+
+        bool operator==(const Change &other) const
+        {
+            return kind == other.kind && section == other.section && question == other.question;
+        }
+    };
+
+    PaperHistory() = default;
+
+    PaperHistory(const PaperHistory &) = delete;
+    PaperHistory &operator=(const PaperHistory &) = delete;
+
+    /**
+     * @brief The history directory kept beside the paper at @p paperPath.
+     */
+    static QString pathFor(const QString &paperPath);
+
+    /**
+     * @brief Opens the history in @p directory, creating it if needed.
+     * @return false if it cannot be created; errorString() says why
+     */
+    bool open(const QString &directory);
+
+    bool isOpen() const { return !m_directory.isEmpty(); }
+    QString directory() const { return m_directory; }
+    QString errorString() const { return m_errorString; }
+
+    /**
+     * @brief Records @p paper as the newest version.
+     *
+     * Nothing is recorded if the paper matches the newest version.
+     * @return Hash of the new or matching version, or an empty array on
+     * failure
+     */
+    QByteArray snapshot(const PaperModel &paper, const QString &message = QString());
+
+    /**
+     * @brief Hash of the newest version, or an empty array if there is none.
+     */
+    QByteArray head() const;
+
+    /**
+     * @brief All versions, newest first.
+     */
+    QVector<Version> versions() const;
+
+    /**
+     * @brief Loads the version @p hash into @p paper, with new IDs.
+     * @return false if the version or any of its objects is missing or
+     * damaged; the paper is then unchanged
+     */
+    bool checkout(const QByteArray &hash, PaperModel &paper) const;
+
+    /**
+     * @brief Changes from version @p from to version @p to.
+     * @param ok Set to false if either version cannot be read
+     */
+    QVector<Change> diff(const QByteArray &from, const QByteArray &to, bool *ok = nullptr) const;
+
+    /**
+     * @brief Objects written by snapshot() since open().
+     */
+    int objectsWritten() const { return m_objectsWritten; }
+
+private:
+    struct Tree
+    {
+        QByteArray exam;
+        QVector<QByteArray> sections;
+    };
+
+    QString m_directory;
+    QString m_errorString;
+    int m_objectsWritten = 0;
+
+    QSet<QByteArray> m_stored; // Objects known to be on disk
+    mutable QMutex m_mutex;
+    mutable QHash<QByteArray, Question> m_questions; // Decoded, by hash
+
+    QString objectPath(const QByteArray &hash) const;
+    QByteArray store(const QByteArray &object);
+    bool storeAsset(const QString &reference);
+    QByteArray load(const QByteArray &hash) const;
+    bool readVersion(const QByteArray &hash, Version *version, Tree *tree) const;
+    bool readSectionObject(const QByteArray &hash, Section *section, QVector<QByteArray> &questions) const;
+    bool readSection(const QByteArray &hash, Section &section) const;
+};
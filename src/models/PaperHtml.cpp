@@ -0,0 +1,353 @@
+#include "PaperHtml.h"
+#include "AssetStore.h"
+#include "StringPool.h"
+#include <QCryptographicHash>
+#include <QHash>
+#include <QMutex>
+
+/**
+ * @file PaperHtml.cpp
+ * @brief Implementation of the shared paper markup functions.
+ */
+
+namespace {
+constexpr int QUESTION_NUMBER_WIDTH = 30;
+constexpr int OR_INDENT = 20;
+
+// Static stylesheet text, split around the values that vary per render
+// style. The pieces are compile-time UTF-16 literals, so assembling a header
+// is a handful of copies instead of repeated QString::arg() rescans.
+constexpr QStringView HEADER_OPEN = u"<html>"
+                                    u"<head>"
+                                    u"<meta charset=\"utf-8\">"
+                                    u"<style>"
+                                    u"@page { "
+                                    u"size: A4 ";
+constexpr QStringView HEADER_PRINT_FONT_FAMILY = u"; "
+                                                 u"margin: 15mm; "
+                                                 u"}"
+                                                 u"@media print { "
+                                                 u"body { "
+                                                 u"font-family:'";
+constexpr QStringView HEADER_FONT_SIZE = u"', serif; "
+                                         u"font-size:";
+constexpr QStringView HEADER_SCREEN_FONT_FAMILY = u"pt; "
+                                                  u"margin:0; "
+                                                  u"line-height:1.4; "
+                                                  u"max-width:100%; "
+                                                  u"}"
+                                                  u"}"
+                                                  u"body { "
+                                                  u"font-family:'";
+constexpr QStringView HEADER_STYLES = u"pt; "
+                                      u"margin:10px; "
+                                      u"line-height:1.4; "
+                                      u"max-width:100%; "
+                                      u"box-sizing:border-box; "
+                                      u"}"
+                                      u"p { "
+                                      u"margin:0; "
+                                      u"padding:0; "
+                                      u"}"
+                                      u"h1 { "
+                                      u"text-align:center; "
+                                      u"margin-bottom:6px; "
+                                      u"font-size:1.3em; "
+                                      u"font-weight:bold; "
+                                      u"}"
+                                      u"h2 { "
+                                      u"text-align:center; "
+                                      u"margin-top:12px; "
+                                      u"margin-bottom:3px; "
+                                      u"font-size:1.0em; "
+                                      u"font-weight:bold; "
+                                      u"}"
+                                      u".metadata { "
+                                      u"text-align:center; "
+                                      u"margin-bottom:12px; "
+                                      u"font-size:0.8em; "
+                                      u"}"
+                                      u".section { "
+                                      u"margin-top:12px; "
+                                      u"page-break-inside:avoid; "
+                                      u"}"
+                                      u".subtitle { "
+                                      u"text-align:center; "
+                                      u"font-weight:bold; "
+                                      u"font-size:0.85em; "
+                                      u"margin-bottom:6px; "
+                                      u"font-style:italic; "
+                                      u"}"
+                                      u".question { "
+                                      u"margin:2px 0; "
+                                      u"text-align:left; "
+                                      u"}"
+                                      u".question-layout { "
+                                      u"width:100%; "
+                                      u"border-collapse:collapse; "
+                                      u"}"
+                                      u".question-layout td { "
+                                      u"border:none; "
+                                      u"padding:0; "
+                                      u"vertical-align:top; "
+                                      u"}"
+                                      u".question-num-cell { "
+                                      u"width:";
+constexpr QStringView HEADER_OR_INDENT = u"px; "
+                                         u"font-weight:bold; "
+                                         u"}"
+                                         u".or-question { "
+                                         u"margin-left:";
+constexpr QStringView HEADER_CLOSE = u"px; "
+                                     u"margin-top:2px; "
+                                     u"}"
+                                     u".mcq-options { "
+                                     u"margin-left:15px; "
+                                     u"margin-top:1px; "
+                                     u"line-height:1.2; "
+                                     u"}"
+                                     u"table { "
+                                     u"border-collapse:collapse; "
+                                     u"width:100%; "
+                                     u"margin:3px 0; "
+                                     u"font-size:0.85em; "
+                                     u"}"
+                                     u"td, th { "
+                                     u"border:1px solid #000; "
+                                     u"padding:2px 4px; "
+                                     u"text-align:left; "
+                                     u"}"
+                                     u"th { "
+                                     u"background-color:#f5f5f5; "
+                                     u"font-weight:bold; "
+                                     u"}"
+                                     u"img { "
+                                     u"max-width:100%; "
+                                     u"height:auto; "
+                                     u"margin:2px 0; "
+                                     u"display:block; "
+                                     u"}"
+                                     u".mcq-table { "
+                                     u"width: 95%; "
+                                     u"border: none; "
+                                     u"margin-left: 15px; "
+                                     u"margin-top: 5px; "
+                                     u"}"
+                                     u".mcq-table td { "
+                                     u"border: none; "
+                                     u"padding: 2px 10px; "
+                                     u"vertical-align: top; "
+                                     u"}"
+                                     u".data-table { "
+                                     u"float: right; "
+                                     u"width: auto; "
+                                     u"margin: 0 0 5px 15px; "
+                                     u"border: 1px solid #000; "
+                                     u"}"
+                                     u".data-table td, .data-table th { "
+                                     u"border: 1px solid #000; "
+                                     u"}"
+                                     u".question-image { "
+                                     u"margin: 5px; "
+                                     u"}";
+// Placeholders for embedded diagrams; each image adds its own height and
+// background-image rule. Backgrounds are dropped by default when printing,
+// hence the color-adjust properties.
+constexpr QStringView HEADER_INLINE_DIAGRAMS = u".inline-diagram { "
+                                               u"display:block; "
+                                               u"float:right; "
+                                               u"width:150px; "
+                                               u"background-position:center; "
+                                               u"background-size:contain; "
+                                               u"background-repeat:no-repeat; "
+                                               u"-webkit-print-color-adjust:exact; "
+                                               u"print-color-adjust:exact; "
+                                               u"}";
+constexpr QStringView HEADER_END = u"</style>"
+                                   u"</head>"
+                                   u"<body>";
+
+constexpr int DIAGRAM_CLASS_HASH_LENGTH = 16;
+
+constexpr int MAX_CACHED_HEADERS = 32;
+
+QString buildHtmlHeader(const RenderStyle &style) {
+  const QStringView orientation =
+      style.portrait ? QStringView(u"portrait") : QStringView(u"landscape");
+  const QString fontSize = QString::number(style.fontSize);
+  const QString numberWidth = QString::number(QUESTION_NUMBER_WIDTH);
+  const QString orIndent = QString::number(OR_INDENT);
+
+  QString header;
+  header.reserve(HEADER_OPEN.size() + orientation.size() +
+                 HEADER_PRINT_FONT_FAMILY.size() +
+                 HEADER_SCREEN_FONT_FAMILY.size() +
+                 2 * (style.fontFamily.size() + HEADER_FONT_SIZE.size() +
+                      fontSize.size()) +
+                 HEADER_STYLES.size() + numberWidth.size() +
+                 HEADER_OR_INDENT.size() + orIndent.size() +
+                 HEADER_CLOSE.size() + HEADER_INLINE_DIAGRAMS.size() +
+                 HEADER_END.size());
+
+  header += HEADER_OPEN;
+  header += orientation;
+  header += HEADER_PRINT_FONT_FAMILY;
+  header += style.fontFamily;
+  header += HEADER_FONT_SIZE;
+  header += fontSize;
+  header += HEADER_SCREEN_FONT_FAMILY;
+  header += style.fontFamily;
+  header += HEADER_FONT_SIZE;
+  header += fontSize;
+  header += HEADER_STYLES;
+  header += numberWidth;
+  header += HEADER_OR_INDENT;
+  header += orIndent;
+  header += HEADER_CLOSE;
+  if (style.inlineDiagrams) {
+    header += HEADER_INLINE_DIAGRAMS;
+  }
+  header += HEADER_END;
+  return header;
+}
+
+// Headers are shared by every model and thread, so batch runs that render
+// many papers in the same style build the stylesheet once.
+QString cachedHtmlHeader(const RenderStyle &style) {
+  static QMutex mutex;
+  static QHash<RenderStyle, QString> headers;
+
+  QMutexLocker locker(&mutex);
+  const auto it = headers.constFind(style);
+  if (it != headers.constEnd()) {
+    return it.value();
+  }
+
+  if (headers.size() >= MAX_CACHED_HEADERS) {
+    headers.clear();
+  }
+  const QString header = buildHtmlHeader(style);
+  headers.insert(style, header);
+  return header;
+}
+} // namespace
+
+QString PaperHtml::header(const RenderStyle &style) {
+  return cachedHtmlHeader(style);
+}
+
+QString PaperHtml::titleBlock(const Exam &exam) {
+  QString html;
+
+  // Exam title
+  if (!exam.title.isEmpty()) {
+    html += QLatin1String("<h1>");
+    HtmlUtils::appendEscaped(html, exam.title);
+    html += QLatin1String("</h1>");
+  }
+
+  // Exam metadata, joined with " | "
+  html += QLatin1String("<div class=\"metadata\">");
+  bool firstPart = true;
+  const auto beginPart = [&html, &firstPart]() {
+    if (!firstPart) {
+      html += QLatin1String(" | ");
+    }
+    firstPart = false;
+  };
+
+  if (!exam.subject.isEmpty()) {
+    beginPart();
+    HtmlUtils::appendEscaped(html, exam.subject);
+  }
+  if (!exam.duration.isEmpty()) {
+    beginPart();
+    HtmlUtils::appendEscaped(html, exam.duration);
+  }
+  if (exam.totalMarks > 0) {
+    beginPart();
+    html += QLatin1String("Total Marks: ") % QString::number(exam.totalMarks);
+  }
+  if (exam.passMarks > 0) {
+    beginPart();
+    html += QLatin1String("Pass Marks: ") % QString::number(exam.passMarks);
+  }
+  if (!exam.className.isEmpty()) {
+    beginPart();
+    html += QLatin1String("Class: ");
+    HtmlUtils::appendEscaped(html, exam.className);
+  }
+
+  html += QLatin1String("</div>");
+
+  // Separator line
+  html += "<hr style=\"border: 0; border-top: 2px solid #000; margin: 10px 0 "
+          "20px 0;\" />";
+
+  return html;
+}
+
+QString PaperHtml::sectionOpening(QStringView label, QStringView subtitle) {
+  QString sectionHtml = QStringLiteral("<div class=\"section\">");
+
+  // Section label (centered heading)
+  if (!label.isEmpty()) {
+    sectionHtml += QLatin1String("<h2>");
+    HtmlUtils::appendEscaped(sectionHtml, label);
+    sectionHtml += QLatin1String("</h2>");
+  }
+
+  // Section subtitle (if present)
+  if (!subtitle.isEmpty()) {
+    sectionHtml += QLatin1String("<div class=\"subtitle\">");
+    HtmlUtils::appendEscaped(sectionHtml, subtitle);
+    sectionHtml += QLatin1String("</div>");
+  }
+
+  return sectionHtml;
+}
+
+void PaperHtml::appendQuestionOpening(QString &out, int questionNumber,
+                                      QStringView text,
+                                      QStringView diagramPath,
+                                      bool inlineDiagram) {
+  // Question Layout Table (Number | Text + Floats)
+  out += QLatin1String("<div class=\"question\">"
+                       "<table class=\"question-layout\"><tr>"
+                       "<td class=\"question-num-cell\">");
+  out += QString::number(questionNumber);
+  out += QLatin1String(")</td>"
+                       "<td class=\"question-text-cell\">");
+  out += text;
+
+  // Embed diagram if present (floated right)
+  if (!diagramPath.isEmpty() && inlineDiagram) {
+    out += QLatin1String("<br/><span class=\"question-image inline-diagram ");
+    out += diagramClass(diagramPath);
+    out += QLatin1String("\" role=\"img\" "
+                         "aria-label=\"Question diagram\"></span>");
+  } else if (!diagramPath.isEmpty()) {
+    // Embedded diagrams keep their reference as the URL; a QTextDocument
+    // gets the image through DiagramCache::addResources()
+    out += QLatin1String("<br/><img src=\"");
+    if (!AssetStore::isReference(diagramPath)) {
+      out += QLatin1String("file://");
+    }
+    out += diagramPath;
+    out += QLatin1String("\" width=\"150\" align=\"right\" "
+                         "class=\"question-image\" "
+                         "alt=\"Question diagram\" />");
+  }
+}
+
+QString PaperHtml::diagramClass(QStringView path) {
+  const QByteArray hash = QCryptographicHash::hash(
+      path.toUtf8(), QCryptographicHash::Sha1);
+  return QLatin1String("diagram-") +
+         QString::fromLatin1(
+             hash.toHex().left(DIAGRAM_CLASS_HASH_LENGTH));
+}
+
+void PaperHtml::appendEscapedText(QString &out, const QString &text) {
+  StringPool::shared().appendEscaped(out, text);
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <QChar>
+#include <QLatin1String>
+#include <QString>
+#include <QStringBuilder>
+#include <QStringView>
+#include "Exam.h"
+#include "RenderStyle.h"
+#include "../utils/HtmlUtils.h"
+
+/**
+ * @file PaperHtml.h
+ * @brief Markup pieces shared by the paper HTML renderers.
+ *
+ * PaperModel and CompactPaper store questions differently but must produce
+ * byte-identical documents, so both assemble them from these functions.
+ */
+
+namespace PaperHtml {
+    /**
+     * Document head and stylesheet for a render style, cached process-wide.
+     */
+    QString header(const RenderStyle &style);
+
+    /**
+     * Exam title, metadata line and separator rule.
+     */
+    QString titleBlock(const Exam &exam);
+
+    /**
+     * Section wrapper, label and subtitle; the wrapper is closed with "</div>"
+     * after the last question.
+     */
+    QString sectionOpening(QStringView label, QStringView subtitle);
+
+    /**
+     * Opens a question: number cell, text cell with the question text and the
+     * diagram, if any. Followed by an optional table and appendQuestionBodyEnd().
+     *
+     * With @p inlineDiagram the diagram is a placeholder carrying
+     * diagramClass(); the exporter supplies the image through a style rule.
+     */
+    void appendQuestionOpening(QString &out, int questionNumber, QStringView text,
+                               QStringView diagramPath, bool inlineDiagram = false);
+
+    /**
+     * CSS class naming the diagram at @p path in inline-diagram documents.
+     * Derived from the path alone, so cached question markup stays valid.
+     */
+    QString diagramClass(QStringView path);
+
+    inline void appendQuestionBodyEnd(QString &out) {
+        out += QLatin1String("</td></tr></table>");
+    }
+
+    inline void appendQuestionEnd(QString &out) {
+        out += QLatin1String("</div>");
+    }
+
+    inline void appendTableOpening(QString &out) {
+        out += QLatin1String("<table class=\"data-table\">");
+    }
+
+    inline void appendTableEnd(QString &out) {
+        out += QLatin1String("</table>");
+    }
+
+    /**
+     * Appends escaped option or cell text. Interned strings reuse the escaped
+     * form cached by StringPool::shared().
+     */
+    void appendEscapedText(QString &out, const QString &text);
+
+    inline void appendEscapedText(QString &out, QStringView text) {
+        HtmlUtils::appendEscaped(out, text);
+    }
+
+    /**
+     * One data table row; the first row of a table is its header.
+     * Row is any range of values convertible to QStringView.
+     */
+    template <typename Row>
+    void appendTableRow(QString &out, bool header, const Row &cells) {
+        const QLatin1String openTag(header ? "<th>" : "<td>");
+        const QLatin1String closeTag(header ? "</th>" : "</td>");
+        out += QLatin1String("<tr>");
+        for (const auto &cell : cells) {
+            out += openTag;
+            appendEscapedText(out, cell);
+            out += closeTag;
+        }
+        out += QLatin1String("</tr>");
+    }
+
+    /**
+     * The "OR" divider and the alternative question; nothing if it is empty.
+     */
+    template <typename Text>
+    void appendOrAlternative(QString &out, const Text &alternative) {
+        if (alternative.isEmpty()) {
+            return;
+        }
+        out += QLatin1String("<div style=\"text-align:center; font-weight:bold; "
+                             "margin: 5px 0;\">OR</div>"
+                             "<div class=\"or-question\">");
+        appendEscapedText(out, alternative);
+        out += QLatin1String("</div>");
+    }
+
+    /**
+     * MCQ options in a two-column table. Options needs size() and operator[]
+     * returning something convertible to QStringView.
+     */
+    template <typename Options>
+    void appendMcqOptions(QString &out, const Options &options) {
+        const int count = static_cast<int>(options.size());
+        if (count == 0) {
+            return;
+        }
+        out += QLatin1String("<div style=\"clear:both;\"></div>"
+                             "<table class=\"mcq-table\">");
+        for (int i = 0; i < count; i += 2) {
+            out += QLatin1String("<tr>");
+
+            // First column (a, c, ...)
+            out += "<td width=\"50%\">(" % QChar('a' + i) % ") ";
+            appendEscapedText(out, options[i]);
+            out += QLatin1String("</td>");
+
+            // Second column (b, d, ...)
+            if (i + 1 < count) {
+                out += "<td width=\"50%\">(" % QChar('a' + i + 1) % ") ";
+                appendEscapedText(out, options[i + 1]);
+                out += QLatin1String("</td>");
+            } else {
+                out += QLatin1String("<td></td>");
+            }
+
+            out += QLatin1String("</tr>");
+        }
+        out += QLatin1String("</table>");
+    }
+
+    /**
+     * Mixed options, one per line. Same requirements as appendMcqOptions().
+     */
+    template <typename Options>
+    void appendMixedOptions(QString &out, const Options &options) {
+        const int count = static_cast<int>(options.size());
+        if (count == 0) {
+            return;
+        }
+        out += QLatin1String("<div style=\"clear:both;\"></div>"
+                             "<div class=\"mcq-options\">");
+        for (int i = 0; i < count; ++i) {
+            out += "(" % QChar('a' + i) % ") ";
+            appendEscapedText(out, options[i]);
+            out += QLatin1String("<br/>");
+        }
+        out += QLatin1String("</div>");
+    }
+}
@@ -0,0 +1,664 @@
+#include "PaperJournal.h"
+#include "PaperCodec.h"
+#include "PaperFile.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QMutexLocker>
+#include <QObject>
+#include <QPromise>
+#include <QSemaphore>
+#include <QThread>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+
+#if defined(Q_OS_WIN)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/**
+ * @file PaperJournal.cpp
+ * @brief Implementation of the PaperJournal class.
+ */
+
+using namespace PaperCodec;
+
+namespace {
+constexpr char JOURNAL_SIGNATURE[4] = {'E', 'P', 'F', 'J'};
+constexpr int RECORD_HEADER_SIZE = 8; // u32 size, u32 CRC-32
+// The journal is compacted once it is larger than the checkpoint, but not
+// before it reaches this size
+constexpr qint64 MIN_COMPACT_BYTES = 1024 * 1024;
+// How long the writer waits before retrying a failed write
+constexpr unsigned long RETRY_DELAY_MS = 5000;
+
+const QString LOCK_FILE_NAME = QStringLiteral("journal.lock");
+
+enum class RecordKind : quint8 {
+  DocumentPath,
+  ExamUpdated,
+  SectionInserted,
+  SectionRemoved,
+  SectionUpdated,
+  SectionMoved,
+  QuestionInserted,
+  QuestionRemoved,
+  QuestionUpdated,
+  QuestionMoved
+};
+
+QString checkpointName(quint32 generation) {
+  return QStringLiteral("checkpoint-%1.epf").arg(generation);
+}
+
+QString journalName(quint32 generation) {
+  return QStringLiteral("journal-%1.log").arg(generation);
+}
+
+/**
+ * Generations that have a checkpoint in @p directory, newest first.
+ */
+QVector<quint32> checkpointGenerations(const QString &directory) {
+  QVector<quint32> generations;
+  const QStringList names = QDir(directory).entryList(
+      {QStringLiteral("checkpoint-*.epf")}, QDir::Files);
+  for (const QString &name : names) {
+    bool ok = false;
+    const quint32 generation =
+        name.mid(11, name.size() - 15).toUInt(&ok); // "checkpoint-" ".epf"
+    if (ok) {
+      generations.append(generation);
+    }
+  }
+  std::sort(generations.begin(), generations.end(), std::greater<quint32>());
+  return generations;
+}
+
+quint32 checksum(const char *data, quint32 size) {
+  return quint32(crc32(crc32(0L, Z_NULL, 0),
+                       reinterpret_cast<const Bytef *>(data), size));
+}
+
+// Size and CRC-32, then the payload
+QByteArray frameRecord(const QByteArray &payload) {
+  QByteArray record;
+  BlockWriter out(record);
+  out.integer<quint32>(payload.size());
+  out.integer<quint32>(checksum(payload.constData(), payload.size()));
+  return record + payload;
+}
+
+bool syncToDisk(QFile &file) {
+  if (!file.flush()) {
+    return false;
+  }
+#if defined(Q_OS_WIN)
+  return _commit(file.handle()) == 0;
+#else
+  return ::fsync(file.handle()) == 0;
+#endif
+}
+
+bool validSection(const PaperModel &paper, int index) {
+  return index >= 0 && index < paper.sections.size();
+}
+
+bool validQuestion(const PaperModel &paper, int section, int index) {
+  return validSection(paper, section) && index >= 0 &&
+         index < paper.sections.at(section).questions.size();
+}
+
+/**
+ * Applies one record to @p paper. Returns false, changing nothing, if the
+ * record does not fit the paper.
+ */
+bool applyRecord(BlockReader &in, PaperModel &paper, QString *documentPath) {
+  const auto kind = static_cast<RecordKind>(in.integer<quint8>());
+  switch (kind) {
+  case RecordKind::DocumentPath: {
+    const QString path = in.string();
+    if (!in.ok() || !in.atEnd()) {
+      return false;
+    }
+    if (documentPath) {
+      *documentPath = path;
+    }
+    return true;
+  }
+  case RecordKind::ExamUpdated: {
+    const Exam exam = readExam(in);
+    if (!in.ok() || !in.atEnd()) {
+      return false;
+    }
+    paper.setExam(exam);
+    return true;
+  }
+  case RecordKind::SectionInserted: {
+    const int index = in.integer<qint32>();
+    Section section;
+    if (!readSection(in, section) || !in.atEnd() || index < 0 ||
+        index > paper.sections.size()) {
+      return false;
+    }
+    paper.insertSection(index, section);
+    return true;
+  }
+  case RecordKind::SectionRemoved: {
+    const int index = in.integer<qint32>();
+    if (!in.ok() || !in.atEnd() || !validSection(paper, index)) {
+      return false;
+    }
+    paper.removeSection(index);
+    return true;
+  }
+  case RecordKind::SectionUpdated: {
+    const int index = in.integer<qint32>();
+    const QString label = in.string();
+    const QString subtitle = in.string();
+    if (!in.ok() || !in.atEnd() || !validSection(paper, index)) {
+      return false;
+    }
+    paper.updateSection(index, label, subtitle);
+    return true;
+  }
+  case RecordKind::SectionMoved: {
+    const int from = in.integer<qint32>();
+    const int to = in.integer<qint32>();
+    if (!in.ok() || !in.atEnd() || !validSection(paper, from) ||
+        !validSection(paper, to)) {
+      return false;
+    }
+    paper.moveSection(from, to);
+    return true;
+  }
+  case RecordKind::QuestionInserted: {
+    const int section = in.integer<qint32>();
+    const int index = in.integer<qint32>();
+    Question question;
+    if (!readQuestion(in, question) || !in.atEnd() ||
+        !validSection(paper, section) || index < 0 ||
+        index > paper.sections.at(section).questions.size()) {
+      return false;
+    }
+    paper.insertQuestion(section, index, question);
+    return true;
+  }
+  case RecordKind::QuestionRemoved: {
+    const int section = in.integer<qint32>();
+    const int index = in.integer<qint32>();
+    if (!in.ok() || !in.atEnd() || !validQuestion(paper, section, index)) {
+      return false;
+    }
+    paper.removeQuestion(section, index);
+    return true;
+  }
+  case RecordKind::QuestionUpdated: {
+    const int section = in.integer<qint32>();
+    const int index = in.integer<qint32>();
+    Question question;
+    if (!readQuestion(in, question) || !in.atEnd() ||
+        !validQuestion(paper, section, index)) {
+      return false;
+    }
+    paper.updateQuestion(section, index, question);
+    return true;
+  }
+  case RecordKind::QuestionMoved: {
+    const int section = in.integer<qint32>();
+    const int from = in.integer<qint32>();
+    const int to = in.integer<qint32>();
+    if (!in.ok() || !in.atEnd() || !validQuestion(paper, section, from) ||
+        !validQuestion(paper, section, to)) {
+      return false;
+    }
+    paper.moveQuestion(section, from, to);
+    return true;
+  }
+  }
+  return false;
+}
+} // namespace
+
+// A step for the writer thread, in queue order
+struct PaperJournal::Task {
+  enum class Kind { Record, DocumentPath, Checkpoint, Save, Sync };
+
+  Kind kind;
+  QByteArray record;      // Record, DocumentPath: framed record
+  QString documentPath;   // DocumentPath
+  PaperSnapshot snapshot; // Checkpoint, Save
+  SaveFunction save;      // Save
+  QPromise<bool> promise; // Save
+  QSemaphore done;        // Sync
+
+  explicit Task(Kind taskKind) : kind(taskKind) {}
+};
+
+struct PaperJournal::WriterState {
+  std::unique_ptr<QFile> journal = std::make_unique<QFile>();
+  QByteArray pending; // Framed records not yet written
+  QString documentPath;
+  // Checkpoint that could not be written while no journal was open; pending
+  // records follow it
+  PaperSnapshot unwrittenCheckpoint;
+  QString error; // Last failure, empty while writes succeed
+};
+
+PaperJournal::PaperJournal(PaperModel &model)
+    : m_model(model), m_writer(std::make_unique<WriterState>()) {
+  m_thread = QThread::create([this]() { run(); });
+  m_thread->start();
+}
+
+PaperJournal::~PaperJournal() {
+  if (m_listener) {
+    m_model.removeChangeListener(m_listener);
+  }
+  {
+    QMutexLocker locker(&m_mutex);
+    m_stopping = true;
+    m_wake.wakeOne();
+  }
+  m_thread->wait();
+  delete m_thread;
+  m_writer->journal->close();
+
+  // A clean exit leaves nothing to recover
+  if (m_listener) {
+    QDir directory(m_directory);
+    for (quint32 generation : checkpointGenerations(m_directory)) {
+      directory.remove(checkpointName(generation));
+      directory.remove(journalName(generation));
+    }
+  }
+}
+
+bool PaperJournal::open(const QString &directory) {
+  if (!QDir().mkpath(directory)) {
+    m_errorString = QObject::tr("Cannot create %1.").arg(directory);
+    return false;
+  }
+  auto lock = std::make_unique<QLockFile>(QDir(directory).filePath(LOCK_FILE_NAME));
+  if (!lock->tryLock(0)) {
+    m_errorString = lock->error() == QLockFile::LockFailedError
+                        ? QObject::tr("The journal is in use by another "
+                                      "instance of the application.")
+                        : QObject::tr("Cannot lock %1.").arg(directory);
+    return false;
+  }
+  m_lock = std::move(lock);
+  m_directory = directory;
+  // New files continue the numbering of any left behind
+  const QVector<quint32> generations = checkpointGenerations(directory);
+  m_generation = generations.isEmpty() ? 0 : generations.first();
+  return true;
+}
+
+bool PaperJournal::hasRecovery() const {
+  return isOpen() && !m_listener &&
+         !checkpointGenerations(m_directory).isEmpty();
+}
+
+bool PaperJournal::recover(PaperModel &paper, QString *documentPath) const {
+  if (!isOpen()) {
+    return false;
+  }
+  const QDir directory(m_directory);
+  for (quint32 generation : checkpointGenerations(m_directory)) {
+    PaperFile checkpoint;
+    PaperModel recovered;
+    if (!checkpoint.open(directory.filePath(checkpointName(generation))) ||
+        !checkpoint.load(recovered)) {
+      continue;
+    }
+    checkpoint.close();
+    replay(directory.filePath(journalName(generation)), recovered,
+           documentPath);
+    paper.setExam(recovered.exam);
+    paper.setSections(recovered.sections);
+    return true;
+  }
+  return false;
+}
+
+bool PaperJournal::replay(const QString &path, PaperModel &paper,
+                          QString *documentPath) const {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+  const QByteArray data = file.readAll();
+  const auto *bytes = reinterpret_cast<const uchar *>(data.constData());
+  if (data.size() < qsizetype(sizeof(JOURNAL_SIGNATURE)) ||
+      std::memcmp(bytes, JOURNAL_SIGNATURE, sizeof(JOURNAL_SIGNATURE)) != 0) {
+    return false;
+  }
+  BlockReader header(bytes + sizeof(JOURNAL_SIGNATURE),
+                     data.size() - sizeof(JOURNAL_SIGNATURE));
+  const quint16 version = header.integer<quint16>();
+  header.integer<quint16>(); // Flags
+  header.integer<quint32>(); // Generation
+  const QString headerPath = header.string();
+  if (!header.ok() || version == 0 || version > FORMAT_VERSION) {
+    return false;
+  }
+  if (documentPath) {
+    *documentPath = headerPath;
+  }
+
+  // Records follow; the first incomplete or damaged one ends the journal
+  qsizetype pos = header.position() - bytes;
+  while (data.size() - pos >= RECORD_HEADER_SIZE) {
+    const quint32 size = qFromLittleEndian<quint32>(bytes + pos);
+    const quint32 crc = qFromLittleEndian<quint32>(bytes + pos + 4);
+    if (size > quint64(data.size() - pos - RECORD_HEADER_SIZE)) {
+      break;
+    }
+    const char *payload = data.constData() + pos + RECORD_HEADER_SIZE;
+    if (checksum(payload, size) != crc) {
+      break;
+    }
+    BlockReader record(reinterpret_cast<const uchar *>(payload), size);
+    if (!applyRecord(record, paper, documentPath)) {
+      break;
+    }
+    pos += RECORD_HEADER_SIZE + size;
+  }
+  return true;
+}
+
+void PaperJournal::start() {
+  if (!isOpen() || m_listener) {
+    return;
+  }
+  m_listener = m_model.addChangeListener(
+      [this](const PaperChange &change) { record(change); });
+  checkpoint();
+}
+
+void PaperJournal::record(const PaperChange &change) {
+  QByteArray payload;
+  BlockWriter out(payload);
+  const auto kind = [&out](RecordKind recordKind) {
+    out.integer<quint8>(static_cast<quint8>(recordKind));
+  };
+
+  switch (change.kind) {
+  case PaperChange::Kind::Reset:
+    // Cheaper to start over than to describe
+    checkpoint();
+    return;
+  case PaperChange::Kind::ExamUpdated:
+    kind(RecordKind::ExamUpdated);
+    writeExam(out, m_model.exam);
+    break;
+  case PaperChange::Kind::SectionInserted:
+    kind(RecordKind::SectionInserted);
+    out.integer<qint32>(change.sectionIndex);
+    writeSection(out, m_model.sections.at(change.sectionIndex));
+    break;
+  case PaperChange::Kind::SectionRemoved:
+    kind(RecordKind::SectionRemoved);
+    out.integer<qint32>(change.sectionIndex);
+    break;
+  case PaperChange::Kind::SectionUpdated: {
+    const Section &section = m_model.sections.at(change.sectionIndex);
+    kind(RecordKind::SectionUpdated);
+    out.integer<qint32>(change.sectionIndex);
+    out.string(section.label);
+    out.string(section.subtitle);
+    break;
+  }
+  case PaperChange::Kind::SectionMoved:
+    kind(RecordKind::SectionMoved);
+    out.integer<qint32>(change.fromIndex);
+    out.integer<qint32>(change.sectionIndex);
+    break;
+  case PaperChange::Kind::QuestionInserted:
+  case PaperChange::Kind::QuestionUpdated:
+    kind(change.kind == PaperChange::Kind::QuestionInserted
+             ? RecordKind::QuestionInserted
+             : RecordKind::QuestionUpdated);
+    out.integer<qint32>(change.sectionIndex);
+    out.integer<qint32>(change.questionIndex);
+    writeQuestion(out, m_model.sections.at(change.sectionIndex)
+                           .questions.at(change.questionIndex));
+    break;
+  case PaperChange::Kind::QuestionRemoved:
+    kind(RecordKind::QuestionRemoved);
+    out.integer<qint32>(change.sectionIndex);
+    out.integer<qint32>(change.questionIndex);
+    break;
+  case PaperChange::Kind::QuestionMoved:
+    kind(RecordKind::QuestionMoved);
+    out.integer<qint32>(change.sectionIndex);
+    out.integer<qint32>(change.fromIndex);
+    out.integer<qint32>(change.questionIndex);
+    break;
+  }
+  appendRecord(payload);
+}
+
+void PaperJournal::appendRecord(const QByteArray &payload) {
+  auto task = std::make_shared<Task>(Task::Kind::Record);
+  task->record = frameRecord(payload);
+  m_journalBytes += task->record.size();
+  enqueue(task);
+
+  if (m_journalBytes > qMax(MIN_COMPACT_BYTES, m_checkpointBytes.load())) {
+    checkpoint();
+  }
+}
+
+void PaperJournal::setErrorHandler(ErrorHandler handler) {
+  m_errorHandler = std::move(handler);
+}
+
+void PaperJournal::setDocumentPath(const QString &path) {
+  if (!m_listener) {
+    return;
+  }
+  QByteArray payload;
+  BlockWriter out(payload);
+  out.integer<quint8>(static_cast<quint8>(RecordKind::DocumentPath));
+  out.string(path);
+
+  auto task = std::make_shared<Task>(Task::Kind::DocumentPath);
+  task->record = frameRecord(payload);
+  task->documentPath = path;
+  m_journalBytes += task->record.size();
+  enqueue(task);
+}
+
+void PaperJournal::checkpoint() {
+  if (!m_listener) {
+    return;
+  }
+  auto task = std::make_shared<Task>(Task::Kind::Checkpoint);
+  task->snapshot = m_model.snapshot();
+  m_journalBytes = 0;
+  enqueue(task);
+}
+
+QFuture<bool> PaperJournal::save(SaveFunction save) {
+  auto task = std::make_shared<Task>(Task::Kind::Save);
+  task->snapshot = m_model.snapshot();
+  task->save = std::move(save);
+  task->promise.start();
+  const QFuture<bool> future = task->promise.future();
+  enqueue(task);
+  return future;
+}
+
+void PaperJournal::sync() {
+  auto task = std::make_shared<Task>(Task::Kind::Sync);
+  enqueue(task);
+  task->done.acquire();
+}
+
+void PaperJournal::enqueue(const std::shared_ptr<Task> &task) {
+  QMutexLocker locker(&m_mutex);
+  m_tasks.enqueue(task);
+  m_wake.wakeOne();
+}
+
+void PaperJournal::run() {
+  QMutexLocker locker(&m_mutex);
+  while (true) {
+    while (m_tasks.isEmpty() && !m_stopping) {
+      if (m_writer->error.isEmpty()) {
+        m_wake.wait(&m_mutex);
+      } else if (!m_wake.wait(&m_mutex, RETRY_DELAY_MS)) {
+        break; // Time to retry the failed write
+      }
+    }
+    if (m_tasks.isEmpty() && m_stopping) {
+      return;
+    }
+
+    // Everything that queued up while the last group was being written
+    // forms the next group and shares one fsync
+    QQueue<std::shared_ptr<Task>> tasks;
+    tasks.swap(m_tasks);
+    locker.unlock();
+
+    for (const std::shared_ptr<Task> &task : tasks) {
+      switch (task->kind) {
+      case Task::Kind::DocumentPath:
+        m_writer->documentPath = task->documentPath;
+        Q_FALLTHROUGH();
+      case Task::Kind::Record:
+        m_writer->pending += task->record;
+        break;
+      case Task::Kind::Checkpoint:
+        retry();
+        if (writeCheckpoint(task->snapshot)) {
+          // Records still pending are part of the checkpoint
+          m_writer->pending.clear();
+          m_writer->unwrittenCheckpoint.reset();
+        } else if (!m_writer->journal->isOpen()) {
+          // Nothing to append to; the snapshot replaces what is pending
+          m_writer->pending.clear();
+          m_writer->unwrittenCheckpoint = task->snapshot;
+        }
+        break;
+      case Task::Kind::Save: {
+        retry();
+        const bool saved = task->save(*task->snapshot);
+        task->promise.addResult(saved);
+        task->promise.finish();
+        break;
+      }
+      case Task::Kind::Sync:
+        retry();
+        task->done.release();
+        break;
+      }
+      // Snapshots are released here rather than at the end of the group
+      task->snapshot.reset();
+    }
+    if (retry()) {
+      reportError(QString());
+    }
+    locker.relock();
+  }
+}
+
+bool PaperJournal::commit() {
+  WriterState &writer = *m_writer;
+  if (writer.pending.isEmpty()) {
+    return true;
+  }
+  QFile &journal = *writer.journal;
+  if (!journal.isOpen()) {
+    reportError(QObject::tr("The journal is not open."));
+    return false;
+  }
+  // A partly written group is cut off again so that the retry follows the
+  // last complete record
+  const qint64 end = journal.pos();
+  if (journal.write(writer.pending) != writer.pending.size() ||
+      !syncToDisk(journal)) {
+    reportError(journal.errorString());
+    journal.resize(end);
+    journal.seek(end);
+    return false;
+  }
+  writer.pending.clear();
+  ++m_commits;
+  return true;
+}
+
+bool PaperJournal::retry() {
+  WriterState &writer = *m_writer;
+  if (writer.unwrittenCheckpoint) {
+    if (!writeCheckpoint(writer.unwrittenCheckpoint)) {
+      return false;
+    }
+    writer.unwrittenCheckpoint.reset();
+  }
+  return commit();
+}
+
+bool PaperJournal::writeCheckpoint(const PaperSnapshot &snapshot) {
+  WriterState &writer = *m_writer;
+  QDir directory(m_directory);
+  const quint32 generation = m_generation.load() + 1;
+  const QString checkpointPath = directory.filePath(checkpointName(generation));
+  if (!PaperFile::save(*snapshot, checkpointPath)) {
+    directory.remove(checkpointName(generation));
+    reportError(QObject::tr("Cannot write %1.").arg(checkpointPath));
+    return false;
+  }
+
+  // The new journal starts with the document path, which the old one may
+  // only have in a record
+  QByteArray header(JOURNAL_SIGNATURE, sizeof(JOURNAL_SIGNATURE));
+  BlockWriter out(header);
+  out.integer<quint16>(FORMAT_VERSION);
+  out.integer<quint16>(0);
+  out.integer<quint32>(generation);
+  out.string(writer.documentPath);
+
+  // The old journal stays open until the new one is complete, so a failure
+  // here leaves records appending to generation N
+  auto journal =
+      std::make_unique<QFile>(directory.filePath(journalName(generation)));
+  if (!journal->open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+      journal->write(header) != header.size() || !syncToDisk(*journal)) {
+    reportError(journal->errorString());
+    journal->close();
+    // A checkpoint without its journal must not be taken for the newest
+    directory.remove(journalName(generation));
+    directory.remove(checkpointName(generation));
+    return false;
+  }
+  writer.journal = std::move(journal);
+
+  // Generation N+1 is complete; everything older can go
+  for (quint32 old : checkpointGenerations(m_directory)) {
+    if (old != generation) {
+      directory.remove(checkpointName(old));
+      directory.remove(journalName(old));
+    }
+  }
+  m_generation = generation;
+  m_checkpointBytes = QFileInfo(checkpointPath).size();
+  return true;
+}
+
+void PaperJournal::reportError(const QString &error) {
+  WriterState &writer = *m_writer;
+  if (writer.error == error) {
+    return;
+  }
+  writer.error = error;
+  if (m_errorHandler) {
+    m_errorHandler(error);
+  }
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFuture>
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+#include <QWaitCondition>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "PaperModel.h"
+
+class QLockFile;
+class QThread;
+
+/**
+ * @file PaperJournal.h
+ * @brief Defines the PaperJournal class, the autosave and crash recovery log.
+ */
+
+/**
+ * @class PaperJournal
+ * @brief Records every change to a PaperModel in an append-only journal.
+ *
+ * Each tracked change is encoded on the spot, in time proportional to the
+ * edit, and handed to a writer thread. The writer appends everything that
+ * queued up while it was busy in one write and makes it durable with one
+ * fsync (group commit), so bursts of edits cost a single disk flush.
+ *
+ * The journal replays on top of a checkpoint, a complete .epf snapshot of
+ * the paper. Once the journal outgrows the checkpoint, or on clear(), a new
+ * checkpoint is written from a model snapshot and the journal starts over.
+ * Files carry a generation number: checkpoint-N.epf and journal-N.log.
+ * Generation N+1 is complete before N is deleted, so a crash at any point
+ * leaves a checkpoint and journal that agree.
+ *
+ * Failed writes are not dropped. Records that could not be written stay
+ * queued and the writer retries them every few seconds; when a checkpoint
+ * cannot be written the journal keeps appending to the current generation.
+ * The error handler hears about the failure and the recovery.
+ *
+ * Journal file: "EPFJ", u16 version, u16 flags, u32 generation and the
+ * document path as a PaperCodec string, then records. A record is a u32
+ * payload size, the payload's CRC-32 and the payload: a u8 change kind and
+ * its indices and content. Recovery stops at the first incomplete or
+ * damaged record, which can only be the tail of an interrupted write.
+ *
+ * Saves of the paper to the user's own file run on the same thread, from a
+ * snapshot, so the window never waits for a large paper to be written.
+ *
+ * The journal directory is locked; a second instance of the application
+ * gets no journal rather than sharing one.
+ */
+class PaperJournal
+{
+public:
+    static constexpr quint16 FORMAT_VERSION = 1;
+
+    /**
+     * @brief Writes the paper to its file; runs on the writer thread.
+     */
+    using SaveFunction = std::function<bool(const PaperModel &paper)>;
+
+    /**
+     * @brief Told why writing the journal failed; runs on the writer thread.
+     *
+     * Called again with an empty string once a retry succeeds.
+     */
+    using ErrorHandler = std::function<void(const QString &error)>;
+
+    /**
+     * @brief Creates a journal for @p model and starts the writer thread.
+     *
+     * Nothing is recorded until open() and start().
+     */
+    explicit PaperJournal(PaperModel &model);
+
+    /**
+     * @brief Writes what is queued, stops the writer and, if the journal was
+     * started, deletes its files: the session ended cleanly.
+     */
+    ~PaperJournal();
+
+    PaperJournal(const PaperJournal &) = delete;
+    PaperJournal &operator=(const PaperJournal &) = delete;
+
+    /**
+     * @brief Locks @p directory, creating it if needed.
+     * @return false if another instance holds the lock or the directory
+     * cannot be created; errorString() says why
+     */
+    bool open(const QString &directory);
+
+    bool isOpen() const { return !m_directory.isEmpty(); }
+    QString errorString() const { return m_errorString; }
+
+    /**
+     * @brief Whether the directory holds a journal from a session that did
+     * not close cleanly.
+     */
+    bool hasRecovery() const;
+
+    /**
+     * @brief Loads the newest checkpoint into @p paper and replays its
+     * journal.
+     * @param documentPath Set to the file the paper was last saved to or
+     * opened from, if any
+     * @return false if there is nothing readable to recover
+     */
+    bool recover(PaperModel &paper, QString *documentPath = nullptr) const;
+
+    /**
+     * @brief Replaces any old files with a checkpoint of the model and
+     * records every change from now on.
+     */
+    void start();
+
+    /**
+     * @brief Sets the handler for write failures. Call before start().
+     */
+    void setErrorHandler(ErrorHandler handler);
+
+    /**
+     * @brief Records the file the paper belongs to, e.g. after Save As.
+     */
+    void setDocumentPath(const QString &path);
+
+    /**
+     * @brief Writes a new checkpoint now and starts an empty journal.
+     */
+    void checkpoint();
+
+    /**
+     * @brief Saves a snapshot of the model on the writer thread.
+     *
+     * The snapshot is taken now; changes queued before it are written first.
+     * @return Future holding the result of @p save
+     */
+    QFuture<bool> save(SaveFunction save);
+
+    /**
+     * @brief Blocks until everything queued so far is on disk.
+     */
+    void sync();
+
+    /**
+     * @brief Generation of the current checkpoint, 0 before start().
+     */
+    quint32 generation() const { return m_generation.load(); }
+
+    /**
+     * @brief Number of fsyncs of the journal so far.
+     */
+    int commitCount() const { return m_commits.load(); }
+
+private:
+    struct Task;
+
+    PaperModel &m_model;
+    QString m_directory;
+    QString m_errorString;
+    std::unique_ptr<QLockFile> m_lock;
+    int m_listener = 0;
+    qint64 m_journalBytes = 0; // Queued since the last checkpoint
+    ErrorHandler m_errorHandler;
+
+    // Shared with the writer thread
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    QQueue<std::shared_ptr<Task>> m_tasks;
+    bool m_stopping = false;
+    QThread *m_thread = nullptr;
+    std::atomic<quint32> m_generation{0};
+    std::atomic<qint64> m_checkpointBytes{0};
+    std::atomic<int> m_commits{0};
+
+    // Writer thread only
+    struct WriterState;
+    std::unique_ptr<WriterState> m_writer;
+
+    void record(const PaperChange &change);
+    void appendRecord(const QByteArray &payload);
+    void enqueue(const std::shared_ptr<Task> &task);
+    void run();
+    bool commit();
+    bool retry();
+    bool writeCheckpoint(const PaperSnapshot &snapshot);
+    void reportError(const QString &error);
+    bool replay(const QString &path, PaperModel &paper, QString *documentPath) const;
+};
@@ -0,0 +1,945 @@
+#include "PaperJson.h"
+#include "AssetStore.h"
+#include "PaperModel.h"
+#include "StringPool.h"
+#include <QDate>
+#include <QFile>
+#include <QHash>
+#include <QIODevice>
+#include <QLatin1String>
+#include <QObject>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QSet>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <cstring>
+#include <limits>
+
+/**
+ * @file PaperJson.cpp
+ * @brief Implementation of the streaming paper JSON writer and reader.
+ */
+
+namespace {
+constexpr qsizetype WRITE_FLUSH_SIZE = 64 * 1024;
+constexpr int INDENT = 2;
+
+const QString FORMAT_NAME = QStringLiteral("exam-paper");
+
+const char *const QUESTION_TYPES[] = {"regular", "or", "mcq", "mixed"};
+
+/**
+ * JsonWriter: Appends JSON tokens to a buffer that is written out in large
+ * chunks. Containers put one member per line; compact arrays stay on one.
+ */
+class JsonWriter {
+public:
+  explicit JsonWriter(QIODevice &device) : m_device(device) {
+    m_buffer.reserve(WRITE_FLUSH_SIZE + 1024);
+  }
+
+  void beginObject() { open('{', false); }
+  void endObject() { close('}'); }
+  void beginArray(bool compact = false) { open('[', compact); }
+  void endArray() { close(']'); }
+
+  void key(const char *name) {
+    nextItem();
+    m_buffer += '"';
+    m_buffer += name;
+    m_buffer += "\": ";
+    m_afterKey = true;
+  }
+
+  void value(const QString &text) {
+    beginValue();
+    appendString(text);
+    flushIfFull();
+  }
+
+  void value(qint64 number) {
+    beginValue();
+    m_buffer += QByteArray::number(number);
+  }
+
+  void value(bool flag) {
+    beginValue();
+    m_buffer += flag ? "true" : "false";
+  }
+
+  void null() {
+    beginValue();
+    m_buffer += "null";
+  }
+
+  void strings(const QVector<QString> &list) {
+    beginArray(true);
+    for (const QString &text : list) {
+      value(text);
+    }
+    endArray();
+  }
+
+  bool finish() {
+    m_buffer += '\n';
+    return flush();
+  }
+
+private:
+  struct Level {
+    bool compact = false;
+    bool empty = true;
+  };
+
+  QIODevice &m_device;
+  QByteArray m_buffer;
+  QVector<Level> m_levels;
+  bool m_afterKey = false;
+  bool m_ok = true;
+
+  void open(char bracket, bool compact) {
+    beginValue();
+    m_buffer += bracket;
+    m_levels.append(Level{compact, true});
+  }
+
+  void close(char bracket) {
+    const Level level = m_levels.takeLast();
+    if (!level.empty && !level.compact) {
+      newline();
+    }
+    m_buffer += bracket;
+    flushIfFull();
+  }
+
+  void beginValue() {
+    if (m_afterKey) {
+      m_afterKey = false;
+    } else if (!m_levels.isEmpty()) {
+      nextItem();
+    }
+  }
+
+  // Separator and line break before a member or element
+  void nextItem() {
+    Level &level = m_levels.last();
+    if (!level.empty) {
+      m_buffer += ',';
+    }
+    if (level.compact) {
+      if (!level.empty) {
+        m_buffer += ' ';
+      }
+    } else {
+      newline();
+    }
+    level.empty = false;
+  }
+
+  void newline() {
+    m_buffer += '\n';
+    m_buffer.append(m_levels.size() * INDENT, ' ');
+  }
+
+  void appendString(const QString &text) {
+    static const char HEX[] = "0123456789abcdef";
+    const QByteArray utf8 = text.toUtf8();
+    const char *data = utf8.constData();
+    const qsizetype size = utf8.size();
+    m_buffer += '"';
+    qsizetype runStart = 0;
+    for (qsizetype i = 0; i < size; ++i) {
+      const uchar c = uchar(data[i]);
+      if (c >= 0x20 && c != '"' && c != '\\') {
+        continue;
+      }
+      m_buffer.append(data + runStart, i - runStart);
+      runStart = i + 1;
+      switch (c) {
+      case '"': m_buffer += "\\\""; break;
+      case '\\': m_buffer += "\\\\"; break;
+      case '\n': m_buffer += "\\n"; break;
+      case '\r': m_buffer += "\\r"; break;
+      case '\t': m_buffer += "\\t"; break;
+      default:
+        m_buffer += "\\u00";
+        m_buffer += HEX[c >> 4];
+        m_buffer += HEX[c & 0xF];
+        break;
+      }
+    }
+    m_buffer.append(data + runStart, size - runStart);
+    m_buffer += '"';
+  }
+
+  void flushIfFull() {
+    if (m_buffer.size() >= WRITE_FLUSH_SIZE) {
+      flush();
+    }
+  }
+
+  bool flush() {
+    if (m_ok && m_device.write(m_buffer) != m_buffer.size()) {
+      m_ok = false;
+    }
+    m_buffer.clear();
+    return m_ok;
+  }
+};
+
+/**
+ * JsonReader: Pull parser over a UTF-8 range. Errors stop it at the first
+ * problem, whose offset from the start of the document is kept; every read
+ * after that returns an empty value.
+ */
+class JsonReader {
+public:
+  JsonReader(const char *document, qsizetype begin, qsizetype end)
+      : m_data(document), m_pos(begin), m_end(end) {}
+
+  bool ok() const { return m_ok; }
+  qsizetype errorOffset() const { return m_errorOffset; }
+
+  bool atEnd() {
+    skipWhitespace();
+    return m_pos == m_end;
+  }
+
+  void fail() {
+    if (m_ok) {
+      m_ok = false;
+      m_errorOffset = m_pos;
+    }
+    m_pos = m_end;
+  }
+
+  bool beginObject() { return open('{'); }
+  bool beginArray() { return open('['); }
+
+  /**
+   * Reads the key of the next object member; false after the closing brace.
+   */
+  bool nextKey(QString &key) {
+    if (!next('}')) {
+      return false;
+    }
+    key = string();
+    skipWhitespace();
+    if (!consume(':')) {
+      fail();
+    }
+    return m_ok;
+  }
+
+  /**
+   * Moves to the next array element; false after the closing bracket.
+   */
+  bool nextElement() { return next(']'); }
+
+  QString string() {
+    skipWhitespace();
+    if (!consume('"')) {
+      fail();
+      return QString();
+    }
+
+    // Plain strings are converted in place
+    const qsizetype start = m_pos;
+    qsizetype pos = start;
+    while (pos < m_end && m_data[pos] != '"' && m_data[pos] != '\\') {
+      ++pos;
+    }
+    if (pos < m_end && m_data[pos] == '"') {
+      m_pos = pos + 1;
+      return QString::fromUtf8(m_data + start, pos - start);
+    }
+
+    QByteArray utf8(m_data + start, pos - start);
+    m_pos = pos;
+    while (m_pos < m_end && m_data[m_pos] != '"') {
+      const char c = m_data[m_pos++];
+      if (c != '\\') {
+        utf8 += c;
+        continue;
+      }
+      if (m_pos == m_end) {
+        break;
+      }
+      switch (m_data[m_pos++]) {
+      case '"': utf8 += '"'; break;
+      case '\\': utf8 += '\\'; break;
+      case '/': utf8 += '/'; break;
+      case 'b': utf8 += '\b'; break;
+      case 'f': utf8 += '\f'; break;
+      case 'n': utf8 += '\n'; break;
+      case 'r': utf8 += '\r'; break;
+      case 't': utf8 += '\t'; break;
+      case 'u':
+        if (!appendEscapedCodePoint(utf8)) {
+          fail();
+          return QString();
+        }
+        break;
+      default:
+        fail();
+        return QString();
+      }
+    }
+    if (!consume('"')) {
+      fail();
+      return QString();
+    }
+    return QString::fromUtf8(utf8);
+  }
+
+  qint64 integer() {
+    skipWhitespace();
+    const bool negative = consume('-');
+    if (m_pos == m_end || !isDigit(m_data[m_pos])) {
+      fail();
+      return 0;
+    }
+    qint64 value = 0;
+    while (m_pos < m_end && isDigit(m_data[m_pos])) {
+      if (value > (std::numeric_limits<qint64>::max() - 9) / 10) {
+        fail();
+        return 0;
+      }
+      value = value * 10 + (m_data[m_pos++] - '0');
+    }
+    return negative ? -value : value;
+  }
+
+  int intValue() {
+    const qint64 value = integer();
+    if (value < std::numeric_limits<int>::min() ||
+        value > std::numeric_limits<int>::max()) {
+      fail();
+      return 0;
+    }
+    return int(value);
+  }
+
+  bool boolean() {
+    if (literal("true")) {
+      return true;
+    }
+    if (!literal("false")) {
+      fail();
+    }
+    return false;
+  }
+
+  /**
+   * Consumes a null if one comes next.
+   */
+  bool null() { return literal("null"); }
+
+  void skipValue() {
+    skipWhitespace();
+    if (m_pos == m_end) {
+      fail();
+      return;
+    }
+    const char c = m_data[m_pos];
+    if (c == '"') {
+      string();
+    } else if (c == '{' || c == '[') {
+      skipContainer();
+    } else {
+      // Number or literal
+      const qsizetype start = m_pos;
+      while (m_pos < m_end && isScalarChar(m_data[m_pos])) {
+        ++m_pos;
+      }
+      if (m_pos == start) {
+        fail();
+      }
+    }
+  }
+
+  /**
+   * Consumes the array that comes next and records where each element
+   * starts and ends, without parsing the elements. Containers are skipped
+   * by tracking only strings and brackets.
+   */
+  bool elementRanges(QVector<QPair<qsizetype, qsizetype>> &ranges) {
+    if (!beginArray()) {
+      return false;
+    }
+    while (nextElement()) {
+      skipWhitespace();
+      const qsizetype start = m_pos;
+      skipValue();
+      ranges.append(qMakePair(start, m_pos));
+    }
+    return m_ok;
+  }
+
+private:
+  const char *m_data;
+  qsizetype m_pos;
+  qsizetype m_end;
+  QVector<bool> m_first; // Per open container: no member read yet
+  bool m_ok = true;
+  qsizetype m_errorOffset = -1;
+
+  static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+  static bool isScalarChar(char c) {
+    return isDigit(c) || (c >= 'a' && c <= 'z') || c == '-' || c == '+' ||
+           c == '.' || c == 'E';
+  }
+
+  void skipWhitespace() {
+    while (m_pos < m_end) {
+      const char c = m_data[m_pos];
+      if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+        break;
+      }
+      ++m_pos;
+    }
+  }
+
+  bool consume(char c) {
+    if (m_pos < m_end && m_data[m_pos] == c) {
+      ++m_pos;
+      return true;
+    }
+    return false;
+  }
+
+  bool literal(const char *word) {
+    skipWhitespace();
+    const qsizetype length = qsizetype(std::strlen(word));
+    if (m_end - m_pos >= length &&
+        std::memcmp(m_data + m_pos, word, length) == 0) {
+      m_pos += length;
+      return true;
+    }
+    return false;
+  }
+
+  bool open(char bracket) {
+    skipWhitespace();
+    if (!consume(bracket)) {
+      fail();
+      return false;
+    }
+    m_first.append(true);
+    return true;
+  }
+
+  bool next(char closing) {
+    skipWhitespace();
+    if (!m_ok) {
+      return false;
+    }
+    if (consume(closing)) {
+      m_first.removeLast();
+      return false;
+    }
+    if (!m_first.last() && !consume(',')) {
+      fail();
+      return false;
+    }
+    m_first.last() = false;
+    return true;
+  }
+
+  void skipContainer() {
+    int depth = 0;
+    while (m_pos < m_end) {
+      const char c = m_data[m_pos++];
+      if (c == '"') {
+        while (m_pos < m_end && m_data[m_pos] != '"') {
+          m_pos += m_data[m_pos] == '\\' ? 2 : 1;
+        }
+        if (m_pos >= m_end) {
+          break;
+        }
+        ++m_pos;
+      } else if (c == '{' || c == '[') {
+        ++depth;
+      } else if ((c == '}' || c == ']') && --depth == 0) {
+        return;
+      }
+    }
+    m_pos = qMin(m_pos, m_end);
+    fail();
+  }
+
+  bool hex4(uint &value) {
+    if (m_end - m_pos < 4) {
+      return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = m_data[m_pos++];
+      value <<= 4;
+      if (c >= '0' && c <= '9') {
+        value |= uint(c - '0');
+      } else if (c >= 'a' && c <= 'f') {
+        value |= uint(c - 'a' + 10);
+      } else if (c >= 'A' && c <= 'F') {
+        value |= uint(c - 'A' + 10);
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // After "\u": the code point, joined with a following low surrogate
+  bool appendEscapedCodePoint(QByteArray &utf8) {
+    uint codePoint = 0;
+    if (!hex4(codePoint)) {
+      return false;
+    }
+    if (codePoint >= 0xD800 && codePoint < 0xDC00 && m_end - m_pos >= 6 &&
+        m_data[m_pos] == '\\' && m_data[m_pos + 1] == 'u') {
+      const qsizetype highEnd = m_pos;
+      m_pos += 2;
+      uint low = 0;
+      if (hex4(low) && low >= 0xDC00 && low < 0xE000) {
+        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+      } else {
+        m_pos = highEnd;
+      }
+    }
+    // Lone surrogates become U+FFFD when the UTF-8 is converted
+    if (codePoint < 0x80) {
+      utf8 += char(codePoint);
+    } else if (codePoint < 0x800) {
+      utf8 += char(0xC0 | (codePoint >> 6));
+      utf8 += char(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+      utf8 += char(0xE0 | (codePoint >> 12));
+      utf8 += char(0x80 | ((codePoint >> 6) & 0x3F));
+      utf8 += char(0x80 | (codePoint & 0x3F));
+    } else {
+      utf8 += char(0xF0 | (codePoint >> 18));
+      utf8 += char(0x80 | ((codePoint >> 12) & 0x3F));
+      utf8 += char(0x80 | ((codePoint >> 6) & 0x3F));
+      utf8 += char(0x80 | (codePoint & 0x3F));
+    }
+    return true;
+  }
+};
+
+void writeExam(JsonWriter &out, const Exam &exam) {
+  out.beginObject();
+  out.key("title");
+  out.value(exam.title);
+  out.key("subject");
+  out.value(exam.subject);
+  out.key("duration");
+  out.value(exam.duration);
+  out.key("totalMarks");
+  out.value(qint64(exam.totalMarks));
+  out.key("passMarks");
+  out.value(qint64(exam.passMarks));
+  out.key("className");
+  out.value(exam.className);
+  out.key("examDate");
+  if (exam.examDate.isValid()) {
+    out.value(exam.examDate.toString(Qt::ISODate));
+  } else {
+    out.null();
+  }
+  out.key("term");
+  out.value(exam.term);
+  out.key("landscape");
+  out.value(exam.isLandscape);
+  out.endObject();
+}
+
+void writeQuestion(JsonWriter &out, const Question &question) {
+  out.beginObject();
+  out.key("type");
+  out.value(QString::fromLatin1(QUESTION_TYPES[int(question.type())]));
+  out.key("text");
+  out.value(question.text);
+  if (!question.diagramPath.isEmpty()) {
+    out.key("diagram");
+    out.value(question.diagramPath);
+  }
+  if (!question.table.isEmpty()) {
+    out.key("table");
+    out.beginArray();
+    for (const QVector<QString> &row : question.table) {
+      out.strings(row);
+    }
+    out.endArray();
+  }
+
+  if (const auto *payload = question.as<OrPayload>()) {
+    out.key("alternative");
+    out.value(payload->alternative);
+  } else if (const auto *payload = question.as<McqPayload>()) {
+    out.key("options");
+    out.strings(payload->options);
+    out.key("correctIndex");
+    out.value(qint64(payload->correctIndex));
+  } else if (const auto *payload = question.as<MixedPayload>()) {
+    out.key("options");
+    out.strings(payload->options);
+  }
+  out.endObject();
+}
+
+void writeSection(JsonWriter &out, const Section &section) {
+  out.beginObject();
+  out.key("label");
+  out.value(section.label);
+  out.key("subtitle");
+  out.value(section.subtitle);
+  out.key("questions");
+  out.beginArray();
+  for (const Question &question : section.questions) {
+    writeQuestion(out, question);
+  }
+  out.endArray();
+  out.endObject();
+}
+
+// Blobs behind the paper's embedded diagrams, each once, base64-encoded
+void writeAssets(JsonWriter &out, const PaperModel &model) {
+  AssetStore &store = AssetStore::shared();
+  QSet<QString> written;
+  for (const Section &section : model.sections) {
+    for (const Question &question : section.questions) {
+      const QString &reference = question.diagramPath;
+      if (!AssetStore::isReference(reference) || written.contains(reference) ||
+          !store.contains(reference)) {
+        continue;
+      }
+      if (written.isEmpty()) {
+        out.key("assets");
+        out.beginObject();
+      }
+      written.insert(reference);
+      out.key(reference.toLatin1().constData());
+      out.value(QString::fromLatin1(store.data(reference).toBase64()));
+    }
+  }
+  if (!written.isEmpty()) {
+    out.endObject();
+  }
+}
+
+void readStrings(JsonReader &in, QVector<QString> &list) {
+  list.clear();
+  if (in.beginArray()) {
+    while (in.nextElement()) {
+      list.append(in.string());
+    }
+  }
+}
+
+void readExam(JsonReader &in, Exam &exam) {
+  if (!in.beginObject()) {
+    return;
+  }
+  QString key;
+  while (in.nextKey(key)) {
+    if (key == QLatin1String("title")) {
+      exam.title = in.string();
+    } else if (key == QLatin1String("subject")) {
+      exam.subject = in.string();
+    } else if (key == QLatin1String("duration")) {
+      exam.duration = in.string();
+    } else if (key == QLatin1String("totalMarks")) {
+      exam.totalMarks = in.intValue();
+    } else if (key == QLatin1String("passMarks")) {
+      exam.passMarks = in.intValue();
+    } else if (key == QLatin1String("className")) {
+      exam.className = in.string();
+    } else if (key == QLatin1String("examDate")) {
+      exam.examDate = in.null() ? QDate()
+                                : QDate::fromString(in.string(), Qt::ISODate);
+    } else if (key == QLatin1String("term")) {
+      exam.term = in.string();
+    } else if (key == QLatin1String("landscape")) {
+      exam.isLandscape = in.boolean();
+    } else {
+      in.skipValue();
+    }
+  }
+}
+
+void readQuestion(JsonReader &in, Question &question) {
+  if (!in.beginObject()) {
+    return;
+  }
+  // Members may come in any order, so the payload is assembled at the end
+  int type = int(QuestionType::Regular);
+  QString alternative;
+  QVector<QString> options;
+  int correctIndex = -1;
+  QString key;
+  while (in.nextKey(key)) {
+    if (key == QLatin1String("type")) {
+      const QString name = in.string();
+      type = -1;
+      for (int i = 0; i <= int(QuestionType::Mixed); ++i) {
+        if (name == QLatin1String(QUESTION_TYPES[i])) {
+          type = i;
+        }
+      }
+      if (type < 0) {
+        in.fail();
+      }
+    } else if (key == QLatin1String("text")) {
+      question.text = in.string();
+    } else if (key == QLatin1String("diagram")) {
+      question.diagramPath = in.string();
+    } else if (key == QLatin1String("table")) {
+      question.table.clear();
+      if (in.beginArray()) {
+        while (in.nextElement()) {
+          question.table.append(QVector<QString>());
+          readStrings(in, question.table.last());
+        }
+      }
+    } else if (key == QLatin1String("alternative")) {
+      alternative = in.string();
+    } else if (key == QLatin1String("options")) {
+      readStrings(in, options);
+    } else if (key == QLatin1String("correctIndex")) {
+      correctIndex = in.intValue();
+    } else {
+      in.skipValue();
+    }
+  }
+
+  question.setType(static_cast<QuestionType>(qMax(type, 0)));
+  if (auto *payload = question.as<OrPayload>()) {
+    payload->alternative = alternative;
+  } else if (auto *payload = question.as<McqPayload>()) {
+    payload->options = options;
+    payload->correctIndex = correctIndex;
+  } else if (auto *payload = question.as<MixedPayload>()) {
+    payload->options = options;
+  }
+  question.id = newNodeId();
+  StringPool::shared().internQuestion(question);
+}
+
+// Stored once the file is known to be a paper
+void readAssets(JsonReader &in, QHash<QString, QByteArray> &assets) {
+  if (!in.beginObject()) {
+    return;
+  }
+  QString reference;
+  while (in.nextKey(reference)) {
+    const QByteArray data = QByteArray::fromBase64(in.string().toLatin1());
+    if (in.ok()) {
+      assets.insert(reference, data);
+    }
+  }
+}
+
+void readSection(JsonReader &in, Section &section) {
+  if (!in.beginObject()) {
+    return;
+  }
+  QString key;
+  while (in.nextKey(key)) {
+    if (key == QLatin1String("label")) {
+      section.label = in.string();
+    } else if (key == QLatin1String("subtitle")) {
+      section.subtitle = in.string();
+    } else if (key == QLatin1String("questions")) {
+      section.questions.clear();
+      if (in.beginArray()) {
+        while (in.nextElement()) {
+          section.questions.append(Question());
+          readQuestion(in, section.questions.last());
+        }
+      }
+    } else {
+      in.skipValue();
+    }
+  }
+  section.id = newNodeId();
+}
+
+bool setError(QString *errorString, const QString &message) {
+  if (errorString) {
+    *errorString = message;
+  }
+  return false;
+}
+
+QString syntaxError(qsizetype offset) {
+  return QObject::tr("Invalid paper JSON at byte %1.").arg(offset);
+}
+} // namespace
+
+bool PaperJson::write(const PaperModel &model, QIODevice &device) {
+  JsonWriter out(device);
+  out.beginObject();
+  out.key("format");
+  out.value(FORMAT_NAME);
+  out.key("version");
+  out.value(qint64(FORMAT_VERSION));
+  out.key("exam");
+  writeExam(out, model.exam);
+  out.key("sections");
+  out.beginArray();
+  for (const Section &section : model.sections) {
+    writeSection(out, section);
+  }
+  out.endArray();
+  writeAssets(out, model);
+  out.endObject();
+  return out.finish();
+}
+
+bool PaperJson::save(const PaperModel &model, const QString &path,
+                     QString *errorString) {
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly) || !write(model, file)) {
+    file.cancelWriting();
+    return setError(errorString, file.errorString());
+  }
+  if (!file.commit()) {
+    return setError(errorString, file.errorString());
+  }
+  return true;
+}
+
+bool PaperJson::read(const char *data, qsizetype size, PaperModel &model,
+                     QString *errorString) {
+  qsizetype start = 0;
+  if (size >= 3 && data[0] == '\xEF' && data[1] == '\xBB' &&
+      data[2] == '\xBF') {
+    start = 3; // UTF-8 byte order mark
+  }
+
+  // Whatever else a file that is not a JSON object is, it is not a paper
+  qsizetype first = start;
+  while (first < size && (data[first] == ' ' || data[first] == '\t' ||
+                          data[first] == '\r' || data[first] == '\n')) {
+    ++first;
+  }
+  if (first == size || data[first] != '{') {
+    return setError(errorString, QObject::tr("Not an exam paper file."));
+  }
+
+  // Top level in this thread; sections are only delimited here
+  JsonReader in(data, start, size);
+  Exam exam;
+  QString format;
+  qint64 version = 0; // Missing
+  QVector<QPair<qsizetype, qsizetype>> ranges;
+  QHash<QString, QByteArray> assets;
+  if (in.beginObject()) {
+    QString key;
+    while (in.nextKey(key)) {
+      if (key == QLatin1String("format")) {
+        format = in.string();
+      } else if (key == QLatin1String("version")) {
+        version = in.integer();
+      } else if (key == QLatin1String("exam")) {
+        readExam(in, exam);
+      } else if (key == QLatin1String("sections")) {
+        ranges.clear();
+        in.elementRanges(ranges);
+      } else if (key == QLatin1String("assets")) {
+        readAssets(in, assets);
+      } else {
+        in.skipValue();
+      }
+    }
+  }
+  if (!in.atEnd()) {
+    in.fail();
+  }
+  if (!in.ok()) {
+    return setError(errorString, syntaxError(in.errorOffset()));
+  }
+  if (format != FORMAT_NAME) {
+    return setError(errorString, QObject::tr("Not an exam paper file."));
+  }
+  if (version < 1) {
+    return setError(errorString,
+                    QObject::tr("The paper file has no format version."));
+  }
+  if (version > FORMAT_VERSION) {
+    return setError(errorString,
+                    QObject::tr("The paper was saved by a newer version of "
+                                "the application (format %1).")
+                        .arg(version));
+  }
+
+  // Sections parse concurrently, each with its own reader over its range
+  const int count = ranges.size();
+  QVector<Section> sections(count);
+  QVector<qsizetype> errors(count, -1);
+  Section *results = sections.data();
+  qsizetype *errorOffsets = errors.data();
+  std::atomic<int> next{0};
+
+  const auto work = [&]() {
+    for (int i = next++; i < count; i = next++) {
+      JsonReader sectionIn(data, ranges[i].first, ranges[i].second);
+      readSection(sectionIn, results[i]);
+      if (!sectionIn.atEnd()) {
+        sectionIn.fail();
+      }
+      if (!sectionIn.ok()) {
+        errorOffsets[i] = sectionIn.errorOffset();
+      }
+    }
+  };
+
+  // Same scheme as parallel rendering: the calling thread works too and
+  // helpers only count if the pool could start them
+  QThreadPool *pool = QThreadPool::globalInstance();
+  QSemaphore finished;
+  int helpers = 0;
+  while (helpers < count - 1 && pool->tryStart([&work, &finished]() {
+    work();
+    finished.release();
+  })) {
+    ++helpers;
+  }
+  work();
+  finished.acquire(helpers);
+
+  for (qsizetype offset : errors) {
+    if (offset >= 0) {
+      return setError(errorString, syntaxError(offset));
+    }
+  }
+
+  // A blob that does not match its key is damaged; only its diagram goes
+  // missing
+  for (auto it = assets.cbegin(); it != assets.cend(); ++it) {
+    AssetStore::shared().insert(it.key(), it.value());
+  }
+  model.exam = exam;
+  model.setSections(sections);
+  return true;
+}
+
+bool PaperJson::load(const QString &path, PaperModel &model,
+                     QString *errorString) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    return setError(errorString, file.errorString());
+  }
+  const qint64 size = file.size();
+  const uchar *mapped = size > 0 ? file.map(0, size) : nullptr;
+  if (mapped) {
+    return read(reinterpret_cast<const char *>(mapped), size, model,
+                errorString);
+  }
+  // Not mappable, e.g. some network file systems
+  const QByteArray data = file.readAll();
+  return read(data, model, errorString);
+}
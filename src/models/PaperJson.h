@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+class PaperModel;
+class QIODevice;
+
+/**
+ * @file PaperJson.h
+ * @brief Human-readable JSON form of a paper, for diffing and interchange.
+ *
+ * The writer streams the paper exam first, then section by section, one key
+ * per line, so two versions of a paper diff cleanly. Nothing is built in
+ * between: no QJsonDocument, no whole-document buffer.
+ *
+ * The reader pulls values straight into Exam, Section and Question objects.
+ * It first finds where each element of the "sections" array starts and ends
+ * with a quick scan that only tracks strings and brackets, then parses the
+ * sections concurrently on the global QThreadPool. Files are memory-mapped
+ * rather than read into a buffer. A file must name the "exam-paper" format
+ * and a version this reader supports. Unknown keys are skipped, so files
+ * that gain keys in later versions still load as far as this version
+ * understands them.
+ *
+ * Layout:
+ * @code
+ * {
+ *   "format": "exam-paper",
+ *   "version": 1,
+ *   "exam": { "title": "...", "totalMarks": 80, "examDate": "2024-03-15", ... },
+ *   "sections": [
+ *     { "label": "Section A", "subtitle": "...", "questions": [
+ *       { "type": "mcq", "text": "...", "diagram": "...", "table": [["x", "y"]],
+ *         "options": ["...", "..."], "correctIndex": 1 }
+ *     ] }
+ *   ],
+ *   "assets": { "asset:9f86d0...": "iVBORw0KGgo..." }
+ * }
+ * @endcode
+ * "type" is one of "regular", "or" (with "alternative"), "mcq" and "mixed".
+ * A "diagram" is a file path or an AssetStore reference; "assets" holds the
+ * referenced blobs, base64-encoded, and is only written when there are any.
+ */
+namespace PaperJson {
+    /**
+     * Format version written by write(); readers reject newer versions.
+     */
+    constexpr int FORMAT_VERSION = 1;
+
+    /**
+     * Streams @p model to @p device as UTF-8 JSON.
+     */
+    bool write(const PaperModel &model, QIODevice &device);
+
+    /**
+     * Writes @p model to @p path, replacing the file atomically.
+     */
+    bool save(const PaperModel &model, const QString &path, QString *errorString = nullptr);
+
+    /**
+     * Parses a paper from UTF-8 JSON into @p model, replacing its exam and
+     * sections. On failure the model is unchanged and @p errorString, if
+     * given, names the byte offset of a syntax error, or says the JSON is
+     * not a paper or has a missing or newer version.
+     */
+    bool read(const char *data, qsizetype size, PaperModel &model, QString *errorString = nullptr);
+
+    inline bool read(const QByteArray &json, PaperModel &model, QString *errorString = nullptr) {
+        return read(json.constData(), json.size(), model, errorString);
+    }
+
+    /**
+     * Maps the file at @p path and parses it with read().
+     */
+    bool load(const QString &path, PaperModel &model, QString *errorString = nullptr);
+}
@@ -1,6 +1,16 @@
 #include "PaperModel.h"
-#include <QChar>
-#include <QStringBuilder>
+#include "PaperHtml.h"
+#include <QByteArray>
+#include <QHash>
+#include <QIODevice>
+#include <QLatin1String>
+#include <QSet>
+#include <QSemaphore>
+#include <QStringView>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <variant>
 
 /**
  * @file PaperModel.cpp
@@ -14,342 +24,614 @@ PaperModel::PaperModel(const Exam &exam, const QVector<Section> &sections)
 // HTML generation constants
 namespace {
 constexpr int DEFAULT_MARGIN = 20;
-constexpr int QUESTION_NUMBER_WIDTH = 30;
-constexpr int OR_INDENT = 20;
-
-const QString HTML_HEADER_TEMPLATE = "<html>"
-                                     "<head>"
-                                     "<meta charset=\"utf-8\">"
-                                     "<style>"
-                                     "@page { "
-                                     "size: A4 %1; "
-                                     "margin: 15mm; "
-                                     "}"
-                                     "@media print { "
-                                     "body { "
-                                     "font-family:'%2', serif; "
-                                     "font-size:%3pt; "
-                                     "margin:0; "
-                                     "line-height:1.4; "
-                                     "max-width:100%; "
-                                     "}"
-                                     "}"
-                                     "body { "
-                                     "font-family:'%2', serif; "
-                                     "font-size:%3pt; "
-                                     "margin:10px; "
-                                     "line-height:1.4; "
-                                     "max-width:100%; "
-                                     "box-sizing:border-box; "
-                                     "}"
-                                     "p { "
-                                     "margin:0; "
-                                     "padding:0; "
-                                     "}"
-                                     "h1 { "
-                                     "text-align:center; "
-                                     "margin-bottom:6px; "
-                                     "font-size:1.3em; "
-                                     "font-weight:bold; "
-                                     "}"
-                                     "h2 { "
-                                     "text-align:center; "
-                                     "margin-top:12px; "
-                                     "margin-bottom:3px; "
-                                     "font-size:1.0em; "
-                                     "font-weight:bold; "
-                                     "}"
-                                     ".metadata { "
-                                     "text-align:center; "
-                                     "margin-bottom:12px; "
-                                     "font-size:0.8em; "
-                                     "}"
-                                     ".section { "
-                                     "margin-top:12px; "
-                                     "page-break-inside:avoid; "
-                                     "}"
-                                     ".subtitle { "
-                                     "text-align:center; "
-                                     "font-weight:bold; "
-                                     "font-size:0.85em; "
-                                     "margin-bottom:6px; "
-                                     "font-style:italic; "
-                                     "}"
-                                     ".question { "
-                                     "margin:2px 0; "
-                                     "text-align:left; "
-                                     "}"
-                                     ".question-layout { "
-                                     "width:100%; "
-                                     "border-collapse:collapse; "
-                                     "}"
-                                     ".question-layout td { "
-                                     "border:none; "
-                                     "padding:0; "
-                                     "vertical-align:top; "
-                                     "}"
-                                     ".question-num-cell { "
-                                     "width:%4px; "
-                                     "font-weight:bold; "
-                                     "}"
-                                     ".or-question { "
-                                     "margin-left:%5px; "
-                                     "margin-top:2px; "
-                                     "}"
-                                     ".mcq-options { "
-                                     "margin-left:15px; "
-                                     "margin-top:1px; "
-                                     "line-height:1.2; "
-                                     "}"
-                                     "table { "
-                                     "border-collapse:collapse; "
-                                     "width:100%; "
-                                     "margin:3px 0; "
-                                     "font-size:0.85em; "
-                                     "}"
-                                     "td, th { "
-                                     "border:1px solid #000; "
-                                     "padding:2px 4px; "
-                                     "text-align:left; "
-                                     "}"
-                                     "th { "
-                                     "background-color:#f5f5f5; "
-                                     "font-weight:bold; "
-                                     "}"
-                                     "img { "
-                                     "max-width:100%; "
-                                     "height:auto; "
-                                     "margin:2px 0; "
-                                     "display:block; "
-                                     "}"
-                                     ".mcq-table { "
-                                     "width: 95%; "
-                                     "border: none; "
-                                     "margin-left: 15px; "
-                                     "margin-top: 5px; "
-                                     "}"
-                                     ".mcq-table td { "
-                                     "border: none; "
-                                     "padding: 2px 10px; "
-                                     "vertical-align: top; "
-                                     "}"
-                                     ".data-table { "
-                                     "float: right; "
-                                     "width: auto; "
-                                     "margin: 0 0 5px 15px; "
-                                     "border: 1px solid #000; "
-                                     "}"
-                                     ".data-table td, .data-table th { "
-                                     "border: 1px solid #000; "
-                                     "}"
-                                     ".question-image { "
-                                     "margin: 5px; "
-                                     "}"
-                                     "</style>"
-                                     "</head>"
-                                     "<body>";
+constexpr int ESTIMATED_HEADER_SIZE = 4096;
+constexpr int ESTIMATED_QUESTION_SIZE = 512;
+constexpr int PARALLEL_CHUNK_QUESTIONS = 32;
+constexpr int PARALLEL_CHUNKS_PER_THREAD = 4;
+
+// Questions [first, end) of one section, rendered as a unit by a worker.
+struct SectionChunk {
+  int section;
+  int first;
+  int end;
+};
+
+// Kept items of the old order that setSections() has not placed yet. Those
+// items fill the positions from the next one to place onwards in their old
+// order, so an item's current index is that position plus the unplaced
+// items before it. A Fenwick tree counts them in O(log n).
+class PendingOrder {
+public:
+  explicit PendingOrder(int size) : m_tree(size + 1, 0) {
+    for (int i = 1; i <= size; ++i) {
+      ++m_tree[i];
+      const int parent = i + (i & -i);
+      if (parent <= size) {
+        m_tree[parent] += m_tree[i];
+      }
+    }
+  }
+
+  // Unplaced items among the first @p count of the old order
+  int before(int count) const {
+    int total = 0;
+    for (int i = count; i > 0; i -= i & -i) {
+      total += m_tree[i];
+    }
+    return total;
+  }
+
+  void place(int oldIndex) {
+    for (int i = oldIndex + 1; i < m_tree.size(); i += i & -i) {
+      --m_tree[i];
+    }
+  }
+
+private:
+  QVector<int> m_tree;
+};
+
+// IDs of @p items, skipping unassigned ones
+template <typename T> QSet<NodeId> idsOf(const QVector<T> &items) {
+  QSet<NodeId> ids;
+  ids.reserve(items.size());
+  for (const T &item : items) {
+    if (item.id != 0) {
+      ids.insert(item.id);
+    }
+  }
+  return ids;
+}
+
+// Old index of each item by ID
+template <typename T> QHash<NodeId, int> positionsOf(const QVector<T> &items) {
+  QHash<NodeId, int> positions;
+  positions.reserve(items.size());
+  for (int i = 0; i < items.size(); ++i) {
+    positions.insert(items.at(i).id, i);
+  }
+  return positions;
+}
+
+// Answer parts rendered below the question layout table, one overload per
+// question type.
+void appendPayloadHtml(QString &, const RegularPayload &) {}
+
+void appendPayloadHtml(QString &out, const OrPayload &payload) {
+  PaperHtml::appendOrAlternative(out, payload.alternative);
+}
+
+void appendPayloadHtml(QString &out, const McqPayload &payload) {
+  PaperHtml::appendMcqOptions(out, payload.options);
+}
+
+void appendPayloadHtml(QString &out, const MixedPayload &payload) {
+  PaperHtml::appendMixedOptions(out, payload.options);
+}
 } // namespace
 
 QString PaperModel::toHtml(const QString &fontFamily, int fontSize,
                            bool portrait) const {
-  // Build HTML using QString builder for better performance
   QString html;
-  html.reserve(4096); // Reserve initial capacity to reduce reallocations
+  html.reserve(ESTIMATED_HEADER_SIZE +
+               getTotalQuestions() * ESTIMATED_QUESTION_SIZE);
+  renderDocument(RenderStyle{fontFamily, fontSize, portrait},
+                 [&html](const QString &chunk) {
+                   html += chunk;
+                   return true;
+                 });
+  return html;
+}
 
-  // HTML header with CSS
-  QString orientation = portrait ? "portrait" : "landscape";
-  html = QString(HTML_HEADER_TEMPLATE)
-             .arg(orientation)
-             .arg(fontFamily)
-             .arg(fontSize)
-             .arg(QUESTION_NUMBER_WIDTH)
-             .arg(OR_INDENT);
+bool PaperModel::render(QIODevice &device, const QString &fontFamily,
+                        int fontSize, bool portrait) const {
+  return render(device, fontFamily, fontSize, portrait, SectionCallback());
+}
 
-  // Exam title
-  if (!exam.title.isEmpty()) {
-    html += "<h1>" % exam.title.toHtmlEscaped() % "</h1>";
+bool PaperModel::render(QIODevice &device, const QString &fontFamily,
+                        int fontSize, bool portrait,
+                        const SectionCallback &sectionRendered) const {
+  return render(device, RenderStyle{fontFamily, fontSize, portrait},
+                sectionRendered);
+}
+
+bool PaperModel::render(QIODevice &device, const RenderStyle &style,
+                        const SectionCallback &sectionRendered) const {
+  if (!device.isWritable()) {
+    return false;
   }
 
-  // Exam metadata
-  html += "<div class=\"metadata\">";
-  QStringList metadataParts;
+  // Transcode and write one fragment at a time so peak memory is bounded by
+  // the largest question rather than the whole document.
+  return renderDocument(
+      style,
+      [&device](const QString &chunk) {
+        const QByteArray utf8 = chunk.toUtf8();
+        return device.write(utf8) == utf8.size();
+      },
+      sectionRendered);
+}
 
-  if (!exam.subject.isEmpty()) {
-    metadataParts << exam.subject.toHtmlEscaped();
+template <typename Sink>
+bool PaperModel::renderDocument(const RenderStyle &style, Sink &&sink,
+                                const SectionCallback &sectionRendered) const {
+  if (!sink(PaperHtml::header(style)) || !sink(renderTitleBlock())) {
+    return false;
   }
-  if (!exam.duration.isEmpty()) {
-    metadataParts << exam.duration.toHtmlEscaped();
-  }
-  if (exam.totalMarks > 0) {
-    metadataParts << QString("Total Marks: %1").arg(exam.totalMarks);
+
+  // Render each section, reusing cached question fragments
+  bool ok = true;
+  m_renderCache->beginPass();
+  if (m_parallelRendering) {
+    ok = renderSectionsParallel(style, sink, sectionRendered);
+  } else {
+    for (int i = 0; i < sections.size(); ++i) {
+      if (!renderSection(sections[i], style, sink) ||
+          (sectionRendered && !sectionRendered(i + 1))) {
+        ok = false;
+        break;
+      }
+    }
   }
-  if (exam.passMarks > 0) {
-    metadataParts << QString("Pass Marks: %1").arg(exam.passMarks);
+  m_renderCache->endPass();
+
+  return ok && sink(QStringLiteral("</body></html>"));
+}
+
+QString PaperModel::renderTitleBlock() const {
+  return PaperHtml::titleBlock(exam);
+}
+
+template <typename Sink>
+bool PaperModel::renderSection(const Section &section, const RenderStyle &style,
+                               Sink &&sink) const {
+  if (!sink(renderSectionOpening(section))) {
+    return false;
   }
-  if (!exam.className.isEmpty()) {
-    metadataParts << QString("Class: %1").arg(exam.className.toHtmlEscaped());
+
+  // Render questions; numbering restarts in every section
+  int questionNumber = 1;
+  for (const Question &question : section.questions) {
+    if (!sink(renderQuestionCached(question, questionNumber, style))) {
+      return false;
+    }
+    ++questionNumber;
   }
 
-  html += metadataParts.join(" | ");
-  html += "</div>";
+  return sink(QStringLiteral("</div>"));
+}
 
-  // Separator line
-  html += "<hr style=\"border: 0; border-top: 2px solid #000; margin: 10px 0 "
-          "20px 0;\" />";
+template <typename Sink>
+bool PaperModel::renderSectionsParallel(
+    const RenderStyle &style, Sink &&sink,
+    const SectionCallback &sectionRendered) const {
+  // Split every section into chunks of questions. Numbering restarts in each
+  // section, so chunks are independent and can render in any order.
+  QVector<SectionChunk> chunks;
+  for (int i = 0; i < sections.size(); ++i) {
+    const int count = sections[i].questions.size();
+    int first = 0;
+    do {
+      const int end = qMin(first + PARALLEL_CHUNK_QUESTIONS, count);
+      chunks.append(SectionChunk{i, first, end});
+      first = end;
+    } while (first < count);
+  }
 
-  // Render each section
-  for (const Section &section : sections) {
-    html += renderSection(section);
+  // Render a bounded batch at a time and hand it to the sink in order, so a
+  // streaming sink never holds more than one batch of fragments.
+  QThreadPool *pool = QThreadPool::globalInstance();
+  const int batchSize =
+      qMax(1, pool->maxThreadCount()) * PARALLEL_CHUNKS_PER_THREAD;
+
+  for (int batchStart = 0; batchStart < chunks.size();
+       batchStart += batchSize) {
+    const int batchCount = qMin(batchSize, int(chunks.size()) - batchStart);
+    QVector<QString> fragments(batchCount);
+    QString *results = fragments.data();
+    const SectionChunk *batch = chunks.constData() + batchStart;
+    std::atomic<int> next{0};
+
+    const auto work = [&]() {
+      for (int i = next++; i < batchCount; i = next++) {
+        const SectionChunk &chunk = batch[i];
+        results[i] = renderQuestionRange(sections[chunk.section], chunk.first,
+                                         chunk.end, style);
+      }
+    };
+
+    // The calling thread works too. Helpers only count if the pool could
+    // start them, so a saturated pool degrades to serial instead of blocking.
+    QSemaphore finished;
+    int helpers = 0;
+    while (helpers < batchCount - 1 && pool->tryStart([&work, &finished]() {
+      work();
+      finished.release();
+    })) {
+      ++helpers;
+    }
+    work();
+    finished.acquire(helpers);
+
+    for (int i = 0; i < batchCount; ++i) {
+      if (!sink(fragments[i])) {
+        return false;
+      }
+      // The last chunk of a section completes it
+      const SectionChunk &chunk = batch[i];
+      if (sectionRendered &&
+          chunk.end == sections[chunk.section].questions.size() &&
+          !sectionRendered(chunk.section + 1)) {
+        return false;
+      }
+    }
   }
 
-  html += "</body></html>";
+  return true;
+}
+
+QString PaperModel::renderSectionOpening(const Section &section) const {
+  return PaperHtml::sectionOpening(section.label, section.subtitle);
+}
+
+QString PaperModel::renderQuestionRange(const Section &section, int first,
+                                        int end,
+                                        const RenderStyle &style) const {
+  QString html;
+  if (first == 0) {
+    html += renderSectionOpening(section);
+  }
+  for (int i = first; i < end; ++i) {
+    html += renderQuestionCached(section.questions[i], i + 1, style);
+  }
+  if (end == section.questions.size()) {
+    html += QLatin1String("</div>");
+  }
   return html;
 }
 
-QString PaperModel::renderSection(const Section &section) const {
-  QString sectionHtml = "<div class=\"section\">";
+QString PaperModel::renderQuestionCached(const Question &question,
+                                         int questionNumber,
+                                         const RenderStyle &style) const {
+  const RenderCache::Key key(question, questionNumber, style);
+  return m_renderCache->fetch(
+      key, [&]() { return renderQuestion(question, questionNumber, style); });
+}
 
-  // Section label (centered heading)
-  if (!section.label.isEmpty()) {
-    sectionHtml += "<h2>" % section.label.toHtmlEscaped() % "</h2>";
+QString PaperModel::renderQuestion(const Question &question,
+                                   int questionNumber,
+                                   const RenderStyle &style) const {
+  QString questionHtml;
+  questionHtml.reserve(question.text.size() + ESTIMATED_QUESTION_SIZE);
+
+  PaperHtml::appendQuestionOpening(questionHtml, questionNumber, question.text,
+                                   question.diagramPath, style.inlineDiagrams);
+
+  // Render table if present (floated right)
+  if (!question.table.isEmpty()) {
+    PaperHtml::appendTableOpening(questionHtml);
+    for (int row = 0; row < question.table.size(); ++row) {
+      // First row as header
+      PaperHtml::appendTableRow(questionHtml, row == 0, question.table[row]);
+    }
+    PaperHtml::appendTableEnd(questionHtml);
   }
 
-  // Section subtitle (if present)
-  if (!section.subtitle.isEmpty()) {
-    sectionHtml += "<div class=\"subtitle\">" %
-                   section.subtitle.toHtmlEscaped() % "</div>";
+  PaperHtml::appendQuestionBodyEnd(questionHtml);
+
+  // Type-specific answer parts, dispatched on the payload alternative
+  std::visit(
+      [&questionHtml](const auto &payload) {
+        appendPayloadHtml(questionHtml, payload);
+      },
+      question.payload);
+
+  PaperHtml::appendQuestionEnd(questionHtml);
+  return questionHtml;
+}
+
+bool PaperModel::isValid() const {
+  return !exam.title.isEmpty() && !sections.isEmpty();
+}
+
+int PaperModel::getTotalQuestions() const {
+  int total = 0;
+  for (const Section &section : sections) {
+    total += section.questions.size();
   }
+  return total;
+}
 
-  // Render questions
-  int questionNumber = 1;
-  for (const Question &question : section.questions) {
-    sectionHtml += renderQuestion(question, questionNumber);
-    ++questionNumber;
+void PaperModel::clear() {
+  exam = Exam();
+  sections.clear();
+  notify(PaperChange());
+}
+
+void PaperModel::setExam(const Exam &next) {
+  if (exam == next) {
+    return;
   }
+  exam = next;
 
-  sectionHtml += "</div>";
-  return sectionHtml;
+  PaperChange change;
+  change.kind = PaperChange::Kind::ExamUpdated;
+  notify(change);
 }
 
-QString PaperModel::renderQuestion(const Question &question,
-                                   int questionNumber) const {
-  QString questionHtml = "<div class=\"question\">";
+void PaperModel::setSections(const QVector<Section> &next) {
+  // Drop sections that are gone, then walk the new order inserting and
+  // moving; every remaining section is found at or after its new index.
+  // Reads go through at() so an unchanged model stays shared with its
+  // snapshots. IDs are looked up in hashes built once, so a sync costs
+  // O(n log n) however large the paper is.
+  const QSet<NodeId> nextIds = idsOf(next);
+  for (int i = sections.size() - 1; i >= 0; --i) {
+    if (!nextIds.contains(sections.at(i).id)) {
+      removeSection(i);
+    }
+  }
 
-  // Prepare floated content (Image + Data Table)
-  QString floatedContent;
+  const QHash<NodeId, int> positions = positionsOf(sections);
+  PendingOrder pending(sections.size());
+  QVector<bool> placed(sections.size(), false);
+  for (int i = 0; i < next.size(); ++i) {
+    const auto it = next[i].id != 0 ? positions.constFind(next[i].id)
+                                    : positions.constEnd();
+    if (it == positions.constEnd() || placed[*it]) {
+      insertSection(i, next[i]);
+      continue;
+    }
+    const int current = i + pending.before(*it);
+    pending.place(*it);
+    placed[*it] = true;
+    if (current != i) {
+      moveSection(current, i);
+    }
+    syncSection(i, next[i]);
+  }
+  // Only left over if the model held an ID twice
+  while (sections.size() > next.size()) {
+    removeSection(sections.size() - 1);
+  }
+}
 
-  // Embed diagram if present (floated right)
-  if (!question.diagramPath.isEmpty()) {
-    floatedContent += "<br/><img src=\"file://" % question.diagramPath %
-                      "\" width=\"150\" align=\"right\" "
-                      "class=\"question-image\" "
-                      "alt=\"Question diagram\" />";
+void PaperModel::syncSection(int index, const Section &next) {
+  // Unchanged since the last sync
+  if (next.version != 0 && sections.at(index).version == next.version) {
+    return;
   }
 
-  // Render table if present (floated right)
-  if (!question.table.isEmpty()) {
-    floatedContent += renderTable(question.table);
-  }
-
-  // Question Layout Table (Number | Text + Floats)
-  questionHtml += "<table class=\"question-layout\"><tr>"
-                  "<td class=\"question-num-cell\">" %
-                  QString::number(questionNumber) %
-                  ")</td>"
-                  "<td class=\"question-text-cell\">" %
-                  question.text % floatedContent % "</td></tr></table>";
-
-  // Handle OR-type questions
-  // Handle OR-type questions
-  if (question.type == QuestionType::Or && !question.subQuestions.isEmpty()) {
-    questionHtml += "<div style=\"text-align:center; font-weight:bold; margin: "
-                    "5px 0;\">OR</div>";
-
-    for (const Question &subQuestion : question.subQuestions) {
-      questionHtml += "<div class=\"or-question\">" %
-                      subQuestion.text.toHtmlEscaped() % "</div>";
+  // Same walk as setSections(), one level down
+  const QSet<NodeId> nextIds = idsOf(next.questions);
+  for (int i = sections.at(index).questions.size() - 1; i >= 0; --i) {
+    if (!nextIds.contains(sections.at(index).questions.at(i).id)) {
+      removeQuestion(index, i);
     }
   }
-  // Handle MCQ-type questions
-  else if (question.type == QuestionType::Mcq && !question.options.isEmpty()) {
-    questionHtml += "<div style=\"clear:both;\"></div>";
-    questionHtml += "<table class=\"mcq-table\">";
-    for (int i = 0; i < question.options.size(); i += 2) {
-      questionHtml += "<tr>";
-
-      // First column (a, c, ...)
-      const QChar label1 = QChar('a' + i);
-      questionHtml += "<td width=\"50%\">(" % label1 % ") " %
-                      question.options[i].toHtmlEscaped() % "</td>";
-
-      // Second column (b, d, ...)
-      if (i + 1 < question.options.size()) {
-        const QChar label2 = QChar('a' + i + 1);
-        questionHtml += "<td width=\"50%\">(" % label2 % ") " %
-                        question.options[i + 1].toHtmlEscaped() % "</td>";
+
+  const QHash<NodeId, int> positions =
+      positionsOf(sections.at(index).questions);
+  PendingOrder pending(sections.at(index).questions.size());
+  QVector<bool> placed(sections.at(index).questions.size(), false);
+  for (int i = 0; i < next.questions.size(); ++i) {
+    const Question &question = next.questions[i];
+    const auto it = question.id != 0 ? positions.constFind(question.id)
+                                     : positions.constEnd();
+    if (it == positions.constEnd() || placed[*it]) {
+      insertQuestion(index, i, question);
+      continue;
+    }
+    const int current = i + pending.before(*it);
+    pending.place(*it);
+    placed[*it] = true;
+    if (current != i) {
+      moveQuestion(index, current, i);
+    }
+    const Question &existing = sections.at(index).questions.at(i);
+    if (question.version == 0 || existing.version != question.version) {
+      if (existing == question) {
+        // Rebuilt, but nothing changed
+        sections[index].questions[i].version = question.version;
       } else {
-        questionHtml += "<td></td>";
+        updateQuestion(index, i, question);
       }
-
-      questionHtml += "</tr>";
     }
-    questionHtml += "</table>";
-  }
-  // Handle Mixed-type questions
-  else if (question.type == QuestionType::Mixed &&
-           !question.options.isEmpty()) {
-    questionHtml += "<div style=\"clear:both;\"></div>";
-    questionHtml += "<div class=\"mcq-options\">";
-    for (int i = 0; i < question.options.size(); ++i) {
-      const QChar optionLabel = QChar('a' + i);
-      questionHtml += "(" % optionLabel % ") " %
-                      question.options[i].toHtmlEscaped() % "<br/>";
+  }
+  while (sections.at(index).questions.size() > next.questions.size()) {
+    removeQuestion(index, sections.at(index).questions.size() - 1);
+  }
+
+  if (sections.at(index).label != next.label ||
+      sections.at(index).subtitle != next.subtitle) {
+    updateSection(index, next.label, next.subtitle);
+  }
+  if (sections.at(index).version != next.version) {
+    sections[index].version = next.version;
+  }
+}
+
+void PaperModel::insertSection(int index, Section section) {
+  if (section.id == 0) {
+    section.id = newNodeId();
+  }
+  for (Question &question : section.questions) {
+    if (question.id == 0) {
+      question.id = newNodeId();
     }
-    questionHtml += "</div>";
   }
+  sections.insert(index, section);
 
-  questionHtml += "</div>";
-  return questionHtml;
+  PaperChange change;
+  change.kind = PaperChange::Kind::SectionInserted;
+  change.sectionId = section.id;
+  change.sectionIndex = index;
+  notify(change);
+}
+
+void PaperModel::removeSection(int index) {
+  PaperChange change;
+  change.kind = PaperChange::Kind::SectionRemoved;
+  change.sectionId = sections[index].id;
+  change.sectionIndex = index;
+  sections.removeAt(index);
+  notify(change);
+}
+
+void PaperModel::updateSection(int index, const QString &label,
+                               const QString &subtitle) {
+  Section &section = sections[index];
+  section.label = label;
+  section.subtitle = subtitle;
+  ++section.version;
+
+  PaperChange change;
+  change.kind = PaperChange::Kind::SectionUpdated;
+  change.sectionId = section.id;
+  change.sectionIndex = index;
+  notify(change);
 }
 
-QString PaperModel::renderTable(const QVector<QVector<QString>> &table) const {
-  if (table.isEmpty()) {
-    return QString();
+void PaperModel::moveSection(int from, int to) {
+  if (from == to) {
+    return;
   }
+  sections.move(from, to);
+
+  PaperChange change;
+  change.kind = PaperChange::Kind::SectionMoved;
+  change.sectionId = sections[to].id;
+  change.sectionIndex = to;
+  change.fromIndex = from;
+  notify(change);
+}
 
-  QString tableHtml = "<table class=\"data-table\">";
+void PaperModel::insertQuestion(int sectionIndex, int index,
+                                Question question) {
+  if (question.id == 0) {
+    question.id = newNodeId();
+  }
+  Section &section = sections[sectionIndex];
+  section.questions.insert(index, question);
+  ++section.version;
+
+  PaperChange change;
+  change.kind = PaperChange::Kind::QuestionInserted;
+  change.sectionId = section.id;
+  change.questionId = question.id;
+  change.sectionIndex = sectionIndex;
+  change.questionIndex = index;
+  notify(change);
+}
 
-  for (int row = 0; row < table.size(); ++row) {
-    tableHtml += "<tr>";
+void PaperModel::removeQuestion(int sectionIndex, int index) {
+  Section &section = sections[sectionIndex];
+  PaperChange change;
+  change.kind = PaperChange::Kind::QuestionRemoved;
+  change.sectionId = section.id;
+  change.questionId = section.questions[index].id;
+  change.sectionIndex = sectionIndex;
+  change.questionIndex = index;
+  section.questions.removeAt(index);
+  ++section.version;
+  notify(change);
+}
 
-    const auto &rowData = table[row];
-    const QString cellTag = (row == 0) ? "th" : "td"; // First row as header
+void PaperModel::updateQuestion(int sectionIndex, int index,
+                                Question question) {
+  Section &section = sections[sectionIndex];
+  Question &existing = section.questions[index];
+  question.id = existing.id;
+  if (question.version <= existing.version) {
+    question.version = existing.version + 1;
+  }
+  existing = question;
+  ++section.version;
+
+  PaperChange change;
+  change.kind = PaperChange::Kind::QuestionUpdated;
+  change.sectionId = section.id;
+  change.questionId = question.id;
+  change.sectionIndex = sectionIndex;
+  change.questionIndex = index;
+  notify(change);
+}
 
-    for (const QString &cell : rowData) {
-      tableHtml +=
-          "<" % cellTag % ">" % cell.toHtmlEscaped() % "</" % cellTag % ">";
+void PaperModel::moveQuestion(int sectionIndex, int from, int to) {
+  if (from == to) {
+    return;
+  }
+  Section &section = sections[sectionIndex];
+  section.questions.move(from, to);
+  ++section.version;
+
+  PaperChange change;
+  change.kind = PaperChange::Kind::QuestionMoved;
+  change.sectionId = section.id;
+  change.questionId = section.questions[to].id;
+  change.sectionIndex = sectionIndex;
+  change.questionIndex = to;
+  change.fromIndex = from;
+  notify(change);
+}
+
+int PaperModel::indexOfSection(NodeId id) const {
+  for (int i = 0; i < sections.size(); ++i) {
+    if (sections[i].id == id) {
+      return i;
     }
+  }
+  return -1;
+}
 
-    tableHtml += "</tr>";
+int PaperModel::indexOfQuestion(int sectionIndex, NodeId id) const {
+  const QVector<Question> &questions = sections[sectionIndex].questions;
+  for (int i = 0; i < questions.size(); ++i) {
+    if (questions[i].id == id) {
+      return i;
+    }
   }
+  return -1;
+}
+
+quint64 PaperModel::version() const { return m_version; }
 
-  tableHtml += "</table>";
-  return tableHtml;
+int PaperModel::addChangeListener(PaperChangeListener listener) {
+  const int handle = ++m_listeners.lastHandle;
+  m_listeners.entries.append(qMakePair(handle, std::move(listener)));
+  return handle;
 }
 
-bool PaperModel::isValid() const {
-  return !exam.title.isEmpty() && !sections.isEmpty();
+void PaperModel::removeChangeListener(int handle) {
+  m_listeners.entries.removeIf(
+      [handle](const QPair<int, PaperChangeListener> &entry) {
+        return entry.first == handle;
+      });
 }
 
-int PaperModel::getTotalQuestions() const {
-  int total = 0;
-  for (const Section &section : sections) {
-    total += section.questions.size();
+void PaperModel::notify(PaperChange change) {
+  change.modelVersion = ++m_version;
+  // Iterate a copy so listeners may add or remove listeners
+  const auto listeners = m_listeners.entries;
+  for (const auto &entry : listeners) {
+    entry.second(change);
   }
-  return total;
 }
 
-void PaperModel::clear() {
-  exam = Exam();
-  sections.clear();
-}
\ No newline at end of file
+PaperSnapshot PaperModel::snapshot() const {
+  return std::make_shared<const PaperModel>(*this);
+}
+
+void PaperModel::setParallelRendering(bool enabled) {
+  m_parallelRendering = enabled;
+}
+
+bool PaperModel::parallelRendering() const { return m_parallelRendering; }
+
+int PaperModel::renderCacheHits() const { return m_renderCache->hits(); }
+
+int PaperModel::renderCacheMisses() const { return m_renderCache->misses(); }
+
+void PaperModel::resetRenderCacheStats() { m_renderCache->resetStats(); }
+
+void PaperModel::clearRenderCache() { m_renderCache->clear(); }
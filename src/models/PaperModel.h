@@ -1,15 +1,69 @@
 #pragma once
 
+#include <QPair>
 #include <QString>
 #include <QVector>
+#include <functional>
+#include <memory>
 #include "Exam.h"
+#include "NodeId.h"
+#include "RenderCache.h"
 #include "Section.h"
 
+class QIODevice;
+class PaperModel;
+
 /**
  * @file PaperModel.h
  * @brief Defines the PaperModel class for exam paper representation and rendering.
  */
 
+/**
+ * @brief Immutable, thread-shareable view of a PaperModel.
+ */
+using PaperSnapshot = std::shared_ptr<const PaperModel>;
+
+/**
+ * @brief One change to the sections or questions of a PaperModel.
+ *
+ * Indices refer to the paper right after the change, so replaying changes in
+ * order turns the old paper into the new one.
+ */
+struct PaperChange
+{
+    enum class Kind {
+        Reset,            ///< Anything may have changed
+        SectionInserted,
+        SectionRemoved,   ///< sectionIndex is where the section was
+        SectionUpdated,   ///< Label or subtitle changed
+        SectionMoved,     ///< From fromIndex to sectionIndex
+        QuestionInserted,
+        QuestionRemoved,  ///< questionIndex is where the question was
+        QuestionUpdated,
+        QuestionMoved,    ///< From fromIndex to questionIndex
+        ExamUpdated       ///< Exam metadata replaced
+    };
+
+    Kind kind = Kind::Reset;
+    NodeId sectionId = 0;
+    NodeId questionId = 0; ///< Question changes only
+    int sectionIndex = -1;
+    int questionIndex = -1;
+    int fromIndex = -1;
+    quint64 modelVersion = 0; ///< PaperModel::version() after the change
+};
+
+/**
+ * @brief Callback receiving each PaperChange as it happens.
+ */
+using PaperChangeListener = std::function<void(const PaperChange&)>;
+
+/**
+ * @brief Callback run after each rendered section with the number of
+ * sections done so far; returning false stops rendering.
+ */
+using SectionCallback = std::function<bool(int sectionsDone)>;
+
 /**
  * @class PaperModel
  * @brief Model class representing a complete exam paper with metadata and sections.
@@ -19,6 +73,12 @@
  * to export the exam paper to various formats, primarily HTML for preview and further
  * conversion to PDF or DOCX.
  * 
+ * Sections and questions carry stable IDs and version counters. Edits made
+ * through the section and question methods below, or through setSections(),
+ * are reported to change listeners one node at a time, so caches can do work
+ * proportional to the edit. Writing to @ref sections or @ref exam directly is
+ * not tracked.
+ *
  * @note This class follows the Model component of the MVC pattern.
  */
 class PaperModel
@@ -70,6 +130,41 @@ public:
      */
     QString toHtml(const QString& fontFamily = "Times New Roman", int fontSize = 12, bool portrait = true) const;
 
+    /**
+     * @brief Streams the paper as UTF-8 HTML to a device.
+     *
+     * Produces the same document as toHtml(), but encodes and writes it one
+     * fragment at a time instead of building the whole document in memory.
+     * Use this for exports; the device must already be open for writing.
+     *
+     * @param device Output device, e.g. an open QFile
+     * @param fontFamily Font family for the document
+     * @param fontSize Font size in points
+     * @param portrait Page orientation
+     * @return true if every fragment was written successfully
+     */
+    bool render(QIODevice& device, const QString& fontFamily = "Times New Roman", int fontSize = 12, bool portrait = true) const;
+
+    /**
+     * @brief Streams the paper, reporting each finished section.
+     *
+     * Same as render() above. @p sectionRendered can report progress and
+     * stop an export between sections by returning false.
+     *
+     * @return true if every fragment was written and rendering was not stopped
+     */
+    bool render(QIODevice& device, const QString& fontFamily, int fontSize, bool portrait, const SectionCallback& sectionRendered) const;
+
+    /**
+     * @brief Streams the paper in a full render style.
+     *
+     * Same as render() above; the style can also switch diagrams to the
+     * inline form used by self-contained HTML exports.
+     *
+     * @return true if every fragment was written and rendering was not stopped
+     */
+    bool render(QIODevice& device, const RenderStyle& style, const SectionCallback& sectionRendered = SectionCallback()) const;
+
     /**
      * @brief Validates the exam paper structure.
      * @return true if the paper has valid exam metadata and at least one section
@@ -87,26 +182,264 @@ public:
      */
     void clear();
 
+    /**
+     * @brief Replaces the exam metadata, reporting an ExamUpdated change.
+     *
+     * Assigning to @ref exam directly is not tracked.
+     */
+    void setExam(const Exam& exam);
+
+    /**
+     * @brief Replaces the sections, reporting only what changed.
+     *
+     * Sections and questions are matched by ID. Nodes whose version is
+     * unchanged are skipped without comparing content; the rest produce
+     * insert, remove, move and update changes.
+     *
+     * @param sections The new sections, usually with IDs from an earlier call
+     */
+    void setSections(const QVector<Section>& sections);
+
+    /**
+     * @brief Inserts a section, assigning IDs where missing.
+     */
+    void insertSection(int index, Section section);
+
+    /**
+     * @brief Removes the section at @p index.
+     */
+    void removeSection(int index);
+
+    /**
+     * @brief Changes the label and subtitle of a section.
+     */
+    void updateSection(int index, const QString& label, const QString& subtitle);
+
+    /**
+     * @brief Moves a section from index @p from to index @p to.
+     */
+    void moveSection(int from, int to);
+
+    /**
+     * @brief Inserts a question into a section, assigning an ID if missing.
+     */
+    void insertQuestion(int sectionIndex, int index, Question question);
+
+    /**
+     * @brief Removes a question from a section.
+     */
+    void removeQuestion(int sectionIndex, int index);
+
+    /**
+     * @brief Replaces the content of a question, keeping its ID.
+     */
+    void updateQuestion(int sectionIndex, int index, Question question);
+
+    /**
+     * @brief Moves a question within its section.
+     */
+    void moveQuestion(int sectionIndex, int from, int to);
+
+    /**
+     * @brief Index of the section with ID @p id, or -1.
+     */
+    int indexOfSection(NodeId id) const;
+
+    /**
+     * @brief Index of the question with ID @p id in a section, or -1.
+     */
+    int indexOfQuestion(int sectionIndex, NodeId id) const;
+
+    /**
+     * @brief Number of tracked changes made to this paper.
+     *
+     * Snapshots keep the version they were taken at.
+     */
+    quint64 version() const;
+
+    /**
+     * @brief Registers a callback for every tracked change.
+     *
+     * Listeners belong to this object; copies and snapshots start without any.
+     *
+     * @param listener Called synchronously after each change
+     * @return Handle for removeChangeListener()
+     */
+    int addChangeListener(PaperChangeListener listener);
+
+    /**
+     * @brief Unregisters a callback added with addChangeListener().
+     */
+    void removeChangeListener(int handle);
+
+    /**
+     * @brief Takes an immutable snapshot of the paper.
+     *
+     * Sections, questions and their strings are implicitly shared with this
+     * model, so a snapshot costs one shallow copy; later edits to the model
+     * detach only the containers they touch. The snapshot can be handed to a
+     * worker thread and read there while the model keeps changing.
+     *
+     * @return Shared pointer to a const copy of the paper
+     */
+    PaperSnapshot snapshot() const;
+
+    /**
+     * @brief Enables rendering sections on the global QThreadPool.
+     *
+     * Sections are split into chunks of questions that render concurrently
+     * and are joined in document order, so the output is byte-identical to
+     * the serial path. Off by default.
+     *
+     * @param enabled true to render in parallel
+     */
+    void setParallelRendering(bool enabled);
+
+    /**
+     * @brief Whether sections are rendered on the global QThreadPool.
+     * @return true if parallel rendering is enabled
+     */
+    bool parallelRendering() const;
+
+    /**
+     * @brief Number of question fragments reused from the render cache.
+     * @return Hit count since the last resetRenderCacheStats()
+     */
+    int renderCacheHits() const;
+
+    /**
+     * @brief Number of question fragments rendered because they were not cached.
+     * @return Miss count since the last resetRenderCacheStats()
+     */
+    int renderCacheMisses() const;
+
+    /**
+     * @brief Resets the render cache hit/miss counters.
+     */
+    void resetRenderCacheStats();
+
+    /**
+     * @brief Drops every cached question fragment.
+     */
+    void clearRenderCache();
+
 private:
     /**
-     * @brief Renders a single section to HTML.
+     * @brief Cache of rendered question fragments.
+     *
+     * Shared between copies of the model; entries are keyed by content, so a
+     * copy can never be served another paper's markup.
+     */
+    std::shared_ptr<RenderCache> m_renderCache = std::make_shared<RenderCache>();
+
+    /**
+     * @brief Whether sections are rendered on the global QThreadPool.
+     */
+    bool m_parallelRendering = false;
+
+    /**
+     * @brief Change listeners; copying a model never copies them.
+     */
+    struct ChangeListeners
+    {
+        ChangeListeners() = default;
+        ChangeListeners(const ChangeListeners&) {}
+        ChangeListeners& operator=(const ChangeListeners&) { return *this; }
+
+        QVector<QPair<int, PaperChangeListener>> entries;
+        int lastHandle = 0;
+    };
+
+    ChangeListeners m_listeners;
+
+    /**
+     * @brief Number of tracked changes, see version().
+     */
+    quint64 m_version = 0;
+
+    /**
+     * @brief Bumps the version and passes a change to every listener.
+     */
+    void notify(PaperChange change);
+
+    /**
+     * @brief Brings the section at @p index in line with @p next, which has
+     * the same ID.
+     */
+    void syncSection(int index, const Section& next);
+
+    /**
+     * @brief Renders the whole document, passing each fragment to a sink.
+     * @param style Render style
+     * @param sink Callable taking a QString fragment, returning false to abort
+     * @param sectionRendered Optional callback after each section
+     * @return true if the sink accepted every fragment
+     */
+    template <typename Sink>
+    bool renderDocument(const RenderStyle& style, Sink&& sink, const SectionCallback& sectionRendered = SectionCallback()) const;
+
+    /**
+     * @brief Renders the exam title, metadata block and separator line.
+     * @return HTML string for the top of the paper
+     */
+    QString renderTitleBlock() const;
+
+    /**
+     * @brief Renders a single section, passing each fragment to a sink.
      * @param section The section to render
-     * @return HTML string for the section
+     * @param style Render style, part of the fragment cache key
+     * @param sink Callable taking a QString fragment, returning false to abort
+     * @return true if the sink accepted every fragment
      */
-    QString renderSection(const Section& section) const;
+    template <typename Sink>
+    bool renderSection(const Section& section, const RenderStyle& style, Sink&& sink) const;
 
     /**
-     * @brief Renders a single question to HTML.
+     * @brief Renders all sections concurrently and passes them to a sink in order.
+     * @param style Render style
+     * @param sink Callable taking a QString fragment, returning false to abort
+     * @param sectionRendered Optional callback after each section
+     * @return true if the sink accepted every fragment
+     */
+    template <typename Sink>
+    bool renderSectionsParallel(const RenderStyle& style, Sink&& sink, const SectionCallback& sectionRendered) const;
+
+    /**
+     * @brief Renders the opening of a section: wrapper, label and subtitle.
+     * @param section The section to render
+     * @return HTML string; the wrapper is closed after the last question
+     */
+    QString renderSectionOpening(const Section& section) const;
+
+    /**
+     * @brief Renders questions [first, end) of a section as one fragment.
+     *
+     * Includes the section opening when @p first is 0 and the closing tag
+     * when @p end is the question count.
+     *
+     * @param section The section to render
+     * @param first Index of the first question
+     * @param end Index one past the last question
+     * @param style Render style
+     * @return HTML string for the range
+     */
+    QString renderQuestionRange(const Section& section, int first, int end, const RenderStyle& style) const;
+
+    /**
+     * @brief Renders a question through the fragment cache.
      * @param question The question to render
      * @param questionNumber The question number
+     * @param style Render style, part of the fragment cache key
      * @return HTML string for the question
      */
-    QString renderQuestion(const Question& question, int questionNumber) const;
+    QString renderQuestionCached(const Question& question, int questionNumber, const RenderStyle& style) const;
 
     /**
-     * @brief Renders a table to HTML.
-     * @param table The table data
-     * @return HTML string for the table
+     * @brief Renders a single question to HTML.
+     * @param question The question to render
+     * @param questionNumber The question number
+     * @param style Render style, selects how the diagram is referenced
+     * @return HTML string for the question
      */
-    QString renderTable(const QVector<QVector<QString>>& table) const;
-};
\ No newline at end of file
+    QString renderQuestion(const Question& question, int questionNumber, const RenderStyle& style) const;
+};
@@ -1,21 +1,145 @@
 #pragma once
 
+#include <QHash>
 #include <QString>
 #include <QVector>
+#include <variant>
+#include "NodeId.h"
 
 enum class QuestionType { Regular, Or, Mcq, Mixed };
 
 /**
- * Question: Stores question text, optional diagram path and optional table.
+ * RegularPayload: A plain question has nothing beyond the common fields.
+ */
+struct RegularPayload
+{
+    bool operator==(const RegularPayload &) const { return true; }
+};
+
+/**
+ * OrPayload: The alternative question offered after "OR", plain text.
+ */
+struct OrPayload
+{
+    QString alternative;
+
+    bool operator==(const OrPayload &other) const { return alternative == other.alternative; }
+};
+
+/**
+ * McqPayload: Options laid out in two columns, with the correct answer.
+ */
+struct McqPayload
+{
+    QVector<QString> options;
+    int correctIndex = -1;
+
+    bool operator==(const McqPayload &other) const
+    {
+        return options == other.options && correctIndex == other.correctIndex;
+    }
+};
+
+/**
+ * MixedPayload: Options listed one per line.
+ */
+struct MixedPayload
+{
+    QVector<QString> options;
+
+    bool operator==(const MixedPayload &other) const { return options == other.options; }
+};
+
+/**
+ * Type-specific part of a question. Alternatives are in QuestionType order,
+ * so the active index is the question type.
+ */
+using QuestionPayload = std::variant<RegularPayload, OrPayload, McqPayload, MixedPayload>;
+
+static_assert(std::is_same_v<std::variant_alternative_t<static_cast<size_t>(QuestionType::Or), QuestionPayload>, OrPayload> &&
+                  std::is_same_v<std::variant_alternative_t<static_cast<size_t>(QuestionType::Mcq), QuestionPayload>, McqPayload> &&
+                  std::is_same_v<std::variant_alternative_t<static_cast<size_t>(QuestionType::Mixed), QuestionPayload>, MixedPayload>,
+              "QuestionPayload alternatives must follow QuestionType");
+
+/**
+ * Question: Stores question text, optional diagram path and optional table,
+ * plus a payload holding only what its type needs. The id and version track
+ * the question across edits; they take no part in comparison or hashing.
  */
 class Question
 {
 public:
-    QuestionType type = QuestionType::Regular;
     QString text; // HTML for formatting
     QString diagramPath;
     QVector<QVector<QString>> table;
-    QVector<Question> subQuestions; // For OR questions
-    QVector<QString> options; // For MCQ
-    int correctIndex = -1; // For MCQ
+    QuestionPayload payload;
+    NodeId id = 0;
+    quint64 version = 0; // Bumped on every edit
+
+    QuestionType type() const { return static_cast<QuestionType>(payload.index()); }
+
+    /**
+     * @brief Replaces the payload with an empty one of the given type.
+     */
+    void setType(QuestionType type)
+    {
+        switch (type) {
+        case QuestionType::Regular: payload = RegularPayload(); break;
+        case QuestionType::Or: payload = OrPayload(); break;
+        case QuestionType::Mcq: payload = McqPayload(); break;
+        case QuestionType::Mixed: payload = MixedPayload(); break;
+        }
+    }
+
+    /**
+     * @brief The payload if it has type T, otherwise nullptr.
+     */
+    template <typename T>
+    const T *as() const { return std::get_if<T>(&payload); }
+
+    template <typename T>
+    T *as() { return std::get_if<T>(&payload); }
+
+    bool operator==(const Question &other) const
+    {
+        return text == other.text && diagramPath == other.diagramPath &&
+               table == other.table && payload == other.payload;
+    }
 };
+
+inline size_t qHash(const RegularPayload &, size_t seed = 0)
+{
+    return seed;
+}
+
+inline size_t qHash(const OrPayload &payload, size_t seed = 0)
+{
+    return qHash(payload.alternative, seed);
+}
+
+inline size_t qHash(const McqPayload &payload, size_t seed = 0)
+{
+    return qHashMulti(seed, payload.correctIndex, payload.options.size(),
+                      qHashRange(payload.options.cbegin(), payload.options.cend()));
+}
+
+inline size_t qHash(const MixedPayload &payload, size_t seed = 0)
+{
+    return qHashMulti(seed, payload.options.size(),
+                      qHashRange(payload.options.cbegin(), payload.options.cend()));
+}
+
+/**
+ * Content hash over every field that affects how a question renders.
+ */
+inline size_t qHash(const Question &question, size_t seed = 0)
+{
+    seed = qHashMulti(seed, static_cast<int>(question.type()), question.text,
+                      question.diagramPath);
+    for (const QVector<QString> &row : question.table) {
+        seed = qHashMulti(seed, row.size(), qHashRange(row.cbegin(), row.cend()));
+    }
+    seed = qHashMulti(seed, question.table.size());
+    return std::visit([seed](const auto &payload) { return qHash(payload, seed); },
+                      question.payload);
+}
@@ -0,0 +1,53 @@
+#include "RenderCache.h"
+
+/**
+ * @file RenderCache.cpp
+ * @brief Implementation of the RenderCache class.
+ */
+
+void RenderCache::beginPass() {
+  QMutexLocker locker(&m_mutex);
+  ++m_generation;
+}
+
+void RenderCache::endPass() {
+  QMutexLocker locker(&m_mutex);
+  // Keep fragments from the previous pass as well, so toggling a question back
+  // and forth (undo/redo) still hits.
+  const quint64 oldest = m_generation > 0 ? m_generation - 1 : 0;
+  for (auto it = m_entries.begin(); it != m_entries.end();) {
+    if (it->generation < oldest) {
+      it = m_entries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void RenderCache::clear() {
+  QMutexLocker locker(&m_mutex);
+  m_entries.clear();
+  m_hits = 0;
+  m_misses = 0;
+}
+
+void RenderCache::resetStats() {
+  QMutexLocker locker(&m_mutex);
+  m_hits = 0;
+  m_misses = 0;
+}
+
+int RenderCache::hits() const {
+  QMutexLocker locker(&m_mutex);
+  return m_hits;
+}
+
+int RenderCache::misses() const {
+  QMutexLocker locker(&m_mutex);
+  return m_misses;
+}
+
+int RenderCache::size() const {
+  QMutexLocker locker(&m_mutex);
+  return static_cast<int>(m_entries.size());
+}
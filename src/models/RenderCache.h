@@ -0,0 +1,133 @@
+#pragma once
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include "Question.h"
+#include "RenderStyle.h"
+
+/**
+ * @file RenderCache.h
+ * @brief Defines the RenderCache class used to reuse rendered HTML fragments.
+ */
+
+/**
+ * @class RenderCache
+ * @brief Caches the HTML fragment of each question between renders.
+ *
+ * Fragments are keyed by the question's content together with its number
+ * and the render style, so an edit only re-renders the questions it touched.
+ * The content hash only picks the bucket; a hit also compares the question
+ * itself, so two questions whose hashes collide never share a fragment. Every render is bracketed by beginPass()/endPass(); entries not
+ * used during the last two passes are dropped so the cache tracks the current
+ * paper instead of every revision typed into it.
+ *
+ * All members are thread-safe; fragments may be fetched from several render
+ * workers at once. Fragments are rendered outside the lock.
+ */
+class RenderCache
+{
+public:
+    /**
+     * @brief Identifies one rendered question fragment.
+     */
+    struct Key
+    {
+        Key(const Question &question, int questionNumber, const RenderStyle &style)
+            : question(question), contentHash(qHash(question)),
+              questionNumber(questionNumber), style(style)
+        {
+        }
+
+        Question question; // Implicitly shared; compared on every hit
+        size_t contentHash = 0;
+        int questionNumber = 0;
+        RenderStyle style;
+
+        bool operator==(const Key &other) const
+        {
+            return contentHash == other.contentHash &&
+                   questionNumber == other.questionNumber && style == other.style &&
+                   question == other.question;
+        }
+    };
+
+    /**
+     * @brief Returns the cached fragment for @p key, rendering it on a miss.
+     * @param key Fragment identity
+     * @param render Callable returning the fragment HTML
+     * @return HTML fragment
+     */
+    template <typename Render>
+    QString fetch(const Key &key, Render &&render)
+    {
+        {
+            QMutexLocker locker(&m_mutex);
+            auto it = m_entries.find(key);
+            if (it != m_entries.end()) {
+                ++m_hits;
+                it->generation = m_generation;
+                return it->html;
+            }
+            ++m_misses;
+        }
+
+        QString html = render();
+        QMutexLocker locker(&m_mutex);
+        m_entries.insert(key, Entry{html, m_generation});
+        return html;
+    }
+
+    /**
+     * @brief Marks the start of a full document render.
+     */
+    void beginPass();
+
+    /**
+     * @brief Marks the end of a full document render and prunes stale fragments.
+     */
+    void endPass();
+
+    /**
+     * @brief Removes all fragments and resets the counters.
+     */
+    void clear();
+
+    /**
+     * @brief Resets the hit/miss counters without dropping fragments.
+     */
+    void resetStats();
+
+    /**
+     * @brief Number of fragments served from the cache.
+     */
+    int hits() const;
+
+    /**
+     * @brief Number of fragments that had to be rendered.
+     */
+    int misses() const;
+
+    /**
+     * @brief Number of fragments currently held.
+     */
+    int size() const;
+
+private:
+    struct Entry
+    {
+        QString html;
+        quint64 generation = 0;
+    };
+
+    mutable QMutex m_mutex;
+    QHash<Key, Entry> m_entries;
+    quint64 m_generation = 0;
+    int m_hits = 0;
+    int m_misses = 0;
+};
+
+inline size_t qHash(const RenderCache::Key &key, size_t seed = 0)
+{
+    return qHashMulti(seed, key.contentHash, key.questionNumber, key.style);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QHash>
+#include <QString>
+
+/**
+ * RenderStyle: Document-wide settings that affect the generated markup.
+ */
+struct RenderStyle
+{
+    QString fontFamily;
+    int fontSize = 12;
+    bool portrait = true;
+    // Diagrams become CSS classes; the HTML exporter embeds their image data
+    bool inlineDiagrams = false;
+
+    bool operator==(const RenderStyle &other) const
+    {
+        return fontSize == other.fontSize && portrait == other.portrait &&
+               inlineDiagrams == other.inlineDiagrams &&
+               fontFamily == other.fontFamily;
+    }
+    bool operator!=(const RenderStyle &other) const { return !(*this == other); }
+};
+
+inline size_t qHash(const RenderStyle &style, size_t seed = 0)
+{
+    return qHashMulti(seed, style.fontFamily, style.fontSize, style.portrait,
+                      style.inlineDiagrams);
+}
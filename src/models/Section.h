@@ -5,7 +5,8 @@
 #include "Question.h"
 
 /**
- * Section: Stores label, subtitle and list of questions.
+ * Section: Stores label, subtitle and list of questions. The version is
+ * bumped whenever the section or any of its questions changes.
  */
 class Section
 {
@@ -13,4 +14,6 @@ public:
     QString label;
     QString subtitle;
     QVector<Question> questions;
+    NodeId id = 0;
+    quint64 version = 0;
 };
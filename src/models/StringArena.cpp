@@ -0,0 +1,66 @@
+#include "StringArena.h"
+#include <algorithm>
+
+/**
+ * @file StringArena.cpp
+ * @brief Implementation of the StringArena class.
+ */
+
+StringArena::StringArena(qsizetype blockSize) : m_blockSize(blockSize) {}
+
+StringArena::StringArena(StringArena &&other) noexcept
+    : m_blocks(std::move(other.m_blocks)), m_blockSize(other.m_blockSize),
+      m_bytesAllocated(other.m_bytesAllocated), m_cursor(other.m_cursor),
+      m_remaining(other.m_remaining) {
+  other.clear();
+}
+
+StringArena &StringArena::operator=(StringArena &&other) noexcept {
+  if (this != &other) {
+    m_blocks = std::move(other.m_blocks);
+    m_blockSize = other.m_blockSize;
+    m_bytesAllocated = other.m_bytesAllocated;
+    m_cursor = other.m_cursor;
+    m_remaining = other.m_remaining;
+    other.clear();
+  }
+  return *this;
+}
+
+QStringView StringArena::store(QStringView text) {
+  const qsizetype size = text.size();
+  if (size == 0) {
+    return QStringView();
+  }
+
+  if (size > m_remaining) {
+    // Oversized strings get a block of their own so the current block keeps
+    // its free space for the small strings that follow.
+    if (size > m_blockSize / 4) {
+      m_blocks.emplace_back(new char16_t[size]);
+      m_bytesAllocated += size * qsizetype(sizeof(char16_t));
+      char16_t *data = m_blocks.back().get();
+      std::copy_n(text.utf16(), size, data);
+      return QStringView(data, size);
+    }
+    m_blocks.emplace_back(new char16_t[m_blockSize]);
+    m_bytesAllocated += m_blockSize * qsizetype(sizeof(char16_t));
+    m_cursor = m_blocks.back().get();
+    m_remaining = m_blockSize;
+  }
+
+  char16_t *data = m_cursor;
+  std::copy_n(text.utf16(), size, data);
+  m_cursor += size;
+  m_remaining -= size;
+  return QStringView(data, size);
+}
+
+void StringArena::clear() {
+  m_blocks.clear();
+  m_bytesAllocated = 0;
+  m_cursor = nullptr;
+  m_remaining = 0;
+}
+
+qsizetype StringArena::bytesAllocated() const { return m_bytesAllocated; }
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QStringView>
+#include <memory>
+#include <vector>
+
+/**
+ * @file StringArena.h
+ * @brief Defines the StringArena class, a monotonic store for string data.
+ */
+
+/**
+ * @class StringArena
+ * @brief Copies strings into large blocks that are released together.
+ *
+ * Storing a string is a bump of a pointer inside the current block; nothing
+ * is freed individually. Views returned by store() stay valid until clear()
+ * or destruction, including after the arena is moved.
+ */
+class StringArena
+{
+public:
+    /**
+     * @brief Constructs an empty arena.
+     * @param blockSize Capacity of each block in UTF-16 code units
+     */
+    explicit StringArena(qsizetype blockSize = 32 * 1024);
+
+    StringArena(const StringArena &) = delete;
+    StringArena &operator=(const StringArena &) = delete;
+    /**
+     * The blocks move with the arena; the source is left empty, so storing
+     * into it afterwards starts a block of its own.
+     */
+    StringArena(StringArena &&other) noexcept;
+    StringArena &operator=(StringArena &&other) noexcept;
+
+    /**
+     * @brief Copies text into the arena.
+     * @param text Text to store
+     * @return View of the stored copy; a null view for empty text
+     */
+    QStringView store(QStringView text);
+
+    /**
+     * @brief Releases every block at once; all views become dangling.
+     */
+    void clear();
+
+    /**
+     * @brief Number of bytes held by the arena's blocks.
+     */
+    qsizetype bytesAllocated() const;
+
+private:
+    std::vector<std::unique_ptr<char16_t[]>> m_blocks;
+    qsizetype m_blockSize;
+    qsizetype m_bytesAllocated = 0;
+    char16_t *m_cursor = nullptr;
+    qsizetype m_remaining = 0;
+};
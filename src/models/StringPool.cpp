@@ -0,0 +1,130 @@
+#include "StringPool.h"
+#include "../utils/HtmlUtils.h"
+
+/**
+ * @file StringPool.cpp
+ * @brief Implementation of the StringPool class.
+ */
+
+namespace {
+/**
+ * Passes the diagram path, table cells and options of @p question through
+ * @p share. The question text and OR alternative are free text, rarely
+ * repeated, and are not pooled.
+ */
+template <typename Share> void shareStrings(Question &question, Share share) {
+  question.diagramPath = share(question.diagramPath);
+
+  for (QVector<QString> &row : question.table) {
+    for (QString &cell : row) {
+      cell = share(cell);
+    }
+  }
+
+  if (McqPayload *mcq = question.as<McqPayload>()) {
+    for (QString &option : mcq->options) {
+      option = share(option);
+    }
+  } else if (MixedPayload *mixed = question.as<MixedPayload>()) {
+    for (QString &option : mixed->options) {
+      option = share(option);
+    }
+  }
+}
+} // namespace
+
+StringPool &StringPool::shared() {
+  static StringPool pool;
+  return pool;
+}
+
+QString StringPool::intern(const QString &text) {
+  if (text.isEmpty()) {
+    return QString();
+  }
+
+  {
+    QReadLocker locker(&m_lock);
+    const auto it = m_strings.constFind(text);
+    if (it != m_strings.constEnd()) {
+      return *it;
+    }
+  }
+
+  // Escape outside the lock; most strings need no escaping at all
+  QString escaped;
+  const char16_t *data = text.utf16();
+  if (HtmlUtils::findEscapable(data, 0, text.size()) != text.size()) {
+    HtmlUtils::appendEscaped(escaped, text);
+  }
+
+  QWriteLocker locker(&m_lock);
+  const auto it = m_strings.constFind(text);
+  if (it != m_strings.constEnd()) {
+    return *it;
+  }
+  m_strings.insert(text);
+  if (!escaped.isEmpty()) {
+    m_escaped.insert(text.constData(), escaped);
+  }
+  return text;
+}
+
+QString StringPool::pooled(const QString &text) const {
+  if (text.isEmpty()) {
+    return QString();
+  }
+  QReadLocker locker(&m_lock);
+  const auto it = m_strings.constFind(text);
+  return it != m_strings.constEnd() ? *it : text;
+}
+
+void StringPool::internQuestion(Question &question) {
+  shareStrings(question, [this](const QString &text) { return intern(text); });
+}
+
+void StringPool::shareQuestion(Question &question) const {
+  shareStrings(question, [this](const QString &text) { return pooled(text); });
+}
+
+void StringPool::appendEscaped(QString &out, const QString &text) const {
+  // A pooled string is always shared with the pool, so a detached string
+  // cannot be pooled and skips the lookup.
+  if (!text.isDetached()) {
+    QReadLocker locker(&m_lock);
+    const auto it = m_escaped.constFind(text.constData());
+    if (it != m_escaped.constEnd()) {
+      out += it.value();
+      return;
+    }
+  }
+  HtmlUtils::appendEscaped(out, text);
+}
+
+int StringPool::size() const {
+  QReadLocker locker(&m_lock);
+  return m_strings.size();
+}
+
+int StringPool::prune() {
+  QWriteLocker locker(&m_lock);
+  int dropped = 0;
+  for (auto it = m_strings.begin(); it != m_strings.end();) {
+    // New copies are only handed out under the lock, so a string held by
+    // the pool alone stays unused
+    if (it->isDetached()) {
+      m_escaped.remove(it->constData());
+      it = m_strings.erase(it);
+      ++dropped;
+    } else {
+      ++it;
+    }
+  }
+  return dropped;
+}
+
+void StringPool::clear() {
+  QWriteLocker locker(&m_lock);
+  m_strings.clear();
+  m_escaped.clear();
+}
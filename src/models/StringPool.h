@@ -0,0 +1,98 @@
+#pragma once
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QString>
+#include <QStringView>
+#include "Question.h"
+
+/**
+ * @file StringPool.h
+ * @brief Defines the StringPool class for sharing repeated question text.
+ */
+
+/**
+ * @class StringPool
+ * @brief Interns strings so equal options and table cells share one buffer.
+ *
+ * Options such as "All of the above" and repeated table headers are stored
+ * once; every interned copy is an implicitly shared reference to the pooled
+ * QString. The pool also keeps the HTML-escaped form of each string that
+ * needs escaping, so renderers escape it once instead of once per use.
+ *
+ * Lookups of escaped text are keyed by the string's buffer address, which is
+ * unique for as long as the pool holds the string. All members are thread-safe.
+ *
+ * Only loaders and importers add strings. The editor merely swaps in pooled
+ * copies of what it already holds, so text typed and retyped is not kept,
+ * and prune() drops what no paper uses any more.
+ */
+class StringPool
+{
+public:
+    StringPool() = default;
+
+    /**
+     * @brief The pool shared by the editor, loaders and importers.
+     */
+    static StringPool &shared();
+
+    /**
+     * @brief Returns the pooled copy of @p text, adding it if needed.
+     * @param text Text to intern
+     * @return A QString sharing the pooled buffer
+     */
+    QString intern(const QString &text);
+
+    /**
+     * @brief Returns the pooled copy of @p text if there is one, else @p text.
+     */
+    QString pooled(const QString &text) const;
+
+    /**
+     * @brief Interns a question's diagram path, options and table cells in
+     * place. Free text, the question and the OR alternative, is left alone.
+     * @param question The question to update
+     */
+    void internQuestion(Question &question);
+
+    /**
+     * @brief Like internQuestion(), but only swaps in strings already pooled
+     * and adds none; for text coming from the editor.
+     * @param question The question to update
+     */
+    void shareQuestion(Question &question) const;
+
+    /**
+     * @brief Appends the HTML-escaped form of @p text.
+     *
+     * Uses the cached escaped form when @p text is a pooled string and
+     * escapes it directly otherwise.
+     *
+     * @param out Buffer to append to
+     * @param text Text to escape
+     */
+    void appendEscaped(QString &out, const QString &text) const;
+
+    /**
+     * @brief Number of distinct strings held.
+     */
+    int size() const;
+
+    /**
+     * @brief Drops the strings that nothing outside the pool refers to.
+     * @return Number of strings dropped
+     */
+    int prune();
+
+    /**
+     * @brief Drops every pooled string; existing copies stay valid.
+     */
+    void clear();
+
+private:
+    mutable QReadWriteLock m_lock;
+    QSet<QString> m_strings; // The only copy the pool holds of each string
+    QHash<const QChar *, QString> m_escaped; // Only strings that change when escaped
+};
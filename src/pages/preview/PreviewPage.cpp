@@ -1,9 +1,10 @@
 #include "PreviewPage.h"
 #include "ui_PreviewPage.h"
 #include "../../models/PaperModel.h"
-#include "../../exporters/DocxExporter.h"
-#include "../../exporters/PdfExporter.h"
+#include "../../exporters/ExportScheduler.h"
+#include "../../layout/DiagramCache.h"
 #include <QPushButton>
+#include <QFile>
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QTextBrowser>
@@ -12,11 +13,11 @@
 #include <QFileInfo>
 #include <QStandardPaths>
 #include <QDateTime>
+#include <QFutureWatcher>
 #include <QProgressDialog>
 #include <QDesktopServices>
 #include <QUrl>
 #include <QRegularExpression>
-#include <QStringConverter>
 
 /**
  * @file PreviewPage.cpp
@@ -168,6 +169,10 @@ void PreviewPage::refreshPreview()
         return;
     }
     
+    // Show diagrams from the shared cache instead of decoding the originals
+    DiagramCache::shared().addResources(
+        *ui->previewBrowser->document(), *m_model,
+        qRound(DiagramCache::SCREEN_DPI * ui->previewBrowser->devicePixelRatioF()));
     QString html = m_model->toHtml();
     ui->previewBrowser->setHtml(html);
     applyZoom();
@@ -207,6 +212,11 @@ void PreviewPage::setDefaultExportDirectory(const QString& directory)
     m_defaultExportDirectory = directory;
 }
 
+void PreviewPage::setInlineHtmlDiagrams(bool enabled)
+{
+    m_inlineHtmlDiagrams = enabled;
+}
+
 QString PreviewPage::getLastExportPath() const
 {
     return m_lastExportPath;
@@ -288,9 +298,7 @@ void PreviewPage::onExportDocx()
         return; // User cancelled
     }
     
-    if (performExport(FormatDocx, filePath)) {
-        showExportSuccess(FormatDocx, filePath);
-    }
+    performExport(FormatDocx, filePath);
 }
 
 void PreviewPage::onExportPdf()
@@ -306,9 +314,7 @@ void PreviewPage::onExportPdf()
         return; // User cancelled
     }
     
-    if (performExport(FormatPdf, filePath)) {
-        showExportSuccess(FormatPdf, filePath);
-    }
+    performExport(FormatPdf, filePath);
 }
 
 void PreviewPage::onExportHtml()
@@ -324,9 +330,7 @@ void PreviewPage::onExportHtml()
         return; // User cancelled
     }
     
-    if (performExport(FormatHtml, filePath)) {
-        showExportSuccess(FormatHtml, filePath);
-    }
+    performExport(FormatHtml, filePath);
 }
 
 void PreviewPage::onPrint()
@@ -414,72 +418,72 @@ QString PreviewPage::getDefaultFilename(ExportFormat format) const
     }
 }
 
-bool PreviewPage::performExport(ExportFormat format, const QString& filePath)
+void PreviewPage::performExport(ExportFormat format, const QString& filePath)
 {
     emit exportStarted(format, filePath);
     
-    QProgressDialog progress(
-        tr("Exporting to %1...").arg(formatEnumToString(format)),
-        tr("Cancel"),
-        0, 0,
-        this
-    );
-    progress.setWindowModality(Qt::WindowModal);
-    progress.setMinimumDuration(500);
-    progress.setValue(0);
-    
-    bool success = false;
-    QString errorMessage;
-    
-    try {
-        switch (format) {
-            case FormatDocx: {
-                DocxExporter exporter;
-                success = exporter.exportToDocx(*m_model, filePath, QString(), 12, true);
-                if (!success) {
-                    errorMessage = tr("Failed to create DOCX file. Check file permissions.");
-                }
-                break;
-            }
-            case FormatPdf: {
-                PdfExporter exporter;
-                success = exporter.exportToPdf(*m_model, filePath, QString(), 12, true);
-                if (!success) {
-                    errorMessage = tr("Failed to create PDF file. Check file permissions.");
+    // The export works on a snapshot, so the model stays editable meanwhile.
+    // It is something the user waits on, so it goes ahead of batch exports.
+    ExportJob job;
+    job.snapshot = m_model->snapshot();
+    job.filePath = filePath;
+    job.style = RenderStyle{QString(), 12, true};
+    job.priority = ExportJob::Priority::Interactive;
+    QString failureMessage;
+    switch (format) {
+        case FormatDocx:
+            job.format = ExportJob::Format::Docx;
+            failureMessage = tr("Failed to create DOCX file. Check file permissions.");
+            break;
+        case FormatPdf:
+            job.format = ExportJob::Format::Pdf;
+            failureMessage = tr("Failed to create PDF file. Check file permissions.");
+            break;
+        case FormatHtml:
+            job.format = ExportJob::Format::Html;
+            job.style.inlineDiagrams = m_inlineHtmlDiagrams;
+            failureMessage = tr("Failed to write HTML file. Check file permissions.");
+            break;
+    }
+    const QFuture<bool> future = ExportScheduler::shared().schedule(job);
+    
+    const QString title = tr("Exporting to %1...").arg(formatEnumToString(format));
+    QProgressDialog* progress = new QProgressDialog(title, tr("Cancel"), 0, 0, this);
+    progress->setWindowModality(Qt::WindowModal);
+    progress->setMinimumDuration(500);
+    progress->setAutoClose(false);
+    progress->setAutoReset(false);
+    
+    QFutureWatcher<bool>* watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcherBase::progressRangeChanged,
+            progress, &QProgressDialog::setRange);
+    connect(watcher, &QFutureWatcherBase::progressValueChanged,
+            progress, &QProgressDialog::setValue);
+    connect(watcher, &QFutureWatcherBase::progressTextChanged, progress,
+            [progress, title](const QString& step) {
+                progress->setLabelText(title + "\n" + step);
+            });
+    connect(progress, &QProgressDialog::canceled, watcher, &QFutureWatcherBase::cancel);
+    connect(watcher, &QFutureWatcherBase::finished, this,
+            [this, watcher, progress, format, filePath, failureMessage]() {
+                progress->deleteLater();
+                watcher->deleteLater();
+                
+                if (watcher->isCanceled()) {
+                    emit exportFailed(format, tr("Export canceled."));
+                    return;
                 }
-                break;
-            }
-            case FormatHtml: {
-                QFile file(filePath);
-                if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-                    QTextStream out(&file);
-                    out.setEncoding(QStringConverter::Utf8);
-                    out << m_model->toHtml(QString(), 12, true);
-                    file.close();
-                    success = true;
+                if (watcher->result()) {
+                    m_lastExportPath = filePath;
+                    m_defaultExportDirectory = QFileInfo(filePath).absolutePath();
+                    emit exportCompleted(format, filePath);
+                    showExportSuccess(format, filePath);
                 } else {
-                    errorMessage = tr("Failed to write HTML file: %1").arg(file.errorString());
+                    emit exportFailed(format, failureMessage);
+                    showExportError(format, failureMessage);
                 }
-                break;
-            }
-        }
-    } catch (const std::exception& e) {
-        success = false;
-        errorMessage = tr("Export error: %1").arg(e.what());
-    }
-    
-    progress.setValue(1);
-    
-    if (success) {
-        m_lastExportPath = filePath;
-        m_defaultExportDirectory = QFileInfo(filePath).absolutePath();
-        emit exportCompleted(format, filePath);
-    } else {
-        emit exportFailed(format, errorMessage);
-        showExportError(format, errorMessage);
-    }
-    
-    return success;
+            });
+    watcher->setFuture(future);
 }
 
 void PreviewPage::showExportSuccess(ExportFormat format, const QString& filePath)
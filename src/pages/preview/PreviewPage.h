@@ -93,6 +93,12 @@ public:
      */
     void setDefaultExportDirectory(const QString& directory);
 
+    /**
+     * @brief Embeds diagrams in exported HTML instead of linking them.
+     * @param enabled true for self-contained HTML files
+     */
+    void setInlineHtmlDiagrams(bool enabled);
+
     /**
      * @brief Gets the last export file path.
      * @return Path to last exported file
@@ -253,6 +259,11 @@ private:
      */
     QString m_lastExportPath;
 
+    /**
+     * @brief Whether HTML exports embed their diagrams.
+     */
+    bool m_inlineHtmlDiagrams = false;
+
     /**
      * @brief Sets up signal-slot connections.
      */
@@ -290,12 +301,15 @@ private:
     QString getDefaultFilename(ExportFormat format) const;
 
     /**
-     * @brief Performs the actual export operation.
+     * @brief Starts an export of a model snapshot in the background.
+     *
+     * A progress dialog follows the export and can cancel it; success or
+     * failure is reported when it finishes.
+     *
      * @param format Export format
      * @param filePath Destination file path
-     * @return true if export succeeded
      */
-    bool performExport(ExportFormat format, const QString& filePath);
+    void performExport(ExportFormat format, const QString& filePath);
 
     /**
      * @brief Shows export success message.
@@ -31,7 +31,8 @@ QString generateSectionLabel(int index) {
 QuestionEditorPage::QuestionEditorPage(QWidget *parent)
     : QWidget(parent), ui(new Ui::QuestionEditorPage),
       m_addSectionButton(nullptr), m_defaultFontFamily(DEFAULT_FONT_FAMILY),
-      m_defaultFontSize(DEFAULT_FONT_SIZE), m_contentModified(false) {
+      m_defaultFontSize(DEFAULT_FONT_SIZE), m_contentModified(false),
+      m_sectionsLocked(false) {
   ui->setupUi(this);
   setupUi();
   setupAddSectionButton();
@@ -127,6 +128,10 @@ QString QuestionEditorPage::promptForSectionLabel(const QString &defaultLabel) {
 }
 
 void QuestionEditorPage::addSection(const QString &label) {
+  if (m_sectionsLocked) {
+    return;
+  }
+
   // Check maximum sections
   if (getSectionCount() >= MAX_SECTIONS) {
     QMessageBox::warning(
@@ -195,17 +200,7 @@ void QuestionEditorPage::setSections(const QVector<Section> &sections) {
 
   // Load sections
   for (const Section &section : sections) {
-    SectionWidget *sectionWidget = new SectionWidget(this);
-    sectionWidget->setDefaultFont(m_defaultFontFamily, m_defaultFontSize);
-    sectionWidget->fromSection(section);
-
-    // Connect signals
-    connect(sectionWidget, &SectionWidget::sectionChanged, this,
-            &QuestionEditorPage::onSectionContentChanged);
-
-    // Add to layout
-    int buttonIndex = ui->sectionsLayout->indexOf(m_addSectionButton);
-    ui->sectionsLayout->insertWidget(buttonIndex, sectionWidget);
+    insertSectionWidget(section);
   }
 
   // If no sections were loaded, add one empty section
@@ -217,6 +212,32 @@ void QuestionEditorPage::setSections(const QVector<Section> &sections) {
   m_contentModified = false;
 }
 
+void QuestionEditorPage::appendSection(const Section &section) {
+  insertSectionWidget(section);
+  emit sectionCountChanged(getSectionCount());
+}
+
+void QuestionEditorPage::setSectionsLocked(bool locked) {
+  m_sectionsLocked = locked;
+  if (m_addSectionButton) {
+    m_addSectionButton->setEnabled(!locked);
+  }
+}
+
+void QuestionEditorPage::insertSectionWidget(const Section &section) {
+  SectionWidget *sectionWidget = new SectionWidget(this);
+  sectionWidget->setDefaultFont(m_defaultFontFamily, m_defaultFontSize);
+  sectionWidget->fromSection(section);
+
+  // Connect signals
+  connect(sectionWidget, &SectionWidget::sectionChanged, this,
+          &QuestionEditorPage::onSectionContentChanged);
+
+  // Add to layout, before the "add section" button
+  int buttonIndex = ui->sectionsLayout->indexOf(m_addSectionButton);
+  ui->sectionsLayout->insertWidget(buttonIndex, sectionWidget);
+}
+
 int QuestionEditorPage::getSectionCount() const {
   return getSectionWidgets().size();
 }
@@ -351,7 +372,7 @@ bool QuestionEditorPage::removeSectionAt(int index) {
 }
 
 bool QuestionEditorPage::removeSectionWidget(SectionWidget *widget) {
-  if (!widget) {
+  if (!widget || m_sectionsLocked) {
     return false;
   }
 
@@ -403,7 +424,7 @@ bool QuestionEditorPage::removeLastSection() {
 }
 
 bool QuestionEditorPage::moveSectionUp(int index) {
-  if (index <= 0 || index >= getSectionCount()) {
+  if (m_sectionsLocked || index <= 0 || index >= getSectionCount()) {
     return false;
   }
 
@@ -422,7 +443,7 @@ bool QuestionEditorPage::moveSectionUp(int index) {
 bool QuestionEditorPage::moveSectionDown(int index) {
   int count = getSectionCount();
 
-  if (index < 0 || index >= count - 1) {
+  if (m_sectionsLocked || index < 0 || index >= count - 1) {
     return false;
   }
 
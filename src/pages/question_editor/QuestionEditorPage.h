@@ -63,6 +63,25 @@ public:
      */
     void setSections(const QVector<Section>& sections);
 
+    /**
+     * @brief Adds one more loaded section after the existing ones.
+     *
+     * Used to fill the page a section at a time while a large paper loads;
+     * the page is not marked as modified.
+     * @param section Section to load
+     */
+    void appendSection(const Section& section);
+
+    /**
+     * @brief Stops sections from being added, removed or reordered.
+     *
+     * Set while appendSection() is still filling the page, so the sections
+     * of a paper being loaded stay in file order. Editing inside a section is
+     * not affected.
+     * @param locked true to lock the section list
+     */
+    void setSectionsLocked(bool locked);
+
     /**
      * @brief Gets the number of sections in this page.
      * @return Count of SectionWidget children
@@ -235,6 +254,11 @@ private:
      */
     bool m_contentModified;
 
+    /**
+     * @brief Whether the section list is locked, see setSectionsLocked().
+     */
+    bool m_sectionsLocked;
+
     /**
      * @brief Sets up signal-slot connections.
      */
@@ -263,6 +287,13 @@ private:
      */
     void addSectionWidget(const QString& label);
 
+    /**
+     * @brief Adds a section widget filled from @p section before the
+     * "add section" button.
+     * @param section Section to show
+     */
+    void insertSectionWidget(const Section& section);
+
     /**
      * @brief Removes a specific section widget.
      * @param widget Pointer to the widget to remove
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <QtGlobal>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BASE64_HAVE_SSE2 1
+#endif
+
+namespace Base64 {
+    /**
+     * Encoded length of @p size bytes, padding included.
+     */
+    constexpr qsizetype encodedSize(qsizetype size) {
+        return (size + 2) / 3 * 4;
+    }
+
+    /**
+     * Writes the standard base64 encoding of data[0, size) to out, which must
+     * hold encodedSize(size) characters; the result matches
+     * QByteArray::toBase64(). Encodes twelve bytes per step when SSE2 is
+     * available. Input cut at a multiple of three bytes can be encoded in
+     * pieces and the pieces concatenated.
+     */
+    inline void encode(const char *data, qsizetype size, char *out) {
+        static constexpr char ALPHABET[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        const auto *in = reinterpret_cast<const uchar *>(data);
+        qsizetype i = 0;
+#ifdef BASE64_HAVE_SSE2
+        const __m128i sixBits = _mm_set1_epi32(0x3F);
+        const __m128i fromUpper = _mm_set1_epi8(25);
+        const __m128i fromLower = _mm_set1_epi8(51);
+        const __m128i fromDigits = _mm_set1_epi8(61);
+        const __m128i fromPlus = _mm_set1_epi8(62);
+        // Reads 16 bytes for every 12 it encodes, so stops 4 bytes early
+        for (; i + 16 <= size; i += 12, out += 16) {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+
+            // One 3-byte group per 32-bit lane: bytes 0-2, 3-5, 6-8, 9-11
+            const __m128i groups = _mm_unpacklo_epi64(
+                _mm_unpacklo_epi32(x, _mm_srli_si128(x, 3)),
+                _mm_unpacklo_epi32(_mm_srli_si128(x, 6), _mm_srli_si128(x, 9)));
+
+            // Spread the 24 bits of each group into four 6-bit indices, one
+            // per byte and in output order
+            __m128i indices = _mm_and_si128(_mm_srli_epi32(groups, 2), sixBits);
+            indices = _mm_or_si128(indices, _mm_and_si128(_mm_slli_epi32(groups, 12), _mm_set1_epi32(0x3000)));
+            indices = _mm_or_si128(indices, _mm_and_si128(_mm_srli_epi32(groups, 4), _mm_set1_epi32(0xF00)));
+            indices = _mm_or_si128(indices, _mm_and_si128(_mm_slli_epi32(groups, 10), _mm_set1_epi32(0x3C0000)));
+            indices = _mm_or_si128(indices, _mm_and_si128(_mm_srli_epi32(groups, 6), _mm_set1_epi32(0x30000)));
+            indices = _mm_or_si128(indices, _mm_and_si128(_mm_slli_epi32(groups, 8), _mm_set1_epi32(0x3F000000)));
+
+            // Map each index onto the alphabet by adding the offset of its
+            // range: 'A' for 0-25, then corrections for a-z, 0-9, '+' and '/'
+            __m128i offsets = _mm_set1_epi8('A');
+            offsets = _mm_add_epi8(offsets, _mm_and_si128(_mm_cmpgt_epi8(indices, fromUpper), _mm_set1_epi8(6)));
+            offsets = _mm_add_epi8(offsets, _mm_and_si128(_mm_cmpgt_epi8(indices, fromLower), _mm_set1_epi8(-75)));
+            offsets = _mm_add_epi8(offsets, _mm_and_si128(_mm_cmpgt_epi8(indices, fromDigits), _mm_set1_epi8(-15)));
+            offsets = _mm_add_epi8(offsets, _mm_and_si128(_mm_cmpgt_epi8(indices, fromPlus), _mm_set1_epi8(3)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_add_epi8(indices, offsets));
+        }
+#endif
+        for (; i + 3 <= size; i += 3, out += 4) {
+            const quint32 group = (quint32(in[i]) << 16) | (quint32(in[i + 1]) << 8) | in[i + 2];
+            out[0] = ALPHABET[group >> 18];
+            out[1] = ALPHABET[(group >> 12) & 0x3F];
+            out[2] = ALPHABET[(group >> 6) & 0x3F];
+            out[3] = ALPHABET[group & 0x3F];
+        }
+        if (i < size) {
+            const bool two = i + 1 < size;
+            const quint32 group = (quint32(in[i]) << 16) | (two ? quint32(in[i + 1]) << 8 : 0);
+            out[0] = ALPHABET[group >> 18];
+            out[1] = ALPHABET[(group >> 12) & 0x3F];
+            out[2] = two ? ALPHABET[(group >> 6) & 0x3F] : '=';
+            out[3] = '=';
+        }
+    }
+}
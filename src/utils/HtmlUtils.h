@@ -0,0 +1,68 @@
+#pragma once
+
+#include <QLatin1String>
+#include <QString>
+#include <QStringView>
+#include <QtAlgorithms>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HTMLUTILS_HAVE_SSE2 1
+#endif
+
+namespace HtmlUtils {
+    /**
+     * Returns the index of the first '<', '>', '&' or '"' in data[from, size),
+     * or size if there is none. Scans eight UTF-16 code units per step when SSE2
+     * is available.
+     */
+    inline qsizetype findEscapable(const char16_t *data, qsizetype from, qsizetype size) {
+#ifdef HTMLUTILS_HAVE_SSE2
+        const __m128i lt = _mm_set1_epi16(u'<');
+        const __m128i gt = _mm_set1_epi16(u'>');
+        const __m128i amp = _mm_set1_epi16(u'&');
+        const __m128i quot = _mm_set1_epi16(u'"');
+        for (; from + 8 <= size; from += 8) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + from));
+            const __m128i hits = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi16(chunk, lt), _mm_cmpeq_epi16(chunk, gt)),
+                _mm_or_si128(_mm_cmpeq_epi16(chunk, amp), _mm_cmpeq_epi16(chunk, quot)));
+            const quint32 mask = static_cast<quint32>(_mm_movemask_epi8(hits));
+            if (mask != 0) {
+                return from + qCountTrailingZeroBits(mask) / 2;
+            }
+        }
+#endif
+        for (; from < size; ++from) {
+            const char16_t c = data[from];
+            if (c == u'<' || c == u'>' || c == u'&' || c == u'"') {
+                return from;
+            }
+        }
+        return size;
+    }
+
+    /**
+     * Appends text to out with the same escaping as QString::toHtmlEscaped(),
+     * copying unescaped runs directly instead of allocating a temporary.
+     */
+    inline void appendEscaped(QString &out, QStringView text) {
+        const char16_t *data = text.utf16();
+        const qsizetype size = text.size();
+        qsizetype runStart = 0;
+        while (runStart < size) {
+            const qsizetype pos = findEscapable(data, runStart, size);
+            out.append(QStringView(data + runStart, pos - runStart));
+            if (pos == size) {
+                break;
+            }
+            switch (data[pos]) {
+            case u'<': out.append(QLatin1String("&lt;")); break;
+            case u'>': out.append(QLatin1String("&gt;")); break;
+            case u'&': out.append(QLatin1String("&amp;")); break;
+            default: out.append(QLatin1String("&quot;")); break;
+            }
+            runStart = pos + 1;
+        }
+    }
+}
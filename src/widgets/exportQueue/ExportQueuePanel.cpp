@@ -0,0 +1,195 @@
+#include "ExportQueuePanel.h"
+#include <QFileInfo>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QProgressBar>
+#include <QVBoxLayout>
+
+namespace {
+enum Column {
+  FileColumn,
+  FormatColumn,
+  PriorityColumn,
+  StatusColumn,
+  ProgressColumn,
+  ColumnCount
+};
+
+QString priorityName(ExportJob::Priority priority) {
+  switch (priority) {
+  case ExportJob::Priority::Batch:
+    return "Batch";
+  case ExportJob::Priority::Normal:
+    return "Normal";
+  case ExportJob::Priority::Interactive:
+    return "Interactive";
+  }
+  return QString();
+}
+
+QString stateName(ExportScheduler::State state) {
+  switch (state) {
+  case ExportScheduler::State::Queued:
+    return "Queued";
+  case ExportScheduler::State::Running:
+    return "Running";
+  case ExportScheduler::State::Finished:
+    return "Done";
+  case ExportScheduler::State::Failed:
+    return "Failed";
+  case ExportScheduler::State::Canceled:
+    return "Canceled";
+  }
+  return QString();
+}
+} // namespace
+
+ExportQueuePanel::ExportQueuePanel(ExportScheduler &scheduler, QWidget *parent)
+    : QWidget(parent), m_scheduler(scheduler) {
+  QVBoxLayout *layout = new QVBoxLayout(this);
+  layout->setContentsMargins(0, 0, 0, 0);
+
+  table = new QTableWidget(0, ColumnCount);
+  table->setHorizontalHeaderLabels(
+      {"File", "Format", "Priority", "Status", "Progress"});
+  table->horizontalHeader()->setSectionResizeMode(FileColumn,
+                                                  QHeaderView::Stretch);
+  table->verticalHeader()->hide();
+  table->setSelectionBehavior(QAbstractItemView::SelectRows);
+  table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+  layout->addWidget(table);
+
+  // Buttons
+  QHBoxLayout *buttonLayout = new QHBoxLayout;
+  cancelButton = new QPushButton("Cancel");
+  clearButton = new QPushButton("Clear Finished");
+  buttonLayout->addStretch();
+  buttonLayout->addWidget(cancelButton);
+  buttonLayout->addWidget(clearButton);
+  layout->addLayout(buttonLayout);
+
+  connect(cancelButton, &QPushButton::clicked, this,
+          &ExportQueuePanel::onCancelClicked);
+  connect(clearButton, &QPushButton::clicked, &m_scheduler,
+          &ExportScheduler::clearFinished);
+  connect(table, &QTableWidget::itemSelectionChanged, this,
+          &ExportQueuePanel::updateButtons);
+  connect(&m_scheduler, &ExportScheduler::jobAdded, this,
+          &ExportQueuePanel::onJobAdded);
+  connect(&m_scheduler, &ExportScheduler::jobChanged, this,
+          &ExportQueuePanel::onJobChanged);
+  connect(&m_scheduler, &ExportScheduler::jobsRemoved, this,
+          &ExportQueuePanel::reload);
+
+  reload();
+}
+
+ExportQueuePanel::~ExportQueuePanel() {}
+
+void ExportQueuePanel::onJobAdded(int id) {
+  const ExportScheduler::JobInfo *info = m_scheduler.job(id);
+  if (!info) {
+    return;
+  }
+  const int row = table->rowCount();
+  table->insertRow(row);
+  fillRow(row, *info);
+  updateButtons();
+}
+
+void ExportQueuePanel::onJobChanged(int id) {
+  const ExportScheduler::JobInfo *info = m_scheduler.job(id);
+  const int row = rowOf(id);
+  if (info && row >= 0) {
+    fillRow(row, *info);
+    updateButtons();
+  }
+}
+
+void ExportQueuePanel::onCancelClicked() {
+  const QList<QTableWidgetItem *> selected = table->selectedItems();
+  QList<int> ids;
+  for (QTableWidgetItem *item : selected) {
+    const int id =
+        table->item(item->row(), FileColumn)->data(Qt::UserRole).toInt();
+    if (!ids.contains(id)) {
+      ids.append(id);
+    }
+  }
+  for (int id : ids) {
+    m_scheduler.cancel(id);
+  }
+}
+
+void ExportQueuePanel::reload() {
+  table->setRowCount(0);
+  for (const ExportScheduler::JobInfo &info : m_scheduler.jobs()) {
+    const int row = table->rowCount();
+    table->insertRow(row);
+    fillRow(row, info);
+  }
+  updateButtons();
+}
+
+int ExportQueuePanel::rowOf(int id) const {
+  for (int row = 0; row < table->rowCount(); ++row) {
+    if (table->item(row, FileColumn)->data(Qt::UserRole).toInt() == id) {
+      return row;
+    }
+  }
+  return -1;
+}
+
+void ExportQueuePanel::fillRow(int row, const ExportScheduler::JobInfo &info) {
+  const auto setText = [this, row](int column, const QString &text) {
+    QTableWidgetItem *item = table->item(row, column);
+    if (!item) {
+      item = new QTableWidgetItem;
+      table->setItem(row, column, item);
+    }
+    item->setText(text);
+    return item;
+  };
+
+  QTableWidgetItem *fileItem =
+      setText(FileColumn, QFileInfo(info.job.filePath).fileName());
+  fileItem->setData(Qt::UserRole, info.id);
+  fileItem->setToolTip(info.job.filePath);
+  setText(FormatColumn, ExportJob::formatName(info.job.format));
+  setText(PriorityColumn, priorityName(info.job.priority));
+  // While running, show the exporter's current step
+  setText(StatusColumn, info.state == ExportScheduler::State::Running &&
+                                !info.progressText.isEmpty()
+                            ? info.progressText
+                            : stateName(info.state));
+
+  QProgressBar *bar =
+      qobject_cast<QProgressBar *>(table->cellWidget(row, ProgressColumn));
+  if (!bar) {
+    bar = new QProgressBar;
+    bar->setTextVisible(false);
+    table->setCellWidget(row, ProgressColumn, bar);
+  }
+  if (info.state == ExportScheduler::State::Finished) {
+    bar->setRange(0, 1);
+    bar->setValue(1);
+  } else if (info.progressMaximum > 0) {
+    bar->setRange(0, info.progressMaximum);
+    bar->setValue(info.progressValue);
+  } else {
+    // Busy indicator until a running export reports its first step
+    bar->setRange(0, info.state == ExportScheduler::State::Running ? 0 : 1);
+    bar->setValue(0);
+  }
+}
+
+void ExportQueuePanel::updateButtons() {
+  bool cancelable = false;
+  for (QTableWidgetItem *item : table->selectedItems()) {
+    const ExportScheduler::JobInfo *info = m_scheduler.job(
+        table->item(item->row(), FileColumn)->data(Qt::UserRole).toInt());
+    cancelable = cancelable || (info && !info->isDone());
+  }
+  cancelButton->setEnabled(cancelable);
+  clearButton->setEnabled(m_scheduler.pendingCount() < table->rowCount());
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "../../exporters/ExportScheduler.h"
+#include <QPushButton>
+#include <QTableWidget>
+#include <QWidget>
+
+/**
+ * ExportQueuePanel: Lists the jobs of an ExportScheduler with their state
+ * and progress, and lets the user cancel them.
+ */
+class ExportQueuePanel : public QWidget {
+  Q_OBJECT
+public:
+  explicit ExportQueuePanel(ExportScheduler &scheduler,
+                            QWidget *parent = nullptr);
+  ~ExportQueuePanel() override;
+
+private slots:
+  void onJobAdded(int id);
+  void onJobChanged(int id);
+  void onCancelClicked();
+  void reload();
+
+private:
+  ExportScheduler &m_scheduler;
+  QTableWidget *table;
+  QPushButton *cancelButton;
+  QPushButton *clearButton;
+
+  int rowOf(int id) const;
+  void fillRow(int row, const ExportScheduler::JobInfo &info);
+  void updateButtons();
+};
@@ -1,4 +1,6 @@
 #include "QuestionWidget.h"
+#include "../../models/AssetStore.h"
+#include "../../models/StringPool.h"
 #include "ui_QuestionWidget.h"
 #include <QComboBox>
 #include <QFileDialog>
@@ -108,6 +110,14 @@ void QuestionWidget::setupConnections() {
   connect(ui->orTextEdit, &QTextEdit::textChanged, this,
           &QuestionWidget::onTextChanged);
 
+  // Table cell edits
+  connect(ui->tableWidget, &QTableWidget::itemChanged, this,
+          &QuestionWidget::contentChanged);
+
+  // Any content change invalidates the exported question
+  connect(this, &QuestionWidget::contentChanged, this,
+          [this]() { m_questionDirty = true; });
+
   // Cursor position change for formatting updates
   connect(ui->textEdit, &QTextEdit::cursorPositionChanged, this,
           &QuestionWidget::updateFormattingButtons);
@@ -242,11 +252,23 @@ void QuestionWidget::updateFormattingButtons() {
 }
 
 Question QuestionWidget::toQuestion() const {
+  // Unchanged questions hand out the same implicitly shared data, so
+  // snapshots of an untouched question cost nothing
+  if (m_questionDirty) {
+    m_cachedQuestion = buildQuestion();
+    m_cachedQuestion.id = m_questionId;
+    m_cachedQuestion.version = ++m_questionVersion;
+    m_questionDirty = false;
+  }
+  return m_cachedQuestion;
+}
+
+Question QuestionWidget::buildQuestion() const {
   Question question;
 
-  // Set type
-  question.type =
-      static_cast<QuestionType>(ui->typeComboBox->currentData().toInt());
+  // Set type; this selects the payload filled in below
+  question.setType(
+      static_cast<QuestionType>(ui->typeComboBox->currentData().toInt()));
 
   // Export rich text content
   question.text = ui->textEdit->toHtml();
@@ -260,36 +282,40 @@ Question QuestionWidget::toQuestion() const {
   // Export table data
   question.table = exportTableData();
 
-  // Export MCQ options if applicable
-  if (question.type == QuestionType::Mcq ||
-      question.type == QuestionType::Mixed) {
-    question.options.clear();
-    question.options << ui->optionAEdit->text().trimmed();
-    question.options << ui->optionBEdit->text().trimmed();
-    question.options << ui->optionCEdit->text().trimmed();
-    question.options << ui->optionDEdit->text().trimmed();
-  } else if (question.type == QuestionType::Or) {
+  // Export the type-specific payload
+  const auto exportOptions = [this]() {
+    return QVector<QString>{ui->optionAEdit->text().trimmed(),
+                            ui->optionBEdit->text().trimmed(),
+                            ui->optionCEdit->text().trimmed(),
+                            ui->optionDEdit->text().trimmed()};
+  };
+  if (McqPayload *mcq = question.as<McqPayload>()) {
+    mcq->options = exportOptions();
+  } else if (MixedPayload *mixed = question.as<MixedPayload>()) {
+    mixed->options = exportOptions();
+  } else if (OrPayload *orPayload = question.as<OrPayload>()) {
     // Export alternative question
-    QString orText = ui->orTextEdit->toPlainText().trimmed();
-    if (!orText.isEmpty()) {
-      Question altQuestion;
-      altQuestion.text = orText;
-      // Sub-question type doesn't arguably matter much for basic rendering,
-      // but we can set it to Regular.
-      altQuestion.type = QuestionType::Regular;
-      question.subQuestions.append(altQuestion);
-    }
+    orPayload->alternative = ui->orTextEdit->toPlainText().trimmed();
   }
 
+  // Share storage with options and table text the loaded paper already
+  // holds; text being typed is not added to the pool
+  StringPool::shared().shareQuestion(question);
+
   return question;
 }
 
 void QuestionWidget::fromQuestion(const Question &question) {
+  m_questionDirty = true;
+  if (question.id != 0) {
+    m_questionId = question.id;
+  }
+
   // Block signals to prevent recursive updates
   ui->typeComboBox->blockSignals(true);
 
   // Set type
-  int typeIndex = ui->typeComboBox->findData(static_cast<int>(question.type));
+  int typeIndex = ui->typeComboBox->findData(static_cast<int>(question.type()));
   if (typeIndex >= 0) {
     ui->typeComboBox->setCurrentIndex(typeIndex);
     onTypeChanged(typeIndex);
@@ -317,17 +343,20 @@ void QuestionWidget::fromQuestion(const Question &question) {
   }
 
   // Load MCQ options
-  if (question.options.size() >= 4) {
-    ui->optionAEdit->setText(question.options[0]);
-    ui->optionBEdit->setText(question.options[1]);
-    ui->optionCEdit->setText(question.options[2]);
-    ui->optionCEdit->setText(question.options[2]);
-    ui->optionDEdit->setText(question.options[3]);
+  const McqPayload *mcq = question.as<McqPayload>();
+  const MixedPayload *mixed = question.as<MixedPayload>();
+  const QVector<QString> options =
+      mcq ? mcq->options : (mixed ? mixed->options : QVector<QString>());
+  if (options.size() >= 4) {
+    ui->optionAEdit->setText(options[0]);
+    ui->optionBEdit->setText(options[1]);
+    ui->optionCEdit->setText(options[2]);
+    ui->optionDEdit->setText(options[3]);
   }
 
   // Load OR alternative
-  if (question.type == QuestionType::Or && !question.subQuestions.isEmpty()) {
-    ui->orTextEdit->setText(question.subQuestions.first().text);
+  if (const OrPayload *orPayload = question.as<OrPayload>()) {
+    ui->orTextEdit->setText(orPayload->alternative);
   }
 }
 
@@ -470,6 +499,7 @@ void QuestionWidget::onTextChanged() { emit contentChanged(); }
 void QuestionWidget::setDefaultFont(const QString &family, int size) {
   QFont font(family, size);
   ui->textEdit->setFont(font);
+  m_questionDirty = true; // The default font is part of the exported HTML
 
   // Update combo boxes to reflect the new defaults
   if (m_fontComboBox) {
@@ -530,6 +560,10 @@ bool QuestionWidget::isValidImagePath(const QString &filePath) const {
   if (filePath.isEmpty() || filePath == tr("No image selected")) {
     return false;
   }
+  // Diagrams embedded in an opened paper file
+  if (AssetStore::isReference(filePath)) {
+    return AssetStore::shared().contains(filePath);
+  }
 
   QFileInfo fileInfo(filePath);
   return fileInfo.exists() && fileInfo.isFile();
@@ -59,6 +59,7 @@ public:
    *
    * @return Question object containing all widget data
    * @note The returned Question preserves HTML formatting from the text editor
+   * @note Repeated calls share one copy until the content changes
    */
   Question toQuestion() const;
 
@@ -244,6 +245,24 @@ private:
    */
   bool m_isCollapsed = false;
 
+  /**
+   * @brief Last exported question, reused by toQuestion() until the content
+   * changes.
+   */
+  mutable Question m_cachedQuestion;
+  mutable bool m_questionDirty = true;
+
+  /**
+   * @brief Stable ID of the edited question and its edit counter.
+   */
+  NodeId m_questionId = newNodeId();
+  mutable quint64 m_questionVersion = 0;
+
+  /**
+   * @brief Reads the current UI content into a new Question.
+   */
+  Question buildQuestion() const;
+
   /**
    * @brief Updates the UI to show either the editor or the summary.
    */
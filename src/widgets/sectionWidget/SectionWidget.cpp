@@ -60,6 +60,10 @@ void SectionWidget::setupConnections() {
           &SectionWidget::onLabelChanged);
   connect(ui->subtitleEdit, &QLineEdit::textChanged, this,
           &SectionWidget::onSubtitleChanged);
+
+  // Every edit, add, remove and move is announced through sectionChanged
+  connect(this, &SectionWidget::sectionChanged, this,
+          [this]() { m_sectionDirty = true; });
 }
 
 void SectionWidget::addQuestionWidget() {
@@ -98,6 +102,17 @@ void SectionWidget::onAddQuestion() { addQuestionWidget(); }
 void SectionWidget::addQuestion() { addQuestionWidget(); }
 
 Section SectionWidget::toSection() const {
+  // Untouched sections hand out the same implicitly shared data
+  if (m_sectionDirty) {
+    m_cachedSection = buildSection();
+    m_cachedSection.id = m_sectionId;
+    m_cachedSection.version = ++m_sectionVersion;
+    m_sectionDirty = false;
+  }
+  return m_cachedSection;
+}
+
+Section SectionWidget::buildSection() const {
   Section section;
 
   // Export section metadata
@@ -121,6 +136,11 @@ void SectionWidget::fromSection(const Section &section) {
   // Clear existing content
   clearSection();
 
+  // Keep the identity of a loaded section
+  if (section.id != 0) {
+    m_sectionId = section.id;
+  }
+
   // Load section metadata
   ui->labelEdit->setText(section.label);
   ui->subtitleEdit->setText(section.subtitle);
@@ -150,6 +170,7 @@ void SectionWidget::fromSection(const Section &section) {
 void SectionWidget::setDefaultFont(const QString &family, int size) {
   m_defaultFontFamily = family;
   m_defaultFontSize = size;
+  m_sectionDirty = true;
 
   // Apply to existing question widgets
   QVector<QuestionWidget *> questionWidgets = getQuestionWidgets();
@@ -222,6 +222,24 @@ private:
      */
     int m_defaultFontSize;
 
+    /**
+     * @brief Last exported section, reused by toSection() until something
+     * in the section changes.
+     */
+    mutable Section m_cachedSection;
+    mutable bool m_sectionDirty = true;
+
+    /**
+     * @brief Stable ID of the edited section and its edit counter.
+     */
+    NodeId m_sectionId = newNodeId();
+    mutable quint64 m_sectionVersion = 0;
+
+    /**
+     * @brief Reads the section and its questions into a new Section.
+     */
+    Section buildSection() const;
+
     /**
      * @brief Adds a new question widget with specified font settings.
      */
@@ -1,11 +1,43 @@
+#include "exporters/DocxExporter.h"
+#include "exporters/ExportScheduler.h"
+#include "exporters/ExportTask.h"
+#include "exporters/HtmlExporter.h"
+#include "exporters/ZipWriter.h"
+#include "layout/DiagramCache.h"
+#include "layout/LayoutBuilder.h"
+#include "layout/PaperLayoutEngine.h"
+#include "models/AssetStore.h"
+#include "models/CompactPaper.h"
 #include "models/Exam.h"
 #include "models/PaperModel.h"
 #include "models/Question.h"
 #include "models/Section.h"
+#include "models/PaperFile.h"
+#include "models/PaperHistory.h"
+#include "models/PaperHtml.h"
+#include "models/PaperJournal.h"
+#include "models/PaperJson.h"
+#include "models/StringArena.h"
+#include "models/StringPool.h"
+#include "utils/Base64.h"
+#include "utils/HtmlUtils.h"
+#include <QBuffer>
 #include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QImage>
+#include <QJsonDocument>
+#include <QPainter>
+#include <QPdfWriter>
 #include <QString>
+#include <QThreadPool>
 #include <QVector>
+#include <QtEndian>
 #include <iostream>
+#include <zlib.h>
 
 // Simple assertion helper
 bool assertContains(const QString &haystack, const QString &needle,
@@ -22,16 +54,76 @@ bool assertContains(const QString &haystack, const QString &needle,
   }
 }
 
-int main() {
+// Reads one entry of a zip archive through its central directory;
+// returns a null array if it is missing or corrupt
+QByteArray zipEntry(const QByteArray &zip, const QString &name) {
+  const auto read16 = [&zip](qsizetype at) {
+    return qFromLittleEndian<quint16>(zip.constData() + at);
+  };
+  const auto read32 = [&zip](qsizetype at) {
+    return qFromLittleEndian<quint32>(zip.constData() + at);
+  };
+  const qsizetype end = zip.lastIndexOf(QByteArray("PK\x05\x06", 4));
+  if (end < 0 || end + 22 > zip.size()) {
+    return QByteArray();
+  }
+  qsizetype at = read32(end + 16);
+  for (int i = 0; i < read16(end + 10) && at + 46 <= zip.size(); ++i) {
+    const quint16 method = read16(at + 10);
+    const quint32 crc = read32(at + 16);
+    const quint32 compressedSize = read32(at + 20);
+    const quint32 size = read32(at + 24);
+    const quint16 nameLength = read16(at + 28);
+    const quint32 offset = read32(at + 42);
+    const QByteArray entryName = zip.mid(at + 46, nameLength);
+    at += 46 + nameLength + read16(at + 30) + read16(at + 32);
+    if (entryName != name.toUtf8()) {
+      continue;
+    }
+
+    const qsizetype dataStart =
+        offset + 30 + read16(offset + 26) + read16(offset + 28);
+    const QByteArray compressed = zip.mid(dataStart, compressedSize);
+    QByteArray data(size, Qt::Uninitialized);
+    if (method == 0) {
+      data = compressed;
+    } else {
+      z_stream stream{};
+      inflateInit2(&stream, -15);
+      stream.next_in =
+          reinterpret_cast<Bytef *>(const_cast<char *>(compressed.constData()));
+      stream.avail_in = compressed.size();
+      stream.next_out = reinterpret_cast<Bytef *>(data.data());
+      stream.avail_out = data.size();
+      const int result = inflate(&stream, Z_FINISH);
+      inflateEnd(&stream);
+      if (result != Z_STREAM_END) {
+        return QByteArray();
+      }
+    }
+    const uLong actualCrc =
+        crc32(0L, reinterpret_cast<const Bytef *>(data.constData()),
+              data.size());
+    return actualCrc == crc ? data : QByteArray();
+  }
+  return QByteArray();
+}
+
+int main(int argc, char *argv[]) {
+  // Fonts need a GUI application; no display is required
+  if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+  QGuiApplication app(argc, argv);
+
   std::cout << "Running Layout Tests..." << std::endl;
 
   // Test 1: MCQ Layout
   {
     std::cout << "\nTest 1: MCQ Layout" << std::endl;
     Question q;
-    q.type = QuestionType::Mcq;
     q.text = "Testing MCQ";
-    q.options = {"Option A", "Option B", "Option C", "Option D"};
+    q.payload = McqPayload{{"Option A", "Option B", "Option C", "Option D"}};
 
     Section s;
     s.label = "Section A";
@@ -61,7 +153,6 @@ int main() {
   {
     std::cout << "\nTest 2: Floating Image" << std::endl;
     Question q;
-    q.type = QuestionType::Regular;
     q.text = "Image Question";
     q.diagramPath = "/tmp/test.png";
 
@@ -122,12 +213,8 @@ int main() {
   {
     std::cout << "\nTest 4: OR Layout" << std::endl;
     Question q;
-    q.type = QuestionType::Or;
     q.text = "Main Question";
-
-    Question altQ;
-    altQ.text = "Alternative Question";
-    q.subQuestions.append(altQ);
+    q.payload = OrPayload{"Alternative Question"};
 
     Section s;
     s.questions.append(q);
@@ -146,5 +233,1992 @@ int main() {
                    "Alternative Question text present");
   }
 
+  // Test 5: Fragment Cache
+  {
+    std::cout << "\nTest 5: Fragment Cache" << std::endl;
+    Section s;
+    for (int i = 0; i < 3; ++i) {
+      Question q;
+      q.text = QString("Cached Question %1").arg(i);
+      s.questions.append(q);
+    }
+
+    PaperModel model;
+    model.sections.append(s);
+
+    const QString first = model.toHtml();
+    model.resetRenderCacheStats();
+    const QString second = model.toHtml();
+
+    if (first == second && model.renderCacheHits() == 3 &&
+        model.renderCacheMisses() == 0) {
+      std::cout << "[PASS] Unchanged questions served from cache" << std::endl;
+    } else {
+      std::cout << "[FAIL] Unchanged render. Hits: " << model.renderCacheHits()
+                << " Misses: " << model.renderCacheMisses() << std::endl;
+    }
+
+    model.sections[0].questions[1].text = "Edited Question";
+    model.resetRenderCacheStats();
+    const QString edited = model.toHtml();
+
+    if (model.renderCacheHits() == 2 && model.renderCacheMisses() == 1) {
+      std::cout << "[PASS] Only the edited question re-rendered" << std::endl;
+    } else {
+      std::cout << "[FAIL] Edited render. Hits: " << model.renderCacheHits()
+                << " Misses: " << model.renderCacheMisses() << std::endl;
+    }
+    assertContains(edited, "Edited Question", "Edited text present");
+
+    model.resetRenderCacheStats();
+    model.toHtml("Arial", 14, false);
+    if (model.renderCacheMisses() == 3) {
+      std::cout << "[PASS] Style change invalidates fragments" << std::endl;
+    } else {
+      std::cout << "[FAIL] Style change. Misses: " << model.renderCacheMisses()
+                << std::endl;
+    }
+
+    // Force two different questions into the same hash bucket
+    RenderCache cache;
+    Question other = s.questions[0];
+    other.text = "Colliding Question";
+    const RenderCache::Key key(s.questions[0], 1, RenderStyle());
+    RenderCache::Key colliding(other, 1, RenderStyle());
+    colliding.contentHash = key.contentHash;
+    cache.fetch(key, []() { return QString("first"); });
+    if (cache.fetch(colliding, []() { return QString("second"); }) ==
+            "second" &&
+        cache.misses() == 2) {
+      std::cout << "[PASS] Hash collision re-renders" << std::endl;
+    } else {
+      std::cout << "[FAIL] Colliding question served another fragment"
+                << std::endl;
+    }
+  }
+
+  // Test 6: Streaming Render
+  {
+    std::cout << "\nTest 6: Streaming Render" << std::endl;
+    Question q;
+    q.text = "Stream \u00e9 Question";
+    q.payload = McqPayload{{"<A>", "B & C", "\"D\"", "E"}};
+
+    Section s;
+    s.label = "Section \u03b1";
+    s.questions.append(q);
+
+    PaperModel model;
+    model.exam.title = "Streamed Exam";
+    model.sections.append(s);
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    const bool ok = model.render(buffer, "Arial", 11, false);
+
+    if (ok && buffer.data() == model.toHtml("Arial", 11, false).toUtf8()) {
+      std::cout << "[PASS] Streamed UTF-8 matches toHtml()" << std::endl;
+    } else {
+      std::cout << "[FAIL] Streamed output differs from toHtml()" << std::endl;
+    }
+
+    QBuffer readOnly;
+    readOnly.open(QIODevice::ReadOnly);
+    if (!model.render(readOnly)) {
+      std::cout << "[PASS] Render rejects a non-writable device" << std::endl;
+    } else {
+      std::cout << "[FAIL] Render wrote to a read-only device" << std::endl;
+    }
+  }
+
+  // Test 7: Cached Header
+  {
+    std::cout << "\nTest 7: Cached Header" << std::endl;
+    PaperModel model;
+    model.exam.title = "Header Exam";
+
+    const QString first = model.toHtml("Font %3", 11, false);
+    const QString second = model.toHtml("Font %3", 11, false);
+
+    if (first == second) {
+      std::cout << "[PASS] Repeated renders are identical" << std::endl;
+    } else {
+      std::cout << "[FAIL] Repeated renders differ" << std::endl;
+    }
+    assertContains(first, "font-family:'Font %3', serif; font-size:11pt;",
+                   "Font family inserted literally");
+    assertContains(first, "size: A4 landscape;", "Orientation inserted");
+    assertContains(first, ".question-num-cell { width:30px;",
+                   "Question number width inserted");
+    assertContains(model.toHtml("Arial", 9, true), "font-size:9pt;",
+                   "Style change picks a different header");
+  }
+
+  // Test 8: HTML Escaping
+  {
+    std::cout << "\nTest 8: HTML Escaping" << std::endl;
+    const QStringList samples = {
+        "",
+        "plain text without markup",
+        "<b>",
+        "a < b && c > \"d\"",
+        "0123456789abcdef<0123456789abcdef&",
+        "\u00e9\u4e2d\u6587 & more text after the sixteenth unit\"",
+    };
+
+    bool allMatch = true;
+    for (const QString &sample : samples) {
+      QString escaped = "prefix:";
+      HtmlUtils::appendEscaped(escaped, sample);
+      if (escaped != "prefix:" + sample.toHtmlEscaped()) {
+        allMatch = false;
+        std::cout << "[FAIL] Escaping differs for: " << sample.toStdString()
+                  << std::endl;
+      }
+    }
+    if (allMatch) {
+      std::cout << "[PASS] appendEscaped matches toHtmlEscaped" << std::endl;
+    }
+
+    Question q;
+    q.text = "Escaped Table";
+    q.table = {{"<h>", "&"}, {"\"x\"", "y"}};
+    Section s;
+    s.label = "A & B";
+    s.questions.append(q);
+    PaperModel model;
+    model.sections.append(s);
+
+    const QString html = model.toHtml();
+    assertContains(html, "<h2>A &amp; B</h2>", "Section label escaped");
+    assertContains(html, "<th>&lt;h&gt;</th><th>&amp;</th>",
+                   "Header cells escaped");
+    assertContains(html, "<td>&quot;x&quot;</td><td>y</td>",
+                   "Body cells escaped");
+  }
+
+  // Test 9: Parallel Rendering
+  {
+    std::cout << "\nTest 9: Parallel Rendering" << std::endl;
+    PaperModel model;
+    model.exam.title = "Parallel Exam";
+    for (int sectionIndex = 0; sectionIndex < 4; ++sectionIndex) {
+      Section s;
+      s.label = QString("Section %1").arg(sectionIndex + 1);
+      // Section 3 is left empty; section 2 spans several chunks.
+      const int count = sectionIndex == 2 ? 0 : 20 + sectionIndex * 40;
+      for (int i = 0; i < count; ++i) {
+        Question q;
+        q.text = QString("S%1 Q%2").arg(sectionIndex).arg(i);
+        if (i % 2) {
+          q.payload = McqPayload{{"A", "B", "C", "D"}};
+        }
+        s.questions.append(q);
+      }
+      model.sections.append(s);
+    }
+
+    const QString serial = model.toHtml();
+    model.clearRenderCache();
+    model.setParallelRendering(true);
+    const QString parallel = model.toHtml();
+
+    if (serial == parallel) {
+      std::cout << "[PASS] Parallel output is byte-identical" << std::endl;
+    } else {
+      std::cout << "[FAIL] Parallel output differs from serial" << std::endl;
+    }
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    if (model.render(buffer) && buffer.data() == serial.toUtf8()) {
+      std::cout << "[PASS] Parallel streaming matches serial" << std::endl;
+    } else {
+      std::cout << "[FAIL] Parallel streaming differs from serial"
+                << std::endl;
+    }
+  }
+
+  // Test 10: Layout IR
+  {
+    std::cout << "\nTest 10: Layout IR" << std::endl;
+    Question mcq;
+    mcq.text = "<p>Pick <b>one</b> &amp; only one</p>";
+    mcq.payload = McqPayload{{"A", "B", "C"}};
+    Question tabular;
+    tabular.text = "Plain";
+    tabular.table = {{"X", "Y"}, {"1"}};
+
+    PaperModel model;
+    model.exam.title = "IR Exam";
+    model.exam.totalMarks = 50;
+    for (int i = 0; i < 2; ++i) {
+      Section s;
+      s.label = QString("Section %1").arg(i + 1);
+      s.questions = {mcq, tabular};
+      model.sections.append(s);
+    }
+
+    const LayoutDocument doc = LayoutBuilder().build(model, RenderStyle());
+    const LayoutQuestion &first = doc.sections[1].questions[0];
+    const LayoutQuestion &second = doc.sections[1].questions[1];
+
+    if (doc.metadata == QStringList{"Total Marks: 50"} &&
+        first.number == 1 && second.number == 2) {
+      std::cout << "[PASS] Metadata and per-section numbering" << std::endl;
+    } else {
+      std::cout << "[FAIL] Metadata or numbering wrong" << std::endl;
+    }
+
+    if (first.options.columns == 2 && first.options.options.size() == 3) {
+      std::cout << "[PASS] MCQ lowered to a two-column grid" << std::endl;
+    } else {
+      std::cout << "[FAIL] MCQ grid wrong" << std::endl;
+    }
+
+    if (first.text.size() == 1 && first.text[0].runs.size() == 3 &&
+        first.text[0].runs[1].bold && first.text[0].runs[1].text == "one" &&
+        first.text[0].runs[2].text == " & only one") {
+      std::cout << "[PASS] Rich text lowered to runs" << std::endl;
+    } else {
+      std::cout << "[FAIL] Rich text runs wrong" << std::endl;
+    }
+
+    if (second.table.rows == 2 && second.table.columns == 2 &&
+        second.table.cell(1, 0) == "1" && second.table.cell(1, 1).isEmpty()) {
+      std::cout << "[PASS] Ragged table padded" << std::endl;
+    } else {
+      std::cout << "[FAIL] Table cells wrong" << std::endl;
+    }
+  }
+
+  // Test 11: Question Payloads
+  {
+    std::cout << "\nTest 11: Question Payloads" << std::endl;
+    Question q;
+    q.text = "Typed";
+    q.setType(QuestionType::Or);
+    if (q.type() == QuestionType::Or && q.as<OrPayload>() &&
+        !q.as<McqPayload>()) {
+      std::cout << "[PASS] Type follows the payload" << std::endl;
+    } else {
+      std::cout << "[FAIL] Type does not follow the payload" << std::endl;
+    }
+
+    Question mcq = q;
+    mcq.payload = McqPayload{{"A", "B"}};
+    Question mixed = q;
+    mixed.payload = MixedPayload{{"A", "B"}};
+    if (qHash(mcq) != qHash(mixed) && !(mcq == mixed)) {
+      std::cout << "[PASS] Payload type is part of the content hash"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] MCQ and Mixed payloads collide" << std::endl;
+    }
+  }
+
+  // Test 12: Compact Storage
+  {
+    std::cout << "\nTest 12: Compact Storage" << std::endl;
+    PaperModel model;
+    model.exam.title = "Compact Exam";
+    model.exam.subject = "Physics";
+    for (int sectionIndex = 0; sectionIndex < 3; ++sectionIndex) {
+      Section s;
+      s.label = QString("Section %1").arg(sectionIndex + 1);
+      s.subtitle = sectionIndex == 1 ? "Answer <all>" : "";
+      for (int i = 0; i < 200; ++i) {
+        Question q;
+        q.text = QString("<p>Q %1 &amp; more</p>").arg(i);
+        switch (i % 4) {
+        case 1:
+          q.payload = McqPayload{{"All of the above", "None", "B & C"}, 1};
+          break;
+        case 2:
+          q.payload = OrPayload{"Alternative <x>"};
+          q.table = {{"H1", "H2"}, {"a", "b"}};
+          break;
+        case 3:
+          q.payload = MixedPayload{{"One", "Two"}};
+          q.diagramPath = "/tmp/diagram.png";
+          break;
+        }
+        s.questions.append(q);
+      }
+      model.sections.append(s);
+    }
+
+    const CompactPaper compact(model);
+    if (compact.sectionCount() == 3 && compact.questionCount() == 600 &&
+        compact.question(201).optionCount == 3) {
+      std::cout << "[PASS] Records laid out flat" << std::endl;
+    } else {
+      std::cout << "[FAIL] Unexpected record layout" << std::endl;
+    }
+
+    if (compact.toHtml() == model.toHtml()) {
+      std::cout << "[PASS] Compact HTML matches PaperModel" << std::endl;
+    } else {
+      std::cout << "[FAIL] Compact HTML differs from PaperModel" << std::endl;
+    }
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    if (compact.render(buffer) && buffer.data() == model.toHtml().toUtf8()) {
+      std::cout << "[PASS] Compact streaming matches PaperModel" << std::endl;
+    } else {
+      std::cout << "[FAIL] Compact streaming differs" << std::endl;
+    }
+
+    if (compact.toModel().sections[2].questions == model.sections[2].questions) {
+      std::cout << "[PASS] Compact paper expands back losslessly" << std::endl;
+    } else {
+      std::cout << "[FAIL] Round trip lost data" << std::endl;
+    }
+
+    // A moved-from arena must not write into the blocks it gave away
+    StringArena source;
+    const QStringView kept = source.store(u"kept");
+    StringArena target(std::move(source));
+    const QStringView fromSource = source.store(u"other");
+    const QStringView fromTarget = target.store(u"more");
+    if (kept == u"kept" && fromSource == u"other" && fromTarget == u"more") {
+      std::cout << "[PASS] Moved-from arena starts its own block" << std::endl;
+    } else {
+      std::cout << "[FAIL] Moved-from arena corrupted stored text"
+                << std::endl;
+    }
+
+    // Large exports go through compact storage, bypassing the fragment cache
+    PaperModel large;
+    large.exam = model.exam;
+    for (int copy = 0; copy < 4; ++copy) {
+      large.sections += model.sections;
+    }
+    // Irregular tables must keep their exact shape on the compact path
+    large.sections[0].questions[0].table = {{}, {}};
+    large.sections[0].questions[4].table = {{"H1", "H2", "H3"}, {"a"}, {}};
+    if (CompactPaper(large).toModel().sections[0].questions ==
+        large.sections[0].questions) {
+      std::cout << "[PASS] Irregular tables expand back unchanged"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Irregular tables changed shape" << std::endl;
+    }
+    const QString largePath = QDir::temp().filePath("paper_build_compact.html");
+    const QString expected = large.toHtml();
+    large.clearRenderCache();
+    const bool exported = HtmlExporter().exportToHtml(large, largePath);
+    QFile largeFile(largePath);
+    largeFile.open(QIODevice::ReadOnly);
+    if (exported && largeFile.readAll() == expected.toUtf8() &&
+        large.renderCacheMisses() == 0) {
+      std::cout << "[PASS] Large paper exported from compact records"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Compact export differs or used the cache"
+                << std::endl;
+    }
+    largeFile.close();
+    QFile::remove(largePath);
+  }
+
+  // Test 13: String Interning
+  {
+    std::cout << "\nTest 13: String Interning" << std::endl;
+    StringPool &pool = StringPool::shared();
+    Question first;
+    first.payload = McqPayload{{QString("All & none"), QString("Yes")}};
+    Question second;
+    second.payload = MixedPayload{{QString("All & none")}};
+    pool.internQuestion(first);
+    pool.internQuestion(second);
+
+    if (first.as<McqPayload>()->options[0].constData() ==
+        second.as<MixedPayload>()->options[0].constData()) {
+      std::cout << "[PASS] Equal options share storage" << std::endl;
+    } else {
+      std::cout << "[FAIL] Equal options were not shared" << std::endl;
+    }
+
+    Section s;
+    s.questions = {first, second};
+    PaperModel model;
+    model.sections.append(s);
+    const QString html = model.toHtml();
+    assertContains(html, "(a) All &amp; none</td>",
+                   "Interned MCQ option escaped");
+    assertContains(html, "(a) All &amp; none<br/>",
+                   "Interned Mixed option escaped");
+
+    // Editor text reuses pooled strings but never grows the pool
+    StringPool local;
+    Question loaded;
+    loaded.payload = McqPayload{{QString("Pooled"), QString("Also pooled")}};
+    local.internQuestion(loaded);
+    Question typed;
+    typed.payload = OrPayload{QString("Typed alternative")};
+    typed.table = {{QString("Pooled"), QString("Typed cell")}};
+    local.shareQuestion(typed);
+    if (local.size() == 2 &&
+        typed.table[0][0].constData() ==
+            loaded.as<McqPayload>()->options[0].constData()) {
+      std::cout << "[PASS] Editor text shared without being added"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Editor text grew the pool to " << local.size()
+                << std::endl;
+    }
+
+    typed = Question();
+    loaded.as<McqPayload>()->options.removeFirst();
+    if (local.prune() == 1 && local.size() == 1) {
+      std::cout << "[PASS] Unused strings pruned" << std::endl;
+    } else {
+      std::cout << "[FAIL] Prune kept " << local.size() << " strings"
+                << std::endl;
+    }
+  }
+
+  // Test 14: Snapshots
+  {
+    std::cout << "\nTest 14: Snapshots" << std::endl;
+    Question q;
+    q.text = "Original question";
+    Section s;
+    s.label = "Section A";
+    s.questions.append(q);
+    PaperModel model;
+    model.exam.title = "Snapshot Exam";
+    model.sections.append(s);
+
+    const PaperSnapshot snapshot = model.snapshot();
+    const QString before = snapshot->toHtml();
+
+    if (snapshot->sections.constData() == model.sections.constData()) {
+      std::cout << "[PASS] Snapshot shares sections with the model"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Snapshot copied the sections" << std::endl;
+    }
+
+    // Edits after the snapshot must not reach it
+    model.sections[0].questions[0].text = "Edited question";
+    model.sections[0].label = "Section B";
+    if (snapshot->toHtml() == before &&
+        snapshot->sections[0].questions[0].text == "Original question") {
+      std::cout << "[PASS] Snapshot unaffected by later edits" << std::endl;
+    } else {
+      std::cout << "[FAIL] Snapshot changed after editing the model"
+                << std::endl;
+    }
+
+    // A worker renders the same document as the GUI thread
+    QString workerHtml;
+    QThreadPool::globalInstance()->start(
+        [snapshot, &workerHtml]() { workerHtml = snapshot->toHtml(); });
+    QThreadPool::globalInstance()->waitForDone();
+    if (workerHtml == before) {
+      std::cout << "[PASS] Snapshot renders identically on a worker thread"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Worker rendering differs" << std::endl;
+    }
+  }
+
+  // Test 15: Change Tracking
+  {
+    std::cout << "\nTest 15: Change Tracking" << std::endl;
+    Question q1;
+    q1.text = "First";
+    q1.id = newNodeId();
+    q1.version = 1;
+    Question q2;
+    q2.text = "Second";
+    q2.id = newNodeId();
+    q2.version = 1;
+    Section s;
+    s.label = "Section A";
+    s.id = newNodeId();
+    s.version = 1;
+    s.questions = {q1, q2};
+
+    PaperModel model;
+    QVector<PaperChange> changes;
+    const int handle = model.addChangeListener(
+        [&changes](const PaperChange &change) { changes.append(change); });
+
+    model.setSections({s});
+    if (changes.size() == 1 &&
+        changes[0].kind == PaperChange::Kind::SectionInserted &&
+        changes[0].sectionId == s.id) {
+      std::cout << "[PASS] New section reported as one insert" << std::endl;
+    } else {
+      std::cout << "[FAIL] Expected one SectionInserted, got "
+                << changes.size() << " changes" << std::endl;
+    }
+
+    // Same versions: nothing to do
+    changes.clear();
+    model.setSections({s});
+    if (changes.isEmpty()) {
+      std::cout << "[PASS] Unchanged paper reports nothing" << std::endl;
+    } else {
+      std::cout << "[FAIL] Unchanged paper reported changes" << std::endl;
+    }
+
+    // Edit one question and swap the two
+    changes.clear();
+    s.questions[1].text = "Second, edited";
+    s.questions[1].version = 2;
+    s.questions.move(1, 0);
+    s.version = 2;
+    model.setSections({s});
+    bool moved = false;
+    bool updated = false;
+    bool other = false;
+    for (const PaperChange &change : changes) {
+      if (change.kind == PaperChange::Kind::QuestionMoved &&
+          change.questionId == q2.id) {
+        moved = true;
+      } else if (change.kind == PaperChange::Kind::QuestionUpdated &&
+                 change.questionId == q2.id) {
+        updated = true;
+      } else {
+        other = true;
+      }
+    }
+    if (moved && updated && !other) {
+      std::cout << "[PASS] Edit and move reported per question" << std::endl;
+    } else {
+      std::cout << "[FAIL] Unexpected changes for edit and move" << std::endl;
+    }
+
+    if (model.sections[0].questions[0].text == "Second, edited" &&
+        model.sections[0].questions[1].id == q1.id &&
+        model.version() == changes.last().modelVersion) {
+      std::cout << "[PASS] Model matches the new sections" << std::endl;
+    } else {
+      std::cout << "[FAIL] Model out of sync after setSections" << std::endl;
+    }
+
+    // Removal by ID; snapshots keep IDs but not listeners
+    const PaperSnapshot snapshot = model.snapshot();
+    model.removeChangeListener(handle);
+    changes.clear();
+    model.removeQuestion(0, model.indexOfQuestion(0, q1.id));
+    if (changes.isEmpty() && model.sections[0].questions.size() == 1 &&
+        snapshot->indexOfQuestion(0, q1.id) == 1) {
+      std::cout << "[PASS] Removed listener and snapshot unaffected"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Listener removal or snapshot IDs broken"
+                << std::endl;
+    }
+
+    // Edits at both ends of a large section; lookups must stay linear
+    Section large;
+    large.id = newNodeId();
+    large.version = 1;
+    for (int i = 0; i < 20000; ++i) {
+      Question q;
+      q.text = QString("Question %1").arg(i);
+      q.id = newNodeId();
+      q.version = 1;
+      large.questions.append(q);
+    }
+    PaperModel bank;
+    bank.setSections({large});
+    large.questions.move(large.questions.size() - 1, 0);
+    large.questions.removeAt(large.questions.size() / 2);
+    Question added;
+    added.text = "Added";
+    added.id = newNodeId();
+    added.version = 1;
+    large.questions.append(added);
+    large.version = 2;
+    QElapsedTimer syncTimer;
+    syncTimer.start();
+    bank.setSections({large});
+    const qint64 syncMs = syncTimer.elapsed();
+    if (bank.sections[0].questions == large.questions &&
+        bank.sections[0].questions.last().id == added.id) {
+      std::cout << "[PASS] Large section synced in " << syncMs << " ms"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Large section out of sync" << std::endl;
+    }
+  }
+
+  // Test 16: Paper Layout Engine
+  {
+    std::cout << "\nTest 16: Paper Layout Engine" << std::endl;
+    Section s;
+    s.label = "Section A";
+    for (int i = 0; i < 60; ++i) {
+      Question q;
+      q.text = "<p>Question <b>" + QString::number(i) + "</b> text</p>";
+      if (i % 3 == 0) {
+        q.payload = McqPayload{{"Alpha", "Beta", "Gamma", "Delta"}};
+      } else if (i % 3 == 1) {
+        q.payload = OrPayload{"Alternative question"};
+      }
+      if (i % 5 == 0) {
+        q.table = {{"x", "y"}, {"1", "2"}};
+      }
+      s.questions.append(q);
+    }
+    PaperModel model;
+    model.exam.title = "Layout Exam";
+    model.sections.append(s);
+    const LayoutDocument layout = LayoutBuilder().build(
+        model, RenderStyle{"Times New Roman", 12, true});
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    int pages = 0;
+    {
+      QPdfWriter writer(&buffer);
+      writer.setPageSize(QPageSize(QPageSize::A4));
+      QPainter painter(&writer);
+      pages = PaperLayoutEngine(layout).paint(painter, writer);
+    }
+
+    if (buffer.data().startsWith("%PDF")) {
+      std::cout << "[PASS] Engine produced a PDF" << std::endl;
+    } else {
+      std::cout << "[FAIL] Output is not a PDF" << std::endl;
+    }
+    if (pages > 1) {
+      std::cout << "[PASS] Long paper paginated over " << pages << " pages"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Expected more than one page, got " << pages
+                << std::endl;
+    }
+  }
+
+  // Test 17: Async Export
+  {
+    std::cout << "\nTest 17: Async Export" << std::endl;
+    PaperModel model;
+    model.exam.title = "Async Exam";
+    for (int i = 0; i < 3; ++i) {
+      Section s;
+      s.label = "Section " + QString::number(i + 1);
+      Question q;
+      q.text = "Question";
+      s.questions.append(q);
+      model.sections.append(s);
+    }
+    const QString path = QDir::temp().filePath("paper_build_async_test.html");
+
+    QFuture<bool> future =
+        HtmlExporter::exportToHtmlAsync(model.snapshot(), path);
+    future.waitForFinished();
+    if (future.result() && QFile::exists(path) &&
+        future.progressValue() == 3 && future.progressMaximum() == 3) {
+      std::cout << "[PASS] Async export reported every section" << std::endl;
+    } else {
+      std::cout << "[FAIL] Async export result or progress wrong"
+                << std::endl;
+    }
+
+    // Canceling between sections stops the export
+    ExportProgress progress;
+    int reported = 0;
+    progress.report = [&reported](int, int, const QString &) { ++reported; };
+    progress.canceled = [&reported]() { return reported >= 1; };
+    if (!HtmlExporter().exportToHtml(model, path, "Times New Roman", 12, true,
+                                     progress) &&
+        reported == 1) {
+      std::cout << "[PASS] Export stopped after cancel" << std::endl;
+    } else {
+      std::cout << "[FAIL] Export ignored cancel" << std::endl;
+    }
+
+    // Failed jobs leave no partial file behind and the old file in place
+    QFile previous(path);
+    previous.open(QIODevice::WriteOnly);
+    previous.write("previous");
+    previous.close();
+    QString partialPath;
+    QFuture<bool> failed = ExportTask::start(
+        path, [&partialPath](const QString &target, const ExportProgress &) {
+          partialPath = target;
+          QFile file(target);
+          file.open(QIODevice::WriteOnly);
+          file.write("partial");
+          return false;
+        });
+    failed.waitForFinished();
+    previous.open(QIODevice::ReadOnly);
+    if (!failed.result() && partialPath != path &&
+        !QFile::exists(partialPath) && previous.readAll() == "previous") {
+      std::cout << "[PASS] Partial output removed" << std::endl;
+    } else {
+      std::cout << "[FAIL] Partial output left behind" << std::endl;
+    }
+    previous.close();
+
+    // A complete file replaces the old one in a single rename
+    QFuture<bool> replaced = ExportTask::start(
+        path, [&partialPath](const QString &target, const ExportProgress &) {
+          partialPath = target;
+          QFile file(target);
+          return file.open(QIODevice::WriteOnly) && file.write("new") == 3;
+        });
+    replaced.waitForFinished();
+    previous.open(QIODevice::ReadOnly);
+    if (replaced.result() && !QFile::exists(partialPath) &&
+        previous.readAll() == "new") {
+      std::cout << "[PASS] Complete output replaced the target" << std::endl;
+    } else {
+      std::cout << "[FAIL] Target not replaced" << std::endl;
+    }
+    previous.close();
+    QFile::remove(path);
+  }
+
+
+  // Test 18: Export Scheduler
+  {
+    std::cout << "\nTest 18: Export Scheduler" << std::endl;
+    PaperModel model;
+    model.exam.title = "Scheduled Exam";
+    Section s;
+    s.label = "Section A";
+    Question q;
+    q.text = "Question";
+    s.questions.append(q);
+    model.sections.append(s);
+
+    ExportScheduler scheduler;
+    scheduler.setMaxConcurrentJobs(1);
+    const auto job = [&model](const QString &name,
+                              ExportJob::Priority priority) {
+      ExportJob result;
+      result.snapshot = model.snapshot();
+      result.format = ExportJob::Format::Html;
+      result.filePath = QDir::temp().filePath(name);
+      result.priority = priority;
+      return result;
+    };
+
+    int first = 0;
+    int batch = 0;
+    int interactive = 0;
+    int merged = 0;
+    int canceled = 0;
+    scheduler.schedule(
+        job("paper_build_sched_1.html", ExportJob::Priority::Batch), &first);
+    scheduler.schedule(
+        job("paper_build_sched_2.html", ExportJob::Priority::Batch), &batch);
+    scheduler.schedule(job("paper_build_sched_3.html",
+                           ExportJob::Priority::Interactive),
+                       &interactive);
+    scheduler.schedule(
+        job("paper_build_sched_4.html", ExportJob::Priority::Batch), &canceled);
+    // Same paper, file and settings from a fresh snapshot
+    QFuture<bool> mergedFuture = scheduler.schedule(
+        job("paper_build_sched_2.html", ExportJob::Priority::Normal), &merged);
+    scheduler.cancel(canceled);
+
+    if (merged == batch && scheduler.jobs().size() == 4 &&
+        scheduler.job(batch)->job.priority == ExportJob::Priority::Normal) {
+      std::cout << "[PASS] Identical pending job merged" << std::endl;
+    } else {
+      std::cout << "[FAIL] Identical pending job queued twice" << std::endl;
+    }
+
+    // With one worker, the interactive job must start before the batch one
+    bool interactiveFirst = false;
+    QElapsedTimer timer;
+    timer.start();
+    while (scheduler.pendingCount() > 0 && timer.elapsed() < 30000) {
+      QCoreApplication::processEvents();
+      if (scheduler.job(interactive)->state != ExportScheduler::State::Queued &&
+          scheduler.job(batch)->state == ExportScheduler::State::Queued) {
+        interactiveFirst = true;
+      }
+    }
+    if (interactiveFirst) {
+      std::cout << "[PASS] Higher priority job ran first" << std::endl;
+    } else {
+      std::cout << "[FAIL] Queue ignored priorities" << std::endl;
+    }
+
+    if (scheduler.job(first)->state == ExportScheduler::State::Finished &&
+        scheduler.job(batch)->state == ExportScheduler::State::Finished &&
+        scheduler.job(interactive)->state == ExportScheduler::State::Finished &&
+        scheduler.job(canceled)->state == ExportScheduler::State::Canceled &&
+        mergedFuture.result() &&
+        !QFile::exists(QDir::temp().filePath("paper_build_sched_4.html"))) {
+      std::cout << "[PASS] Scheduled jobs finished or canceled" << std::endl;
+    } else {
+      std::cout << "[FAIL] Scheduled jobs ended in the wrong state"
+                << std::endl;
+    }
+
+    // Exports of one file run in order; a merged caller that cancels only
+    // drops itself
+    scheduler.setMaxConcurrentJobs(2);
+    const QString samePath =
+        QDir::temp().filePath("paper_build_sched_same.html");
+    int older = 0;
+    int newer = 0;
+    QFuture<bool> olderFuture = scheduler.schedule(
+        job("paper_build_sched_same.html", ExportJob::Priority::Normal),
+        &older);
+    QFuture<bool> dropped = scheduler.schedule(
+        job("paper_build_sched_same.html", ExportJob::Priority::Normal));
+    model.sections[0].questions[0].text = "Edited question";
+    scheduler.schedule(
+        job("paper_build_sched_same.html", ExportJob::Priority::Interactive),
+        &newer);
+    dropped.cancel();
+    bool overlapped = false;
+    timer.restart();
+    while (scheduler.pendingCount() > 0 && timer.elapsed() < 30000) {
+      QCoreApplication::processEvents();
+      overlapped = overlapped ||
+                   (scheduler.job(newer)->state != ExportScheduler::State::Queued &&
+                    !scheduler.job(older)->isDone());
+    }
+    QFile same(samePath);
+    same.open(QIODevice::ReadOnly);
+    if (!overlapped && dropped.isCanceled() && olderFuture.result() &&
+        scheduler.job(newer)->state == ExportScheduler::State::Finished &&
+        same.readAll().contains("Edited question")) {
+      std::cout << "[PASS] Same-file exports serialized, merged cancel kept"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Same-file exports overlapped or were canceled"
+                << std::endl;
+    }
+    same.close();
+    QFile::remove(samePath);
+
+    scheduler.clearFinished();
+    if (scheduler.jobs().isEmpty()) {
+      std::cout << "[PASS] Finished jobs cleared" << std::endl;
+    } else {
+      std::cout << "[FAIL] Finished jobs still listed" << std::endl;
+    }
+  }
+
+
+  // Test 19: Parallel Page Layout
+  {
+    std::cout << "\nTest 19: Parallel Page Layout" << std::endl;
+    PaperModel model;
+    model.exam.title = "Question Bank";
+    for (int section = 0; section < 6; ++section) {
+      Section s;
+      s.label = "Section " + QString(QChar('A' + section));
+      for (int i = 0; i < 50; ++i) {
+        Question q;
+        q.text = "Question " + QString::number(i) +
+                 QString(" with a longer body that wraps").repeated(i % 4);
+        if (i % 2 == 0) {
+          q.payload = McqPayload{{"One", "Two", "Three", "Four"}};
+        }
+        s.questions.append(q);
+      }
+      model.sections.append(s);
+    }
+    const LayoutDocument layout = LayoutBuilder().build(
+        model, RenderStyle{"Times New Roman", 12, true});
+
+    // Paginate with one thread and with the whole pool
+    const auto paint = [&layout](int &placed) {
+      QBuffer buffer;
+      buffer.open(QIODevice::WriteOnly);
+      QPdfWriter writer(&buffer);
+      writer.setPageSize(QPageSize(QPageSize::A4));
+      QPainter painter(&writer);
+      return PaperLayoutEngine(layout).paint(
+          painter, writer, [&placed](int, int questionsPlaced) {
+            placed = questionsPlaced;
+            return true;
+          });
+    };
+    QThreadPool *pool = QThreadPool::globalInstance();
+    const int threads = pool->maxThreadCount();
+    int serialPlaced = 0;
+    pool->setMaxThreadCount(1);
+    const int serialPages = paint(serialPlaced);
+    pool->setMaxThreadCount(qMax(threads, 4));
+    int parallelPlaced = 0;
+    const int parallelPages = paint(parallelPlaced);
+    pool->setMaxThreadCount(threads);
+
+    if (serialPages == parallelPages && serialPages > 1) {
+      std::cout << "[PASS] Same " << serialPages
+                << " pages with any thread count" << std::endl;
+    } else {
+      std::cout << "[FAIL] Pagination differs: " << serialPages << " vs "
+                << parallelPages << std::endl;
+    }
+    if (serialPlaced == 300 && parallelPlaced == 300) {
+      std::cout << "[PASS] Every question placed in order" << std::endl;
+    } else {
+      std::cout << "[FAIL] Placed " << serialPlaced << " and "
+                << parallelPlaced << " questions" << std::endl;
+    }
+  }
+
+
+  // Test 20: Diagram Cache
+  {
+    std::cout << "\nTest 20: Diagram Cache" << std::endl;
+    const QString photoPath = QDir::temp().filePath("paper_build_photo.jpg");
+    QImage photo(2400, 1600, QImage::Format_RGB32);
+    photo.fill(Qt::darkCyan);
+    {
+      QPainter painter(&photo);
+      for (int x = 0; x < photo.width(); x += 40) {
+        painter.drawLine(x, 0, photo.width() - x, photo.height());
+      }
+    }
+    photo.save(photoPath, "JPEG", 95);
+
+    DiagramCache cache;
+    const QImage prepared = cache.image(photoPath, 150, 300);
+    if (prepared.size() == QSize(469, 313)) {
+      std::cout << "[PASS] Diagram resampled to 300 DPI at 150px"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Unexpected diagram size " << prepared.width()
+                << "x" << prepared.height() << std::endl;
+    }
+
+    cache.image(photoPath, 150, 300);
+    const DiagramCache::Diagram encoded = cache.encoded(photoPath, 150, 300);
+    if (cache.hits() == 1 && cache.misses() == 2 &&
+        encoded.mimeType == "image/jpeg" &&
+        encoded.data.startsWith("\xFF\xD8") &&
+        encoded.data.size() < QFileInfo(photoPath).size()) {
+      std::cout << "[PASS] Decoded once, recompressed smaller" << std::endl;
+    } else {
+      std::cout << "[FAIL] Cache reuse or recompression wrong" << std::endl;
+    }
+
+    // Editing the file invalidates its entry
+    QFile file(photoPath);
+    file.open(QIODevice::ReadWrite);
+    file.setFileTime(QFileInfo(photoPath).lastModified().addSecs(10),
+                     QFileDevice::FileModificationTime);
+    file.close();
+    cache.image(photoPath, 150, 300);
+    if (cache.misses() == 3) {
+      std::cout << "[PASS] Modified file decoded again" << std::endl;
+    } else {
+      std::cout << "[FAIL] Stale diagram served" << std::endl;
+    }
+
+    // Small images are never scaled up
+    const QString iconPath = QDir::temp().filePath("paper_build_icon.png");
+    QImage icon(100, 50, QImage::Format_ARGB32);
+    icon.fill(Qt::transparent);
+    icon.save(iconPath, "PNG");
+    if (cache.image(iconPath, 150, 300).size() == QSize(100, 50) &&
+        cache.encoded(iconPath, 150, 300).mimeType == "image/png") {
+      std::cout << "[PASS] Small diagram kept at its size" << std::endl;
+    } else {
+      std::cout << "[FAIL] Small diagram rescaled" << std::endl;
+    }
+    QFile::remove(photoPath);
+    QFile::remove(iconPath);
+  }
+
+
+  // Test 21: Vector Diagrams
+  {
+    std::cout << "\nTest 21: Vector Diagrams" << std::endl;
+    const QString svgPath = QDir::temp().filePath("paper_build_circuit.svg");
+    QFile svgFile(svgPath);
+    svgFile.open(QIODevice::WriteOnly);
+    svgFile.write("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"200\" "
+                  "height=\"100\"><line x1=\"0\" y1=\"50\" x2=\"200\" "
+                  "y2=\"50\" stroke=\"black\"/><circle cx=\"100\" "
+                  "cy=\"50\" r=\"20\" fill=\"none\" stroke=\"black\"/>"
+                  "</svg>");
+    svgFile.close();
+
+    const auto svg = DiagramCache::shared().vector(svgPath);
+    if (svg && svg->defaultSize() == QSizeF(200, 100) &&
+        DiagramCache::shared().vector(svgPath) == svg) {
+      std::cout << "[PASS] SVG parsed once and cached" << std::endl;
+    } else {
+      std::cout << "[FAIL] SVG not parsed or not cached" << std::endl;
+    }
+
+    // Parsed SVGs share the byte budget with images
+    const QString copyPath = QDir::temp().filePath("paper_build_circuit2.svg");
+    QFile::remove(copyPath);
+    QFile::copy(svgPath, copyPath);
+    DiagramCache small(QFileInfo(svgPath).size() * 6);
+    small.vector(svgPath);
+    small.vector(copyPath);
+    if (small.vectorCount() == 1 && small.bytes() <= QFileInfo(svgPath).size() * 6 &&
+        small.vector(copyPath) && small.hits() == 1) {
+      std::cout << "[PASS] Least recently used SVG evicted" << std::endl;
+    } else {
+      std::cout << "[FAIL] " << small.vectorCount() << " SVGs held past the budget"
+                << std::endl;
+    }
+    QFile::remove(copyPath);
+
+    PaperModel model;
+    Section s;
+    s.label = "Section A";
+    Question q;
+    q.text = "Find the current through the resistor.";
+    q.diagramPath = svgPath;
+    s.questions.append(q);
+    model.sections.append(s);
+    const LayoutDocument layout = LayoutBuilder().build(
+        model, RenderStyle{"Times New Roman", 12, true});
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    {
+      QPdfWriter writer(&buffer);
+      QPainter painter(&writer);
+      PaperLayoutEngine(layout).paint(painter, writer);
+    }
+    if (buffer.data().startsWith("%PDF") &&
+        !buffer.data().contains("/Subtype /Image")) {
+      std::cout << "[PASS] SVG diagram drawn as vector content" << std::endl;
+    } else {
+      std::cout << "[FAIL] SVG diagram was rasterized" << std::endl;
+    }
+    QFile::remove(svgPath);
+  }
+
+  // Test 22: Native DOCX
+  {
+    std::cout << "\nTest 22: Native DOCX" << std::endl;
+    const QString photoPath = QDir::temp().filePath("paper_build_docx.png");
+    QImage photo(1200, 800, QImage::Format_RGB32);
+    photo.fill(Qt::darkCyan);
+    photo.save(photoPath, "PNG");
+
+    PaperModel model;
+    model.exam.title = "Physics & Chemistry";
+    model.exam.subject = "Science";
+    for (int i = 0; i < 2; ++i) {
+      Section s;
+      s.label = QString("Section %1").arg(QChar('A' + i));
+      Question q;
+      q.text = "Find <b>x</b> if x<sup>2</sup> = 4";
+      q.diagramPath = photoPath;
+      q.table = {{"x", "y"}, {"1", "2"}};
+      s.questions.append(q);
+      Question mcq;
+      mcq.text = "Pick one";
+      mcq.payload = McqPayload{{"A", "B", "C"}};
+      s.questions.append(mcq);
+      model.sections.append(s);
+    }
+
+    const QString docxPath = QDir::temp().filePath("paper_build_test.docx");
+    int progressSteps = 0;
+    ExportProgress progress;
+    progress.report = [&progressSteps](int, int, const QString &) {
+      ++progressSteps;
+    };
+    const bool exported = DocxExporter().exportToDocx(
+        model, docxPath, "Times New Roman", 12, true, progress);
+    QFile docxFile(docxPath);
+    docxFile.open(QIODevice::ReadOnly);
+    const QByteArray docx = docxFile.readAll();
+    docxFile.close();
+
+    const QString documentXml =
+        QString::fromUtf8(zipEntry(docx, "word/document.xml"));
+    if (exported && docx.startsWith("PK\x03\x04") &&
+        !zipEntry(docx, "[Content_Types].xml").isEmpty() &&
+        !zipEntry(docx, "word/styles.xml").isEmpty() &&
+        !zipEntry(docx, "word/numbering.xml").isEmpty() &&
+        !zipEntry(docx, "word/_rels/document.xml.rels").isEmpty() &&
+        progressSteps == 2) {
+      std::cout << "[PASS] DOCX package complete" << std::endl;
+    } else {
+      std::cout << "[FAIL] DOCX package incomplete" << std::endl;
+    }
+    assertContains(documentXml, "Physics &amp; Chemistry",
+                   "DOCX title escaped");
+    assertContains(documentXml, "<w:vertAlign w:val=\"superscript\"/>",
+                   "DOCX run formatting");
+    assertContains(documentXml, "<w:numId w:val=\"2\"/>",
+                   "DOCX numbering per section");
+    assertContains(documentXml, "<w:tblpPr", "DOCX floating data table");
+
+    // The diagram is embedded once, downscaled and uncompressed
+    const QByteArray media = zipEntry(docx, "word/media/image1.jpeg");
+    const QImage embedded = QImage::fromData(media);
+    if (!embedded.isNull() && embedded.width() < photo.width() &&
+        zipEntry(docx, "word/media/image2.jpeg").isNull() &&
+        documentXml.count("r:embed=\"rIdImage1\"") == 2) {
+      std::cout << "[PASS] DOCX diagram embedded once" << std::endl;
+    } else {
+      std::cout << "[FAIL] DOCX diagram missing or duplicated" << std::endl;
+    }
+
+    // Canceling stops the export
+    ExportProgress cancel;
+    cancel.canceled = []() { return true; };
+    if (!DocxExporter().exportToDocx(model, docxPath, "Times New Roman", 12,
+                                     true, cancel)) {
+      std::cout << "[PASS] DOCX export canceled" << std::endl;
+    } else {
+      std::cout << "[FAIL] DOCX export ignored cancel" << std::endl;
+    }
+    QFile::remove(docxPath);
+    QFile::remove(photoPath);
+  }
+
+  // Test 23: Parallel Zip Compression
+  {
+    std::cout << "\nTest 23: Parallel Zip Compression" << std::endl;
+    QByteArray xml;
+    for (int i = 0; i < 100000; ++i) {
+      xml += "<w:p><w:r><w:t>Question " + QByteArray::number(i % 977) +
+             "</w:t></w:r></w:p>";
+    }
+    const QByteArray media(200000, 'j');
+
+    // Several blocks per entry, written in small pieces as by
+    // QXmlStreamWriter
+    const auto writeArchive = [&](QThreadPool *pool) {
+      QBuffer buffer;
+      buffer.open(QIODevice::WriteOnly);
+      ZipWriter zip(&buffer, pool);
+      zip.addEntry("styles.xml", xml.left(5000));
+      QIODevice *device = zip.beginEntry("document.xml");
+      for (int at = 0; at < xml.size(); at += 100) {
+        device->write(xml.mid(at, 100));
+      }
+      zip.endEntry();
+      zip.addEntry("media/image1.jpeg", media, ZipWriter::Method::Stored);
+      return zip.finish() ? buffer.data() : QByteArray();
+    };
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(4);
+    const QByteArray serial = writeArchive(nullptr);
+    const QByteArray parallel = writeArchive(&pool);
+    if (!parallel.isEmpty() && parallel == serial) {
+      std::cout << "[PASS] Same archive with and without the pool"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Parallel archive differs" << std::endl;
+    }
+    if (zipEntry(parallel, "document.xml") == xml &&
+        zipEntry(parallel, "styles.xml") == xml.left(5000) &&
+        zipEntry(parallel, "media/image1.jpeg") == media &&
+        parallel.size() < xml.size() / 4 + media.size() + 1000) {
+      std::cout << "[PASS] Blocks join into valid deflate streams"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Parallel archive unreadable" << std::endl;
+    }
+  }
+
+  // Test 24: Self-contained HTML
+  {
+    std::cout << "\nTest 24: Self-contained HTML" << std::endl;
+    bool encoderMatches = true;
+    QByteArray bytes;
+    for (int size = 0; size <= 100; ++size) {
+      QByteArray encoded(Base64::encodedSize(size), Qt::Uninitialized);
+      Base64::encode(bytes.constData(), size, encoded.data());
+      encoderMatches = encoderMatches && encoded == bytes.toBase64();
+      bytes += char(size * 37 + 11);
+    }
+    if (encoderMatches) {
+      std::cout << "[PASS] Base64 matches QByteArray::toBase64" << std::endl;
+    } else {
+      std::cout << "[FAIL] Base64 differs from QByteArray::toBase64"
+                << std::endl;
+    }
+
+    // Two copies of a small diagram, used by three questions, and a photo
+    // that needs downscaling
+    const QString iconPath = QDir::temp().filePath("paper_build_inline.png");
+    const QString copyPath =
+        QDir::temp().filePath("paper_build_inline_copy.png");
+    const QString photoPath = QDir::temp().filePath("paper_build_inline.jpg");
+    QImage icon(120, 60, QImage::Format_RGB32);
+    icon.fill(Qt::darkRed);
+    icon.save(iconPath, "PNG");
+    QFile::remove(copyPath);
+    QFile::copy(iconPath, copyPath);
+    QImage photo(2400, 1600, QImage::Format_RGB32);
+    photo.fill(Qt::darkCyan);
+    photo.save(photoPath, "JPEG", 95);
+
+    PaperModel model;
+    model.exam.title = "Inline Diagrams";
+    Section s;
+    s.label = "Section A";
+    for (const QString &path : {iconPath, copyPath, iconPath, photoPath}) {
+      Question q;
+      q.text = "Describe the diagram";
+      q.diagramPath = path;
+      s.questions.append(q);
+    }
+    model.sections.append(s);
+
+    RenderStyle style{"Times New Roman", 12, true};
+    style.inlineDiagrams = true;
+    const QString htmlPath = QDir::temp().filePath("paper_build_inline.html");
+    const bool exported = HtmlExporter().exportToHtml(model, htmlPath, style);
+    QFile htmlFile(htmlPath);
+    htmlFile.open(QIODevice::ReadOnly);
+    const QString html = QString::fromUtf8(htmlFile.readAll());
+    htmlFile.close();
+
+    QFile iconFile(iconPath);
+    iconFile.open(QIODevice::ReadOnly);
+    const QString iconUri =
+        "data:image/png;base64," + QString::fromLatin1(iconFile.readAll().toBase64());
+    iconFile.close();
+    const QString iconClass = PaperHtml::diagramClass(iconPath);
+    const QString copyClass = PaperHtml::diagramClass(copyPath);
+    if (exported && !html.contains("file://") &&
+        html.count(iconUri) == 1 &&
+        html.contains("." + iconClass + ",." + copyClass + " { height:75px;") &&
+        html.count("class=\"question-image inline-diagram " + iconClass) == 2 &&
+        html.indexOf(iconUri) < html.indexOf("</head>")) {
+      std::cout << "[PASS] Identical diagrams embedded once in the head"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Diagrams not embedded once" << std::endl;
+    }
+
+    // The photo is downscaled to print resolution before embedding
+    const int photoData = html.indexOf("data:image/jpeg;base64,");
+    const int photoEnd = html.indexOf('"', photoData);
+    if (photoData > 0 && html.contains("{ height:100px; background-image") &&
+        photoEnd - photoData < QFileInfo(photoPath).size()) {
+      std::cout << "[PASS] Oversized diagram recompressed" << std::endl;
+    } else {
+      std::cout << "[FAIL] Oversized diagram embedded as is" << std::endl;
+    }
+
+    QFile::remove(htmlPath);
+    QFile::remove(iconPath);
+    QFile::remove(copyPath);
+    QFile::remove(photoPath);
+  }
+
+  // Test 25: Binary Paper File
+  {
+    std::cout << "\nTest 25: Binary Paper File" << std::endl;
+    PaperModel model;
+    model.exam.title = "Térm Exam";
+    model.exam.subject = "Physics";
+    model.exam.totalMarks = 80;
+    model.exam.passMarks = 32;
+    model.exam.examDate = QDate(2024, 3, 15);
+    model.exam.isLandscape = true;
+    for (int i = 0; i < 3; ++i) {
+      Section s;
+      s.label = QString("Section %1").arg(QChar('A' + i));
+      s.subtitle = "Answer all";
+      for (int j = 0; j < 50; ++j) {
+        Question q;
+        q.text = QString("Question <b>%1</b> π").arg(j);
+        if (j % 4 == 1) {
+          q.payload = McqPayload{{"One", "Two", "Three"}, 2};
+        } else if (j % 4 == 2) {
+          q.payload = OrPayload{"Or this one"};
+          q.diagramPath = "/tmp/diagram.png";
+        } else if (j % 4 == 3) {
+          q.payload = MixedPayload{{"Yes", "No"}};
+          q.table = {{"x", "y"}, {"1", "2", "3"}};
+        }
+        s.questions.append(q);
+      }
+      model.sections.append(s);
+    }
+
+    const QString paperPath = QDir::temp().filePath("paper_build_test.epf");
+    QString error;
+    PaperFile file;
+    const bool saved = PaperFile::save(model, paperPath, &error);
+    if (saved && PaperFile::isPaperFile(paperPath) && file.open(paperPath) &&
+        file.sectionCount() == 3 && file.questionCount(2) == 50 &&
+        file.exam() == model.exam && !file.isDecoded(0)) {
+      std::cout << "[PASS] Opened with only the header and table read"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Paper file not opened: "
+                << file.errorString().toStdString() << std::endl;
+    }
+
+    bool ok = false;
+    const Section second = file.section(1, &ok);
+    if (ok && file.isDecoded(1) && !file.isDecoded(2) &&
+        second.label == "Section B" &&
+        second.questions == model.sections[1].questions &&
+        file.section(1).id == second.id) {
+      std::cout << "[PASS] Section decoded on first use" << std::endl;
+    } else {
+      std::cout << "[FAIL] Lazy section wrong" << std::endl;
+    }
+
+    PaperModel loaded;
+    bool sameSections = file.load(loaded) &&
+                        loaded.sections.size() == model.sections.size();
+    for (int i = 0; sameSections && i < model.sections.size(); ++i) {
+      sameSections = loaded.sections[i].label == model.sections[i].label &&
+                     loaded.sections[i].questions ==
+                         model.sections[i].questions;
+    }
+    if (sameSections && loaded.exam == model.exam &&
+        loaded.toHtml() == model.toHtml()) {
+      std::cout << "[PASS] Round trip renders identically" << std::endl;
+    } else {
+      std::cout << "[FAIL] Round trip lost data" << std::endl;
+    }
+    file.close();
+
+    // Truncated files and files from newer versions fail cleanly
+    QFile raw(paperPath);
+    raw.open(QIODevice::ReadOnly);
+    QByteArray bytes = raw.readAll();
+    raw.close();
+    const QString brokenPath = QDir::temp().filePath("paper_build_broken.epf");
+    const auto writeBroken = [&brokenPath](const QByteArray &data) {
+      QFile broken(brokenPath);
+      broken.open(QIODevice::WriteOnly);
+      broken.write(data);
+    };
+    writeBroken(bytes.left(bytes.size() - 100));
+    PaperFile truncated;
+    const bool truncatedFails = !truncated.open(brokenPath);
+    bytes[8] = char(PaperFile::FORMAT_VERSION + 1);
+    writeBroken(bytes);
+    PaperFile newer;
+    if (truncatedFails && !newer.open(brokenPath) &&
+        !newer.errorString().isEmpty()) {
+      std::cout << "[PASS] Damaged and newer files rejected" << std::endl;
+    } else {
+      std::cout << "[FAIL] Damaged file accepted" << std::endl;
+    }
+    QFile::remove(paperPath);
+    QFile::remove(brokenPath);
+  }
+
+  // Test 26: Streaming JSON
+  {
+    std::cout << "\nTest 26: Streaming JSON" << std::endl;
+    PaperModel model;
+    model.exam.title = "Mid \"Term\" Exam";
+    model.exam.subject = "Maths\\Physics";
+    model.exam.totalMarks = 80;
+    model.exam.examDate = QDate(2024, 3, 15);
+    for (int i = 0; i < 40; ++i) {
+      Section s;
+      s.label = QString("Section %1").arg(i + 1);
+      s.subtitle = "Answer\tall\nquestions";
+      for (int j = 0; j < 25; ++j) {
+        Question q;
+        q.text = QString("Solve <b>%1</b> \xF0\x9F\x98\x80 \x01").arg(j);
+        if (j % 3 == 1) {
+          q.payload = McqPayload{{"\"A\"", "B"}, 1};
+          q.table = {{"x", "y"}, {"1", "2"}};
+        } else if (j % 3 == 2) {
+          q.payload = OrPayload{"Or: prove it"};
+          q.diagramPath = "/tmp/diagram.png";
+        }
+        s.questions.append(q);
+      }
+      model.sections.append(s);
+    }
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    PaperJson::write(model, buffer);
+    QJsonParseError parseError;
+    QJsonDocument::fromJson(buffer.data(), &parseError);
+    PaperModel loaded;
+    QString error;
+    bool same = parseError.error == QJsonParseError::NoError &&
+                PaperJson::read(buffer.data(), loaded, &error) &&
+                loaded.exam == model.exam &&
+                loaded.sections.size() == model.sections.size();
+    for (int i = 0; same && i < model.sections.size(); ++i) {
+      same = loaded.sections[i].subtitle == model.sections[i].subtitle &&
+             loaded.sections[i].questions == model.sections[i].questions;
+    }
+    if (same && loaded.toHtml() == model.toHtml()) {
+      std::cout << "[PASS] Valid JSON that round-trips" << std::endl;
+    } else {
+      std::cout << "[FAIL] JSON round trip lost data: "
+                << error.toStdString() << std::endl;
+    }
+
+    // Hand-written files: any key order, escapes, unknown keys
+    const QByteArray handWritten = R"({
+      "sections": [{ "questions": [{ "options": ["é", "😀"],
+        "extra": {"nested": [1, "]"]}, "correctIndex": 0, "type": "mcq",
+        "text": "Pick \/ one" }], "label": "A" }],
+      "exam": { "examDate": null, "title": "T" },
+      "version": 1, "format": "exam-paper" })";
+    PaperModel hand;
+    const McqPayload *mcq = nullptr;
+    if (PaperJson::read(handWritten, hand, &error) &&
+        hand.sections.size() == 1 && hand.exam.title == "T" &&
+        (mcq = hand.sections[0].questions[0].as<McqPayload>()) &&
+        mcq->options == QVector<QString>{QString::fromUtf8("\xC3\xA9"),
+                                         QString::fromUtf8(
+                                             "\xF0\x9F\x98\x80")} &&
+        hand.sections[0].questions[0].text == "Pick / one") {
+      std::cout << "[PASS] Hand-written JSON parsed" << std::endl;
+    } else {
+      std::cout << "[FAIL] Hand-written JSON: " << error.toStdString()
+                << std::endl;
+    }
+
+    // Errors anywhere, including inside a section, leave the model alone
+    QByteArray broken = buffer.data();
+    broken.replace("\"label\": \"Section 30\"", "\"label\": Section 30");
+    const bool brokenFails = !PaperJson::read(broken, hand, &error) &&
+                             error.contains("byte") &&
+                             hand.exam.title == "T";
+    const bool newerFails = !PaperJson::read(
+        R"({"format": "exam-paper", "version": 2, "sections": []})", hand);
+    if (brokenFails && newerFails && hand.sections.size() == 1) {
+      std::cout << "[PASS] Malformed and newer JSON rejected" << std::endl;
+    } else {
+      std::cout << "[FAIL] Bad JSON accepted" << std::endl;
+    }
+
+    // Only JSON that says it is a paper, and which version, is one
+    const bool unmarkedFails =
+        !PaperJson::read(R"({"version": 1, "sections": []})", hand, &error) &&
+        error.contains("Not an exam paper");
+    const bool otherFails = !PaperJson::read(
+        R"({"format": "settings", "version": 1, "sections": []})", hand);
+    const bool unversionedFails = !PaperJson::read(
+        R"({"format": "exam-paper", "sections": []})", hand, &error) &&
+        error.contains("version");
+    const bool notObjectFails =
+        !PaperJson::read(QByteArray("\x89PNG\r\n"), hand, &error) &&
+        error.contains("Not an exam paper");
+    if (unmarkedFails && otherFails && unversionedFails && notObjectFails &&
+        hand.sections.size() == 1) {
+      std::cout << "[PASS] JSON without the paper format rejected"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Foreign JSON accepted: " << error.toStdString()
+                << std::endl;
+    }
+  }
+
+  // Test 27: Edit Journal
+  {
+    std::cout << "\nTest 27: Edit Journal" << std::endl;
+    const QString journalDir = QDir::temp().filePath("paper_build_journal");
+    const QString crashDir = QDir::temp().filePath("paper_build_crash");
+    QDir(journalDir).removeRecursively();
+    QDir(crashDir).removeRecursively();
+
+    const auto samePaper = [](const PaperModel &a, const PaperModel &b) {
+      if (a.exam != b.exam || a.sections.size() != b.sections.size()) {
+        return false;
+      }
+      for (int i = 0; i < a.sections.size(); ++i) {
+        if (a.sections[i].label != b.sections[i].label ||
+            a.sections[i].subtitle != b.sections[i].subtitle ||
+            a.sections[i].questions != b.sections[i].questions) {
+          return false;
+        }
+      }
+      return true;
+    };
+    // Copies the files as a crash would leave them, without the lock
+    const auto copyJournal = [&journalDir, &crashDir]() {
+      QDir(crashDir).removeRecursively();
+      QDir().mkpath(crashDir);
+      const QDir from(journalDir);
+      const QStringList names = from.entryList(
+          {QStringLiteral("checkpoint-*.epf"), QStringLiteral("journal-*.log")},
+          QDir::Files);
+      for (const QString &name : names) {
+        QFile::copy(from.filePath(name), QDir(crashDir).filePath(name));
+      }
+      return names;
+    };
+
+    PaperModel model;
+    model.exam.title = "Unit Test";
+    for (int i = 0; i < 2; ++i) {
+      Section s;
+      s.label = QString("Section %1").arg(QChar('A' + i));
+      for (int j = 0; j < 5; ++j) {
+        Question q;
+        q.text = QString("Question %1").arg(j);
+        s.questions.append(q);
+      }
+      model.sections.append(s);
+    }
+
+    {
+      PaperJournal journal(model);
+      const bool opened = journal.open(journalDir) && !journal.hasRecovery();
+      journal.start();
+      journal.setDocumentPath("/tmp/unit_test.epf");
+
+      Question mcq;
+      mcq.text = "Pick one";
+      mcq.payload = McqPayload{{"Yes", "No"}, 1};
+      model.insertQuestion(0, 2, mcq);
+      Question edited = model.sections[1].questions[3];
+      edited.text = "Edited <i>text</i>";
+      edited.table = {{"a", "b"}};
+      model.updateQuestion(1, 3, edited);
+      model.moveQuestion(0, 0, 4);
+      model.removeQuestion(1, 1);
+      model.updateSection(1, "Section B", "Answer any two");
+      Exam exam = model.exam;
+      exam.totalMarks = 50;
+      exam.examDate = QDate(2024, 5, 2);
+      model.setExam(exam);
+      Section extra;
+      extra.label = "Section C";
+      extra.questions.append(mcq);
+      model.insertSection(2, extra);
+      model.moveSection(2, 0);
+      journal.sync();
+
+      PaperModel other;
+      PaperJournal second(other);
+      if (opened && journal.commitCount() > 0 && !second.open(journalDir) &&
+          !second.errorString().isEmpty()) {
+        std::cout << "[PASS] Journal locked and committed" << std::endl;
+      } else {
+        std::cout << "[FAIL] Journal not open or not written" << std::endl;
+      }
+
+      copyJournal();
+      {
+        PaperModel recovered;
+        PaperJournal crashed(recovered);
+        QString documentPath;
+        if (crashed.open(crashDir) && crashed.hasRecovery() &&
+            crashed.recover(recovered, &documentPath) &&
+            samePaper(recovered, model) &&
+            documentPath == "/tmp/unit_test.epf") {
+          std::cout << "[PASS] Every edit recovered after a crash" << std::endl;
+        } else {
+          std::cout << "[FAIL] Recovered paper differs" << std::endl;
+        }
+
+        // A torn write at the end loses nothing that was committed
+        const QString journalPath = QDir(crashDir).filePath(
+            QString("journal-%1.log").arg(journal.generation()));
+        QFile torn(journalPath);
+        torn.open(QIODevice::WriteOnly | QIODevice::Append);
+        torn.write(QByteArray("\x40\x00\x00\x00garbage", 11));
+        torn.close();
+        PaperModel tornPaper;
+        if (crashed.recover(tornPaper) && samePaper(tornPaper, model)) {
+          std::cout << "[PASS] Torn tail ignored" << std::endl;
+        } else {
+          std::cout << "[FAIL] Torn tail broke recovery" << std::endl;
+        }
+      }
+
+      // A reset starts a new generation from a checkpoint
+      const quint32 generation = journal.generation();
+      model.clear();
+      Section fresh;
+      fresh.label = "Fresh";
+      model.insertSection(0, fresh);
+      journal.sync();
+      const QStringList names = copyJournal();
+      PaperModel afterReset;
+      PaperJournal resetJournal(afterReset);
+      if (journal.generation() > generation && names.size() == 2 &&
+          resetJournal.open(crashDir) && resetJournal.recover(afterReset) &&
+          samePaper(afterReset, model)) {
+        std::cout << "[PASS] Clear wrote a new checkpoint" << std::endl;
+      } else {
+        std::cout << "[FAIL] Checkpoint not rotated" << std::endl;
+      }
+    }
+
+    // A clean exit leaves nothing behind to recover
+    PaperModel afterExit;
+    PaperJournal reopened(afterExit);
+    if (reopened.open(journalDir) && !reopened.hasRecovery()) {
+      std::cout << "[PASS] Clean exit removed the journal" << std::endl;
+    } else {
+      std::cout << "[FAIL] Journal left after a clean exit" << std::endl;
+    }
+    QDir(journalDir).removeRecursively();
+    QDir(crashDir).removeRecursively();
+  }
+
+  // Test 28: Paper Package
+  {
+    std::cout << "\nTest 28: Paper Package" << std::endl;
+    // One diagram under two names, used by five questions
+    const QString diagramPath = QDir::temp().filePath("paper_build_asset.png");
+    const QString copyPath = QDir::temp().filePath("paper_build_asset_copy.png");
+    const QString missingPath = QDir::temp().filePath("paper_build_missing.png");
+    QImage diagram(400, 200, QImage::Format_ARGB32);
+    diagram.fill(QColor(0, 128, 0, 128));
+    diagram.save(diagramPath, "PNG");
+    QFile::remove(copyPath);
+    QFile::copy(diagramPath, copyPath);
+    QFile::remove(missingPath);
+
+    PaperModel model;
+    model.exam.title = "Packaged Paper";
+    Section s;
+    s.label = "Section A";
+    for (const QString &path :
+         {diagramPath, copyPath, diagramPath, copyPath, diagramPath,
+          missingPath}) {
+      Question q;
+      q.text = "Label the diagram";
+      q.diagramPath = path;
+      s.questions.append(q);
+    }
+    model.sections.append(s);
+
+    const QString paperPath = QDir::temp().filePath("paper_build_package.epf");
+    const bool saved = PaperFile::save(model, paperPath);
+    QFile::remove(diagramPath);
+    QFile::remove(copyPath);
+
+    // The paper no longer needs the files it was made from
+    AssetStore::shared().clear();
+    PaperFile file;
+    PaperModel loaded;
+    const bool opened = saved && file.open(paperPath) && file.load(loaded);
+    const bool unread = AssetStore::shared().bytes() == 0;
+    const QVector<Question> questions = loaded.sections.value(0).questions;
+    const QString reference = questions.value(0).diagramPath;
+    bool shared = opened && file.assetCount() == 1 && questions.size() == 6 &&
+                  AssetStore::isReference(reference) &&
+                  AssetStore::shared().contains(reference);
+    for (int i = 1; shared && i < 5; ++i) {
+      shared = questions[i].diagramPath == reference;
+    }
+    if (shared && questions[5].diagramPath == missingPath) {
+      std::cout << "[PASS] Diagram stored once and referenced by hash"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Diagram not packaged" << std::endl;
+    }
+
+    DiagramCache &cache = DiagramCache::shared();
+    cache.clear();
+    bool decodedOnce = true;
+    for (int i = 0; i < 5; ++i) {
+      decodedOnce = decodedOnce && !cache.image(reference, 150).isNull();
+    }
+    const DiagramCache::Diagram encoded = cache.encoded(reference, 150);
+    if (decodedOnce && cache.misses() == 2 && cache.hits() == 4 &&
+        encoded.mimeType == "image/png" &&
+        loaded.toHtml().contains("src=\"" + reference + "\"")) {
+      std::cout << "[PASS] Embedded diagram decoded once from the store"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Embedded diagram misses " << cache.misses()
+                << std::endl;
+    }
+    if (unread && AssetStore::shared().bytes() > 0) {
+      std::cout << "[PASS] Blob read on first use, not on open" << std::endl;
+    } else {
+      std::cout << "[FAIL] Blob read eagerly" << std::endl;
+    }
+
+    // JSON carries the blob too, and exports inline it
+    QBuffer json;
+    json.open(QIODevice::WriteOnly);
+    PaperJson::write(loaded, json);
+    const QByteArray jsonData = json.data();
+    AssetStore::shared().clear();
+    PaperModel fromJson;
+    const bool jsonLoaded = PaperJson::read(jsonData, fromJson) &&
+                            AssetStore::shared().contains(reference);
+    const QString htmlPath = QDir::temp().filePath("paper_build_package.html");
+    HtmlExporter().exportToHtml(fromJson, htmlPath);
+    QFile html(htmlPath);
+    html.open(QIODevice::ReadOnly);
+    const QByteArray exported = html.readAll();
+    html.close();
+    if (jsonLoaded && exported.contains("data:image/png;base64,") &&
+        !exported.contains("asset:")) {
+      std::cout << "[PASS] Blob survives JSON and HTML export" << std::endl;
+    } else {
+      std::cout << "[FAIL] Blob lost outside the paper file" << std::endl;
+    }
+
+    // A blob that does not match its hash is damage
+    QFile raw(paperPath);
+    raw.open(QIODevice::ReadOnly);
+    QByteArray bytes = raw.readAll();
+    raw.close();
+    bytes[bytes.size() - 1] = char(bytes[bytes.size() - 1] ^ 0x55);
+    AssetStore::shared().clear();
+    const QString brokenPath = QDir::temp().filePath("paper_build_broken.epf");
+    QFile broken(brokenPath);
+    broken.open(QIODevice::WriteOnly);
+    broken.write(bytes);
+    broken.close();
+    PaperFile damaged;
+    const bool damagedOpened = damaged.open(brokenPath);
+    if (damagedOpened && AssetStore::shared().data(reference).isEmpty() &&
+        !AssetStore::shared().contains(reference)) {
+      std::cout << "[PASS] Damaged blob rejected on first use" << std::endl;
+    } else {
+      std::cout << "[FAIL] Damaged blob accepted" << std::endl;
+    }
+    damaged.close();
+    file.close();
+
+    // Blobs stay while an open paper retains them
+    AssetStore &store = AssetStore::shared();
+    PaperFile reopened;
+    reopened.open(paperPath);
+    const bool kept = store.prune() == 0 && !store.data(reference).isEmpty();
+    reopened.close();
+    if (kept && store.prune() == 1 && !store.contains(reference) &&
+        store.bytes() == 0) {
+      std::cout << "[PASS] Blob dropped once its paper is closed"
+                << std::endl;
+    } else {
+      std::cout << "[FAIL] Blob outlived its paper" << std::endl;
+    }
+    cache.clear();
+    QFile::remove(paperPath);
+    QFile::remove(brokenPath);
+    QFile::remove(htmlPath);
+  }
+
+  // Test 29: Version History
+  {
+    std::cout << "\nTest 29: Version History" << std::endl;
+    const QString historyDir = QDir::temp().filePath("paper_build_history");
+    QDir(historyDir).removeRecursively();
+
+    PaperModel model;
+    model.exam.title = "Draft";
+    for (int i = 0; i < 3; ++i) {
+      Section s;
+      s.label = QString("Section %1").arg(QChar('A' + i));
+      for (int j = 0; j < 20; ++j) {
+        Question q;
+        q.text = QString("Question %1.%2").arg(i).arg(j);
+        if (j % 5 == 0) {
+          q.payload = McqPayload{{"Yes", "No"}, 0};
+        }
+        s.questions.append(q);
+      }
+      model.sections.append(s);
+    }
+    const Exam draftExam = model.exam;
+    const QVector<Section> draftSections = model.sections;
+
+    PaperHistory history;
+    const QByteArray draft = history.open(historyDir)
+                                 ? history.snapshot(model, "Draft")
+                                 : QByteArray();
+    const int draftObjects = history.objectsWritten();
+
+    // One question edited, one added, the exam renamed
+    Question edited = model.sections[1].questions[4];
+    edited.text = "Edited question";
+    model.updateQuestion(1, 4, edited);
+    Question added;
+    added.text = "New question";
+    model.insertQuestion(2, 7, added);
+    Exam exam = model.exam;
+    exam.title = "Moderated";
+    model.setExam(exam);
+    const QByteArray moderated = history.snapshot(model, "Moderated");
+    const int moderatedObjects = history.objectsWritten() - draftObjects;
+    const QByteArray unchanged = history.snapshot(model, "Again");
+
+    if (!draft.isEmpty() && draftObjects == 60 + 3 + 2 &&
+        moderatedObjects == 2 + 2 + 2 && unchanged == moderated &&
+        history.objectsWritten() == draftObjects + moderatedObjects) {
+      std::cout << "[PASS] Snapshot writes only changed objects" << std::endl;
+    } else {
+      std::cout << "[FAIL] Objects written: " << draftObjects << ", "
+                << moderatedObjects << std::endl;
+    }
+
+    using Kind = PaperHistory::Change::Kind;
+    const QVector<PaperHistory::Change> expected = {
+        {Kind::ExamChanged, -1, -1},    {Kind::SectionChanged, 1, -1},
+        {Kind::QuestionChanged, 1, 4},  {Kind::SectionChanged, 2, -1},
+        {Kind::QuestionAdded, 2, 7}};
+    bool diffOk = false;
+    const QVector<PaperHistory::Change> changes =
+        history.diff(draft, moderated, &diffOk);
+    const QVector<PaperHistory::Version> versions = history.versions();
+    if (diffOk && changes == expected && versions.size() == 2 &&
+        versions[0].hash == moderated && versions[0].parent == draft &&
+        versions[1].message == "Draft" && versions[1].parent.isEmpty()) {
+      std::cout << "[PASS] Structural diff from hashes" << std::endl;
+    } else {
+      std::cout << "[FAIL] Diff has " << changes.size() << " changes"
+                << std::endl;
+    }
+
+    // Long sections: scattered edits align exactly; lists that differ
+    // everywhere fall back to comparing positions
+    PaperModel longPaper;
+    Section longSection;
+    longSection.label = "Long";
+    for (int j = 0; j < 3000; ++j) {
+      Question q;
+      q.text = QString("Long question %1").arg(j);
+      longSection.questions.append(q);
+    }
+    longPaper.sections.append(longSection);
+    const QString longHistoryDir =
+        QDir::temp().filePath("paper_build_history_long");
+    QDir(longHistoryDir).removeRecursively();
+    PaperHistory longHistory;
+    longHistory.open(longHistoryDir);
+    const QByteArray longDraft = longHistory.snapshot(longPaper, "Long");
+    longPaper.removeQuestion(0, 2500);
+    longPaper.removeQuestion(0, 1200);
+    Question inserted;
+    inserted.text = "Inserted question";
+    longPaper.insertQuestion(0, 300, inserted);
+    const QByteArray longEdited = longHistory.snapshot(longPaper, "Scattered");
+    for (int j = 0; j < longPaper.sections[0].questions.size(); j += 2) {
+      Question q = longPaper.sections[0].questions[j];
+      q.text += " (rewritten)";
+      longPaper.updateQuestion(0, j, q);
+    }
+    const QByteArray longRewritten = longHistory.snapshot(longPaper, "Rewritten");
+    QElapsedTimer diffTimer;
+    diffTimer.start();
+    bool longOk = false;
+    const QVector<PaperHistory::Change> scattered =
+        longHistory.diff(longDraft, longEdited, &longOk);
+    const QVector<PaperHistory::Change> scatteredExpected = {
+        {Kind::SectionChanged, 0, -1},
+        {Kind::QuestionAdded, 0, 300},
+        {Kind::QuestionRemoved, 0, 1200},
+        {Kind::QuestionRemoved, 0, 2500}};
+    const QVector<PaperHistory::Change> rewritten =
+        longHistory.diff(longEdited, longRewritten, &longOk);
+    bool positional = longOk && rewritten.size() == 1 + 1500;
+    for (int i = 1; positional && i < rewritten.size(); ++i) {
+      positional = rewritten[i].kind == Kind::QuestionChanged &&
+                   rewritten[i].question == 2 * (i - 1);
+    }
+    if (scattered == scatteredExpected && positional) {
+      std::cout << "[PASS] Long sections diffed in " << diffTimer.elapsed()
+                << " ms" << std::endl;
+    } else {
+      std::cout << "[FAIL] Long section diff has " << scattered.size()
+                << " and " << rewritten.size() << " changes" << std::endl;
+    }
+    QDir(longHistoryDir).removeRecursively();
+
+    // Embedded diagrams are kept with the versions that use them
+    const QString assetHistoryDir =
+        QDir::temp().filePath("paper_build_history_assets");
+    QDir(assetHistoryDir).removeRecursively();
+    QImage figureImage(8, 8, QImage::Format_ARGB32);
+    figureImage.fill(QColor(200, 0, 0));
+    QByteArray png;
+    QBuffer pngBuffer(&png);
+    pngBuffer.open(QIODevice::WriteOnly);
+    figureImage.save(&pngBuffer, "PNG");
+    PaperModel illustrated;
+    Section figures;
+    Question figure;
+    figure.text = "Label the figure";
+    figure.diagramPath = AssetStore::shared().add(png);
+    figures.questions.append(figure);
+    illustrated.sections.append(figures);
+    PaperHistory assetHistory;
+    const QByteArray illustratedVersion =
+        assetHistory.open(assetHistoryDir)
+            ? assetHistory.snapshot(illustrated, "Figure")
+            : QByteArray();
+    // The paper moved on and its blob was dropped
+    AssetStore::shared().clear();
+    PaperModel checkedOut;
+    if (!illustratedVersion.isEmpty() &&
+        assetHistory.checkout(illustratedVersion, checkedOut) &&
+        AssetStore::shared().data(figure.diagramPath) == png) {
+      std::cout << "[PASS] Diagram restored from history" << std::endl;
+    } else {
+      std::cout << "[FAIL] Diagram lost from history" << std::endl;
+    }
+    QDir(assetHistoryDir).removeRecursively();
+
+    // Another instance reads the same history
+    PaperHistory reopened;
+    PaperModel restored;
+    bool same = reopened.open(historyDir) && reopened.head() == moderated &&
+                reopened.checkout(draft, restored) &&
+                restored.exam == draftExam &&
+                restored.sections.size() == draftSections.size();
+    for (int i = 0; same && i < draftSections.size(); ++i) {
+      same = restored.sections[i].label == draftSections[i].label &&
+             restored.sections[i].questions == draftSections[i].questions;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    PaperModel latest;
+    const bool latestOk = reopened.checkout(moderated, latest) &&
+                          latest.sections[2].questions == model.sections[2].questions &&
+                          latest.exam.title == "Moderated";
+    if (same && latestOk) {
+      std::cout << "[PASS] Checked out both versions (second in "
+                << timer.elapsed() << " ms)" << std::endl;
+    } else {
+      std::cout << "[FAIL] Checked out paper differs" << std::endl;
+    }
+
+    // A damaged object fails the checkout and leaves the paper alone
+    const QByteArray questionKind = QByteArray::fromHex("01"); // ObjectKind::Question
+    QDir objects(QDir(historyDir).filePath("objects"));
+    const QStringList buckets = objects.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString &bucket : buckets) {
+      const QDir dir(objects.filePath(bucket));
+      for (const QString &name : dir.entryList(QDir::Files)) {
+        QFile object(dir.filePath(name));
+        object.open(QIODevice::ReadOnly);
+        const bool isQuestion = object.read(1) == questionKind;
+        object.close();
+        if (isQuestion) {
+          object.open(QIODevice::WriteOnly | QIODevice::Append);
+          object.write("x");
+          object.close();
+        }
+      }
+    }
+    PaperHistory damaged;
+    PaperModel untouched;
+    untouched.exam.title = "Untouched";
+    if (damaged.open(historyDir) && !damaged.checkout(draft, untouched) &&
+        untouched.exam.title == "Untouched" && untouched.sections.isEmpty()) {
+      std::cout << "[PASS] Damaged history rejected" << std::endl;
+    } else {
+      std::cout << "[FAIL] Damaged object accepted" << std::endl;
+    }
+    QDir(historyDir).removeRecursively();
+  }
+
   return 0;
 }